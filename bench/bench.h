@@ -0,0 +1,31 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+#include "fmt/core.h"
+
+namespace netstack::bench {
+
+// Prevents the compiler from optimizing away a computed value
+template<typename T> inline void DoNotOptimize(const T& value)
+{
+	asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs fn(iteration) the given number of times and reports the time per
+// iteration and the iteration rate
+template<typename Fn> double Run(std::string_view name, const size_t iterations, Fn&& fn)
+{
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	for (size_t n = 0; n < iterations; ++n)
+		fn(n);
+	const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+
+	const auto nsPerIteration = elapsed.count() / static_cast<double>(iterations);
+	fmt::print("{:40s} {:10.1f} ns/op {:14.0f} op/s\n", name, nsPerIteration, 1e9 / nsPerIteration);
+	return nsPerIteration;
+}
+
+}
@@ -0,0 +1,59 @@
+#include "bench.h"
+#include "buffer.h"
+
+#include <algorithm>
+#include <array>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfBuffers = 65536;
+constexpr size_t BurstSize = 32;
+
+// Allocates every buffer and writes all of it, as a flood of incoming
+// packets would; the first time round, this takes the page faults
+void Fill(const std::string_view name, std::vector<BufferPtr>& buffers)
+{
+	bench::Run(name, NumberOfBuffers, [&](const size_t n) {
+		buffers[n] = std::make_unique<Buffer>();
+		auto span = buffers[n]->WriteSpan();
+		std::fill(span.begin(), span.end(), std::byte{0x55});
+		buffers[n]->IncrementFilled(span.size());
+	});
+	for (auto& buffer : buffers)
+		buffer.reset();
+}
+
+void Bursts(const std::string_view name)
+{
+	std::array<BufferPtr, BurstSize> burst;
+	bench::Run(name, 1000000 / BurstSize, [&](const size_t) {
+		for (auto& buffer : burst)
+			buffer = std::make_unique<Buffer>();
+		bench::DoNotOptimize(burst);
+		for (auto& buffer : burst)
+			buffer.reset();
+	});
+}
+
+}
+
+int main()
+{
+	std::vector<BufferPtr> buffers(NumberOfBuffers);
+	Fill("heap, first fill", buffers);
+	Fill("heap, refill", buffers);
+	Bursts("heap, burst of 32 alloc+free");
+
+	// 64 MiB as in the default configuration, faulted in up front
+	if (auto result = Buffer::ReserveArena({}); result) {
+		fmt::print("cannot reserve arena: {}\n", *result);
+		return 1;
+	}
+	Fill("arena (thp, prefaulted), first fill", buffers);
+	Fill("arena (thp, prefaulted), refill", buffers);
+	Bursts("arena, burst of 32 alloc+free");
+	return 0;
+}
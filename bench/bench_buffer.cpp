@@ -0,0 +1,64 @@
+#include "bench.h"
+#include "buffer.h"
+#include "protocols/ip_checksum.h"
+
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+// Jumbo frames spread over several segments, more of them than fit in the
+// caches
+constexpr size_t NumberOfPackets = 4096;
+constexpr size_t SegmentsPerPacket = 9;
+
+// The segments of a packet are allocated far apart, as they are when many
+// packets are received interleaved
+std::vector<BufferPtr> MakePackets()
+{
+	std::vector<BufferPtr> packets(NumberOfPackets);
+	std::vector<Buffer*> tails(NumberOfPackets);
+	for (size_t segment = 0; segment < SegmentsPerPacket; ++segment) {
+		for (size_t n = 0; n < NumberOfPackets; ++n) {
+			auto& buffer = segment == 0 ? *(packets[n] = std::make_unique<Buffer>()) : tails[n]->AddBuffer();
+			for (auto& b : buffer.WriteSpan())
+				b = static_cast<std::byte>(n + segment);
+			buffer.IncrementFilled(Buffer::Size);
+			tails[n] = &buffer;
+		}
+	}
+	return packets;
+}
+
+void Measure(const std::string_view setting)
+{
+	auto packets = MakePackets();
+	size_t total = 0;
+	bench::Run(fmt::format("chain walk, {}", setting), 20 * NumberOfPackets, [&](const size_t n) {
+		for (const auto b : packets[n % NumberOfPackets]->chain())
+			total += b->ReadSpan().size();
+	});
+	bench::Run(fmt::format("data size, {}", setting), 20 * NumberOfPackets, [&](const size_t n) {
+		total += packets[n % NumberOfPackets]->data().size();
+	});
+	bench::Run(fmt::format("checksum, {}", setting), NumberOfPackets, [&](const size_t n) {
+		auto& packet = *packets[n];
+		auto it = packet.data().begin();
+		total += protocol::ip::CalculateChecksum(SegmentsPerPacket * Buffer::Size, [&]() { return *it++; });
+	});
+	bench::DoNotOptimize(total);
+}
+
+}
+
+int main()
+{
+	Measure("heap");
+	if (auto result = Buffer::ReserveArena({}); result) {
+		fmt::print("cannot reserve arena: {}\n", *result);
+		return 1;
+	}
+	Measure("arena");
+	return 0;
+}
@@ -0,0 +1,146 @@
+#include "bench.h"
+#include "buffer.h"
+#include "netorder.h"
+#include "slip.h"
+#include "protocols/ip_checksum.h"
+#include "protocols/vj.h"
+
+#include <optional>
+#include <string>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfSegments = 100000;
+// TCP payload for the default SLIP MTU of 1006 bytes
+constexpr size_t BulkSegmentSize = 1006 - 40;
+constexpr uint8_t ACK = 0x10, PSH = 0x08;
+
+struct Segment {
+	uint16_t id;
+	uint32_t seq;
+	uint32_t ack;
+	uint8_t flags;
+	size_t payload;
+	// TCP timestamps (RFC 7323), which change with every segment
+	std::optional<uint32_t> timestamp;
+};
+
+BufferPtr Build(const Segment& s)
+{
+	const size_t headerSize = 40 + (s.timestamp ? 12 : 0);
+	const auto totalLength = headerSize + s.payload;
+	std::vector<std::byte> header(headerSize);
+	auto it = header.begin();
+	using namespace net_order;
+	for (const uint16_t v : { uint16_t{0x4500}, static_cast<uint16_t>(totalLength), s.id, uint16_t{0x4000}, uint16_t{0x4006}, uint16_t{0}, uint16_t{0x0a00}, uint16_t{0x0001}, uint16_t{0x0a00}, uint16_t{0x0002}, uint16_t{1234}, uint16_t{23} })
+		Produce_u16(it, v);
+	Produce_u32(it, s.seq);
+	Produce_u32(it, s.ack);
+	Produce_u8(it, static_cast<uint8_t>((headerSize - 20) / 4 << 4));
+	Produce_u8(it, s.flags);
+	Produce_u16(it, 8192);
+	Produce_u16(it, static_cast<uint16_t>(s.seq * 31 + s.ack)); // stands in for the checksum
+	Produce_u16(it, 0);
+	if (s.timestamp) {
+		Produce_u16(it, 0x0101);
+		Produce_u16(it, 0x080a);
+		Produce_u32(it, *s.timestamp);
+		Produce_u32(it, *s.timestamp - 10);
+	}
+	auto source = header.begin();
+	const auto checksum = protocol::ip::CalculateChecksum(20, [&]() { return Consume_u8(source); });
+	auto dest = header.begin() + 10;
+	Produce_u16(dest, checksum);
+
+	auto packet = std::make_unique<Buffer>();
+	auto current = packet.get();
+	for (size_t n = 0; n < totalLength; ++n) {
+		if (current->WriteSpan().empty()) current = &current->AddBuffer();
+		current->WriteSpan().front() = n < headerSize ? header[n] : static_cast<std::byte>(n);
+		current->IncrementFilled(1);
+	}
+	return packet;
+}
+
+// One direction of a connection, as the sender's SLIP driver sees it
+template<typename NextFn> std::vector<BufferPtr> Stream(NextFn&& next)
+{
+	std::vector<BufferPtr> packets;
+	Segment segment{ 1, 1000, 5000, ACK, 0, {} };
+	for (size_t n = 0; n < NumberOfSegments; ++n) {
+		next(segment, n);
+		packets.push_back(Build(segment));
+		++segment.id;
+	}
+	return packets;
+}
+
+// Reports the bytes on the wire per packet and per payload byte for plain
+// SLIP and CSLIP, and the payload rate this gives on a 9600 baud line (10
+// bits per byte)
+void Report(const std::string& name, const std::vector<BufferPtr>& packets)
+{
+	size_t payload = 0, plain = 0, compressed = 0;
+	const auto count = [](size_t& total) { return [&total](std::byte) { ++total; }; };
+	for (const auto& packet : packets) {
+		const auto data = packet->ReadSpan();
+		const auto headerSize = 20 + (std::to_integer<size_t>(data[32]) >> 4) * 4;
+		payload += packet->data().size() - headerSize;
+		slip::Transmit(*packet, count(plain));
+	}
+
+	protocol::vj::Compressor compressor;
+	const auto ns = bench::Run(name + " compress", packets.size(), [&](const size_t n) {
+		const auto result = compressor.Compress(*packets[n]);
+		slip::Transmit(result.Header(), *packets[n], result.replaced, count(compressed));
+	});
+	bench::DoNotOptimize(ns);
+
+	const auto& stats = compressor.GetStats();
+	const auto perPacket = [&](const size_t wire) { return static_cast<double>(wire) / static_cast<double>(packets.size()); };
+	fmt::print("{:40s} slip {:7.1f} cslip {:7.1f} wire bytes/packet ({} compressed, {} uncompressed, {} ip)\n",
+		name, perPacket(plain), perPacket(compressed), stats.compressed, stats.uncompressed, stats.ip);
+	if (payload == 0) return;
+	const auto perPayload = [&](const size_t wire) { return static_cast<double>(wire) / static_cast<double>(payload); };
+	fmt::print("{:40s} slip {:7.3f} cslip {:7.3f} wire bytes/payload byte, {:.0f} -> {:.0f} payload bytes/s at 9600 baud\n",
+		"", perPayload(plain), perPayload(compressed), 960.0 / perPayload(plain), 960.0 / perPayload(compressed));
+}
+
+}
+
+int main()
+{
+	// Full-sized segments in one direction
+	Report("bulk", Stream([](Segment& s, const size_t n) {
+		if (n > 0) s.seq += BulkSegmentSize;
+		s.payload = BulkSegmentSize;
+	}));
+	// The ACKs going the other way, one for every other segment
+	Report("bulk acks", Stream([](Segment& s, const size_t n) {
+		if (n > 0) s.ack += 2 * BulkSegmentSize;
+	}));
+	// Typing into a remote shell: every keystroke is echoed and acked
+	Report("interactive", Stream([](Segment& s, const size_t n) {
+		if (n > 0) {
+			++s.seq;
+			++s.ack;
+		}
+		s.flags = ACK | PSH;
+		s.payload = 1;
+	}));
+	// Timestamps change the TCP options in every segment, which the
+	// compressed format cannot express
+	Report("interactive with timestamps", Stream([](Segment& s, const size_t n) {
+		if (n > 0) {
+			++s.seq;
+			++s.ack;
+		}
+		s.flags = ACK | PSH;
+		s.payload = 1;
+		s.timestamp = static_cast<uint32_t>(1000 + n);
+	}));
+	return 0;
+}
@@ -0,0 +1,54 @@
+#include "bench.h"
+#include "buffer.h"
+#include "dump.h"
+
+#include <string>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfDumps = 20000;
+
+// Formats the same bytes into text with the line callback, the way the
+// tracer used to, and with the table-driven formatter
+void Compare(const std::string& name, const std::vector<std::byte>& data, const Buffer& chain)
+{
+	std::string text;
+	const auto callback = bench::Run(name + " Dump + fmt", NumberOfDumps, [&](size_t) {
+		text.clear();
+		dump_buffer::Dump(data, [&](const size_t offset, std::string_view bytes, std::string_view chars) {
+			text += fmt::format("{:4x}: {:48s} {}\n", offset, bytes, chars);
+		});
+		bench::DoNotOptimize(text);
+	});
+
+	std::string out(dump_buffer::MaxFormattedSize(data.size()), ' ');
+	const auto table = bench::Run(name + " FormatTo", NumberOfDumps, [&](size_t) {
+		bench::DoNotOptimize(dump_buffer::FormatTo(data, out.data()));
+	});
+	bench::Run(name + " Format(chain)", NumberOfDumps, [&](size_t) {
+		bench::DoNotOptimize(dump_buffer::Format(chain));
+	});
+	fmt::print("{:40s} {:10.1f}x faster, {:.2f} ns/byte\n", "", callback / table, table / static_cast<double>(data.size()));
+}
+
+}
+
+int main()
+{
+	for (const auto size : { size_t{64}, size_t{1500}, size_t{3 * Buffer::Size} }) {
+		std::vector<std::byte> data(size);
+		Buffer chain;
+		auto buffer = &chain;
+		for (size_t n = 0; n < size; ++n) {
+			data[n] = static_cast<std::byte>(n * 7);
+			if (buffer->WriteSpan().empty()) buffer = &buffer->AddBuffer();
+			buffer->WriteSpan().front() = data[n];
+			buffer->IncrementFilled(1);
+		}
+		Compare(fmt::format("{} bytes", size), data, chain);
+	}
+	return 0;
+}
@@ -0,0 +1,72 @@
+#include "bench.h"
+#include "filter.h"
+
+#include <string>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfPackets = 1024;
+constexpr size_t NumberOfRuns = 5000;
+
+// A mix of ICMP, TCP and UDP between a handful of hosts; only the headers
+// matter
+std::vector<std::vector<std::byte>> MakePackets()
+{
+	std::vector<std::vector<std::byte>> packets;
+	for (size_t n = 0; n < NumberOfPackets; ++n) {
+		std::vector<std::byte> packet(28);
+		packet[0] = std::byte{0x45};
+		packet[8] = std::byte{64};
+		constexpr uint8_t protocols[] = { 1, 6, 6, 17 };
+		packet[9] = std::byte{protocols[n % 4]};
+		packet[12] = std::byte{10};
+		packet[15] = static_cast<std::byte>(n % 7);
+		packet[16] = std::byte{192};
+		packet[17] = std::byte{168};
+		packet[19] = static_cast<std::byte>(n % 5);
+		packet[22] = std::byte{0};
+		packet[23] = static_cast<std::byte>(n % 3 == 0 ? 22 : 53);
+		packets.push_back(std::move(packet));
+	}
+	return packets;
+}
+
+template<typename Fn> void Measure(const std::string& name, const std::vector<std::vector<std::byte>>& packets, Fn&& fn)
+{
+	size_t matched = 0;
+	// One operation is one packet
+	bench::Run(name, NumberOfRuns * packets.size(), [&](const size_t n) {
+		matched += fn(packets[n % packets.size()]) ? 1 : 0;
+	});
+	bench::DoNotOptimize(matched);
+	fmt::print("{:40s} {:.0f}% matched\n", "", 100.0 * static_cast<double>(matched) / static_cast<double>(NumberOfRuns * packets.size()));
+}
+
+}
+
+int main()
+{
+	const auto packets = MakePackets();
+	for (const std::string rule : {
+		"icmp",
+		"src 10.0.0.0/8",
+		"tcp and dport == 22",
+		"udp and (sport == 53 or dport == 53)",
+		"not icmp and ip.dst == 192.168.0.0/16 and ip.ttl > 1",
+		"host 10.0.0.3 or host 192.168.0.4",
+	}) {
+		const auto program = std::get<filter::Program>(filter::Compile(rule));
+		Measure(rule, packets, [&](const std::vector<std::byte>& packet) { return program(packet); });
+	}
+
+	// What the compiled rule is up against: the same test written by hand
+	Measure("tcp and dport == 22, by hand", packets, [](const std::vector<std::byte>& packet) {
+		if (packet.size() < 20 || packet[9] != std::byte{6}) return false;
+		const auto offset = (std::to_integer<size_t>(packet[0]) & 0xf) * 4;
+		return packet.size() >= offset + 4 && packet[offset + 2] == std::byte{0} && packet[offset + 3] == std::byte{22};
+	});
+	return 0;
+}
@@ -0,0 +1,78 @@
+#include "bench.h"
+#include "buffer.h"
+#include "forward.h"
+#include "routing.h"
+#include "protocols/ip.h"
+
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfPackets = 1000000;
+constexpr size_t PayloadSize = 64;
+
+constexpr uint32_t Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	return (static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 8) | d;
+}
+
+BufferPtr MakePacket(const uint32_t destAddr)
+{
+	protocol::ip::Header header{};
+	header.totalLength = static_cast<uint16_t>(protocol::ip::constants::HeaderSize + PayloadSize);
+	header.ttl = 255;
+	header.protocol = protocol::ip::constants::protocol::UDP;
+	header.sourceAddr = Addr(10, 0, 0, 2);
+	header.destAddr = destAddr;
+	header.headerSize = protocol::ip::constants::HeaderSize;
+
+	auto buffer = std::make_unique<Buffer>();
+	protocol::ip::ConstructHeader(header, *buffer);
+	buffer->IncrementFilled(PayloadSize);
+	return buffer;
+}
+
+}
+
+int main()
+{
+	routing::Table routes;
+	routes.Add({ Addr(10, 0, 0, 0), 16, { 0 } });
+	for (int n = 0; n < 64; ++n)
+		routes.Add({ Addr(10, 1, n, 0), 24, { 1 } });
+	routes.Add({ 0, 0, { 1, Addr(10, 1, 0, 254) } });
+
+	// The transmit function hands the buffer straight back, so that the
+	// benchmark measures the forwarding path without any allocation
+	BufferPtr packet = MakePacket(Addr(10, 1, 7, 9));
+	forward::Forwarder forwarder(routes, [&](size_t, BufferPtr buffer) { packet = std::move(buffer); });
+	forwarder.AddInterface(Addr(10, 0, 0, 1));
+	forwarder.AddInterface(Addr(10, 1, 0, 1));
+
+	const auto original = MakePacket(Addr(10, 1, 7, 9));
+	bench::Run("forward (header restored per packet)", NumberOfPackets, [&](size_t n) {
+		// Restore the TTL every time it would expire
+		if (n % 250 == 0) {
+			const auto header = original->ReadSpan();
+			std::copy(header.begin(), header.end(), packet->ModifySpan().begin());
+		}
+		forwarder.Forward(0, packet);
+	});
+
+	std::vector<uint32_t> addrs;
+	for (size_t n = 0; n < 4096; ++n)
+		addrs.push_back(Addr(10, static_cast<uint8_t>(n % 3), static_cast<uint8_t>(n * 7), static_cast<uint8_t>(n)));
+	bench::Run("route lookup", NumberOfPackets, [&](size_t n) {
+		bench::DoNotOptimize(routes.Lookup(addrs[n % addrs.size()]));
+	});
+
+	std::vector<std::optional<routing::NextHop>> nextHops(addrs.size());
+	const auto nsPerBatch = bench::Run("route lookup (bulk, 4096)", NumberOfPackets / addrs.size(), [&](size_t) {
+		routes.Lookup(addrs, nextHops);
+		bench::DoNotOptimize(nextHops);
+	});
+	fmt::print("{:40s} {:10.1f} ns/op\n", "route lookup (bulk, per address)", nsPerBatch / static_cast<double>(addrs.size()));
+	return 0;
+}
@@ -0,0 +1,88 @@
+#include "bench.h"
+#include "buffer.h"
+#include "slip.h"
+#include "drivers/bufferglue.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t FrameSize = 1500;
+constexpr size_t NumberOfFrames = 50000;
+constexpr size_t PipeSize = 1 << 20;
+
+// A stream of back-to-back SLIP frames, as a busy line would deliver it
+std::vector<std::byte> EncodeFrames()
+{
+	Buffer frame;
+	auto buffer = &frame;
+	for (size_t n = 0; n < FrameSize; ++n) {
+		if (buffer->WriteSpan().empty())
+			buffer = &buffer->AddBuffer();
+		buffer->WriteSpan().front() = static_cast<std::byte>(n);
+		buffer->IncrementFilled(1);
+	}
+	std::vector<std::byte> encoded;
+	slip::Transmit(frame, [&](const std::byte b) { encoded.push_back(b); });
+
+	std::vector<std::byte> stream;
+	for (size_t n = 0; n < NumberOfFrames; ++n)
+		stream.insert(stream.end(), encoded.begin(), encoded.end());
+	return stream;
+}
+
+// Reads the stream from a pipe with the given glue sizing and reports the
+// number of read() calls needed per MB
+void Receive(const std::string& name, const std::vector<std::byte>& stream, const BufferGlue::Sizing& sizing)
+{
+	int fds[2];
+	if (::pipe(fds) != 0) return;
+	::fcntl(fds[1], F_SETPIPE_SZ, static_cast<int>(PipeSize));
+
+	std::thread writer([&]() {
+		for (size_t offset = 0; offset < stream.size(); ) {
+			const auto amount = ::write(fds[1], stream.data() + offset, std::min(PipeSize, stream.size() - offset));
+			if (amount <= 0) break;
+			offset += static_cast<size_t>(amount);
+		}
+		::close(fds[1]);
+	});
+
+	BufferGlue glue(sizing);
+	size_t frames = 0;
+	using Clock = std::chrono::steady_clock;
+	const auto start = Clock::now();
+	for(;;) {
+		const auto writeSpan = glue.GetWriteSpan();
+		const auto amount = ::read(fds[0], writeSpan.data(), writeSpan.size());
+		if (amount <= 0) break;
+		glue.HandleDataReceived(static_cast<size_t>(amount), [](auto span, auto&& onByte, auto&& onComplete) {
+			return slip::Decode(span, onByte, onComplete);
+		}, [&](BufferPtr) { ++frames; });
+	}
+	const std::chrono::duration<double> elapsed = Clock::now() - start;
+	writer.join();
+	::close(fds[0]);
+
+	const auto& stats = glue.GetStats();
+	const auto megabytes = static_cast<double>(stats.bytes) / (1024.0 * 1024.0);
+	fmt::print("{:40s} {:10.1f} reads/MB {:10.0f} bytes/read {:8.1f} MB/s {:6d} frames\n",
+		name, static_cast<double>(stats.reads) / megabytes, stats.BytesPerRead(), megabytes / elapsed.count(), frames);
+}
+
+}
+
+int main()
+{
+	const auto stream = EncodeFrames();
+	for (const size_t size : { 1024, 4096, 16384, 65536 })
+		Receive(fmt::format("fixed {} bytes", size), stream, { size, size });
+	Receive("adaptive 1024-65536 bytes", stream, { 1024, 65536 });
+	return 0;
+}
@@ -0,0 +1,118 @@
+#include "bench.h"
+#include "busypoll.h"
+#include "buffer.h"
+#include "slip.h"
+#include "drivers/slipdevice.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfRoundTrips = 20000;
+
+// 10.0.0.1:1234 -> 10.0.0.2:7, "hello"
+constexpr std::array<uint8_t, 33> udpHello{
+	0x45, 0x00, 0x00, 0x21, 0x12, 0x34, 0x40, 0x00, 0x40, 0x11, 0x14, 0x96, 0x0a, 0x00, 0x00, 0x01,
+	0x0a, 0x00, 0x00, 0x02, 0x04, 0xd2, 0x00, 0x07, 0x00, 0x0d, 0xa3, 0x26, 0x68, 0x65, 0x6c, 0x6c,
+	0x6f
+};
+
+// Sends frames into the master side of a pseudo terminal and waits for the
+// device on the slave side to echo them, as a peer on a serial line would.
+// Several frames per write show how well a backend batches once data is
+// waiting, counted as the system calls the device makes per frame.
+void RoundTrips(const devices::SLIPDevice::Backend backend, const char* name, const size_t framesPerWrite)
+{
+	const auto master = ::posix_openpt(O_RDWR | O_NOCTTY);
+	if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0) {
+		fmt::print("{:40s} cannot allocate a pseudo terminal\n", name);
+		return;
+	}
+	termios tio{};
+	::tcgetattr(master, &tio);
+	::cfmakeraw(&tio);
+	::tcsetattr(master, TCSANOW, &tio);
+
+	devices::SLIPDevice device;
+	devices::SLIPConfig config;
+	config.backend = backend;
+	if (auto result = device.Open(::ptsname(master), config); result) {
+		fmt::print("{:40s} cannot open device: {}\n", name, *result);
+		::close(master);
+		return;
+	}
+
+	// With more than one CPU, the echo thread and the peer each get one
+	const bool pin = std::thread::hardware_concurrency() > 1;
+	std::thread echo([&]() {
+		if (pin) busypoll::PinThread(1);
+		std::array<BufferPtr, 8> burst;
+		while(true) {
+			const auto result = device.RxBurst(burst);
+			if (!std::holds_alternative<size_t>(result) || std::get<size_t>(result) == 0) break;
+			device.TxBurst(nonstd::span{burst.data(), std::get<size_t>(result)});
+			for (auto& buffer : burst)
+				buffer.reset();
+		}
+	});
+	if (pin) busypoll::PinThread(0);
+
+	Buffer packet;
+	std::copy(udpHello.begin(), udpHello.end(), reinterpret_cast<uint8_t*>(packet.WriteSpan().data()));
+	packet.IncrementFilled(udpHello.size());
+	std::vector<std::byte> frame;
+	for (size_t n = 0; n < framesPerWrite; ++n)
+		slip::Transmit(packet, [&](const std::byte b) { frame.push_back(b); });
+
+	using Clock = std::chrono::steady_clock;
+	std::vector<double> roundTrips;
+	roundTrips.reserve(NumberOfRoundTrips);
+	// The echo is encoded the same way
+	std::vector<std::byte> reply(frame.size());
+	for (size_t n = 0; n < NumberOfRoundTrips / framesPerWrite; ++n) {
+		const auto start = Clock::now();
+		if (::write(master, frame.data(), frame.size()) != static_cast<ssize_t>(frame.size())) break;
+		size_t received = 0;
+		while (received < reply.size()) {
+			const auto result = ::read(master, reply.data() + received, reply.size() - received);
+			if (result <= 0) break;
+			received += static_cast<size_t>(result);
+		}
+		roundTrips.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+	}
+
+	::close(master);
+	echo.join();
+	std::sort(roundTrips.begin(), roundTrips.end());
+	if (roundTrips.empty()) return;
+	const auto percentile = [&](const double p) { return roundTrips[static_cast<size_t>(p * static_cast<double>(roundTrips.size() - 1))]; };
+	const auto frames = static_cast<double>(roundTrips.size() * framesPerWrite);
+	const auto& calls = device.GetSystemCalls();
+	fmt::print("{:24s} {:2d} frame(s) p50 {:8.1f} us p99 {:8.1f} us max {:8.1f} us, calls/frame rx {:5.2f} tx {:5.2f}\n",
+		name, framesPerWrite, percentile(0.5), percentile(0.99), roundTrips.back(),
+		static_cast<double>(calls.receive.Get()) / frames, static_cast<double>(calls.transmit.Get()) / frames);
+}
+
+}
+
+int main()
+{
+	fmt::print("{} frames of {} bytes echoed through a pseudo terminal, {} cpu(s)\n",
+		NumberOfRoundTrips, udpHello.size(), std::thread::hardware_concurrency());
+	for (const size_t framesPerWrite : { 1, 16 }) {
+		RoundTrips(devices::SLIPDevice::Backend::Read, "blocking read", framesPerWrite);
+		RoundTrips(devices::SLIPDevice::Backend::IOUring, "io_uring", framesPerWrite);
+		RoundTrips(devices::SLIPDevice::Backend::BusyPoll, "busy poll", framesPerWrite);
+	}
+	return 0;
+}
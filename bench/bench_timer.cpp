@@ -0,0 +1,52 @@
+#include "bench.h"
+#include "timer.h"
+
+#include <memory>
+#include <random>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfTimers = 100000;
+constexpr size_t NumberOfRuns = 20;
+
+}
+
+int main()
+{
+	size_t fired = 0;
+	std::vector<std::unique_ptr<timer::Timer>> timers;
+	for (size_t n = 0; n < NumberOfTimers; ++n)
+		timers.push_back(std::make_unique<timer::Timer>([&fired]() { ++fired; }));
+
+	// Retransmit-like timeouts of up to a few seconds, in milliseconds
+	std::mt19937 random(1);
+	std::vector<uint64_t> timeouts(NumberOfTimers);
+	for (auto& timeout : timeouts)
+		timeout = 1 + random() % 5000;
+
+	timer::Wheel wheel;
+	bench::Run("arm", NumberOfRuns * NumberOfTimers, [&](const size_t n) {
+		wheel.Arm(*timers[n % NumberOfTimers], wheel.Current() + timeouts[n % NumberOfTimers]);
+	});
+	bench::Run("cancel", NumberOfTimers, [&](const size_t n) {
+		timers[n]->Cancel();
+	});
+
+	// Most timers are cancelled before they expire, which makes the two
+	// operations above the common case; the rest are expanded tick by tick
+	for (size_t n = 0; n < NumberOfTimers; ++n)
+		wheel.Arm(*timers[n], wheel.Current() + timeouts[n]);
+	uint64_t now = wheel.Current();
+	bench::Run("advance one tick, 100k timers", 5000, [&](const size_t) {
+		wheel.Advance(++now);
+	});
+	bench::Run("advance one tick, idle", 1000000, [&](const size_t) {
+		wheel.Advance(++now);
+	});
+	bench::DoNotOptimize(fired);
+	fmt::print("{:40s} {} fired\n", "", fired);
+	return 0;
+}
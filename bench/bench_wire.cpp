@@ -0,0 +1,133 @@
+#include "bench.h"
+#include "buffer.h"
+#include "netorder.h"
+#include "drivers/wiredevice.h"
+#include "protocols/icmp.h"
+#include "protocols/ip.h"
+#include "protocols/ip_checksum.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace netstack;
+
+namespace {
+
+constexpr size_t NumberOfRoundTrips = 200000;
+constexpr size_t BurstSize = 32;
+constexpr size_t NumberOfBursts = 20000;
+
+BufferPtr MakeEchoRequest(const size_t payloadSize)
+{
+	std::vector<std::byte> icmp(protocol::icmp::constants::ErrorHeaderSize + payloadSize);
+	icmp[0] = std::byte{protocol::icmp::constants::message_type::EchoRequest};
+	{
+		size_t index = 0;
+		const auto checksum = protocol::ip::CalculateChecksum(icmp.size(), [&]() { return std::to_integer<uint8_t>(icmp[index++]); });
+		auto it = icmp.begin() + 2;
+		net_order::Produce_u16(it, checksum);
+	}
+
+	protocol::ip::Header header{};
+	header.totalLength = static_cast<uint16_t>(protocol::ip::constants::HeaderSize + icmp.size());
+	header.ttl = protocol::ip::constants::DefaultTTL;
+	header.protocol = protocol::ip::constants::protocol::ICMP;
+	header.sourceAddr = 0x0a000002;
+	header.destAddr = 0x0a000001;
+	header.headerSize = protocol::ip::constants::HeaderSize;
+
+	auto packet = std::make_unique<Buffer>();
+	protocol::ip::ConstructHeader(header, *packet);
+	auto buffer = packet.get();
+	for (const auto b : icmp) {
+		if (buffer->WriteSpan().empty())
+			buffer = &buffer->AddBuffer();
+		buffer->WriteSpan().front() = b;
+		buffer->IncrementFilled(1);
+	}
+	return packet;
+}
+
+// Answers echo requests until 'amount' packets have been handled
+void Respond(devices::NetDevice& device, const size_t amount)
+{
+	std::array<BufferPtr, BurstSize> burst;
+	for (size_t handled = 0; handled < amount; ) {
+		const auto received = std::get<size_t>(device.RxBurst(burst));
+		for (auto& buffer : nonstd::span{burst.data(), received}) {
+			const auto ipResult = protocol::ip::ParseHeader(*buffer);
+			const auto& ipHeader = std::get<protocol::ip::Header>(ipResult);
+			const auto icmpResult = protocol::icmp::Parse(ipHeader, *buffer);
+			protocol::icmp::Process(ipHeader, std::get<protocol::icmp::Header>(icmpResult), *buffer);
+		}
+		device.TxBurst(nonstd::span{burst.data(), received});
+		handled += received;
+	}
+}
+
+// Replies differ from the request in the headers only, so copying those
+// back turns a reply into a new request
+void Restore(const Buffer& request, Buffer& reply)
+{
+	constexpr auto headerSize = protocol::ip::constants::HeaderSize + protocol::icmp::constants::ErrorHeaderSize;
+	const auto source = request.ReadSpan().first(headerSize);
+	std::copy(source.begin(), source.end(), reply.ModifySpan().begin());
+}
+
+void PingPong(const char* name, const devices::WireConfig& config, const size_t payloadSize)
+{
+	auto [local, remote] = devices::WireDevice::CreatePair(config);
+	std::thread responder([&remote = *remote]() { Respond(remote, NumberOfRoundTrips); });
+
+	const auto request = MakeEchoRequest(payloadSize);
+	std::array<BufferPtr, 1> burst{ MakeEchoRequest(payloadSize) };
+	bench::Run(name, NumberOfRoundTrips, [&](size_t) {
+		local->TxBurst(burst);
+		local->RxBurst(burst);
+		Restore(*request, *burst[0]);
+	});
+	responder.join();
+}
+
+void Throughput(const char* name, const devices::WireConfig& config, const size_t payloadSize)
+{
+	auto [local, remote] = devices::WireDevice::CreatePair(config);
+	std::thread responder([&remote = *remote]() { Respond(remote, NumberOfBursts * BurstSize); });
+
+	const auto request = MakeEchoRequest(payloadSize);
+	std::array<BufferPtr, BurstSize> burst;
+	for (auto& buffer : burst)
+		buffer = MakeEchoRequest(payloadSize);
+	const auto nsPerBurst = bench::Run(name, NumberOfBursts, [&](size_t) {
+		local->TxBurst(burst);
+		for (size_t received = 0; received < BurstSize; ) {
+			const auto amount = std::get<size_t>(local->RxBurst(nonstd::span{burst.data() + received, BurstSize - received}));
+			for (auto& buffer : nonstd::span{burst.data() + received, amount})
+				Restore(*request, *buffer);
+			received += amount;
+		}
+	});
+	fmt::print("{:40s} {:10.1f} ns/op\n", std::string(name) + " (per packet)", nsPerBurst / BurstSize);
+	responder.join();
+}
+
+}
+
+int main()
+{
+	devices::WireConfig direct;
+	devices::WireConfig slip;
+	slip.slip = true;
+
+	PingPong("ping-pong, 56 bytes", direct, 56);
+	PingPong("ping-pong, 56 bytes, SLIP", slip, 56);
+	PingPong("ping-pong, 1400 bytes", direct, 1400);
+	PingPong("ping-pong, 1400 bytes, SLIP", slip, 1400);
+
+	Throughput("echo burst of 32, 56 bytes", direct, 56);
+	Throughput("echo burst of 32, 56 bytes, SLIP", slip, 56);
+	Throughput("echo burst of 32, 1400 bytes", direct, 1400);
+	Throughput("echo burst of 32, 1400 bytes, SLIP", slip, 1400);
+	return 0;
+}
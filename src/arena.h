@@ -0,0 +1,177 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Fixed-size slots carved out of a single mapping that is made once, at
+// startup. The pages can be faulted in right away, so that the first packets
+// do not pay for it, and backed by huge pages, so that a stack touching many
+// buffers at a high rate needs few TLB entries.
+namespace netstack::arena {
+
+using ErrorCode = int;
+
+enum class Pages {
+	Normal,
+	// Transparent huge pages; the kernel may still use normal pages if it
+	// has none to spare, or if THP is disabled altogether
+	Transparent,
+	// Huge pages reserved with vm.nr_hugepages; reserving fails if there
+	// are not enough
+	Huge,
+};
+
+struct Config {
+	// Rounded up to whole pages
+	size_t size{64 << 20};
+	Pages pages{Pages::Transparent};
+	// Fault in all pages when reserving, rather than on first use
+	bool prefault{true};
+};
+
+struct Usage {
+	size_t slots{};
+	size_t inUse{};
+	// Allocations that found the arena full
+	uint64_t exhausted{};
+};
+
+// Allocation and release are lock-free and may happen on any thread, but
+// Reserve() must be done before the arena is shared. Freed slots go on a
+// stack whose head carries a tag against ABA; slots that were never used
+// are handed out in order, so that a lazily faulted arena only touches the
+// pages it needs.
+class Arena
+{
+public:
+	static constexpr inline size_t HugePageSize = 2 << 20;
+	// Slots of up to a cache line are rounded up to a power of two, larger
+	// ones to whole cache lines, so that no slot straddles more lines than
+	// it needs to
+	static constexpr inline size_t SlotAlignment = 64;
+
+	Arena() = default;
+	~Arena()
+	{
+		if (region != nullptr) ::munmap(region, regionSize);
+	}
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	// Maps the arena and divides it into slots of at least slotSize bytes
+	std::optional<ErrorCode> Reserve(const Config& config, size_t slotSize);
+
+	// Returns nullptr if the arena is full, or was never reserved, or if
+	// size does not fit in a slot
+	void* Allocate(size_t size);
+	// Returns false if p is not from this arena
+	bool Release(void* p);
+
+	Usage GetUsage() const { return { numberOfSlots, shared.inUse.load(std::memory_order_relaxed), exhausted.load(std::memory_order_relaxed) }; }
+
+private:
+	static constexpr inline uint32_t Empty = UINT32_MAX;
+
+	static constexpr uint64_t Pack(const uint32_t index, const uint32_t tag) { return (static_cast<uint64_t>(tag) << 32) | index; }
+	static constexpr uint32_t Index(const uint64_t head) { return static_cast<uint32_t>(head); }
+	static constexpr uint32_t Tag(const uint64_t head) { return static_cast<uint32_t>(head >> 32); }
+
+	std::byte* Slot(const uint32_t index) const { return region + index * slotSize; }
+	// A free slot holds the index of the next free slot. A thread that is
+	// about to fail its compare-exchange may read it while the slot is
+	// reused, hence the atomic access.
+	std::atomic_ref<uint32_t> Link(const uint32_t index) const { return std::atomic_ref<uint32_t>{*reinterpret_cast<uint32_t*>(Slot(index))}; }
+
+	std::byte* region{};
+	size_t regionSize{};
+	size_t slotSize{};
+	size_t numberOfSlots{};
+
+	// Both change with every allocation
+	struct alignas(SlotAlignment) {
+		std::atomic<uint64_t> free{Pack(Empty, 0)};
+		std::atomic<size_t> inUse{};
+	} shared;
+	std::atomic<size_t> unused{};
+	std::atomic<uint64_t> exhausted{};
+};
+
+inline std::optional<ErrorCode> Arena::Reserve(const Config& config, const size_t size)
+{
+	if (region != nullptr) return EBUSY;
+	const auto pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+	const auto unit = config.pages == Pages::Normal ? pageSize : HugePageSize;
+	const auto length = (config.size + unit - 1) / unit * unit;
+	const auto alignedSlotSize = size <= SlotAlignment ? std::bit_ceil(size) : (size + SlotAlignment - 1) / SlotAlignment * SlotAlignment;
+	if (size == 0 || length / alignedSlotSize == 0 || length / alignedSlotSize >= Empty) return EINVAL;
+
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	if (config.pages == Pages::Huge) flags |= MAP_HUGETLB;
+	// Transparent huge pages must be asked for before the pages are faulted
+	// in, and the mapping aligned to them
+	if (config.prefault && config.pages != Pages::Transparent) flags |= MAP_POPULATE;
+	const auto slack = config.pages == Pages::Transparent ? HugePageSize : 0;
+	auto p = static_cast<std::byte*>(::mmap(nullptr, length + slack, PROT_READ | PROT_WRITE, flags, -1, 0));
+	if (p == MAP_FAILED) return errno;
+	if (slack != 0) {
+		const auto aligned = reinterpret_cast<std::byte*>((reinterpret_cast<uintptr_t>(p) + HugePageSize - 1) & ~(HugePageSize - 1));
+		if (aligned != p) ::munmap(p, static_cast<size_t>(aligned - p));
+		::munmap(aligned + length, static_cast<size_t>(p + slack - aligned));
+		p = aligned;
+		// Without THP, this fails and the arena still saves the page faults
+		::madvise(p, length, MADV_HUGEPAGE);
+		if (config.prefault) {
+			for (size_t offset = 0; offset < length; offset += pageSize)
+				p[offset] = std::byte{};
+		}
+	}
+
+	region = p;
+	regionSize = length;
+	slotSize = alignedSlotSize;
+	numberOfSlots = length / alignedSlotSize;
+	return {};
+}
+
+inline void* Arena::Allocate(const size_t size)
+{
+	if (size > slotSize) return nullptr;
+	auto head = shared.free.load(std::memory_order_acquire);
+	while (Index(head) != Empty) {
+		const auto next = Link(Index(head)).load(std::memory_order_relaxed);
+		if (shared.free.compare_exchange_weak(head, Pack(next, Tag(head) + 1), std::memory_order_acquire, std::memory_order_acquire)) {
+			shared.inUse.fetch_add(1, std::memory_order_relaxed);
+			return Slot(Index(head));
+		}
+	}
+	if (unused.load(std::memory_order_relaxed) < numberOfSlots) {
+		if (const auto index = unused.fetch_add(1, std::memory_order_relaxed); index < numberOfSlots) {
+			shared.inUse.fetch_add(1, std::memory_order_relaxed);
+			return Slot(static_cast<uint32_t>(index));
+		}
+	}
+	exhausted.fetch_add(1, std::memory_order_relaxed);
+	return nullptr;
+}
+
+inline bool Arena::Release(void* p)
+{
+	// Pointers from elsewhere do not compare reliably as pointers
+	const auto offset = reinterpret_cast<uintptr_t>(p) - reinterpret_cast<uintptr_t>(region);
+	if (region == nullptr || offset >= numberOfSlots * slotSize) return false;
+	const auto index = static_cast<uint32_t>(offset / slotSize);
+	auto head = shared.free.load(std::memory_order_relaxed);
+	do {
+		Link(index).store(Index(head), std::memory_order_relaxed);
+	} while (!shared.free.compare_exchange_weak(head, Pack(index, Tag(head) + 1), std::memory_order_release, std::memory_order_relaxed));
+	shared.inUse.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+}
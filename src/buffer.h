@@ -1,8 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
 #include <cstddef>
 #include <memory>
+#include <new>
+#include "arena.h"
 #include "nonstd/span.hpp"
 
 #include "range/v3/numeric/accumulate.hpp"
@@ -22,7 +25,7 @@ namespace netstack {
 		using reference = T&;
 
 		BufferChainIterator() = default;
-		BufferChainIterator(T& buffer) : buffer(&buffer) { }
+		BufferChainIterator(T& buffer);
 
 		BufferChainIterator& operator++();
 		BufferChainIterator operator++(int);
@@ -55,6 +58,8 @@ namespace netstack {
 		friend bool operator!=(const BufferDataIterator& a, const BufferDataIterator& b) { return !(a == b); }
 
 	 private:
+		 void Enter(const Buffer* segment);
+
 		 const Buffer* buffer{};
 		 nonstd::span<value_type> span;
 		 nonstd::span<value_type>::iterator it;
@@ -95,17 +100,77 @@ namespace netstack {
 template<typename T> inline constexpr bool ranges::enable_safe_range<netstack::BufferChain<T>> = true;
 
 namespace netstack {
+	 // A segment is a small descriptor that points to its data. In the
+	 // arena the data lives elsewhere: walking a chain then only touches the
+	 // descriptors, and two of them share a cache line rather than each
+	 // sitting next to a kilobyte of data. On the heap both come from one
+	 // block, which costs a single allocation.
 	 class Buffer final
 	 {
 	 public:
 		constexpr static inline size_t Size = 1024;
+		constexpr static inline size_t DataAlignment = 64;
+
+		 Buffer() : dataBuffer(this == pending.owner ? pending.data : AllocateData()) { pending = {}; }
+		 ~Buffer() { if (!HasInlineData()) ReleaseData(dataBuffer); }
+		 Buffer(const Buffer&) = delete;
+		 Buffer& operator=(const Buffer&) = delete;
+
+		 // Descriptors and data come from arenas of their own once these
+		 // have been reserved, and from the heap before that and whenever an
+		 // arena is full. config.size is for the data; the descriptors take
+		 // as many slots. Reserve them before starting the threads that
+		 // allocate buffers.
+		 static std::optional<arena::ErrorCode> ReserveArena(const arena::Config& config)
+		 {
+			 const auto descriptors = (config.size + Size - 1) / Size * sizeof(Buffer);
+			 if (auto result = DescriptorArena().Reserve({ descriptors, config.pages, config.prefault }, sizeof(Buffer)); result) return result;
+			 return DataArena().Reserve(config, Size);
+		 }
+		 // Of the data arena, which holds the bulk of the memory
+		 static arena::Usage GetArenaUsage() { return DataArena().GetUsage(); }
+
+		 // A descriptor only comes from its arena along with a data slot;
+		 // otherwise the data follows the descriptor in a single heap block.
+		 // The constructor picks the data up from pending.
+		 static void* operator new(const size_t size)
+		 {
+			 if (const auto data = DataArena().Allocate(Size); data != nullptr) {
+				 if (const auto p = DescriptorArena().Allocate(size); p != nullptr) {
+					 pending = { p, static_cast<std::byte*>(data) };
+					 return p;
+				 }
+				 DataArena().Release(data);
+			 }
+			 const auto p = static_cast<std::byte*>(::operator new(DataOffset() + Size, std::align_val_t{DataAlignment}));
+			 pending = { p, p + DataOffset() };
+			 return p;
+		 }
+		 static void operator delete(void* p)
+		 {
+			 if (!DescriptorArena().Release(p)) ::operator delete(p, std::align_val_t{DataAlignment});
+		 }
 
-		 nonstd::span<const std::byte> ReadSpan() const { return {&dataBuffer[0], filled}; }
-		 nonstd::span<std::byte> WriteSpan() { return {&dataBuffer[filled], dataBuffer.size() - filled}; }
+		 nonstd::span<const std::byte> ReadSpan() const { return {dataBuffer + consumed, filled - consumed}; }
+		 nonstd::span<std::byte> WriteSpan() { return {dataBuffer + filled, Size - filled}; }
+		 nonstd::span<std::byte> ModifySpan() { return {dataBuffer + consumed, filled - consumed}; }
 
 		 void IncrementFilled(const size_t amount) { filled += amount; }
+		 // Drops data from the front of this segment, such as the headers of
+		 // a packet whose payload is handed on without copying it
+		 void Consume(const size_t amount) { consumed += std::min(amount, filled - consumed); }
 
 		 Buffer* next() const { return nextBuffer.get(); }
+		 // Asks for the data of the next segment and the descriptor after
+		 // it; the iterators call this on every segment they enter, so that
+		 // this segment's descriptor was asked for one step earlier
+		 void PrefetchNext() const
+		 {
+			 if (const auto n = nextBuffer.get(); n != nullptr) {
+				 __builtin_prefetch(n->dataBuffer + n->consumed);
+				 __builtin_prefetch(n->nextBuffer.get());
+			 }
+		 }
 
 		 BufferChain<Buffer> chain() { return BufferChain{*this}; }
 		 BufferChain<const Buffer> chain() const { return BufferChain{*this}; }
@@ -117,14 +182,63 @@ namespace netstack {
 			 return *nextBuffer;
 		 }
 
+		 Buffer& AddBuffer(BufferPtr buffer) {
+			 nextBuffer = std::move(buffer);
+			 return *nextBuffer;
+		 }
+
 	 private:
+		 // Never destroyed: detached threads may free buffers while the
+		 // process exits
+		 static arena::Arena& DescriptorArena()
+		 {
+			 static auto* const instance = new arena::Arena;
+			 return *instance;
+		 }
+		 static arena::Arena& DataArena()
+		 {
+			 static auto* const instance = new arena::Arena;
+			 return *instance;
+		 }
+
+		 static constexpr size_t DataOffset() { return (sizeof(Buffer) + DataAlignment - 1) / DataAlignment * DataAlignment; }
+		 bool HasInlineData() const { return reinterpret_cast<uintptr_t>(dataBuffer) == reinterpret_cast<uintptr_t>(this) + DataOffset(); }
+
+		 static std::byte* AllocateData()
+		 {
+			 if (const auto p = DataArena().Allocate(Size); p != nullptr) return static_cast<std::byte*>(p);
+			 return static_cast<std::byte*>(::operator new(Size, std::align_val_t{DataAlignment}));
+		 }
+		 static void ReleaseData(std::byte* p)
+		 {
+			 if (!DataArena().Release(p)) ::operator delete(p, std::align_val_t{DataAlignment});
+		 }
+
+		 // Set by operator new between allocating a buffer and
+		 // constructing it
+		 struct Pending {
+			 void* owner;
+			 std::byte* data;
+		 };
+		 static inline thread_local Pending pending{};
+
 		 BufferPtr nextBuffer;
-		 std::array<std::byte, Size> dataBuffer;
+		 std::byte* dataBuffer;
 		 size_t filled{};
+		 size_t consumed{};
 	};
+	static_assert(sizeof(Buffer) * 2 <= arena::Arena::SlotAlignment, "descriptors should share cache lines");
+
+	template<typename T> BufferChainIterator<T>::BufferChainIterator(T& buffer)
+		: buffer(&buffer)
+	{
+		buffer.PrefetchNext();
+	}
 
 	template<typename T> BufferChainIterator<T>& BufferChainIterator<T>::operator++() {
 		buffer = buffer->next();
+		if (buffer != nullptr)
+			buffer->PrefetchNext();
 		return *this;
 	}
 
@@ -153,24 +267,27 @@ namespace netstack {
 	}
 
 	inline BufferDataIterator::BufferDataIterator(const Buffer* buffer)
-		: buffer(buffer)
 	{
-		if (buffer != nullptr)
+		Enter(buffer);
+	}
+
+	inline void BufferDataIterator::Enter(const Buffer* segment)
+	{
+		buffer = segment;
+		if (buffer != nullptr) {
+			buffer->PrefetchNext();
 			span = buffer->ReadSpan();
+		} else {
+			span = {};
+		}
 		it = span.begin();
 	}
 
 	inline BufferDataIterator& BufferDataIterator::operator++()
 	{
 		++it;
-		while (buffer != nullptr && it == span.end()) {
-			buffer = buffer->next();
-			if (buffer != nullptr)
-				span = buffer->ReadSpan();
-			else
-				span = {};
-			it = span.begin();
-		}
+		while (buffer != nullptr && it == span.end())
+			Enter(buffer->next());
 		return *this;
 	}
 
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Support for polling devices instead of blocking on them: a thread that
+// busy-polls never waits for the scheduler to wake it up, at the cost of
+// keeping a CPU busy, so it is best pinned to a CPU of its own.
+namespace netstack::busypoll {
+
+using ErrorCode = int;
+
+// Tells the CPU that this is a spin loop; on x86, this saves power and
+// frees resources for the sibling hyperthread
+inline void Relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#elif defined(__aarch64__)
+	asm volatile("yield");
+#endif
+}
+
+struct Config {
+	// A poll that found nothing is repeated right away this many times,
+	uint32_t spins{20000};
+	// then this many times after pausing the CPU for increasingly long,
+	uint32_t pauses{2000};
+	// and from then on after sleeping; zero keeps pausing instead
+	std::chrono::microseconds sleep{50};
+};
+
+// Adaptive backoff between polls that found nothing: call Idle() after each
+// of them and Reset() whenever there was work, so a busy device is polled
+// back-to-back while an idle one gradually stops burning CPU time
+class Backoff
+{
+public:
+	// Pause instructions between polls at most; a pause takes up to a few
+	// hundred cycles on recent CPUs
+	static constexpr inline uint32_t MaxPauses = 64;
+
+	explicit Backoff(const Config& config = {}) : config(config) { }
+
+	void Idle()
+	{
+		if (idle < config.spins) {
+			++idle;
+			return;
+		}
+		if (idle - config.spins < config.pauses || config.sleep.count() == 0) {
+			for (uint32_t n = 0; n < pauseLength; ++n)
+				Relax();
+			pauseLength = std::min(pauseLength * 2, MaxPauses);
+			idle = std::min(idle + 1, config.spins + config.pauses);
+			return;
+		}
+		std::this_thread::sleep_for(config.sleep);
+	}
+
+	void Reset()
+	{
+		idle = 0;
+		pauseLength = 1;
+	}
+
+private:
+	Config config;
+	uint32_t idle{};
+	uint32_t pauseLength{1};
+};
+
+// Restricts the calling thread to the given CPU
+inline std::optional<ErrorCode> PinThread(const unsigned cpu)
+{
+	if (cpu >= CPU_SETSIZE) return EINVAL;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	if (const auto result = ::pthread_setaffinity_np(::pthread_self(), sizeof(set), &set); result != 0)
+		return result;
+	return {};
+}
+
+}
@@ -1,25 +1,138 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
+#include <vector>
 #include "nonstd/span.hpp"
 #include "range/v3/algorithm/copy.hpp"
 #include "../buffer.h"
 
 namespace netstack {
+// Staging area between the raw bytes a device reads and the buffers handed
+// to the stack. The process function passed in calls onByte() for every
+// decoded byte and onComplete() at the end of a frame, or onComplete(false)
+// to discard the bytes of the current frame.
+//
+// The amount offered to each read adapts to the load: it doubles whenever a
+// read fills all of it, as more data is likely waiting, and halves after a
+// number of reads in a row that used only a fraction of it.
 class BufferGlue
 {
 public:
 	using BufferReceivedCallback = std::function<void(std::unique_ptr<Buffer>)>;
 
+	struct Sizing {
+		size_t minimum = 1024;
+		size_t maximum = 1024;
+	};
+
+	struct Stats {
+		uint64_t reads{};
+		uint64_t bytes{};
+		uint64_t grown{};
+		uint64_t shrunk{};
+
+		double BytesPerRead() const { return reads > 0 ? static_cast<double>(bytes) / static_cast<double>(reads) : 0.0; }
+	};
+
+	// Reads using less than 1/ShrinkFraction of the offered size count as small
+	static constexpr inline size_t ShrinkFraction = 4;
+	static constexpr inline unsigned ShrinkAfter = 8;
+
+	BufferGlue() : BufferGlue(Sizing{}) { }
+	explicit BufferGlue(const Sizing& sizing)
+		: sizing{ sizing.minimum, std::max(sizing.minimum, sizing.maximum) }, readSize(sizing.minimum), receiveBuffer(readSize)
+	{
+	}
+
 	auto GetWriteSpan()
 	{
-		return nonstd::span{ receiveBuffer.data() + receiveBufferFilled, receiveBuffer.size() - receiveBufferFilled };
+		if (receiveBuffer.size() < receiveBufferFilled + readSize)
+			receiveBuffer.resize(receiveBufferFilled + readSize);
+		return nonstd::span{ receiveBuffer.data() + receiveBufferFilled, readSize };
 	}
 
+	// The amount the next read should ask for
+	size_t ReadSize() const { return readSize; }
+	const Stats& GetStats() const { return stats; }
+
 	template<typename ProcessFn> void HandleDataReceived(const size_t bytesReceived, ProcessFn&& process, BufferReceivedCallback callback)
 	{
-		const auto bufferSpan = nonstd::span{ receiveBuffer.data(), receiveBufferFilled + bytesReceived };
-		const auto it = process(bufferSpan, [&](const std::byte b)
+		Account(bytesReceived);
+		ProcessReceiveBuffer(receiveBufferFilled + bytesReceived, process, callback);
+		Resize();
+	}
+
+	// Processes data that was received elsewhere, such as in a buffer the
+	// kernel picked, without copying it to the receive buffer first. Only
+	// what is left unprocessed is kept for the next call.
+	template<typename ProcessFn> void HandleData(nonstd::span<const std::byte> data, ProcessFn&& process, BufferReceivedCallback callback)
+	{
+		Account(data.size());
+		// Leftovers from the previous call must be completed first
+		while (receiveBufferFilled > 0 && !data.empty()) {
+			const auto writeSpan = GetWriteSpan();
+			const auto amount = std::min(writeSpan.size(), data.size());
+			std::copy_n(data.begin(), amount, writeSpan.begin());
+			data = data.subspan(amount);
+			ProcessReceiveBuffer(receiveBufferFilled + amount, process, callback);
+		}
+		if (!data.empty()) {
+			const auto it = Process(data, process, callback);
+			receiveBufferFilled = std::distance(it, data.cend());
+			if (receiveBuffer.size() < receiveBufferFilled)
+				receiveBuffer.resize(receiveBufferFilled);
+			std::copy(it, data.cend(), receiveBuffer.begin());
+		}
+		Resize();
+	}
+
+private:
+	// Processes the first 'filled' bytes of the receive buffer and moves
+	// whatever is left unprocessed to the front
+	template<typename ProcessFn> void ProcessReceiveBuffer(const size_t filled, ProcessFn&& process, const BufferReceivedCallback& callback)
+	{
+		const auto bufferSpan = nonstd::span{ receiveBuffer.data(), filled };
+		const auto it = Process(bufferSpan, process, callback);
+		receiveBufferFilled = std::distance(it, bufferSpan.cend());
+		ranges::copy(it, bufferSpan.cend(), receiveBuffer.begin());
+	}
+
+	void Account(const size_t bytesReceived)
+	{
+		++stats.reads;
+		stats.bytes += bytesReceived;
+		if (bytesReceived >= readSize) {
+			smallReads = 0;
+			if (readSize < sizing.maximum) {
+				readSize = std::min(readSize * 2, sizing.maximum);
+				++stats.grown;
+			}
+		} else if (bytesReceived < readSize / ShrinkFraction && readSize > sizing.minimum) {
+			if (++smallReads >= ShrinkAfter) {
+				smallReads = 0;
+				readSize = std::max(readSize / 2, sizing.minimum);
+				++stats.shrunk;
+			}
+		} else {
+			smallReads = 0;
+		}
+	}
+
+	// Gives back memory once the read size has dropped well below it
+	void Resize()
+	{
+		const auto needed = receiveBufferFilled + readSize;
+		if (receiveBuffer.size() >= 4 * needed) {
+			receiveBuffer.resize(needed);
+			receiveBuffer.shrink_to_fit();
+		}
+	}
+
+	template<typename Container, typename ProcessFn> auto Process(const Container& data, ProcessFn&& process, const BufferReceivedCallback& callback)
+	{
+		return process(data, [&](const std::byte b)
 		{
 			if (!currentBuffer) {
 				currentBuffer = std::make_unique<Buffer>();
@@ -33,20 +146,22 @@ public:
 			}
 			writeSpan.front() = b;
 			fillingBuffer->IncrementFilled(1);
-		}, [&]() {
-			if (currentBuffer)
+		}, [&](const bool complete = true) {
+			if (currentBuffer && complete)
 				callback(std::move(currentBuffer));
+			currentBuffer.reset();
 			fillingBuffer = nullptr;
 		});
-
-		receiveBufferFilled = std::distance(it, bufferSpan.cend());
-		ranges::copy(it, receiveBuffer.cend(), receiveBuffer.begin());
 	}
 
-private:
+	const Sizing sizing;
+	size_t readSize;
+	unsigned smallReads{};
+	Stats stats;
+
 	std::unique_ptr<Buffer> currentBuffer;
 	Buffer* fillingBuffer{};
-	std::array<std::byte, 1024> receiveBuffer;
+	std::vector<std::byte> receiveBuffer;
 	size_t receiveBufferFilled{};
 };
 }
\ No newline at end of file
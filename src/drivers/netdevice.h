@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <variant>
+#include "nonstd/span.hpp"
+
+namespace netstack {
+
+class Buffer;
+using BufferPtr = std::unique_ptr<Buffer>;
+
+namespace devices {
+
+namespace capability {
+	// The device verifies and fills in checksums itself
+	static constexpr inline uint32_t ChecksumOffload = 1 << 0;
+	// Buffer chains are handed to the device as-is, without flattening
+	static constexpr inline uint32_t ScatterGather = 1 << 1;
+}
+
+// Statistics counter with a single writer; reading it from any other
+// thread is fine
+class Counter
+{
+public:
+	void Add(const uint64_t amount) { value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed); }
+	uint64_t Get() const { return value.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t> value{};
+};
+
+// Receive counters are only updated by RxBurst(), transmit counters by
+// TxBurst(), so each direction may be served by its own thread
+struct Counters {
+	Counter rxPackets;
+	Counter rxBytes;
+	Counter rxDropped;
+	Counter rxErrors;
+	Counter txPackets;
+	Counter txBytes;
+	Counter txDropped;
+	Counter txErrors;
+};
+
+class NetDevice
+{
+public:
+	using ErrorCode = int;
+	using BurstResult = std::variant<ErrorCode, size_t>;
+
+	virtual ~NetDevice() = default;
+
+	// Receives up to buffers.size() packets, blocking until there is at
+	// least one; returns the number of packets stored at the front of
+	// 'buffers'
+	virtual BurstResult RxBurst(nonstd::span<BufferPtr> buffers) = 0;
+
+	// Transmits packets from the front of 'buffers' and returns how many
+	// were sent; those are taken over, the rest is left to the caller
+	virtual BurstResult TxBurst(nonstd::span<BufferPtr> buffers) = 0;
+
+	size_t MTU() const { return mtu; }
+	uint32_t Capabilities() const { return capabilities; }
+	const Counters& GetCounters() const { return counters; }
+
+protected:
+	NetDevice(const size_t mtu, const uint32_t capabilities) : mtu(mtu), capabilities(capabilities) { }
+
+	size_t mtu;
+	uint32_t capabilities;
+	Counters counters;
+};
+
+}
+}
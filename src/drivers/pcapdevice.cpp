@@ -0,0 +1,126 @@
+#include "pcapdevice.h"
+#include <algorithm>
+#include <thread>
+
+#include "../buffer.h"
+#include "../clock.h"
+
+namespace netstack::devices {
+
+namespace {
+
+BufferPtr CopyToBuffer(nonstd::span<const std::byte> data)
+{
+	auto head = std::make_unique<Buffer>();
+	auto buffer = head.get();
+	while (true) {
+		const auto writeSpan = buffer->WriteSpan();
+		const auto amount = std::min(writeSpan.size(), data.size());
+		std::copy_n(data.begin(), amount, writeSpan.begin());
+		buffer->IncrementFilled(amount);
+		data = data.subspan(amount);
+		if (data.empty()) break;
+		buffer = &buffer->AddBuffer();
+	}
+	return head;
+}
+
+}
+
+pcap::Result PcapReplayDevice::Open(const std::string& path)
+{
+	next.reset();
+	start.reset();
+	return reader.Open(path);
+}
+
+NetDevice::BurstResult PcapReplayDevice::RxBurst(nonstd::span<BufferPtr> buffers)
+{
+	size_t amount = 0, bytes = 0;
+	while (amount < buffers.size()) {
+		if (!next) {
+			next = reader.Next();
+			if (!next && config.loop) {
+				reader.Rewind();
+				start.reset();
+				next = reader.Next();
+			}
+			if (!next) break;
+		}
+
+		if (config.honorTimestamps) {
+			if (!start)
+				start = std::pair{ next->timestamp, Clock::now() };
+			const auto offset = next->timestamp >= start->first ? next->timestamp - start->first : 0;
+			const auto due = start->second + std::chrono::nanoseconds(offset);
+			if (Clock::now() < due) {
+				if (amount > 0) break;
+				std::this_thread::sleep_until(due);
+			}
+		}
+
+		bytes += next->data.size();
+		buffers[amount++] = CopyToBuffer(next->data);
+		next.reset();
+	}
+	counters.rxPackets.Add(amount);
+	counters.rxBytes.Add(bytes);
+	return amount;
+}
+
+NetDevice::BurstResult PcapReplayDevice::TxBurst(nonstd::span<BufferPtr> buffers)
+{
+	size_t bytes = 0;
+	for (auto& buffer : buffers) {
+		bytes += buffer->data().size();
+		buffer.reset();
+	}
+	counters.txPackets.Add(buffers.size());
+	counters.txBytes.Add(bytes);
+	return buffers.size();
+}
+
+CaptureDevice::CaptureDevice(std::unique_ptr<NetDevice> device, pcap::Writer& writer)
+	: NetDevice(device->MTU(), device->Capabilities()), device(std::move(device)), writer(writer)
+{
+}
+
+NetDevice::BurstResult CaptureDevice::RxBurst(nonstd::span<BufferPtr> buffers)
+{
+	const auto result = device->RxBurst(buffers);
+	if (std::holds_alternative<ErrorCode>(result)) return result;
+
+	const auto amount = std::get<size_t>(result);
+	const auto now = clock::RealTimeNanoseconds();
+	size_t bytes = 0;
+	for (const auto& buffer : buffers.first(amount)) {
+		writer.Write(*buffer, now);
+		bytes += buffer->data().size();
+	}
+	counters.rxPackets.Add(amount);
+	counters.rxBytes.Add(bytes);
+	return result;
+}
+
+NetDevice::BurstResult CaptureDevice::TxBurst(nonstd::span<BufferPtr> buffers)
+{
+	// Packets that are sent are gone afterwards, so record them up front;
+	// this may include some that end up not being sent
+	const auto now = clock::RealTimeNanoseconds();
+	size_t bytes = 0;
+	for (const auto& buffer : buffers) {
+		writer.Write(*buffer, now);
+		bytes += buffer->data().size();
+	}
+
+	const auto result = device->TxBurst(buffers);
+	if (std::holds_alternative<size_t>(result)) {
+		const auto amount = std::get<size_t>(result);
+		counters.txPackets.Add(amount);
+		// The sizes of a partial burst are unknown once the packets are gone
+		if (amount == buffers.size()) counters.txBytes.Add(bytes);
+	}
+	return result;
+}
+
+}
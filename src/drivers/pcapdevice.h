@@ -0,0 +1,65 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include "netdevice.h"
+#include "../pcap.h"
+
+namespace netstack::devices {
+
+struct ReplayConfig {
+	// Deliver packets with the same spacing as in the capture, rather than
+	// as fast as possible
+	bool honorTimestamps{false};
+	// Start over at the end of the capture instead of reporting end-of-file
+	bool loop{false};
+};
+
+// Receives the packets of a capture file; transmitted packets are discarded.
+//
+// Buffers carry their data inline, so every packet is copied once out of
+// the mapped file; nothing else is copied on the way.
+class PcapReplayDevice final : public NetDevice
+{
+public:
+	static constexpr inline size_t DefaultMTU = 65535;
+
+	explicit PcapReplayDevice(const ReplayConfig& config = {}) : NetDevice(DefaultMTU, capability::ScatterGather), config(config) { }
+
+	pcap::Result Open(const std::string& path);
+
+	// Returns 0 packets at the end of the capture. When honoring timestamps,
+	// a burst ends early rather than holding on to packets that are due
+	BurstResult RxBurst(nonstd::span<BufferPtr> buffers) override;
+	BurstResult TxBurst(nonstd::span<BufferPtr> buffers) override;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	ReplayConfig config;
+	pcap::Reader reader;
+	std::optional<pcap::Packet> next;
+	// Maps capture time onto Clock time, set by the first packet of a pass
+	std::optional<std::pair<uint64_t, Clock::time_point>> start;
+};
+
+// Passes everything through to another device, writing a copy of all
+// received and transmitted packets to a capture file
+class CaptureDevice final : public NetDevice
+{
+public:
+	CaptureDevice(std::unique_ptr<NetDevice> device, pcap::Writer& writer);
+
+	BurstResult RxBurst(nonstd::span<BufferPtr> buffers) override;
+	BurstResult TxBurst(nonstd::span<BufferPtr> buffers) override;
+
+	const NetDevice& Device() const { return *device; }
+
+private:
+	std::unique_ptr<NetDevice> device;
+	pcap::Writer& writer;
+};
+
+}
@@ -1,13 +1,57 @@
 #include "slipdevice.h"
 #include <unistd.h>
+#include <cerrno>
 #include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
 
 #include "range/v3/algorithm/copy.hpp"
 #include "../buffer.h"
 #include "../slip.h"
+#include "../stats.h"
 
 namespace netstack::devices {
 
+namespace {
+
+std::optional<speed_t> ToSpeed(const unsigned baudRate)
+{
+	switch(baudRate) {
+		case 1200: return B1200;
+		case 2400: return B2400;
+		case 4800: return B4800;
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		case 500000: return B500000;
+		case 576000: return B576000;
+		case 921600: return B921600;
+		case 1000000: return B1000000;
+		case 1152000: return B1152000;
+		case 1500000: return B1500000;
+		case 2000000: return B2000000;
+		case 2500000: return B2500000;
+		case 3000000: return B3000000;
+		case 3500000: return B3500000;
+		case 4000000: return B4000000;
+	}
+	return {};
+}
+
+}
+
+SLIPDevice::SLIPDevice()
+	: NetDevice(DefaultMTU, 0)
+	, glue(BufferGlue::Sizing{ 1024, MaxPacketSize })
+	, decoder(MaxPacketSize)
+	, enqueue([this](BufferPtr buffer) { received.push_back(std::move(buffer)); })
+{
+}
+
 SLIPDevice::~SLIPDevice()
 {
 	Close();
@@ -15,36 +59,335 @@ SLIPDevice::~SLIPDevice()
 
 void SLIPDevice::Close()
 {
+	// Frames that were accepted by TxBurst() must still go out
+	if (backend == Backend::IOUring && fd >= 0) CompleteWrites(0);
+	receiveRing.Close();
+	transmitRing.Close();
+	readPending = false;
+	writesStarted = writesCompleted = 0;
+	backend = Backend::Read;
 	if (fd >= 0) ::close(fd);
 	fd = -1;
 }
 
-std::optional<SLIPDevice::ErrorCode> SLIPDevice::Open(std::string_view device)
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::Open(std::string_view device, const SLIPConfig& config)
 {
 	Close();
 	fd = open(device.data(), O_NOCTTY | O_RDWR);
 	if (fd < 0)
 		return errno;
+
+	compressHeaders = config.compressHeaders;
+	compressor = {};
+	decompressor = {};
+	if (auto result = SetupTty(config); result) {
+		Close();
+		return result;
+	}
+	if (config.backend == Backend::IOUring && !SetupURing())
+		backend = Backend::IOUring;
+	if (config.backend == Backend::BusyPoll) {
+		if (const auto flags = ::fcntl(fd, F_GETFL); flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) {
+			const auto error = errno;
+			Close();
+			return error;
+		}
+		backend = Backend::BusyPoll;
+		backoff = busypoll::Backoff(config.busyPoll);
+	}
+	return {};
+}
+
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::SetupTty(const SLIPConfig& config)
+{
+	termios tio{};
+	if (::tcgetattr(fd, &tio) != 0)
+		return errno == ENOTTY ? std::nullopt : std::optional<ErrorCode>{errno};
+
+	if (config.raw) {
+		::cfmakeraw(&tio);
+		// Ignore modem control lines, many SLIP cables lack them
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = config.minBytes;
+		tio.c_cc[VTIME] = config.interByteTimeout;
+	}
+	if (config.baudRate != 0) {
+		const auto speed = ToSpeed(config.baudRate);
+		if (!speed) return EINVAL;
+		::cfsetispeed(&tio, *speed);
+		::cfsetospeed(&tio, *speed);
+	}
+	if (::tcsetattr(fd, TCSANOW, &tio) != 0)
+		return errno;
 	return {};
 }
 
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::SetupURing()
+{
+	auto result = receiveRing.Setup(4);
+	if (!result) result = receiveRing.SetupProvidedBuffers(ReceiveBufferGroup, ReceiveBufferCount, ReceiveBufferSize);
+	if (!result) result = transmitRing.Setup(MaxWritesInFlight);
+	if (result) {
+		receiveRing.Close();
+		transmitRing.Close();
+	}
+	return result;
+}
+
+template<typename Container, typename OnByteFn, typename OnEndFn> auto SLIPDevice::Decode(const Container& data, OnByteFn&& onByte, OnEndFn&& onEnd)
+{
+	return decoder.Decode(data, onByte, [&](const bool complete = true) {
+		// The lost frame may have changed the sender's compression state
+		if (!complete) decompressor.Toss();
+		onEnd(complete);
+	});
+}
+
+// Decoding and copying the bytes into the frame's buffers happen in a single
+// pass, so the decode stage covers both; assembly is what it takes to turn
+// the buffers into a packet and hand it over
+void SLIPDevice::Deliver(BufferPtr frame, const BufferGlue::BufferReceivedCallback& callback, stats::StageTimer& timer)
+{
+	timer.Mark(latency::Stage::SLIPDecode);
+	if (compressHeaders) {
+		frame = decompressor.Decompress(std::move(frame));
+		if (!frame) {
+			counters.rxDropped.Add(1);
+			timer.Restart();
+			return;
+		}
+	}
+	callback(std::move(frame));
+	timer.Mark(latency::Stage::Assembly);
+}
+
+std::variant<SLIPDevice::ErrorCode, size_t> SLIPDevice::Receive(const BufferGlue::BufferReceivedCallback& callback)
+{
+	if (backend == Backend::IOUring)
+		return ReceiveURing(callback);
+
+	const auto writeSpan = glue.GetWriteSpan();
+	ssize_t bytesReceived;
+	for (;;) {
+		systemCalls.receive.Add(1);
+		bytesReceived = ::read(fd, writeSpan.data(), writeSpan.size());
+		if (bytesReceived >= 0 || errno != EAGAIN || backend != Backend::BusyPoll) break;
+		backoff.Idle();
+	}
+	if (bytesReceived < 0)
+		return ErrorCode{errno};
+	backoff.Reset();
+	// The read waits until data arrives, so timing starts once it returns
+	stats::StageTimer timer;
+
+	glue.HandleDataReceived(static_cast<size_t>(bytesReceived), [this](auto span, auto&& onByte, auto&& onComplete) {
+		return Decode(span, onByte, onComplete);
+	}, [&](BufferPtr frame) { Deliver(std::move(frame), callback, timer); });
+	return static_cast<size_t>(bytesReceived);
+}
+
+std::variant<SLIPDevice::ErrorCode, size_t> SLIPDevice::ReceiveURing(const BufferGlue::BufferReceivedCallback& callback)
+{
+	std::array<uring::Completion, ReceiveBufferCount> completions;
+	for(;;) {
+		// The read is queued only; it is submitted along with the wait below
+		if (!readPending) {
+			const auto queued = receiveRing.SupportsMultishotRead()
+				? receiveRing.PrepareReadMultishot(fd, ReceiveBufferGroup, 0)
+				: receiveRing.PrepareRead(fd, ReceiveBufferGroup, glue.ReadSize(), 0);
+			if (!queued) return ErrorCode{EBUSY};
+			readPending = true;
+		}
+
+		size_t amount;
+		while ((amount = receiveRing.Reap(completions)) == 0) {
+			systemCalls.receive.Add(1);
+			if (const auto result = receiveRing.Submit(1); std::holds_alternative<ErrorCode>(result))
+				return std::get<ErrorCode>(result);
+		}
+
+		stats::StageTimer timer;
+		size_t bytesReceived = 0;
+		bool end = false;
+		std::optional<ErrorCode> error;
+		for (const auto& completion : nonstd::span{completions.data(), amount}) {
+			if (!completion.more) readPending = false;
+			// Out of buffers, the read is queued again once they are back
+			if (completion.result == -ENOBUFS) continue;
+			if (completion.result < 0) {
+				error = ErrorCode{-completion.result};
+				continue;
+			}
+			if (completion.result == 0) end = true;
+			if (!completion.bufferId) continue;
+			const auto length = static_cast<size_t>(completion.result);
+			if (length > 0) {
+				glue.HandleData(receiveRing.ProvidedBuffer(*completion.bufferId, length), [this](auto span, auto&& onByte, auto&& onComplete) {
+					return Decode(span, onByte, onComplete);
+				}, [&](BufferPtr frame) { Deliver(std::move(frame), callback, timer); });
+			}
+			receiveRing.RecycleProvidedBuffer(*completion.bufferId);
+			bytesReceived += length;
+		}
+		if (error) return *error;
+		if (bytesReceived > 0 || end) return bytesReceived;
+	}
+}
+
 std::optional<SLIPDevice::ErrorCode> SLIPDevice::Read(BufferGlue::BufferReceivedCallback&& callback)
 {
 	for(;;) {
-		const auto writeSpan = glue.GetWriteSpan();
-		const auto bytesReceived = ::read(fd, writeSpan.data(), writeSpan.size());
-		if (bytesReceived < 0)
-			return ErrorCode{errno};
-		if (bytesReceived == 0)
+		const auto result = Receive(callback);
+		if (std::holds_alternative<ErrorCode>(result))
+			return std::get<ErrorCode>(result);
+		if (std::get<size_t>(result) == 0)
 			break;
+	}
 
-		glue.HandleDataReceived(static_cast<size_t>(bytesReceived), [](auto span, auto&& onByte, auto&& onComplete) {
-			return slip::Decode(span, onByte, onComplete);
-		}, callback);
+	return ErrorCode{};
+}
 
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::Flush()
+{
+	if (backend == Backend::IOUring)
+		return FlushURing();
+
+	for (size_t offset = 0; offset < transmitBuffer.size(); ) {
+		systemCalls.transmit.Add(1);
+		const auto bytesWritten = ::write(fd, transmitBuffer.data() + offset, transmitBuffer.size() - offset);
+		if (bytesWritten < 0) {
+			if (errno == EINTR) continue;
+			// Only when busy polling, which makes the descriptor non-blocking
+			if (errno == EAGAIN) {
+				pollfd pfd{ fd, POLLOUT, 0 };
+				systemCalls.transmit.Add(1);
+				::poll(&pfd, 1, -1);
+				continue;
+			}
+			return ErrorCode{errno};
+		}
+		offset += static_cast<size_t>(bytesWritten);
 	}
+	return {};
+}
 
-	return ErrorCode{};
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::FlushURing()
+{
+	// Only a full pipeline is waited for
+	if (auto result = CompleteWrites(MaxWritesInFlight - 1); result)
+		return result;
+	if (transmitBuffer.empty())
+		return {};
+
+	// Ordering holds back a write until the ring is idle, which costs about
+	// as much as the write itself, so it is only asked for when needed
+	auto& writeBuffer = writeBuffers[writesStarted % MaxWritesInFlight];
+	std::swap(writeBuffer, transmitBuffer);
+	if (!transmitRing.PrepareWrite(fd, writeBuffer, 0, writesStarted != writesCompleted))
+		return ErrorCode{EBUSY};
+	// Once queued, the write goes out with the next submission regardless
+	++writesStarted;
+	systemCalls.transmit.Add(1);
+	if (const auto result = transmitRing.Submit(0); std::holds_alternative<ErrorCode>(result))
+		return std::get<ErrorCode>(result);
+	return {};
+}
+
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::CompleteWrites(const size_t limit)
+{
+	std::array<uring::Completion, MaxWritesInFlight> completions;
+	std::optional<ErrorCode> error;
+	while (writesStarted != writesCompleted) {
+		const auto amount = transmitRing.Reap(completions);
+		if (amount == 0) {
+			if (error || writesStarted - writesCompleted <= limit) break;
+			systemCalls.transmit.Add(1);
+			if (const auto result = transmitRing.Submit(1); std::holds_alternative<ErrorCode>(result))
+				return std::get<ErrorCode>(result);
+			continue;
+		}
+		// Later writes are queued behind a short one already, so what is
+		// left of it cannot be sent in order; tty writes block until done,
+		// so this takes a hangup or the like
+		for (const auto& completion : nonstd::span{completions.data(), amount}) {
+			const auto& written = writeBuffers[writesCompleted++ % MaxWritesInFlight];
+			if (completion.result < 0)
+				error = ErrorCode{-completion.result};
+			else if (static_cast<size_t>(completion.result) < written.size())
+				error = ErrorCode{EIO};
+		}
+	}
+	return error;
 }
 
-}
\ No newline at end of file
+size_t SLIPDevice::Encode(const Buffer& buffer)
+{
+	const auto push = [&](const std::byte b) { transmitBuffer.push_back(b); };
+	if (!compressHeaders)
+		return slip::Transmit(buffer, push);
+	const auto compressed = compressor.Compress(buffer);
+	return slip::Transmit(compressed.Header(), buffer, compressed.replaced, push);
+}
+
+std::optional<SLIPDevice::ErrorCode> SLIPDevice::Write(const Buffer& buffer)
+{
+	transmitBuffer.clear();
+	stats::Add(stats::Id::SLIPTxEscapes, Encode(buffer));
+	return Flush();
+}
+
+NetDevice::BurstResult SLIPDevice::RxBurst(nonstd::span<BufferPtr> buffers)
+{
+	while (received.empty()) {
+		const auto result = Receive(enqueue);
+		if (std::holds_alternative<ErrorCode>(result)) {
+			if (std::get<ErrorCode>(result) == EINTR) continue;
+			counters.rxErrors.Add(1);
+			return std::get<ErrorCode>(result);
+		}
+		if (std::get<size_t>(result) == 0)
+			return size_t{0};
+
+		if (const auto dropped = decoder.GetStats().dropped; dropped != droppedFrames) {
+			counters.rxDropped.Add(dropped - droppedFrames);
+			droppedFrames = dropped;
+		}
+		if (const auto escapes = decoder.GetStats().escapes; escapes != receivedEscapes) {
+			stats::Add(stats::Id::SLIPRxEscapes, escapes - receivedEscapes);
+			receivedEscapes = escapes;
+		}
+	}
+
+	size_t amount = 0, bytes = 0;
+	for (; amount < buffers.size() && !received.empty(); ++amount) {
+		buffers[amount] = std::move(received.front());
+		received.pop_front();
+		bytes += buffers[amount]->data().size();
+	}
+	counters.rxPackets.Add(amount);
+	counters.rxBytes.Add(bytes);
+	return amount;
+}
+
+NetDevice::BurstResult SLIPDevice::TxBurst(nonstd::span<BufferPtr> buffers)
+{
+	transmitBuffer.clear();
+	size_t bytes = 0, escapes = 0;
+	for (const auto& buffer : buffers) {
+		escapes += Encode(*buffer);
+		bytes += buffer->data().size();
+	}
+	stats::Add(stats::Id::SLIPTxEscapes, escapes);
+	if (auto result = Flush(); result) {
+		counters.txErrors.Add(1);
+		return *result;
+	}
+
+	for (auto& buffer : buffers)
+		buffer.reset();
+	counters.txPackets.Add(buffers.size());
+	counters.txBytes.Add(bytes);
+	return buffers.size();
+}
+
+}
@@ -1,36 +1,163 @@
 #pragma once
 
 #include <array>
+#include <cstdint>
+#include <deque>
 #include <functional>
 #include <memory>
 #include <string_view>
 #include <variant>
+#include <vector>
 #include "bufferglue.h"
+#include "../busypoll.h"
+#include "netdevice.h"
+#include "uring.h"
+#include "../slip.h"
+#include "../stats.h"
+#include "../protocols/vj.h"
 #include "nonstd/span.hpp"
 
 namespace netstack { class Buffer; }
 
 namespace netstack::devices {
 
-class SLIPDevice final
+struct SLIPConfig {
+	enum class Backend {
+		Read,
+		IOUring,
+		// Non-blocking reads in a loop, backing off as configured below
+		BusyPoll,
+	};
+	// Falls back to Read if io_uring cannot be used
+	Backend backend{Backend::IOUring};
+	busypoll::Config busyPoll;
+
+	// Put the tty in raw mode, so that bytes pass unmodified and reads are
+	// not held back until a newline. Ignored if the device is not a tty.
+	bool raw{true};
+	// Line speed in bits per second; 0 keeps the current setting
+	unsigned baudRate{0};
+	// A read returns once minBytes have arrived, or once the line has been
+	// quiet for interByteTimeout tenths of a second after the first byte.
+	// Larger values let the kernel gather more bytes per read, at the cost
+	// of latency for frames that are shorter than minBytes. Busy polling
+	// ignores both.
+	uint8_t minBytes{1};
+	uint8_t interByteTimeout{0};
+
+	// CSLIP: Van Jacobson TCP/IP header compression (RFC 1144), compatible
+	// with Linux' cslip line discipline; both ends must enable it
+	bool compressHeaders{false};
+};
+
+// With the io_uring backend, a multishot read (Linux 6.7) stays armed and
+// fills the provided buffers in order as data arrives. Whatever completed
+// while earlier data was being decoded is reaped in one go without entering
+// the kernel, and waiting takes a single system call. Older kernels get one
+// plain read at a time, as separate reads may complete out of order and the
+// line is a byte stream. Each burst is a single write; up to
+// MaxWritesInFlight are queued, each starting once the previous one has
+// completed, so TxBurst() only waits when the line falls that far behind.
+// A failed write is reported by a later TxBurst().
+//
+// With busy polling, the receiving thread never sleeps in the kernel while
+// data is flowing; writes still wait for room in the tty's buffer.
+class SLIPDevice final : public NetDevice
 {
 public:
 	static constexpr inline size_t MaxPacketSize = 65536;
-	using ErrorCode = int;
+	// RFC 1055 suggests 1006 bytes, as used by Berkeley UNIX
+	static constexpr inline size_t DefaultMTU = 1006;
 
-	SLIPDevice() = default;
+	using Backend = SLIPConfig::Backend;
+
+	// Every read, write, poll or io_uring_enter the device makes, so that
+	// backends can be compared by system calls per frame
+	struct SystemCalls {
+		Counter receive;
+		Counter transmit;
+	};
+
+	SLIPDevice();
 	~SLIPDevice();
 	SLIPDevice(const SLIPDevice&) = delete;
 	SLIPDevice& operator=(const SLIPDevice&) = delete;
 
-	std::optional<ErrorCode> Open(std::string_view device);
+	std::optional<ErrorCode> Open(std::string_view device, const SLIPConfig& config = {});
 	void Close();
 
+	Backend GetBackend() const { return backend; }
+	const BufferGlue::Stats& GetReceiveStats() const { return glue.GetStats(); }
+	const slip::Decoder::Stats& GetDecoderStats() const { return decoder.GetStats(); }
+	const protocol::vj::Compressor::Stats& GetCompressorStats() const { return compressor.GetStats(); }
+	const protocol::vj::Decompressor::Stats& GetDecompressorStats() const { return decompressor.GetStats(); }
+	const SystemCalls& GetSystemCalls() const { return systemCalls; }
+
 	std::optional<ErrorCode> Read(BufferGlue::BufferReceivedCallback&& callback);
+	std::optional<ErrorCode> Write(const Buffer& buffer);
+
+	// Returns 0 packets once the device has reached end-of-file
+	BurstResult RxBurst(nonstd::span<BufferPtr> buffers) override;
+	// All packets are encoded back-to-back and written at once
+	BurstResult TxBurst(nonstd::span<BufferPtr> buffers) override;
 
 private:
+	static constexpr inline uint16_t ReceiveBufferGroup = 0;
+	// A multishot read keeps filling buffers while earlier ones are decoded;
+	// if it runs out, it stops and is queued again. A tty returns no more
+	// than a page per read, and plain reads ask for what the glue suggests.
+	static constexpr inline unsigned ReceiveBufferCount = 16;
+	static constexpr inline size_t ReceiveBufferSize = 4096;
+	static constexpr inline size_t MaxWritesInFlight = 4;
+
+	std::optional<ErrorCode> SetupTty(const SLIPConfig& config);
+	std::optional<ErrorCode> SetupURing();
+
+	// Performs a single read and decodes what it returned; yields the
+	// number of bytes read
+	std::variant<ErrorCode, size_t> Receive(const BufferGlue::BufferReceivedCallback& callback);
+	std::variant<ErrorCode, size_t> ReceiveURing(const BufferGlue::BufferReceivedCallback& callback);
+	// Writes transmitBuffer; with io_uring, this only queues the write
+	std::optional<ErrorCode> Flush();
+	std::optional<ErrorCode> FlushURing();
+	// Reaps completed writes, waiting until no more than 'limit' are left
+	std::optional<ErrorCode> CompleteWrites(size_t limit);
+
+	// Decodes SLIP, dropping the compression state on damaged frames
+	template<typename Container, typename OnByteFn, typename OnEndFn> auto Decode(const Container& data, OnByteFn&& onByte, OnEndFn&& onEnd);
+	// Passes a frame on, decompressed if need be
+	void Deliver(BufferPtr frame, const BufferGlue::BufferReceivedCallback& callback, stats::StageTimer& timer);
+	// Appends the frame for a packet to transmitBuffer; returns the number
+	// of escaped bytes
+	size_t Encode(const Buffer& buffer);
+
 	int fd{-1};
+	Backend backend{Backend::Read};
+	busypoll::Backoff backoff;
 	BufferGlue glue;
+	slip::Decoder decoder;
+	// Part of the decoder's dropped frames and escapes already added to the
+	// counters
+	uint64_t droppedFrames{};
+	uint64_t receivedEscapes{};
+	bool compressHeaders{};
+	protocol::vj::Compressor compressor;
+	protocol::vj::Decompressor decompressor;
+	std::vector<std::byte> transmitBuffer;
+
+	uring::Ring receiveRing;
+	bool readPending{};
+	// Receive and transmit may be called from different threads, and a ring
+	// has a single user
+	uring::Ring transmitRing;
+	// Writes in flight are writesCompleted up to writesStarted, modulo the size
+	std::array<std::vector<std::byte>, MaxWritesInFlight> writeBuffers;
+	size_t writesStarted{};
+	size_t writesCompleted{};
+	SystemCalls systemCalls;
+	// Frames decoded by RxBurst() that did not fit in the burst
+	std::deque<BufferPtr> received;
+	BufferGlue::BufferReceivedCallback enqueue;
 };
 
-}
\ No newline at end of file
+}
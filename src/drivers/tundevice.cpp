@@ -0,0 +1,217 @@
+#include "tundevice.h"
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/if_tun.h>
+
+#include "../buffer.h"
+#include "../stats.h"
+
+namespace netstack::devices {
+
+namespace {
+
+std::optional<int> QueryMTU(const std::string& name)
+{
+	const auto sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) return {};
+
+	ifreq ifr{};
+	std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+	const auto result = ::ioctl(sock, SIOCGIFMTU, &ifr);
+	::close(sock);
+	if (result < 0) return {};
+	return ifr.ifr_mtu;
+}
+
+}
+
+TUNDevice::~TUNDevice()
+{
+	Close();
+}
+
+void TUNDevice::Close()
+{
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	spare.clear();
+	receiveVector.clear();
+}
+
+std::optional<TUNDevice::ErrorCode> TUNDevice::Open(std::string_view device, const int flags)
+{
+	Close();
+	if (device.size() >= IFNAMSIZ) return ENAMETOOLONG;
+
+	// Non-blocking, so that bursts can tell when the device has run dry
+	fd = ::open("/dev/net/tun", O_RDWR | O_CLOEXEC | O_NONBLOCK);
+	if (fd < 0)
+		return errno;
+
+	ifreq ifr{};
+	ifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+	if (flags & MultiQueue) ifr.ifr_flags |= IFF_MULTI_QUEUE;
+	std::copy(device.begin(), device.end(), ifr.ifr_name);
+	if (::ioctl(fd, TUNSETIFF, &ifr) < 0) {
+		const auto error = errno;
+		Close();
+		return error;
+	}
+	name = ifr.ifr_name;
+	mtu = QueryMTU(name).value_or(MaxPacketSize);
+
+	constexpr auto numberOfBuffers = (MaxPacketSize + Buffer::Size - 1) / Buffer::Size;
+	spare.resize(numberOfBuffers);
+	receiveVector.resize(numberOfBuffers);
+	Replenish(numberOfBuffers);
+	return {};
+}
+
+void TUNDevice::Replenish(const size_t amount)
+{
+	for (size_t n = 0; n < amount; ++n) {
+		spare[n] = std::make_unique<Buffer>();
+		const auto writeSpan = spare[n]->WriteSpan();
+		receiveVector[n] = iovec{ writeSpan.data(), writeSpan.size() };
+	}
+}
+
+std::optional<TUNDevice::ErrorCode> TUNDevice::Wait(const short events)
+{
+	pollfd pfd{ fd, events, 0 };
+	while (::poll(&pfd, 1, -1) < 0) {
+		if (errno != EINTR) return ErrorCode{errno};
+	}
+	return {};
+}
+
+std::variant<TUNDevice::ErrorCode, BufferPtr> TUNDevice::ReadPacket()
+{
+	ssize_t bytesReceived;
+	// The descriptor is non-blocking, so this is the cost of the call itself
+	stats::StageTimer timer;
+	do {
+		bytesReceived = ::readv(fd, receiveVector.data(), static_cast<int>(receiveVector.size()));
+	} while (bytesReceived < 0 && errno == EINTR);
+	if (bytesReceived < 0) {
+		if (errno == EAGAIN) return BufferPtr{};
+		return ErrorCode{errno};
+	}
+	if (bytesReceived == 0)
+		return BufferPtr{};
+	timer.Mark(latency::Stage::Read);
+
+	// Chain the buffers that were filled; the first one heads the packet
+	auto remaining = static_cast<size_t>(bytesReceived);
+	size_t used = 0;
+	Buffer* tail = nullptr;
+	BufferPtr head;
+	while (remaining > 0) {
+		auto& buffer = spare[used++];
+		const auto amount = std::min(remaining, buffer->WriteSpan().size());
+		buffer->IncrementFilled(amount);
+		remaining -= amount;
+		if (!head) {
+			head = std::move(buffer);
+			tail = head.get();
+		} else {
+			tail = &tail->AddBuffer(std::move(buffer));
+		}
+	}
+	Replenish(used);
+	return head;
+}
+
+std::optional<TUNDevice::ErrorCode> TUNDevice::Read(BufferGlue::BufferReceivedCallback&& callback)
+{
+	for (;;) {
+		auto result = ReadPacket();
+		if (std::holds_alternative<ErrorCode>(result))
+			return std::get<ErrorCode>(result);
+		if (auto& buffer = std::get<BufferPtr>(result); buffer) {
+			callback(std::move(buffer));
+			return {};
+		}
+		if (auto error = Wait(POLLIN); error)
+			return error;
+	}
+}
+
+std::optional<TUNDevice::ErrorCode> TUNDevice::WritePacket(const Buffer& buffer)
+{
+	// A write must contain the entire packet, so gather the chain
+	transmitVector.clear();
+	for (const auto b : buffer.chain()) {
+		const auto readSpan = b->ReadSpan();
+		if (readSpan.empty()) continue;
+		transmitVector.push_back(iovec{ const_cast<std::byte*>(readSpan.data()), readSpan.size() });
+	}
+
+	for (;;) {
+		const auto bytesWritten = ::writev(fd, transmitVector.data(), static_cast<int>(transmitVector.size()));
+		if (bytesWritten >= 0) break;
+		if (errno == EINTR) continue;
+		if (errno == EAGAIN) {
+			if (auto error = Wait(POLLOUT); error) return error;
+			continue;
+		}
+		return ErrorCode{errno};
+	}
+	return {};
+}
+
+std::optional<TUNDevice::ErrorCode> TUNDevice::Write(const Buffer& buffer)
+{
+	return WritePacket(buffer);
+}
+
+NetDevice::BurstResult TUNDevice::RxBurst(nonstd::span<BufferPtr> buffers)
+{
+	size_t amount = 0, bytes = 0;
+	while (amount < buffers.size()) {
+		auto result = ReadPacket();
+		if (std::holds_alternative<ErrorCode>(result)) {
+			counters.rxErrors.Add(1);
+			if (amount > 0) break;
+			return std::get<ErrorCode>(result);
+		}
+		auto& buffer = std::get<BufferPtr>(result);
+		if (!buffer) {
+			if (amount > 0) break;
+			if (auto error = Wait(POLLIN); error) return *error;
+			continue;
+		}
+		bytes += buffer->data().size();
+		buffers[amount++] = std::move(buffer);
+	}
+	counters.rxPackets.Add(amount);
+	counters.rxBytes.Add(bytes);
+	return amount;
+}
+
+NetDevice::BurstResult TUNDevice::TxBurst(nonstd::span<BufferPtr> buffers)
+{
+	size_t amount = 0, bytes = 0;
+	for (; amount < buffers.size(); ++amount) {
+		auto& buffer = buffers[amount];
+		if (auto error = WritePacket(*buffer); error) {
+			counters.txErrors.Add(1);
+			if (amount > 0) break;
+			return *error;
+		}
+		bytes += buffer->data().size();
+		buffer.reset();
+	}
+	counters.txPackets.Add(amount);
+	counters.txBytes.Add(bytes);
+	return amount;
+}
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <sys/uio.h>
+#include "bufferglue.h"
+#include "netdevice.h"
+
+namespace netstack { class Buffer; }
+
+namespace netstack::devices {
+
+// Linux TUN device: every read() yields exactly one IP packet, so no framing
+// is needed and packets are read straight into a buffer chain with readv().
+//
+// A TUNDevice is a single queue. With MultiQueue, Open() may be called for
+// the same interface name on several TUNDevice instances; the kernel then
+// spreads flows over the queues, so each worker thread can own one.
+class TUNDevice final : public NetDevice
+{
+public:
+	static constexpr inline size_t MaxPacketSize = 65536;
+
+	enum Flags {
+		None = 0,
+		MultiQueue = 1 << 0,
+	};
+
+	TUNDevice() : NetDevice(0, capability::ScatterGather) { }
+	~TUNDevice();
+	TUNDevice(const TUNDevice&) = delete;
+	TUNDevice& operator=(const TUNDevice&) = delete;
+
+	// 'device' may contain a %d, which the kernel replaces; see Name()
+	std::optional<ErrorCode> Open(std::string_view device, int flags = None);
+	void Close();
+
+	const std::string& Name() const { return name; }
+
+	// Reads a single packet; blocks until one is available
+	std::optional<ErrorCode> Read(BufferGlue::BufferReceivedCallback&& callback);
+	std::optional<ErrorCode> Write(const Buffer& buffer);
+
+	// Every packet still takes a syscall of its own; bursts only save on
+	// waiting, as the device is only polled when it has nothing to offer
+	BurstResult RxBurst(nonstd::span<BufferPtr> buffers) override;
+	BurstResult TxBurst(nonstd::span<BufferPtr> buffers) override;
+
+private:
+	// Returns nullptr if no packet is available
+	std::variant<ErrorCode, BufferPtr> ReadPacket();
+	std::optional<ErrorCode> WritePacket(const Buffer& buffer);
+	std::optional<ErrorCode> Wait(short events);
+	void Replenish(size_t amount);
+
+	int fd{-1};
+	std::string name;
+	// Buffers ready to receive the next packet, enough for the largest
+	// possible one; only those that were actually filled are replaced
+	std::vector<BufferPtr> spare;
+	std::vector<iovec> receiveVector;
+	std::vector<iovec> transmitVector;
+};
+
+}
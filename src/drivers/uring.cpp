@@ -0,0 +1,281 @@
+#include "uring.h"
+#include <cerrno>
+
+#ifdef NETSTACK_HAVE_IO_URING
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace netstack::devices::uring {
+
+#ifdef NETSTACK_HAVE_IO_URING
+
+namespace {
+
+// Linux 6.7; the number is part of the ABI and the uapi headers may well be
+// older than the kernel, so Setup() asks the kernel rather than the headers
+constexpr uint8_t OpReadMultishot = 49;
+
+// The rings are shared with the kernel; indices are published with release
+// semantics and read with acquire semantics
+unsigned LoadAcquire(const unsigned* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+void StoreRelease(unsigned* p, const unsigned value) { __atomic_store_n(p, value, __ATOMIC_RELEASE); }
+
+template<typename T> T* At(void* base, const uint32_t offset)
+{
+	return reinterpret_cast<T*>(static_cast<std::byte*>(base) + offset);
+}
+
+void* Map(const size_t length, const int fd, const off_t offset)
+{
+	const auto p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE, fd, offset);
+	return p == MAP_FAILED ? nullptr : p;
+}
+
+void Unmap(void*& p, const size_t length)
+{
+	if (p != nullptr) ::munmap(p, length);
+	p = nullptr;
+}
+
+}
+
+Ring::~Ring()
+{
+	Close();
+}
+
+void Ring::Close()
+{
+	// Closing the ring cancels whatever is still in flight
+	if (fd >= 0) ::close(fd);
+	fd = -1;
+	if (cqRing == sqRing) cqRing = nullptr;
+	Unmap(cqRing, cqRingSize);
+	Unmap(sqRing, sqRingSize);
+	Unmap(sqes, sqesSize);
+	Unmap(bufferRing, bufferRingSize);
+	Unmap(bufferMemory, bufferCount * bufferSize);
+	bufferCount = 0;
+	pending = 0;
+	multishotRead = false;
+}
+
+std::optional<ErrorCode> Ring::Setup(const unsigned entries)
+{
+	Close();
+	io_uring_params params{};
+	fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+	if (fd < 0) {
+		fd = -1;
+		return ErrorCode{errno};
+	}
+
+	sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	const bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap)
+		sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+	sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+
+	sqRing = Map(sqRingSize, fd, IORING_OFF_SQ_RING);
+	cqRing = singleMap ? sqRing : Map(cqRingSize, fd, IORING_OFF_CQ_RING);
+	sqes = Map(sqesSize, fd, IORING_OFF_SQES);
+	if (sqRing == nullptr || cqRing == nullptr || sqes == nullptr) {
+		const auto error = errno;
+		Close();
+		return error;
+	}
+
+	sqHead = At<unsigned>(sqRing, params.sq_off.head);
+	sqTail = At<unsigned>(sqRing, params.sq_off.tail);
+	sqMask = *At<unsigned>(sqRing, params.sq_off.ring_mask);
+	sqArray = At<unsigned>(sqRing, params.sq_off.array);
+	cqHead = At<unsigned>(cqRing, params.cq_off.head);
+	cqTail = At<unsigned>(cqRing, params.cq_off.tail);
+	cqMask = *At<unsigned>(cqRing, params.cq_off.ring_mask);
+	cqes = At<io_uring_cqe>(cqRing, params.cq_off.cqes);
+	multishotRead = Supports(OpReadMultishot);
+	return {};
+}
+
+bool Ring::Supports(const uint8_t opcode) const
+{
+	constexpr size_t MaxOps = 256;
+	alignas(io_uring_probe) std::array<std::byte, sizeof(io_uring_probe) + MaxOps * sizeof(io_uring_probe_op)> storage{};
+	auto probe = reinterpret_cast<io_uring_probe*>(storage.data());
+	if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, MaxOps) < 0) return false;
+	return opcode <= probe->last_op && (probe->ops[opcode].flags & IO_URING_OP_SUPPORTED) != 0;
+}
+
+std::optional<ErrorCode> Ring::SetupProvidedBuffers(const uint16_t group, const unsigned count, const size_t size)
+{
+	if (count == 0 || (count & (count - 1)) != 0 || count > 32768) return EINVAL;
+
+	bufferRingSize = count * sizeof(io_uring_buf);
+	bufferRing = Map(bufferRingSize, -1, 0);
+	bufferMemory = Map(count * size, -1, 0);
+	if (bufferRing == nullptr || bufferMemory == nullptr) {
+		const auto error = errno;
+		Unmap(bufferRing, bufferRingSize);
+		Unmap(bufferMemory, count * size);
+		return error;
+	}
+
+	io_uring_buf_reg reg{};
+	reg.ring_addr = reinterpret_cast<uintptr_t>(bufferRing);
+	reg.ring_entries = count;
+	reg.bgid = group;
+	if (::syscall(__NR_io_uring_register, fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+		const auto error = errno;
+		Unmap(bufferRing, bufferRingSize);
+		Unmap(bufferMemory, count * size);
+		return error;
+	}
+
+	bufferCount = count;
+	bufferSize = size;
+	bufferTail = 0;
+	for (unsigned id = 0; id < count; ++id)
+		RecycleProvidedBuffer(static_cast<uint16_t>(id));
+	return {};
+}
+
+nonstd::span<const std::byte> Ring::ProvidedBuffer(const uint16_t id, const size_t length) const
+{
+	return { static_cast<const std::byte*>(bufferMemory) + id * bufferSize, std::min(length, bufferSize) };
+}
+
+void Ring::RecycleProvidedBuffer(const uint16_t id)
+{
+	// io_uring_buf_ring is not usable from C++, as the flexible array
+	// declaration gains padding; the tail overlays the first entry's 'resv'
+	auto bufs = static_cast<io_uring_buf*>(bufferRing);
+	auto& buf = bufs[bufferTail & (bufferCount - 1)];
+	buf.addr = reinterpret_cast<uintptr_t>(static_cast<std::byte*>(bufferMemory) + id * bufferSize);
+	buf.len = static_cast<uint32_t>(bufferSize);
+	buf.bid = id;
+	++bufferTail;
+	__atomic_store_n(&bufs[0].resv, bufferTail, __ATOMIC_RELEASE);
+}
+
+void* Ring::NextSqe()
+{
+	// Only this side moves the tail, the kernel moves the head
+	const auto tail = *sqTail;
+	if (tail - LoadAcquire(sqHead) > sqMask) return nullptr;
+	auto sqe = static_cast<io_uring_sqe*>(sqes) + (tail & sqMask);
+	std::memset(sqe, 0, sizeof(*sqe));
+	return sqe;
+}
+
+void Ring::Advance()
+{
+	const auto tail = *sqTail;
+	sqArray[tail & sqMask] = tail & sqMask;
+	StoreRelease(sqTail, tail + 1);
+	++pending;
+}
+
+bool Ring::PrepareRead(const int target, const uint16_t group, const size_t length, const uint64_t userData)
+{
+	auto sqe = static_cast<io_uring_sqe*>(NextSqe());
+	if (sqe == nullptr) return false;
+	sqe->opcode = IORING_OP_READ;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->fd = target;
+	sqe->off = static_cast<uint64_t>(-1);
+	sqe->len = static_cast<uint32_t>(length);
+	sqe->buf_group = group;
+	sqe->user_data = userData;
+	Advance();
+	return true;
+}
+
+bool Ring::PrepareReadMultishot(const int target, const uint16_t group, const uint64_t userData)
+{
+	if (!multishotRead) return false;
+	auto sqe = static_cast<io_uring_sqe*>(NextSqe());
+	if (sqe == nullptr) return false;
+	sqe->opcode = OpReadMultishot;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->fd = target;
+	sqe->off = static_cast<uint64_t>(-1);
+	// The length is that of the buffer the kernel picks
+	sqe->buf_group = group;
+	sqe->user_data = userData;
+	Advance();
+	return true;
+}
+
+bool Ring::PrepareWrite(const int target, const nonstd::span<const std::byte> data, const uint64_t userData, const bool ordered)
+{
+	auto sqe = static_cast<io_uring_sqe*>(NextSqe());
+	if (sqe == nullptr) return false;
+	sqe->opcode = IORING_OP_WRITE;
+	if (ordered) sqe->flags = IOSQE_IO_DRAIN;
+	sqe->fd = target;
+	sqe->off = static_cast<uint64_t>(-1);
+	sqe->addr = reinterpret_cast<uintptr_t>(data.data());
+	sqe->len = static_cast<uint32_t>(data.size());
+	sqe->user_data = userData;
+	Advance();
+	return true;
+}
+
+std::variant<ErrorCode, unsigned> Ring::Submit(const unsigned waitFor)
+{
+	for(;;) {
+		const auto result = ::syscall(__NR_io_uring_enter, fd, pending, waitFor, waitFor > 0 ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+		if (result < 0) {
+			// Interrupted while waiting; whatever was queued is submitted
+			// already if the count was returned
+			if (errno == EINTR) continue;
+			return ErrorCode{errno};
+		}
+		pending -= static_cast<unsigned>(result);
+		return static_cast<unsigned>(result);
+	}
+}
+
+size_t Ring::Reap(nonstd::span<Completion> completions)
+{
+	auto head = *cqHead;
+	const auto tail = LoadAcquire(cqTail);
+	size_t amount = 0;
+	for (; head != tail && amount < completions.size(); ++head, ++amount) {
+		const auto& cqe = static_cast<const io_uring_cqe*>(cqes)[head & cqMask];
+		auto& completion = completions[amount];
+		completion.userData = cqe.user_data;
+		completion.result = cqe.res;
+		completion.bufferId.reset();
+		completion.more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+		if (cqe.flags & IORING_CQE_F_BUFFER)
+			completion.bufferId = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+	}
+	StoreRelease(cqHead, head);
+	return amount;
+}
+
+#else
+
+Ring::~Ring() = default;
+void Ring::Close() { }
+std::optional<ErrorCode> Ring::Setup(unsigned) { return ENOSYS; }
+std::optional<ErrorCode> Ring::SetupProvidedBuffers(uint16_t, unsigned, size_t) { return ENOSYS; }
+nonstd::span<const std::byte> Ring::ProvidedBuffer(uint16_t, size_t) const { return {}; }
+void Ring::RecycleProvidedBuffer(uint16_t) { }
+bool Ring::PrepareRead(int, uint16_t, size_t, uint64_t) { return false; }
+bool Ring::PrepareReadMultishot(int, uint16_t, uint64_t) { return false; }
+bool Ring::PrepareWrite(int, nonstd::span<const std::byte>, uint64_t, bool) { return false; }
+std::variant<ErrorCode, unsigned> Ring::Submit(unsigned) { return ErrorCode{ENOSYS}; }
+size_t Ring::Reap(nonstd::span<Completion>) { return 0; }
+
+#endif
+
+}
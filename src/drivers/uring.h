@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <variant>
+#include "nonstd/span.hpp"
+
+namespace netstack::devices::uring {
+
+using ErrorCode = int;
+
+// Whether io_uring support is compiled in, which the build does when the
+// kernel headers have provided buffer rings (NETSTACK_HAVE_IO_URING); the
+// kernel may still refuse it, in which case Ring::Setup() fails
+#ifdef NETSTACK_HAVE_IO_URING
+constexpr inline bool Available = true;
+#else
+constexpr inline bool Available = false;
+#endif
+
+struct Completion {
+	uint64_t userData;
+	int32_t result;
+	// Only valid if the request selected a provided buffer
+	std::optional<uint16_t> bufferId;
+	// A multishot request stays armed and completes again
+	bool more{};
+};
+
+// Minimal io_uring wrapper using the raw system calls. A Ring must only be
+// used by a single thread.
+//
+// Provided buffers are registered as a buffer ring: reads do not name a
+// buffer, the kernel picks one once data is available, so no memory is tied
+// up by reads that are merely waiting. A multishot read keeps filling them
+// in order, one completion per buffer, until it fails or runs out.
+class Ring
+{
+public:
+	Ring() = default;
+	~Ring();
+	Ring(const Ring&) = delete;
+	Ring& operator=(const Ring&) = delete;
+
+	// Fails with ENOSYS if io_uring is not compiled in or not supported
+	std::optional<ErrorCode> Setup(unsigned entries);
+	void Close();
+
+	// Whether the kernel has multishot reads (Linux 6.7); probed by Setup()
+	bool SupportsMultishotRead() const { return multishotRead; }
+
+	// Registers 'count' (a power of two) buffers of 'size' bytes as 'group'
+	std::optional<ErrorCode> SetupProvidedBuffers(uint16_t group, unsigned count, size_t size);
+	nonstd::span<const std::byte> ProvidedBuffer(uint16_t id, size_t length) const;
+	// Hands a buffer back to the kernel once its contents are consumed
+	void RecycleProvidedBuffer(uint16_t id);
+
+	// Queue a request; these fail only if the submission queue is full
+	bool PrepareRead(int fd, uint16_t group, size_t length, uint64_t userData);
+	// Reads into the group's buffers whenever data is available, each read
+	// as much as fits in a buffer
+	bool PrepareReadMultishot(int fd, uint16_t group, uint64_t userData);
+	// An ordered write starts only once all earlier requests have completed
+	bool PrepareWrite(int fd, nonstd::span<const std::byte> data, uint64_t userData, bool ordered = false);
+
+	// Submits everything queued and waits until at least 'waitFor'
+	// completions are available, in a single system call
+	std::variant<ErrorCode, unsigned> Submit(unsigned waitFor);
+
+	// Moves available completions to 'completions' and releases them all at
+	// once; does not enter the kernel
+	size_t Reap(nonstd::span<Completion> completions);
+
+private:
+	int fd{-1};
+	void* sqRing{};
+	size_t sqRingSize{};
+	void* cqRing{};
+	size_t cqRingSize{};
+	void* sqes{};
+	size_t sqesSize{};
+
+	// Pointers into the mapped rings
+	unsigned* sqHead{};
+	unsigned* sqTail{};
+	unsigned sqMask{};
+	unsigned* sqArray{};
+	unsigned* cqHead{};
+	unsigned* cqTail{};
+	unsigned cqMask{};
+	void* cqes{};
+	unsigned pending{};
+	bool multishotRead{};
+
+	void* bufferRing{};
+	size_t bufferRingSize{};
+	void* bufferMemory{};
+	size_t bufferSize{};
+	unsigned bufferCount{};
+	uint16_t bufferTail{};
+
+	// Returns the next free entry, which is submitted by Advance()
+	void* NextSqe();
+	void Advance();
+	bool Supports(uint8_t opcode) const;
+};
+
+}
@@ -0,0 +1,163 @@
+#include "wiredevice.h"
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#include "../buffer.h"
+#include "../slip.h"
+
+namespace netstack::devices {
+
+namespace {
+
+using Chunk = std::vector<std::byte>;
+
+BufferPtr Copy(const Buffer& source)
+{
+	auto copy = std::make_unique<Buffer>();
+	auto buffer = copy.get();
+	for (const auto b : source.chain()) {
+		const auto readSpan = b->ReadSpan();
+		if (buffer->WriteSpan().size() < readSpan.size())
+			buffer = &buffer->AddBuffer();
+		std::copy(readSpan.begin(), readSpan.end(), buffer->WriteSpan().begin());
+		buffer->IncrementFilled(readSpan.size());
+	}
+	return copy;
+}
+
+}
+
+// A single direction of a link
+struct WireDevice::Channel {
+	SPSCRing<BufferPtr, RingSize> packets;
+	SPSCRing<Chunk, RingSize> chunks;
+	// Chunks the receiver is done with, on their way back to the sender
+	SPSCRing<Chunk, RingSize> freeChunks;
+};
+
+std::pair<std::unique_ptr<WireDevice>, std::unique_ptr<WireDevice>> WireDevice::CreatePair(const WireConfig& config)
+{
+	auto aToB = std::make_shared<Channel>();
+	auto bToA = std::make_shared<Channel>();
+	return {
+		std::unique_ptr<WireDevice>(new WireDevice(config, bToA, aToB)),
+		std::unique_ptr<WireDevice>(new WireDevice(config, aToB, bToA))
+	};
+}
+
+std::unique_ptr<WireDevice> WireDevice::CreateLoopback(const WireConfig& config)
+{
+	auto channel = std::make_shared<Channel>();
+	return std::unique_ptr<WireDevice>(new WireDevice(config, channel, channel));
+}
+
+WireDevice::WireDevice(const WireConfig& config, std::shared_ptr<Channel> rx, std::shared_ptr<Channel> tx)
+	: NetDevice(config.mtu, capability::ScatterGather)
+	, slip(config.slip)
+	, rx(std::move(rx))
+	, tx(std::move(tx))
+	, enqueue([this](BufferPtr buffer) { received.push_back(std::move(buffer)); })
+{
+}
+
+WireDevice::~WireDevice() = default;
+
+bool WireDevice::Receive()
+{
+	if (!slip) {
+		std::array<BufferPtr, 32> burst;
+		const auto amount = rx->packets.PopBurst(burst);
+		for (auto& buffer : nonstd::span{burst.data(), amount})
+			received.push_back(std::move(buffer));
+		return amount > 0;
+	}
+
+	auto chunk = rx->chunks.Pop();
+	if (!chunk) return false;
+	// Feed the chunk through the glue in the pieces a read() would return
+	for (size_t offset = 0; offset < chunk->size(); ) {
+		const auto writeSpan = glue.GetWriteSpan();
+		const auto amount = std::min(writeSpan.size(), chunk->size() - offset);
+		std::copy_n(chunk->begin() + offset, amount, writeSpan.begin());
+		glue.HandleDataReceived(amount, [this](auto span, auto&& onByte, auto&& onComplete) {
+			return decoder.Decode(span, onByte, onComplete);
+		}, enqueue);
+		offset += amount;
+	}
+	// If the sender's free list is full, the chunk is simply released
+	rx->freeChunks.Push(std::move(*chunk));
+	return true;
+}
+
+NetDevice::BurstResult WireDevice::RxBurst(nonstd::span<BufferPtr> buffers)
+{
+	while (received.empty()) {
+		if (!Receive())
+			std::this_thread::yield();
+	}
+
+	size_t amount = 0, bytes = 0;
+	for (; amount < buffers.size() && !received.empty(); ++amount) {
+		buffers[amount] = std::move(received.front());
+		received.pop_front();
+		bytes += buffers[amount]->data().size();
+	}
+	counters.rxPackets.Add(amount);
+	counters.rxBytes.Add(bytes);
+	return amount;
+}
+
+NetDevice::BurstResult WireDevice::TxBurst(nonstd::span<BufferPtr> buffers)
+{
+	size_t amount, bytes = 0;
+	if (!slip) {
+		// The consumer only ever frees up more space, so this much will fit
+		amount = std::min(buffers.size(), RingSize - tx->packets.Size());
+		for (const auto& buffer : buffers.first(amount))
+			bytes += buffer->data().size();
+		tx->packets.PushBurst(buffers.first(amount));
+	} else {
+		auto chunk = tx->freeChunks.Pop().value_or(Chunk{});
+		chunk.clear();
+		for (const auto& buffer : buffers) {
+			slip::Transmit(*buffer, [&](const std::byte b) { chunk.push_back(b); });
+			bytes += buffer->data().size();
+		}
+		amount = tx->chunks.Push(std::move(chunk)) ? buffers.size() : 0;
+		if (amount > 0) {
+			for (auto& buffer : buffers)
+				buffer.reset();
+		}
+	}
+
+	if (amount == 0 && !buffers.empty()) {
+		counters.txErrors.Add(1);
+		return ErrorCode{ENOBUFS};
+	}
+	counters.txPackets.Add(amount);
+	counters.txBytes.Add(bytes);
+	return amount;
+}
+
+std::optional<WireDevice::ErrorCode> WireDevice::Read(BufferGlue::BufferReceivedCallback&& callback)
+{
+	std::array<BufferPtr, 32> burst;
+	const auto result = RxBurst(burst);
+	if (std::holds_alternative<ErrorCode>(result))
+		return std::get<ErrorCode>(result);
+	for (auto& buffer : nonstd::span{burst.data(), std::get<size_t>(result)})
+		callback(std::move(buffer));
+	return {};
+}
+
+std::optional<WireDevice::ErrorCode> WireDevice::Write(const Buffer& buffer)
+{
+	BufferPtr copy = Copy(buffer);
+	const auto result = TxBurst(nonstd::span{&copy, 1});
+	if (std::holds_alternative<ErrorCode>(result))
+		return std::get<ErrorCode>(result);
+	return {};
+}
+
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "bufferglue.h"
+#include "netdevice.h"
+#include "../ring.h"
+#include "../slip.h"
+
+namespace netstack::devices {
+
+struct WireConfig {
+	size_t mtu{1500};
+	// Pass packets through SLIP encoding and decoding, so that its cost is
+	// included as if the link were a serial line
+	bool slip{false};
+};
+
+// In-memory point-to-point link without any kernel involvement, for tests
+// and benchmarks. Each direction is a single-producer/single-consumer ring,
+// so an end may be served by one receive and one transmit thread.
+//
+// Without SLIP, buffers are handed over as-is; with SLIP, every transmit
+// burst is encoded into a single chunk of bytes which the receiver decodes
+// through BufferGlue, just like SLIPDevice does with what read() returns.
+// Chunks are recycled to the sender, so the steady state does not allocate.
+class WireDevice final : public NetDevice
+{
+public:
+	static constexpr inline size_t RingSize = 1024;
+
+	struct Channel;
+
+	// Creates both ends of a link
+	static std::pair<std::unique_ptr<WireDevice>, std::unique_ptr<WireDevice>> CreatePair(const WireConfig& config = {});
+	// Creates a device that receives whatever it transmits
+	static std::unique_ptr<WireDevice> CreateLoopback(const WireConfig& config = {});
+
+	~WireDevice();
+	WireDevice(const WireDevice&) = delete;
+	WireDevice& operator=(const WireDevice&) = delete;
+
+	// Same contract as SLIPDevice: Read() blocks until at least one packet
+	// was received and Write() sends a copy of the buffer
+	std::optional<ErrorCode> Read(BufferGlue::BufferReceivedCallback&& callback);
+	std::optional<ErrorCode> Write(const Buffer& buffer);
+
+	// RxBurst() spins until a packet arrives; TxBurst() fails with ENOBUFS
+	// if the ring is full
+	BurstResult RxBurst(nonstd::span<BufferPtr> buffers) override;
+	BurstResult TxBurst(nonstd::span<BufferPtr> buffers) override;
+
+private:
+	WireDevice(const WireConfig& config, std::shared_ptr<Channel> rx, std::shared_ptr<Channel> tx);
+
+	// Moves pending packets into the queue; returns false if there were none
+	bool Receive();
+
+	bool slip;
+	std::shared_ptr<Channel> rx;
+	std::shared_ptr<Channel> tx;
+	BufferGlue glue;
+	slip::Decoder decoder;
+	std::deque<BufferPtr> received;
+	BufferGlue::BufferReceivedCallback enqueue;
+};
+
+}
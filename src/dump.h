@@ -1,8 +1,16 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <cctype>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
 #include <string_view>
 #include "fmt/core.h"
+#include "nonstd/span.hpp"
+#include "buffer.h"
 
 #include "range/v3/algorithm/fill.hpp"
 
@@ -51,5 +59,132 @@ namespace netstack {
 				callback(offset - numberOfCharsForThisLine, std::string_view(hexByteBuffer.data(), numberOfCharsForThisLine * Props::charsPerByte - 1), std::string_view(textBuffer.data(), numberOfCharsForThisLine));
 			}
 		}
+
+		// The functions below produce the text that printing Dump()'s lines
+		// as "{:4x}: {:48s} {}\n" gives, but write it straight into memory:
+		// every byte is converted through tables, without branches or calls
+		// per byte or line
+		namespace detail {
+			// Both hex digits of every byte value
+			constexpr auto hexPairTable = []() {
+				std::array<std::array<char, 2>, 256> table{};
+				for (size_t n = 0; n < table.size(); ++n) {
+					table[n][0] = hexTable[n >> 4];
+					table[n][1] = hexTable[n & 15];
+				}
+				return table;
+			}();
+
+			// The byte itself if std::isprint() holds in the C locale, '.' otherwise
+			constexpr auto printableTable = []() {
+				std::array<char, 256> table{};
+				for (size_t n = 0; n < table.size(); ++n)
+					table[n] = n >= 0x20 && n < 0x7f ? static_cast<char>(n) : '.';
+				return table;
+			}();
+
+			constexpr inline size_t MinOffsetDigits = 4;
+			constexpr inline size_t MaxOffsetDigits = sizeof(size_t) * 2;
+
+			inline char* FormatOffset(size_t offset, char* out)
+			{
+				std::array<char, MaxOffsetDigits> digits;
+				size_t n = 0;
+				do {
+					digits[n++] = hexTable[offset & 15];
+					offset >>= 4;
+				} while (offset != 0);
+				for (size_t pad = n; pad < MinOffsetDigits; ++pad)
+					*out++ = ' ';
+				while (n > 0)
+					*out++ = digits[--n];
+				return out;
+			}
+		}
+
+		// The most FormatTo() writes for 'size' bytes
+		template<typename Props = DefaultProperties>
+		constexpr size_t MaxFormattedSize(const size_t size)
+		{
+			constexpr size_t lineSize = detail::MaxOffsetDigits + 2 + Props::bytesPerLine * Props::charsPerByte + 1 + Props::bytesPerLine + 1;
+			return (size + Props::bytesPerLine - 1) / Props::bytesPerLine * lineSize;
+		}
+
+		// Formats a single line of at most bytesPerLine bytes
+		template<typename Props = DefaultProperties>
+		char* FormatLine(const std::byte* data, const size_t size, const size_t offset, char* out)
+		{
+			using namespace detail;
+			out = FormatOffset(offset, out);
+			*out++ = ':';
+			*out++ = ' ';
+			for (size_t n = 0; n < size; ++n, out += 3) {
+				const auto& pair = hexPairTable[std::to_integer<uint8_t>(data[n])];
+				out[0] = pair[0];
+				out[1] = pair[1];
+				out[2] = ' ';
+			}
+			// Short lines are padded, so that the characters line up
+			const auto padding = (Props::bytesPerLine - size) * Props::charsPerByte + 1;
+			out = std::fill_n(out, padding, ' ');
+			for (size_t n = 0; n < size; ++n)
+				out[n] = printableTable[std::to_integer<uint8_t>(data[n])];
+			out += size;
+			*out++ = '\n';
+			return out;
+		}
+
+		// Formats 'span', of which the first byte is at 'offset', into 'out',
+		// which must have room for MaxFormattedSize(span.size()) characters;
+		// returns the end of the output
+		template<typename Props = DefaultProperties>
+		char* FormatTo(nonstd::span<const std::byte> span, char* out, const size_t offset = 0)
+		{
+			for (size_t n = 0; n < span.size(); n += Props::bytesPerLine)
+				out = FormatLine<Props>(span.data() + n, std::min<size_t>(Props::bytesPerLine, span.size() - n), offset + n, out);
+			return out;
+		}
+
+		template<typename Props = DefaultProperties>
+		std::string Format(nonstd::span<const std::byte> span)
+		{
+			std::string result(MaxFormattedSize<Props>(span.size()), ' ');
+			result.resize(static_cast<size_t>(FormatTo<Props>(span, result.data()) - result.data()));
+			return result;
+		}
+
+		// Formats a whole chain in a single pass over its buffers; lines
+		// continue across buffer boundaries
+		template<typename Props = DefaultProperties>
+		std::string Format(const Buffer& buffer)
+		{
+			std::string result(MaxFormattedSize<Props>(buffer.data().size()), ' ');
+			auto out = result.data();
+			std::array<std::byte, Props::bytesPerLine> line;
+			size_t filled = 0, offset = 0;
+			for (const auto b : buffer.chain()) {
+				auto span = b->ReadSpan();
+				// A line started in the previous buffer is completed first
+				if (filled > 0) {
+					const auto amount = std::min(span.size(), line.size() - filled);
+					std::copy_n(span.begin(), amount, line.begin() + filled);
+					filled += amount;
+					span = span.subspan(amount);
+					if (filled < line.size()) continue;
+					out = FormatLine<Props>(line.data(), filled, offset, out);
+					offset += filled;
+					filled = 0;
+				}
+				const auto whole = span.size() - span.size() % line.size();
+				out = FormatTo<Props>(span.first(whole), out, offset);
+				offset += whole;
+				filled = span.size() - whole;
+				std::copy(span.begin() + whole, span.end(), line.begin());
+			}
+			if (filled > 0)
+				out = FormatLine<Props>(line.data(), filled, offset, out);
+			result.resize(static_cast<size_t>(out - result.data()));
+			return result;
+		}
 	}
 }
\ No newline at end of file
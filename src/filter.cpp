@@ -0,0 +1,451 @@
+#include "filter.h"
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <optional>
+#include "buffer.h"
+#include "protocols/ip.h"
+
+namespace netstack::filter {
+
+namespace {
+
+namespace ip = protocol::ip;
+
+enum class Base { IP, Payload };
+enum class Op { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+struct Field {
+	Base base;
+	size_t offset;
+	size_t size;
+	uint32_t mask;
+};
+
+struct NamedField {
+	std::string_view name;
+	Field field;
+};
+
+constexpr std::array<NamedField, 12> namedFields{{
+	{ "ip.tos", { Base::IP, 1, 1, 0xff } },
+	{ "ip.len", { Base::IP, 2, 2, 0xffff } },
+	{ "ip.id", { Base::IP, 4, 2, 0xffff } },
+	{ "ip.frag", { Base::IP, 6, 2, 0x1fff } },
+	{ "ip.ttl", { Base::IP, ip::constants::offset::TTL, 1, 0xff } },
+	{ "ip.proto", { Base::IP, ip::constants::offset::Protocol, 1, 0xff } },
+	{ "ip.src", { Base::IP, ip::constants::offset::SourceAddr, 4, 0xffffffff } },
+	{ "ip.dst", { Base::IP, ip::constants::offset::DestAddr, 4, 0xffffffff } },
+	{ "icmp.type", { Base::Payload, 0, 1, 0xff } },
+	{ "icmp.code", { Base::Payload, 1, 1, 0xff } },
+	{ "sport", { Base::Payload, 0, 2, 0xffff } },
+	{ "dport", { Base::Payload, 2, 2, 0xffff } },
+}};
+
+constexpr uint32_t FullMask(const size_t size)
+{
+	return size == 4 ? 0xffffffff : (uint32_t{1} << (size * 8)) - 1;
+}
+
+template<size_t Size> uint32_t Load(const std::byte* p)
+{
+	uint32_t v = 0;
+	for (size_t n = 0; n < Size; ++n)
+		v = (v << 8) | std::to_integer<uint32_t>(p[n]);
+	return v;
+}
+
+// A compiled (sub)expression; constants are kept apart so that they can be
+// folded into the expressions using them
+struct Node {
+	Program program;
+	std::optional<bool> constant;
+};
+
+Node Always(const bool value)
+{
+	return { [value](nonstd::span<const std::byte>) { return value; }, value };
+}
+
+template<Base B, size_t Size, typename Compare, bool Masked>
+Program MakeComparison(const size_t offset, const uint32_t mask, const uint32_t value)
+{
+	return [offset, mask, value](const nonstd::span<const std::byte> packet) {
+		size_t start = offset;
+		if constexpr (B == Base::Payload) {
+			// Later fragments carry data from the middle of the payload
+			if (packet.size() < ip::constants::HeaderSize || (Load<2>(packet.data() + 6) & 0x1fff) != 0) return false;
+			start += (std::to_integer<size_t>(packet[0]) & 0xf) * 4;
+		}
+		if (start + Size > packet.size()) return false;
+		auto v = Load<Size>(packet.data() + start);
+		if constexpr (Masked) v &= mask;
+		return Compare{}(v, value);
+	};
+}
+
+template<Base B, size_t Size, typename Compare>
+Program SpecializeMask(const Field& field, const uint32_t value)
+{
+	if (field.mask == FullMask(Size))
+		return MakeComparison<B, Size, Compare, false>(field.offset, field.mask, value);
+	return MakeComparison<B, Size, Compare, true>(field.offset, field.mask, value);
+}
+
+template<Base B, size_t Size>
+Program SpecializeOp(const Field& field, const Op op, const uint32_t value)
+{
+	switch(op) {
+		case Op::Equal: return SpecializeMask<B, Size, std::equal_to<uint32_t>>(field, value);
+		case Op::NotEqual: return SpecializeMask<B, Size, std::not_equal_to<uint32_t>>(field, value);
+		case Op::Less: return SpecializeMask<B, Size, std::less<uint32_t>>(field, value);
+		case Op::LessEqual: return SpecializeMask<B, Size, std::less_equal<uint32_t>>(field, value);
+		case Op::Greater: return SpecializeMask<B, Size, std::greater<uint32_t>>(field, value);
+		case Op::GreaterEqual: break;
+	}
+	return SpecializeMask<B, Size, std::greater_equal<uint32_t>>(field, value);
+}
+
+template<Base B>
+Program SpecializeSize(const Field& field, const Op op, const uint32_t value)
+{
+	switch(field.size) {
+		case 1: return SpecializeOp<B, 1>(field, op, value);
+		case 2: return SpecializeOp<B, 2>(field, op, value);
+	}
+	return SpecializeOp<B, 4>(field, op, value);
+}
+
+Node Comparison(const Field& field, const Op op, const uint32_t value)
+{
+	if (field.base == Base::IP)
+		return { SpecializeSize<Base::IP>(field, op, value), {} };
+	return { SpecializeSize<Base::Payload>(field, op, value), {} };
+}
+
+Node And(Node a, Node b)
+{
+	if (a.constant) return *a.constant ? std::move(b) : std::move(a);
+	if (b.constant) return *b.constant ? std::move(a) : std::move(b);
+	return { [a = std::move(a.program), b = std::move(b.program)](const nonstd::span<const std::byte> packet) {
+		return a(packet) && b(packet);
+	}, {} };
+}
+
+Node Or(Node a, Node b)
+{
+	if (a.constant) return *a.constant ? std::move(a) : std::move(b);
+	if (b.constant) return *b.constant ? std::move(b) : std::move(a);
+	return { [a = std::move(a.program), b = std::move(b.program)](const nonstd::span<const std::byte> packet) {
+		return a(packet) || b(packet);
+	}, {} };
+}
+
+Node Not(Node a)
+{
+	if (a.constant) return Always(!*a.constant);
+	return { [a = std::move(a.program)](const nonstd::span<const std::byte> packet) { return !a(packet); }, {} };
+}
+
+struct Constant {
+	uint32_t value;
+	unsigned length;
+};
+
+struct Token {
+	enum class Kind { End, Word, Number, Address, Symbol, Invalid };
+
+	Kind kind{Kind::End};
+	std::string_view text;
+	size_t position{};
+	uint32_t value{};
+};
+
+std::optional<uint32_t> ParseNumber(const std::string_view text)
+{
+	const bool hex = text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X');
+	uint64_t value = 0;
+	for (const auto c : hex ? text.substr(2) : text) {
+		if (hex && std::isxdigit(static_cast<unsigned char>(c)))
+			value = value * 16 + static_cast<uint64_t>(std::isdigit(static_cast<unsigned char>(c)) ? c - '0' : std::tolower(c) - 'a' + 10);
+		else if (!hex && std::isdigit(static_cast<unsigned char>(c)))
+			value = value * 10 + static_cast<uint64_t>(c - '0');
+		else
+			return {};
+		if (value > 0xffffffff) return {};
+	}
+	return static_cast<uint32_t>(value);
+}
+
+std::optional<uint32_t> ParseAddress(std::string_view text)
+{
+	uint32_t addr = 0;
+	for (int n = 0; n < 4; ++n) {
+		const auto dot = text.find('.');
+		if ((dot == std::string_view::npos) != (n == 3)) return {};
+		const auto part = text.substr(0, dot);
+		if (part.empty() || part.size() > 3) return {};
+		const auto value = ParseNumber(part);
+		if (!value || *value > 255) return {};
+		addr = (addr << 8) | *value;
+		text = dot == std::string_view::npos ? std::string_view{} : text.substr(dot + 1);
+	}
+	return addr;
+}
+
+class Lexer
+{
+public:
+	explicit Lexer(const std::string_view text) : text(text) { }
+
+	Token Next()
+	{
+		while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+			++position;
+		Token token;
+		token.position = position;
+		if (position == text.size()) return token;
+
+		const auto c = static_cast<unsigned char>(text[position]);
+		if (std::isalpha(c) || c == '_') {
+			token.kind = Token::Kind::Word;
+			token.text = Take([](const unsigned char c) { return std::isalnum(c) || c == '_' || c == '.'; });
+			return token;
+		}
+		if (std::isdigit(c)) {
+			token.text = Take([](const unsigned char c) { return std::isalnum(c) || c == '.'; });
+			const auto value = token.text.find('.') != std::string_view::npos ? ParseAddress(token.text) : ParseNumber(token.text);
+			token.kind = !value ? Token::Kind::Invalid : token.text.find('.') != std::string_view::npos ? Token::Kind::Address : Token::Kind::Number;
+			token.value = value.value_or(0);
+			return token;
+		}
+		for (const std::string_view symbol : { "&&", "||", "==", "!=", "<=", ">=", "<", ">", "!", "&", "(", ")", "[", "]", ":", "/" }) {
+			if (text.substr(position, symbol.size()) == symbol) {
+				token.kind = Token::Kind::Symbol;
+				token.text = text.substr(position, symbol.size());
+				position += symbol.size();
+				return token;
+			}
+		}
+		token.kind = Token::Kind::Invalid;
+		token.text = text.substr(position, 1);
+		return token;
+	}
+
+private:
+	template<typename Fn> std::string_view Take(Fn&& accept)
+	{
+		const auto start = position;
+		while (position < text.size() && accept(static_cast<unsigned char>(text[position])))
+			++position;
+		return text.substr(start, position - start);
+	}
+
+	const std::string_view text;
+	size_t position{};
+};
+
+// Recursive descent; the first error ends parsing and is kept in 'error'
+class Parser
+{
+public:
+	explicit Parser(const std::string_view text) : lexer(text) { Advance(); }
+
+	std::variant<Error, Program> Parse()
+	{
+		auto node = ParseOr();
+		if (node && token.kind != Token::Kind::End) node = Fail("unexpected '" + std::string(token.text) + "'");
+		if (!node) return *error;
+		return std::move(node->program);
+	}
+
+private:
+	void Advance() { token = lexer.Next(); }
+
+	bool Accept(const std::string_view text)
+	{
+		if ((token.kind != Token::Kind::Word && token.kind != Token::Kind::Symbol) || token.text != text) return false;
+		Advance();
+		return true;
+	}
+
+	template<typename T = Node> std::optional<T> Fail(std::string message)
+	{
+		return Fail<T>(std::move(message), token.position);
+	}
+
+	template<typename T = Node> std::optional<T> Fail(std::string message, const size_t position)
+	{
+		if (!error) error = Error{ position, std::move(message) };
+		return {};
+	}
+
+	std::optional<Node> ParseOr()
+	{
+		auto node = ParseAnd();
+		while (node && (Accept("or") || Accept("||"))) {
+			auto rhs = ParseAnd();
+			if (!rhs) return {};
+			node = Or(std::move(*node), std::move(*rhs));
+		}
+		return node;
+	}
+
+	std::optional<Node> ParseAnd()
+	{
+		auto node = ParseUnary();
+		while (node && (Accept("and") || Accept("&&"))) {
+			auto rhs = ParseUnary();
+			if (!rhs) return {};
+			node = And(std::move(*node), std::move(*rhs));
+		}
+		return node;
+	}
+
+	std::optional<Node> ParseUnary()
+	{
+		if (Accept("not") || Accept("!")) {
+			auto node = ParseUnary();
+			if (!node) return {};
+			return Not(std::move(*node));
+		}
+		return ParsePrimary();
+	}
+
+	std::optional<Node> ParsePrimary()
+	{
+		if (Accept("(")) {
+			auto node = ParseOr();
+			if (node && !Accept(")")) return Fail("expected ')'");
+			return node;
+		}
+		if (Accept("true")) return Always(true);
+		if (Accept("false")) return Always(false);
+		for (const auto& [name, number] : { std::pair{ "icmp", ip::constants::protocol::ICMP }, std::pair{ "tcp", ip::constants::protocol::TCP }, std::pair{ "udp", ip::constants::protocol::UDP } }) {
+			if (Accept(name)) return Comparison(Find("ip.proto"), Op::Equal, number);
+		}
+		if (Accept("host")) {
+			const auto addr = ParseConstant();
+			if (!addr) return {};
+			return Or(CompareWithPrefix(Find("ip.src"), Op::Equal, *addr), CompareWithPrefix(Find("ip.dst"), Op::Equal, *addr));
+		}
+		for (const auto& [name, field] : { std::pair{ "src", "ip.src" }, std::pair{ "dst", "ip.dst" } }) {
+			if (Accept(name)) {
+				const auto addr = ParseConstant();
+				if (!addr) return {};
+				return CompareWithPrefix(Find(field), Op::Equal, *addr);
+			}
+		}
+		return ParseComparison();
+	}
+
+	std::optional<Node> ParseComparison()
+	{
+		auto field = ParseField();
+		if (!field) return {};
+		if (Accept("&")) {
+			if (token.kind != Token::Kind::Number) return Fail("expected a mask");
+			field->mask &= token.value;
+			Advance();
+		}
+
+		std::optional<Op> op;
+		constexpr std::array<std::pair<std::string_view, Op>, 6> ops{{
+			{ "==", Op::Equal }, { "!=", Op::NotEqual }, { "<", Op::Less }, { "<=", Op::LessEqual }, { ">", Op::Greater }, { ">=", Op::GreaterEqual }
+		}};
+		for (const auto& [text, value] : ops) {
+			if (Accept(text)) {
+				op = value;
+				break;
+			}
+		}
+		if (!op) return Fail("expected a comparison");
+
+		const auto position = token.position;
+		const auto constant = ParseConstant();
+		if (!constant) return {};
+		if (constant->length < 32 && *op != Op::Equal && *op != Op::NotEqual)
+			return Fail("a prefix can only be compared with == or !=", position);
+		return CompareWithPrefix(*field, *op, *constant);
+	}
+
+	std::optional<Field> ParseField()
+	{
+		if (token.kind != Token::Kind::Word) return Fail<Field>("expected a field");
+		const auto name = token.text;
+		const auto position = token.position;
+		Advance();
+		for (const auto& named : namedFields) {
+			if (named.name == name) return named.field;
+		}
+		if (name != "ip" && name != "payload") return Fail<Field>("unknown field '" + std::string(name) + "'", position);
+
+		Field field{ name == "ip" ? Base::IP : Base::Payload, 0, 1, 0 };
+		if (!Accept("[")) return Fail<Field>("expected '['");
+		if (token.kind != Token::Kind::Number) return Fail<Field>("expected an offset");
+		field.offset = token.value;
+		Advance();
+		if (Accept(":")) {
+			if (token.kind != Token::Kind::Number || (token.value != 1 && token.value != 2 && token.value != 4))
+				return Fail<Field>("expected a size of 1, 2 or 4");
+			field.size = token.value;
+			Advance();
+		}
+		if (!Accept("]")) return Fail<Field>("expected ']'");
+		field.mask = FullMask(field.size);
+		return field;
+	}
+
+	// A number, or an address with an optional prefix length, which is 32
+	// for plain numbers
+	std::optional<Constant> ParseConstant()
+	{
+		if (token.kind == Token::Kind::Number) {
+			const auto value = token.value;
+			Advance();
+			return Constant{ value, 32 };
+		}
+		if (token.kind != Token::Kind::Address) return Fail<Constant>("expected a number or address");
+		const auto addr = token.value;
+		Advance();
+		if (!Accept("/")) return Constant{ addr, 32 };
+		if (token.kind != Token::Kind::Number || token.value > 32) return Fail<Constant>("expected a prefix length");
+		const auto length = token.value;
+		Advance();
+		return Constant{ addr, length };
+	}
+
+	static Node CompareWithPrefix(Field field, const Op op, const Constant& constant)
+	{
+		if (constant.length == 0) return Always(op == Op::Equal);
+		const auto prefixMask = constant.length == 32 ? 0xffffffff : ~(0xffffffffu >> constant.length);
+		field.mask &= prefixMask;
+		return Comparison(field, op, constant.value & prefixMask);
+	}
+
+	static Field Find(const std::string_view name)
+	{
+		for (const auto& named : namedFields) {
+			if (named.name == name) return named.field;
+		}
+		return {};
+	}
+
+	Lexer lexer;
+	Token token;
+	std::optional<Error> error;
+};
+
+}
+
+std::variant<Error, Program> Compile(const std::string_view expression)
+{
+	return Parser(expression).Parse();
+}
+
+bool Matches(const Program& program, const Buffer& buffer)
+{
+	return program(buffer.ReadSpan());
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include "nonstd/span.hpp"
+
+namespace netstack {
+
+class Buffer;
+
+// Packet filters over the IPv4 header and the bytes following it. A filter
+// is compiled into a tree of closures, each specialized for the field size,
+// base and comparison it performs, so evaluating it involves no
+// interpretation.
+//
+// Expressions combine terms with 'and'/'&&', 'or'/'||', 'not'/'!' and
+// parentheses. A term is one of
+//   icmp, tcp, udp, true, false
+//   host ADDR, src ADDR[/LEN], dst ADDR[/LEN]
+//   VALUE OP CONSTANT, where OP is ==, !=, <, <=, > or >=
+// A VALUE is a field, optionally masked as 'FIELD & CONSTANT':
+//   ip.tos, ip.len, ip.id, ip.frag, ip.ttl, ip.proto, ip.src, ip.dst
+//   icmp.type, icmp.code, sport, dport (following the IP header)
+//   ip[OFFSET:SIZE], payload[OFFSET:SIZE] (SIZE is 1, 2 or 4, default 1)
+// Constants are decimal, 0x hexadecimal or dotted quads; an address with a
+// prefix length compares only the prefix (== and != only).
+//
+// Filters look at the first segment of a packet only; a term that refers to
+// bytes beyond it is false, as is one that refers to bytes following the IP
+// header of a fragment other than the first.
+namespace filter {
+
+using Program = std::function<bool(nonstd::span<const std::byte> packet)>;
+
+struct Error {
+	size_t position;
+	std::string message;
+};
+
+std::variant<Error, Program> Compile(std::string_view expression);
+
+bool Matches(const Program& program, const Buffer& buffer);
+
+}
+}
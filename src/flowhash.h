@@ -0,0 +1,157 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <optional>
+#include "buffer.h"
+#include "netorder.h"
+#include "protocols/ip.h"
+
+namespace netstack::flow {
+	namespace constants {
+		// Default RSS key from the Microsoft RSS specification
+		static constexpr inline std::array<uint8_t, 40> DefaultKey{
+			0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2, 0x41, 0x67,
+			0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0, 0xd0, 0xca, 0x2b, 0xcb,
+			0xae, 0x7b, 0x30, 0xb4, 0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30,
+			0xf2, 0x0c, 0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa
+		};
+	}
+
+	struct Key {
+		uint32_t sourceAddr{};
+		uint32_t destAddr{};
+		uint8_t protocol{};
+		std::optional<uint16_t> sourcePort;
+		std::optional<uint16_t> destPort;
+	};
+
+	inline bool HasPorts(const uint8_t protocol)
+	{
+		return protocol == protocol::ip::constants::protocol::TCP || protocol == protocol::ip::constants::protocol::UDP;
+	}
+
+	// Extracts the flow key straight from the first segment, without checksum
+	// validation; this is intended for steering before any other processing
+	inline std::optional<Key> ExtractKey(const Buffer& buffer)
+	{
+		const auto data = buffer.ReadSpan();
+		if (data.size() < protocol::ip::constants::HeaderSize) return {};
+		const auto versionHeaderLength = std::to_integer<uint8_t>(data[0]);
+		if (versionHeaderLength >> 4 != protocol::ip::constants::Version) return {};
+		const size_t headerSize = (versionHeaderLength & 0xf) * sizeof(uint32_t);
+		if (headerSize < protocol::ip::constants::HeaderSize) return {};
+
+		Key key;
+		uint16_t flagsFrag;
+		{
+			auto it = data.begin() + 6;
+			flagsFrag = net_order::Consume_u16(it);
+			++it; // ttl
+			key.protocol = net_order::Consume_u8(it);
+			it += 2; // checksum
+			key.sourceAddr = net_order::Consume_u32(it);
+			key.destAddr = net_order::Consume_u32(it);
+		}
+
+		// Only the first fragment carries the ports; keep all fragments of a
+		// datagram on the same queue by never using ports for fragments
+		const auto isFragment = (flagsFrag & (protocol::ip::constants::flag::MF | 0x1fff)) != 0;
+		if (HasPorts(key.protocol) && !isFragment && data.size() >= headerSize + 2 * sizeof(uint16_t)) {
+			auto it = data.begin() + headerSize;
+			key.sourcePort = net_order::Consume_u16(it);
+			key.destPort = net_order::Consume_u16(it);
+		}
+		return key;
+	}
+
+	// Toeplitz hash as used by RSS. The key is expanded into one lookup table
+	// per input byte position, so hashing costs one load per input byte.
+	class ToeplitzHasher
+	{
+	public:
+		static constexpr inline size_t MaxInputSize = 12; // src/dst addr + src/dst port
+
+		template<size_t N>
+		explicit ToeplitzHasher(const std::array<uint8_t, N>& key)
+		{
+			static_assert(N >= MaxInputSize + sizeof(uint32_t), "key too short");
+			for (size_t position = 0; position < MaxInputSize; ++position) {
+				for (unsigned int value = 0; value < 256; ++value) {
+					uint32_t result{};
+					for (unsigned int bit = 0; bit < 8; ++bit) {
+						if ((value & (0x80 >> bit)) == 0) continue;
+						result ^= KeyWindow(key, position * 8 + bit);
+					}
+					tables[position][value] = result;
+				}
+			}
+		}
+
+		ToeplitzHasher() : ToeplitzHasher(constants::DefaultKey) { }
+
+		uint32_t Hash(const Key& key) const
+		{
+			std::array<std::byte, MaxInputSize> input;
+			auto it = input.begin();
+			net_order::Produce_u32(it, key.sourceAddr);
+			net_order::Produce_u32(it, key.destAddr);
+			if (key.sourcePort && key.destPort) {
+				net_order::Produce_u16(it, *key.sourcePort);
+				net_order::Produce_u16(it, *key.destPort);
+			}
+
+			const auto length = static_cast<size_t>(std::distance(input.begin(), it));
+			uint32_t result{};
+			for (size_t position = 0; position < length; ++position)
+				result ^= tables[position][std::to_integer<uint8_t>(input[position])];
+			return result;
+		}
+
+	private:
+		// Returns the 32 key bits starting at the given bit offset
+		template<size_t N>
+		static uint32_t KeyWindow(const std::array<uint8_t, N>& key, const size_t bitOffset)
+		{
+			uint64_t window{};
+			const auto byteOffset = bitOffset / 8;
+			for (size_t n = 0; n < 5; ++n)
+				window = (window << 8) | (byteOffset + n < N ? key[byteOffset + n] : 0);
+			return static_cast<uint32_t>(window >> (8 - bitOffset % 8));
+		}
+
+		std::array<std::array<uint32_t, 256>, MaxInputSize> tables;
+	};
+
+	// Maps a flow hash to a queue through an RSS-style indirection table, so
+	// the spread over queues can be changed without changing the hash
+	template<size_t NumberOfEntries = 128>
+	class IndirectionTable
+	{
+		static_assert((NumberOfEntries & (NumberOfEntries - 1)) == 0, "number of entries must be a power of two");
+
+	public:
+		explicit IndirectionTable(const size_t numberOfQueues = 1)
+		{
+			Spread(numberOfQueues);
+		}
+
+		void Spread(const size_t numberOfQueues)
+		{
+			for (size_t n = 0; n < NumberOfEntries; ++n)
+				entries[n] = static_cast<uint16_t>(n % numberOfQueues);
+		}
+
+		void Set(const size_t entry, const uint16_t queue) { entries[entry] = queue; }
+
+		size_t QueueFor(const uint32_t hash) const
+		{
+			return entries[hash & (NumberOfEntries - 1)];
+		}
+
+	private:
+		std::array<uint16_t, NumberOfEntries> entries;
+	};
+}
@@ -0,0 +1,112 @@
+#include "forward.h"
+#include <algorithm>
+#include "buffer.h"
+#include "netorder.h"
+#include "stats.h"
+#include "protocols/icmp.h"
+#include "protocols/ip.h"
+#include "protocols/ip_checksum.h"
+
+namespace netstack::forward {
+
+namespace {
+
+// Decrements the TTL of the (already validated) header in the first segment
+void DecrementTTL(Buffer& buffer)
+{
+	const auto header = buffer.ModifySpan();
+
+	auto ttlIt = header.begin() + protocol::ip::constants::offset::TTL;
+	const auto oldWord = net_order::Consume_u16(ttlIt);
+	const auto newWord = static_cast<uint16_t>(oldWord - 0x100);
+
+	auto checksumIt = header.begin() + protocol::ip::constants::offset::Checksum;
+	const auto checksum = net_order::Consume_u16(checksumIt);
+
+	auto it = header.begin() + protocol::ip::constants::offset::TTL;
+	net_order::Produce_u16(it, newWord);
+	it = header.begin() + protocol::ip::constants::offset::Checksum;
+	net_order::Produce_u16(it, protocol::ip::UpdateChecksum(checksum, oldWord, newWord));
+}
+
+}
+
+Forwarder::Forwarder(const routing::Table& routes, TransmitFn transmit, ClockFn clock, const ratelimit::Config& errorRateLimit)
+	: routes(routes), transmit(std::move(transmit)), clock(std::move(clock)), errorRateLimit(errorRateLimit)
+{
+}
+
+size_t Forwarder::AddInterface(const uint32_t addr)
+{
+	interfaceAddrs.push_back(addr);
+	errorGenerators.push_back(std::make_unique<protocol::icmp::ErrorGenerator>(errorRateLimit));
+	return interfaceAddrs.size() - 1;
+}
+
+bool Forwarder::IsLocal(const uint32_t addr) const
+{
+	return std::find(interfaceAddrs.begin(), interfaceAddrs.end(), addr) != interfaceAddrs.end();
+}
+
+void Forwarder::SendError(const size_t ingress, const protocol::icmp::Error& error, const Buffer& original)
+{
+	auto message = errorGenerators[ingress]->Generate(error, interfaceAddrs[ingress], original, clock());
+	if (!message) return;
+
+	// Errors go back towards the source, which normally is via the ingress
+	// interface; prefer the routing table if it knows better
+	auto egress = ingress;
+	{
+		auto it = original.ReadSpan().begin() + protocol::ip::constants::offset::SourceAddr;
+		if (const auto nextHop = routes.Lookup(net_order::Consume_u32(it)); nextHop)
+			egress = nextHop->interface;
+	}
+	transmit(egress, std::move(message));
+}
+
+static_assert(stats::Offset(stats::Id::Forwarded, Result::TimeExceeded) == stats::Id::ForwardTimeExceeded);
+
+Result Forwarder::Forward(const size_t ingress, BufferPtr& buffer, protocol::ip::Header* header)
+{
+	const auto result = Route(ingress, buffer, header);
+	stats::Add(stats::Offset(stats::Id::Forwarded, result));
+	return result;
+}
+
+Result Forwarder::Route(const size_t ingress, BufferPtr& buffer, protocol::ip::Header* localHeader)
+{
+	const auto maybe_header = protocol::ip::ParseHeaderForForwarding(*buffer);
+	if (std::holds_alternative<protocol::ip::Result>(maybe_header)) {
+		if (const auto error = protocol::icmp::ErrorFor(std::get<protocol::ip::Result>(maybe_header), *buffer); error)
+			SendError(ingress, *error, *buffer);
+		return Result::Invalid;
+	}
+	const auto& header = std::get<protocol::ip::Header>(maybe_header);
+
+	// All fields that are rewritten must be in the first segment
+	if (buffer->ReadSpan().size() < header.headerSize) return Result::Invalid;
+
+	if (IsLocal(header.destAddr)) {
+		if (localHeader != nullptr) *localHeader = header;
+		return Result::Local;
+	}
+
+	if (header.ttl <= 1) {
+		SendError(ingress, { protocol::icmp::constants::message_type::TimeExceeded, protocol::icmp::constants::code::time_exceeded::TTL }, *buffer);
+		buffer.reset();
+		return Result::TimeExceeded;
+	}
+
+	const auto nextHop = routes.Lookup(header.destAddr);
+	if (!nextHop) {
+		SendError(ingress, { protocol::icmp::constants::message_type::DestinationUnreachable, protocol::icmp::constants::code::destination_unreachable::Net }, *buffer);
+		buffer.reset();
+		return Result::NoRoute;
+	}
+
+	DecrementTTL(*buffer);
+	transmit(nextHop->interface, std::move(buffer));
+	return Result::Forwarded;
+}
+
+}
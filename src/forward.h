@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "clock.h"
+#include "routing.h"
+#include "protocols/icmp.h"
+#include "protocols/ip.h"
+
+namespace netstack {
+
+class Buffer;
+using BufferPtr = std::unique_ptr<Buffer>;
+
+namespace forward {
+
+enum class Result {
+	Forwarded,
+	Local,
+	Invalid,
+	NoRoute,
+	TimeExceeded,
+};
+
+// IPv4 forwarding between interfaces. Packets are forwarded in place: the
+// TTL is decremented and the header checksum patched incrementally in the
+// first segment, and the original buffer chain is handed to the egress
+// interface.
+//
+// Every interface has its own rate-limited ICMP error generator; Forward()
+// may be called concurrently as long as each ingress interface is served
+// by a single thread.
+class Forwarder
+{
+public:
+	using TransmitFn = std::function<void(size_t interface, BufferPtr buffer)>;
+	using ClockFn = std::function<uint64_t()>;
+
+	Forwarder(const routing::Table& routes, TransmitFn transmit, ClockFn clock = clock::NowMilliseconds, const ratelimit::Config& errorRateLimit = {});
+
+	// Returns the index of the new interface
+	size_t AddInterface(uint32_t addr);
+
+	// Takes ownership of the buffer unless the result is Local or Invalid.
+	// For Local, the parsed header is stored in 'header' if given, so that
+	// local delivery need not parse it again.
+	Result Forward(size_t ingress, BufferPtr& buffer, protocol::ip::Header* header = nullptr);
+
+private:
+	Result Route(size_t ingress, BufferPtr& buffer, protocol::ip::Header* localHeader);
+	bool IsLocal(uint32_t addr) const;
+	void SendError(size_t ingress, const protocol::icmp::Error& error, const Buffer& original);
+
+	const routing::Table& routes;
+	TransmitFn transmit;
+	ClockFn clock;
+	ratelimit::Config errorRateLimit;
+	std::vector<uint32_t> interfaceAddrs;
+	std::vector<std::unique_ptr<protocol::icmp::ErrorGenerator>> errorGenerators;
+};
+
+}
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Per-stage latency measurement. Durations are recorded in log-linear
+// histograms in the style of HdrHistogram: every power of two is split into
+// SubBuckets linear buckets, so a bucket is never wider than 1/SubBuckets of
+// the values it holds.
+//
+// Recording is compiled in only when NETSTACK_LATENCY is defined (see the
+// CMake option of the same name); otherwise stats::StageTimer is empty and
+// the histograms take no space.
+namespace netstack::latency {
+
+#ifdef NETSTACK_LATENCY
+constexpr inline bool Enabled = true;
+#else
+constexpr inline bool Enabled = false;
+#endif
+
+// From a read returning to a reply being queued
+enum class Stage : uint32_t {
+	Read,
+	SLIPDecode,
+	Assembly,
+	IPParse,
+	Checksum,
+	Protocol,
+	Transmit,
+	Count
+};
+constexpr inline size_t NumberOfStages = static_cast<size_t>(Stage::Count);
+
+constexpr std::string_view Name(const Stage stage)
+{
+	constexpr std::array<std::string_view, NumberOfStages> names{
+		"read", "slip_decode", "assembly", "ip_parse", "checksum", "protocol", "transmit"
+	};
+	return names[static_cast<size_t>(stage)];
+}
+
+constexpr inline unsigned SubBucketBits = 3;
+constexpr inline uint64_t SubBuckets = uint64_t{1} << SubBucketBits;
+// Longer durations end up in the last bucket; 2^40 ticks is several
+// minutes at common TSC rates
+constexpr inline unsigned MaxExponent = 39;
+constexpr inline size_t NumberOfBuckets = (MaxExponent - SubBucketBits + 2) * SubBuckets;
+constexpr inline uint64_t MaxValue = (uint64_t{1} << (MaxExponent + 1)) - 1;
+
+constexpr size_t BucketFor(uint64_t ticks)
+{
+	if (ticks < SubBuckets) return static_cast<size_t>(ticks);
+	if (ticks > MaxValue) ticks = MaxValue;
+	const auto exponent = static_cast<unsigned>(63 - __builtin_clzll(ticks));
+	return (exponent - SubBucketBits + 1) * SubBuckets + ((ticks >> (exponent - SubBucketBits)) & (SubBuckets - 1));
+}
+
+// The smallest value that lands in the bucket
+constexpr uint64_t LowerBound(const size_t bucket)
+{
+	if (bucket < SubBuckets) return bucket;
+	const auto exponent = static_cast<unsigned>(bucket / SubBuckets) + SubBucketBits - 1;
+	return (SubBuckets + bucket % SubBuckets) << (exponent - SubBucketBits);
+}
+
+constexpr uint64_t UpperBound(const size_t bucket)
+{
+	return bucket + 1 < NumberOfBuckets ? LowerBound(bucket + 1) - 1 : MaxValue;
+}
+
+template<typename T> using Histogram = std::array<T, NumberOfBuckets>;
+// Nothing is stored unless recording is enabled
+template<typename T> using Histograms = std::array<Histogram<T>, Enabled ? NumberOfStages : 0>;
+
+// The time stamp counter where there is one; it is assumed to run at a
+// constant rate, as it does on all x86 CPUs of the last decade
+inline uint64_t Now()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	timespec ts;
+	::clock_gettime(CLOCK_MONOTONIC, &ts);
+	return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + static_cast<uint64_t>(ts.tv_nsec);
+#endif
+}
+
+// Measured against the steady clock on first use, which takes a few
+// milliseconds
+inline double TicksPerNanosecond()
+{
+#if defined(__x86_64__) || defined(__i386__)
+	static const double ticksPerNanosecond = []() {
+		using namespace std::chrono;
+		const auto start = steady_clock::now();
+		const auto startTicks = Now();
+		while (steady_clock::now() - start < milliseconds(10)) { }
+		const auto elapsed = duration_cast<nanoseconds>(steady_clock::now() - start).count();
+		return static_cast<double>(Now() - startTicks) / static_cast<double>(elapsed);
+	}();
+	return ticksPerNanosecond;
+#else
+	return 1.0;
+#endif
+}
+
+struct Summary {
+	uint64_t count{};
+	// In nanoseconds, as the upper bound of the bucket holding the percentile
+	double p50{};
+	double p90{};
+	double p99{};
+	double p999{};
+	double max{};
+};
+
+inline Summary Summarize(const Histogram<uint64_t>& histogram, const double ticksPerNanosecond)
+{
+	Summary summary;
+	for (const auto count : histogram)
+		summary.count += count;
+	if (summary.count == 0) return summary;
+
+	const auto toNanoseconds = [&](const size_t bucket) { return static_cast<double>(UpperBound(bucket)) / ticksPerNanosecond; };
+	const std::array<std::pair<double, double*>, 4> percentiles{{
+		{ 0.5, &summary.p50 }, { 0.9, &summary.p90 }, { 0.99, &summary.p99 }, { 0.999, &summary.p999 }
+	}};
+	size_t next = 0;
+	uint64_t seen = 0;
+	for (size_t bucket = 0; bucket < histogram.size(); ++bucket) {
+		if (histogram[bucket] == 0) continue;
+		seen += histogram[bucket];
+		for (; next < percentiles.size() && static_cast<double>(seen) >= percentiles[next].first * static_cast<double>(summary.count); ++next)
+			*percentiles[next].second = toNanoseconds(bucket);
+		summary.max = toNanoseconds(bucket);
+	}
+	return summary;
+}
+
+}
@@ -1,43 +1,808 @@
 #include "quill/Quill.h"
 #include "buffer.h"
+#include "busypoll.h"
+#include "clock.h"
 #include "dump.h"
+#include "filter.h"
+#include "flowhash.h"
+#include "drivers/pcapdevice.h"
 #include "drivers/slipdevice.h"
+#include "drivers/tundevice.h"
+#include "forward.h"
+#include "netorder.h"
+#include "pcap.h"
+#include "protocols/icmp.h"
 #include "protocols/ip.h"
+#include "protocols/udp.h"
+#include "ring.h"
+#include "routing.h"
+#include "socket.h"
+#include "stats.h"
+#include "timer.h"
+#include "trace.h"
 #include "fmt/core.h"
 
 #include "range/v3/view/transform.hpp"
 #include "range/v3/numeric/accumulate.hpp"
 #include "range/v3/algorithm/fill.hpp"
 
+#include <arpa/inet.h>
+#include <pthread.h>
+#include <signal.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	constexpr size_t ReceiveRingSize = 256;
+	constexpr size_t TransmitRingSize = 256;
+	constexpr size_t BurstSize = 32;
+	constexpr auto StatsPublishInterval = std::chrono::milliseconds(100);
+
+	using TransmitRing = netstack::MPSCRing<netstack::BufferPtr, TransmitRingSize>;
+
+	// Pushes to a ring that may be full; a capture replayed at maximum speed
+	// outruns the consumers, but unlike a live device it can wait for them
+	template<typename Ring>
+	bool Push(Ring& ring, netstack::BufferPtr&& buffer, const bool wait)
+	{
+		while (!ring.Push(std::move(buffer))) {
+			if (!wait) return false;
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+	// Every thread that processes packets owns a wheel for the protocol
+	// timers and a socket stack for the flows it handles, and drives both
+	// from its loop, so timers fire and applications run on the thread
+	// that serves their flows
+	struct Worker {
+		explicit Worker(TransmitRing& transmitRing)
+			: sockets([&transmitRing](netstack::BufferPtr buffer) { return transmitRing.Push(std::move(buffer)); }) { }
+
+		netstack::SPSCRing<netstack::BufferPtr, ReceiveRingSize> receiveRing;
+		netstack::protocol::icmp::ErrorGenerator errorGenerator;
+		netstack::timer::Wheel timers{netstack::clock::NowMilliseconds()};
+		netstack::socket::Stack sockets;
+		std::thread thread;
+		// Set once nothing more is pushed to receiveRing; the worker returns
+		// when it has emptied the ring
+		std::atomic<bool> stop{};
+	};
+
+	using DevicePtr = std::unique_ptr<netstack::devices::NetDevice>;
+
+	struct Interface {
+		DevicePtr device;
+		TransmitRing transmitRing;
+		netstack::protocol::icmp::ErrorGenerator errorGenerator; // used by the receiver only
+		netstack::timer::Wheel timers{netstack::clock::NowMilliseconds()}; // likewise
+		netstack::socket::Stack sockets{[this](netstack::BufferPtr buffer) { return transmitRing.Push(std::move(buffer)); }}; // likewise
+		std::thread receiver;
+		std::thread transmitter;
+		// Set once nothing more is pushed to transmitRing; the transmitter
+		// returns when it has emptied the ring
+		std::atomic<bool> stop{};
+
+		// The stats publisher reads the counters until they are unregistered
+		~Interface()
+		{
+			if (device) netstack::stats::UnregisterDevice(device->GetCounters());
+		}
+	};
+
+	// Handles a packet addressed to this host, whose IP header has been
+	// parsed; returns the packet to be sent back, which is either the buffer
+	// rewritten into a reply or an ICMP error. UDP datagrams are handed to
+	// the sockets, which take the buffer.
+	netstack::BufferPtr DeliverLocally(const netstack::protocol::ip::Header& ipHeader, netstack::BufferPtr& buffer, netstack::protocol::icmp::ErrorGenerator& errorGenerator, netstack::socket::Stack& sockets)
+	{
+		namespace ip = netstack::protocol::ip;
+		namespace icmp = netstack::protocol::icmp;
+		namespace udp = netstack::protocol::udp;
+
+		// The forwarder passes fragments, but they are not reassembled
+		if ((ipHeader.flags & ip::constants::flag::MF) != 0 || ipHeader.frag != 0) {
+			netstack::stats::Add(netstack::stats::Id::IPUnsupported);
+			return {};
+		}
+		if (ipHeader.protocol == ip::constants::protocol::UDP) {
+			const auto udpResult = udp::Parse(ipHeader, *buffer);
+			if (!std::holds_alternative<udp::Header>(udpResult)) return {};
+			if (sockets.Deliver(ipHeader, std::get<udp::Header>(udpResult), buffer)) return {};
+			const icmp::Error error{ icmp::constants::message_type::DestinationUnreachable, icmp::constants::code::destination_unreachable::Port };
+			return errorGenerator.Generate(error, ipHeader.destAddr, *buffer, netstack::clock::NowMilliseconds());
+		}
+		if (ipHeader.protocol != ip::constants::protocol::ICMP) {
+			const icmp::Error error{ icmp::constants::message_type::DestinationUnreachable, icmp::constants::code::destination_unreachable::Protocol };
+			return errorGenerator.Generate(error, ipHeader.destAddr, *buffer, netstack::clock::NowMilliseconds());
+		}
+
+		netstack::stats::StageTimer timer;
+		const auto icmpResult = icmp::Parse(ipHeader, *buffer);
+		if (!std::holds_alternative<icmp::Header>(icmpResult)) return {};
+		const auto reply = icmp::Process(ipHeader, std::get<icmp::Header>(icmpResult), *buffer);
+		timer.Mark(netstack::latency::Stage::Protocol);
+		if (!reply) return {};
+		return std::move(buffer);
+	}
+
+	netstack::BufferPtr DeliverLocally(netstack::BufferPtr& buffer, netstack::protocol::icmp::ErrorGenerator& errorGenerator, netstack::socket::Stack& sockets)
+	{
+		namespace ip = netstack::protocol::ip;
+
+		const auto ipResult = ip::ParseHeader(*buffer);
+		if (std::holds_alternative<ip::Result>(ipResult)) {
+			// Nothing is known about the destination, so answer on its behalf
+			const auto error = netstack::protocol::icmp::ErrorFor(std::get<ip::Result>(ipResult), *buffer);
+			if (!error) return {};
+			auto it = buffer->ReadSpan().begin() + ip::constants::offset::DestAddr;
+			return errorGenerator.Generate(*error, netstack::net_order::Consume_u32(it), *buffer, netstack::clock::NowMilliseconds());
+		}
+		return DeliverLocally(std::get<ip::Header>(ipResult), buffer, errorGenerator, sockets);
+	}
+
+	// Set by --drop and --steer. Both are evaluated on the first segment of a
+	// frame as soon as it is received; steering rules are tried in order
+	// and override the flow hash.
+	struct Filters {
+		std::optional<netstack::filter::Program> drop;
+		std::vector<std::pair<netstack::filter::Program, size_t>> steer;
+	} filters;
+
+	bool Drop(const netstack::Buffer& buffer)
+	{
+		if (!filters.drop || !netstack::filter::Matches(*filters.drop, buffer)) return false;
+		netstack::stats::Add(netstack::stats::Id::FilterDrops);
+		return true;
+	}
+
+	std::optional<netstack::filter::Program> CompileFilter(const std::string& expression)
+	{
+		auto result = netstack::filter::Compile(expression);
+		if (const auto error = std::get_if<netstack::filter::Error>(&result)) {
+			fmt::print("cannot parse filter '{}': {} at position {}\n", expression, error->message, error->position);
+			return {};
+		}
+		return std::get<netstack::filter::Program>(std::move(result));
+	}
+
+	// Set by --udp-echo
+	std::optional<uint16_t> udpEchoPort;
+
+	// Answers every datagram with its own payload (RFC 862)
+	netstack::socket::Task EchoServer(netstack::socket::Stack& sockets, const uint16_t port)
+	{
+		netstack::socket::UDPSocket socket(sockets);
+		if (auto error = socket.Bind({ 0, port }); error) {
+			fmt::print("cannot bind udp port {}: {}\n", port, strerror(*error));
+			co_return;
+		}
+		while(true) {
+			auto datagram = co_await socket.Receive();
+			std::swap(datagram.source, datagram.destination);
+			co_await socket.Send(std::move(datagram));
+		}
+	}
+
+	// Every thread that processes packets runs its own instance of the
+	// applications, which all bind the same ports, much like SO_REUSEPORT
+	// does: a flow is served by whichever thread it is steered to
+	void StartApplications(netstack::socket::Stack& sockets)
+	{
+		if (udpEchoPort) EchoServer(sockets, *udpEchoPort);
+	}
+
+	// Set by --trace and --trace-file; the writer must outlive the tracer
+	std::unique_ptr<netstack::pcap::Writer> traceWriter;
+	std::unique_ptr<netstack::trace::Tracer> tracer;
+
+	void ProcessFrames(Worker& worker, TransmitRing& transmitRing, const uint16_t queue, const bool wait)
+	{
+		StartApplications(worker.sockets);
+		std::array<netstack::BufferPtr, BurstSize> burst;
+		while(true) {
+			worker.timers.Advance(netstack::clock::NowMilliseconds());
+			worker.sockets.Run();
+			// Read before popping, so that an empty ring means it is drained
+			const auto stop = worker.stop.load(std::memory_order_acquire);
+			const auto amount = worker.receiveRing.PopBurst(burst);
+			if (amount == 0) {
+				if (stop) return;
+				std::this_thread::yield();
+				continue;
+			}
+			for (auto& buffer : nonstd::span{burst.data(), amount}) {
+				if (tracer) tracer->Trace(*buffer, queue);
+				if (auto reply = DeliverLocally(buffer, worker.errorGenerator, worker.sockets); reply && !Push(transmitRing, std::move(reply), wait))
+					netstack::stats::Add(netstack::stats::Id::TransmitRingDrops);
+				buffer.reset();
+			}
+		}
+	}
+
+	// Hands the burst to the device; whatever it does not take is dropped
+	void Transmit(netstack::devices::NetDevice& device, nonstd::span<netstack::BufferPtr> burst)
+	{
+		if (burst.empty()) return;
+		netstack::stats::StageTimer timer;
+		device.TxBurst(burst);
+		timer.Mark(netstack::latency::Stage::Transmit);
+		for (auto& buffer : burst)
+			buffer.reset();
+	}
+
+	void TransmitFrames(Interface& interface)
+	{
+		std::array<netstack::BufferPtr, BurstSize> burst;
+		while(true) {
+			const auto stop = interface.stop.load(std::memory_order_acquire);
+			const auto amount = interface.transmitRing.PopBurst(burst);
+			if (amount == 0) {
+				if (stop) return;
+				std::this_thread::yield();
+				continue;
+			}
+			Transmit(*interface.device, nonstd::span{burst.data(), amount});
+		}
+	}
+
+	// Parses 'megabytes[,normal|thp|huge][,lazy]' for --arena
+	std::optional<netstack::arena::Config> ParseArena(const std::string_view spec)
+	{
+		netstack::arena::Config config;
+		size_t start = 0;
+		for (size_t n = 0; start <= spec.size(); ++n) {
+			const auto end = std::min(spec.find(',', start), spec.size());
+			const auto item = spec.substr(start, end - start);
+			start = end + 1;
+			if (n == 0) {
+				if (item.empty() || item.find_first_not_of("0123456789") != std::string_view::npos) return {};
+				config.size = static_cast<size_t>(std::atol(std::string(item).c_str())) << 20;
+			} else if (item == "normal") {
+				config.pages = netstack::arena::Pages::Normal;
+			} else if (item == "thp") {
+				config.pages = netstack::arena::Pages::Transparent;
+			} else if (item == "huge") {
+				config.pages = netstack::arena::Pages::Huge;
+			} else if (item == "lazy") {
+				config.prefault = false;
+			} else {
+				return {};
+			}
+		}
+		return config;
+	}
+
+	// Set by --busy-poll: the CPU the first receiving thread is pinned to,
+	// the others take the CPUs after it
+	std::optional<unsigned> busyPollCPU;
+
+	void PinReceiver(quill::Logger* dl, const size_t index)
+	{
+		if (!busyPollCPU) return;
+		const auto cpu = *busyPollCPU + static_cast<unsigned>(index);
+		if (auto error = netstack::busypoll::PinThread(cpu); error)
+			LOG_WARNING(dl, "cannot pin receiver {} to cpu {}: {}", index, cpu, strerror(*error));
+	}
+
+	// Set by --capture; all devices opened by OpenDevice() are recorded
+	std::unique_ptr<netstack::pcap::Writer> captureWriter;
+
+	std::variant<netstack::devices::NetDevice::ErrorCode, DevicePtr> OpenDeviceWithoutCapture(const std::string& spec)
+	{
+		if (spec.rfind("tun:", 0) == 0) {
+			auto tun = std::make_unique<netstack::devices::TUNDevice>();
+			if (auto result = tun->Open(std::string_view{spec}.substr(4)); result) return *result;
+			return DevicePtr{std::move(tun)};
+		}
+		if (spec.rfind("pcap:", 0) == 0 || spec.rfind("pcap-ts:", 0) == 0) {
+			netstack::devices::ReplayConfig config;
+			config.honorTimestamps = spec[4] == '-';
+			auto replay = std::make_unique<netstack::devices::PcapReplayDevice>(config);
+			switch(replay->Open(spec.substr(spec.find(':') + 1))) {
+				case netstack::pcap::Result::Success: return DevicePtr{std::move(replay)};
+				case netstack::pcap::Result::InvalidFormat: return EINVAL;
+				default: return ENOENT;
+			}
+		}
+		netstack::devices::SLIPConfig config;
+		if (busyPollCPU) config.backend = netstack::devices::SLIPDevice::Backend::BusyPoll;
+		auto path = spec;
+		if (path.rfind("cslip:", 0) == 0) {
+			config.compressHeaders = true;
+			path = path.substr(6);
+		}
+		if (const auto at = path.rfind('@'); at != std::string::npos) {
+			const auto baudRate = std::string_view{path}.substr(at + 1);
+			if (baudRate.empty() || baudRate.find_first_not_of("0123456789") != std::string_view::npos) return EINVAL;
+			config.baudRate = static_cast<unsigned>(std::atoi(path.c_str() + at + 1));
+			path = path.substr(0, at);
+		}
+		auto slip = std::make_unique<netstack::devices::SLIPDevice>();
+		if (auto result = slip->Open(path, config); result) return *result;
+		return DevicePtr{std::move(slip)};
+	}
+
+	// Opens 'tun:name' as a TUN device, 'pcap:file' or 'pcap-ts:file' as a
+	// capture replayed at maximum speed or with the original timing, and
+	// anything else as a SLIP tty, optionally followed by '@baudrate'; a
+	// 'cslip:' prefix enables header compression. The device's counters are
+	// published under the spec.
+	std::variant<netstack::devices::NetDevice::ErrorCode, DevicePtr> OpenDevice(const std::string& spec)
+	{
+		auto result = OpenDeviceWithoutCapture(spec);
+		if (!std::holds_alternative<DevicePtr>(result)) return result;
+		auto& device = std::get<DevicePtr>(result);
+		if (captureWriter)
+			device = std::make_unique<netstack::devices::CaptureDevice>(std::move(device), *captureWriter);
+		netstack::stats::RegisterDevice(spec, device->GetCounters());
+		return result;
+	}
+
+	std::optional<uint32_t> ParseAddr(const std::string& s)
+	{
+		in_addr addr;
+		if (inet_pton(AF_INET, s.c_str(), &addr) != 1) return {};
+		return ntohl(addr.s_addr);
+	}
+
+	// Parses 'device=addr'
+	std::optional<std::pair<std::string, uint32_t>> ParseInterface(const std::string& arg)
+	{
+		const auto eq = arg.find('=');
+		if (eq == std::string::npos) return {};
+		const auto addr = ParseAddr(arg.substr(eq + 1));
+		if (!addr) return {};
+		return std::pair{ arg.substr(0, eq), *addr };
+	}
+
+	// Parses 'route=prefix/length,interface[,gateway]'
+	std::optional<netstack::routing::Route> ParseRoute(const std::string& arg)
+	{
+		const auto slash = arg.find('/');
+		const auto comma = arg.find(',');
+		if (arg.rfind("route=", 0) != 0 || slash == std::string::npos || comma == std::string::npos || comma < slash) return {};
+		const auto prefix = ParseAddr(arg.substr(6, slash - 6));
+		if (!prefix) return {};
+
+		netstack::routing::Route route;
+		route.prefix = *prefix;
+		route.length = static_cast<uint8_t>(std::atoi(arg.substr(slash + 1, comma - slash - 1).c_str()));
+		route.nextHop.interface = static_cast<size_t>(std::atoi(arg.substr(comma + 1).c_str()));
+		if (const auto gatewayComma = arg.find(',', comma + 1); gatewayComma != std::string::npos) {
+			const auto gateway = ParseAddr(arg.substr(gatewayComma + 1));
+			if (!gateway) return {};
+			route.nextHop.gateway = *gateway;
+		}
+		return route;
+	}
+
+	size_t QueueFor(const netstack::Buffer& buffer, const netstack::flow::ToeplitzHasher& hasher, const netstack::flow::IndirectionTable<>& indirectionTable, const size_t numberOfQueues)
+	{
+		for (const auto& [program, queue] : filters.steer) {
+			if (netstack::filter::Matches(program, buffer)) return queue % numberOfQueues;
+		}
+		const auto key = netstack::flow::ExtractKey(buffer);
+		return key ? indirectionTable.QueueFor(hasher.Hash(*key)) : 0;
+	}
+
+	int RunHost(quill::Logger* dl, const std::string& device, const size_t numberOfWorkers)
+	{
+		Interface interface;
+		{
+			auto result = OpenDevice(device);
+			if (std::holds_alternative<netstack::devices::NetDevice::ErrorCode>(result)) {
+				fmt::print("cannot open device '{}': {}\n", device, strerror(std::get<netstack::devices::NetDevice::ErrorCode>(result)));
+				return -1;
+			}
+			interface.device = std::move(std::get<DevicePtr>(result));
+		}
+		interface.transmitter = std::thread([&]() { TransmitFrames(interface); });
+		const auto wait = device.rfind("pcap:", 0) == 0;
+
+		// The main thread performs device I/O and decoding; complete frames
+		// are steered to a worker by their flow hash, so that all frames of a
+		// flow are processed in order by the same worker
+		std::vector<std::unique_ptr<Worker>> workers;
+		for (size_t n = 0; n < numberOfWorkers; ++n) {
+			auto& worker = *workers.emplace_back(std::make_unique<Worker>(interface.transmitRing));
+			worker.thread = std::thread([&worker, &interface, n, wait]() { ProcessFrames(worker, interface.transmitRing, static_cast<uint16_t>(n), wait); });
+		}
+
+		const netstack::flow::ToeplitzHasher hasher;
+		const netstack::flow::IndirectionTable<> indirectionTable(numberOfWorkers);
+		std::array<netstack::BufferPtr, BurstSize> burst;
+		PinReceiver(dl, 0);
+		while(true)
+		{
+			const auto result = interface.device->RxBurst(burst);
+			if (std::holds_alternative<netstack::devices::NetDevice::ErrorCode>(result)) {
+				LOG_ERROR(dl, "cannot read from device: {}", strerror(std::get<netstack::devices::NetDevice::ErrorCode>(result)));
+				break;
+			}
+			if (std::get<size_t>(result) == 0) {
+				LOG_INFO(dl, "end of input");
+				break;
+			}
+			for (auto& buffer : nonstd::span{burst.data(), std::get<size_t>(result)}) {
+				if (Drop(*buffer)) {
+					buffer.reset();
+					continue;
+				}
+				const auto queue = QueueFor(*buffer, hasher, indirectionTable, numberOfWorkers);
+				if (!Push(workers[queue]->receiveRing, std::move(buffer), wait)) {
+					netstack::stats::Add(netstack::stats::Id::ReceiveRingDrops);
+					LOG_WARNING(dl, "receive ring full, dropping frame");
+				}
+				buffer.reset();
+			}
+		}
+		// Workers push replies until they are done, so the transmitter is
+		// stopped last
+		for (auto& worker : workers) {
+			worker->stop.store(true, std::memory_order_release);
+			worker->thread.join();
+		}
+		interface.stop.store(true, std::memory_order_release);
+		interface.transmitter.join();
+		return 0;
+	}
+
+	// With a multi-queue TUN device the kernel spreads flows over the queues,
+	// so every worker owns a queue and performs its own I/O
+	int RunTUNHost(quill::Logger* dl, const std::string& device, const size_t numberOfWorkers)
+	{
+		struct TUNWorker {
+			netstack::devices::TUNDevice device;
+			netstack::protocol::icmp::ErrorGenerator errorGenerator;
+			netstack::timer::Wheel timers{netstack::clock::NowMilliseconds()};
+			netstack::socket::Stack sockets{[this](netstack::BufferPtr buffer) { return SendNow(std::move(buffer)); }};
+			std::thread thread;
+
+			// Sockets send right away rather than with the replies of a burst
+			bool SendNow(netstack::BufferPtr buffer)
+			{
+				const auto result = device.TxBurst(nonstd::span{&buffer, 1});
+				return std::holds_alternative<size_t>(result) && std::get<size_t>(result) == 1;
+			}
+
+			~TUNWorker() { netstack::stats::UnregisterDevice(device.GetCounters()); }
+		};
+
+		std::vector<std::unique_ptr<TUNWorker>> workers;
+		for (size_t n = 0; n < numberOfWorkers; ++n) {
+			auto& worker = *workers.emplace_back(std::make_unique<TUNWorker>());
+			// The first queue creates the interface, the others attach to it
+			const auto& name = n == 0 ? device : workers.front()->device.Name();
+			if (auto result = worker.device.Open(name, netstack::devices::TUNDevice::MultiQueue); result) {
+				fmt::print("cannot open tun device '{}': {}\n", name, strerror(*result));
+				return -1;
+			}
+			netstack::stats::RegisterDevice(fmt::format("tun:{}/{}", worker.device.Name(), n), worker.device.GetCounters());
+		}
+		LOG_INFO(dl, "using tun device {} with {} queue(s)", workers.front()->device.Name(), numberOfWorkers);
+
+		for (size_t n = 0; n < workers.size(); ++n) {
+			workers[n]->thread = std::thread([dl, &worker = *workers[n], queue = static_cast<uint16_t>(n)]() {
+				PinReceiver(dl, queue);
+				StartApplications(worker.sockets);
+				std::array<netstack::BufferPtr, BurstSize> burst;
+				std::array<netstack::BufferPtr, BurstSize> replies;
+				while(true) {
+					const auto result = worker.device.RxBurst(burst);
+					if (std::holds_alternative<netstack::devices::NetDevice::ErrorCode>(result)) {
+						LOG_ERROR(dl, "cannot read from tun device: {}", strerror(std::get<netstack::devices::NetDevice::ErrorCode>(result)));
+						break;
+					}
+					size_t numberOfReplies = 0;
+					for (auto& buffer : nonstd::span{burst.data(), std::get<size_t>(result)}) {
+						if (Drop(*buffer)) {
+							buffer.reset();
+							continue;
+						}
+						if (tracer) tracer->Trace(*buffer, queue);
+						if (auto reply = DeliverLocally(buffer, worker.errorGenerator, worker.sockets); reply)
+							replies[numberOfReplies++] = std::move(reply);
+						buffer.reset();
+					}
+					Transmit(worker.device, nonstd::span{replies.data(), numberOfReplies});
+					// The read blocks, so timers are only as punctual as the
+					// traffic; the same goes for the forwarder
+					worker.timers.Advance(netstack::clock::NowMilliseconds());
+					worker.sockets.Run();
+				}
+			});
+		}
+		for (auto& worker : workers)
+			worker->thread.join();
+		return 0;
+	}
+
+	void PrintLatency(const netstack::stats::Snapshot& snapshot)
+	{
+		for (size_t n = 0; n < snapshot.latency.size(); ++n) {
+			const auto stage = static_cast<netstack::latency::Stage>(n);
+			const auto summary = netstack::latency::Summarize(snapshot.latency[n], snapshot.ticksPerNanosecond);
+			if (summary.count == 0) continue;
+			fmt::print("latency.{:24s} {} samples, p50 {:.0f} p90 {:.0f} p99 {:.0f} p99.9 {:.0f} max {:.0f} ns\n",
+				netstack::latency::Name(stage), summary.count, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+		}
+	}
+
+	// Prints the latency histograms whenever SIGUSR1 arrives. The signal is
+	// blocked before any other thread is started, so they all inherit the
+	// mask and only this thread receives it.
+	void StartLatencyDumper()
+	{
+		sigset_t signals;
+		sigemptyset(&signals);
+		sigaddset(&signals, SIGUSR1);
+		pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+		std::thread([signals]() {
+			for(;;) {
+				int signal;
+				if (sigwait(&signals, &signal) != 0) continue;
+				PrintLatency(netstack::stats::Aggregate());
+				std::fflush(stdout);
+			}
+		}).detach();
+	}
+
+	// Traced packets are either logged as hex dumps or written to a capture
+	// file; both happen on the tracer's own thread
+	bool StartTracing(quill::Logger* dl, const netstack::trace::Config& config, const std::string& path)
+	{
+		if (!path.empty()) {
+			traceWriter = std::make_unique<netstack::pcap::Writer>();
+			if (traceWriter->Open(path) != netstack::pcap::Result::Success) {
+				fmt::print("cannot create trace file '{}'\n", path);
+				return false;
+			}
+			tracer = std::make_unique<netstack::trace::Tracer>(config, [](const netstack::trace::Record& record) {
+				traceWriter->Write(record.Data(), record.length, record.timestamp);
+			});
+			return true;
+		}
+		tracer = std::make_unique<netstack::trace::Tracer>(config, [dl](const netstack::trace::Record& record) {
+			auto dump = netstack::dump_buffer::Format(record.Data());
+			if (!dump.empty()) dump.pop_back(); // the logger ends the message itself
+			LOG_INFO(dl, "packet of {} bytes from queue {}\n{}", record.length, record.source, dump);
+		});
+		return true;
+	}
+
+	// Prints the counters of a running (or finished) instance started with
+	// '--stats file'
+	int ShowStats(const std::string& path)
+	{
+		const auto result = netstack::stats::Read(path);
+		if (std::holds_alternative<netstack::stats::ErrorCode>(result)) {
+			fmt::print("cannot read stats file '{}': {}\n", path, strerror(std::get<netstack::stats::ErrorCode>(result)));
+			return -1;
+		}
+		const auto& snapshot = std::get<netstack::stats::Snapshot>(result);
+		for (size_t n = 0; n < netstack::stats::NumberOfCounters; ++n) {
+			const auto id = static_cast<netstack::stats::Id>(n);
+			fmt::print("{:32s} {}\n", netstack::stats::Name(id), snapshot[id]);
+		}
+		for (const auto& device : snapshot.devices) {
+			for (size_t n = 0; n < device.values.size(); ++n)
+				fmt::print("{:32s} {}\n", fmt::format("{}.{}", device.name, netstack::stats::DeviceCounterName(n)), device.values[n]);
+		}
+		PrintLatency(snapshot);
+		return 0;
+	}
+
+	int RunForwarder(quill::Logger* dl, const std::vector<std::string>& args)
+	{
+		netstack::routing::Table routes;
+		std::vector<std::unique_ptr<Interface>> interfaces;
+
+		// The forwarder is not modified after setup; it is shared by all
+		// receive threads and the transmit rings take care of the hand-off
+		netstack::forward::Forwarder forwarder(routes, [&](size_t interface, netstack::BufferPtr buffer) {
+			if (interface >= interfaces.size() || !interfaces[interface]->transmitRing.Push(std::move(buffer))) {
+				netstack::stats::Add(netstack::stats::Id::TransmitRingDrops);
+				LOG_WARNING(dl, "cannot queue frame for interface {}, dropping", interface);
+			}
+		});
+
+		for (const auto& arg : args) {
+			if (auto route = ParseRoute(arg); route) {
+				routes.Add(*route);
+				continue;
+			}
+			const auto interface = ParseInterface(arg);
+			if (!interface) {
+				fmt::print("cannot parse '{}'\n", arg);
+				return -1;
+			}
+			auto result = OpenDevice(interface->first);
+			if (std::holds_alternative<netstack::devices::NetDevice::ErrorCode>(result)) {
+				fmt::print("cannot open device '{}': {}\n", interface->first, strerror(std::get<netstack::devices::NetDevice::ErrorCode>(result)));
+				return -1;
+			}
+			interfaces.emplace_back(std::make_unique<Interface>())->device = std::move(std::get<DevicePtr>(result));
+			forwarder.AddInterface(interface->second);
+		}
+
+		for (size_t index = 0; index < interfaces.size(); ++index) {
+			auto& interface = *interfaces[index];
+			interface.transmitter = std::thread([&interface]() { TransmitFrames(interface); });
+			interface.receiver = std::thread([&, index]() {
+				PinReceiver(dl, index);
+				StartApplications(interface.sockets);
+				std::array<netstack::BufferPtr, BurstSize> burst;
+				while(true) {
+					const auto result = interface.device->RxBurst(burst);
+					if (std::holds_alternative<netstack::devices::NetDevice::ErrorCode>(result)) {
+						LOG_ERROR(dl, "cannot read from interface {}: {}", index, strerror(std::get<netstack::devices::NetDevice::ErrorCode>(result)));
+						break;
+					}
+					for (auto& buffer : nonstd::span{burst.data(), std::get<size_t>(result)}) {
+						if (Drop(*buffer)) {
+							buffer.reset();
+							continue;
+						}
+						if (tracer) tracer->Trace(*buffer, static_cast<uint16_t>(index));
+						netstack::protocol::ip::Header ipHeader;
+						if (forwarder.Forward(index, buffer, &ipHeader) == netstack::forward::Result::Local) {
+							if (auto reply = DeliverLocally(ipHeader, buffer, interface.errorGenerator, interface.sockets); reply && !interface.transmitRing.Push(std::move(reply)))
+								netstack::stats::Add(netstack::stats::Id::TransmitRingDrops);
+						}
+						buffer.reset();
+					}
+					interface.timers.Advance(netstack::clock::NowMilliseconds());
+					interface.sockets.Run();
+				}
+			});
+		}
+
+		// Any receiver may forward to any interface
+		for (auto& interface : interfaces)
+			interface->receiver.join();
+		for (auto& interface : interfaces) {
+			interface->stop.store(true, std::memory_order_release);
+			interface->transmitter.join();
+		}
+		return 0;
+	}
+}
+
 int main(int argc, char* argv[])
 {
+	if constexpr (netstack::latency::Enabled)
+		StartLatencyDumper();
 	quill::start();
 	auto dl = quill::get_logger();
 	LOG_INFO(dl, "startup");
 
-	if (argc != 2) {
-		fmt::print("usage: {} device\n", argv[0]);
-		return -1;
-	}
-	const auto device = argv[1];
+	if (argc == 3 && std::string(argv[1]) == "--show-stats")
+		return ShowStats(argv[2]);
 
-	netstack::devices::SLIPDevice slip;
-	if (auto result = slip.Open(device); result) {
-		fmt::print("cannot open slip device '{}': {}\n", device, strerror(*result));
+	bool exportStats = false;
+	bool trace = false;
+	netstack::trace::Config traceConfig;
+	std::string traceFile;
+	const auto isOption = [](const std::string& arg) {
+		return arg == "--capture" || arg == "--stats" || arg == "--trace" || arg == "--trace-file" || arg == "--trace-filter" || arg == "--drop" || arg == "--steer" || arg == "--udp-echo" || arg == "--busy-poll" || arg == "--arena";
+	};
+	while (argc >= 3 && isOption(argv[1])) {
+		const std::string option = argv[1];
+		if (option == "--capture") {
+			captureWriter = std::make_unique<netstack::pcap::Writer>();
+			if (captureWriter->Open(argv[2]) != netstack::pcap::Result::Success) {
+				fmt::print("cannot create capture file '{}'\n", argv[2]);
+				return -1;
+			}
+		} else if (option == "--stats") {
+			if (auto result = netstack::stats::Export(argv[2]); result) {
+				fmt::print("cannot create stats file '{}': {}\n", argv[2], strerror(*result));
+				return -1;
+			}
+			exportStats = true;
+		} else if (option == "--trace") {
+			traceConfig.sampleRate = static_cast<uint32_t>(std::max(1, std::atoi(argv[2])));
+			trace = true;
+		} else if (option == "--trace-file") {
+			traceFile = argv[2];
+			trace = true;
+		} else if (option == "--udp-echo") {
+			const auto port = std::atoi(argv[2]);
+			if (port <= 0 || port > 65535) {
+				fmt::print("cannot parse udp port '{}'\n", argv[2]);
+				return -1;
+			}
+			udpEchoPort = static_cast<uint16_t>(port);
+		} else if (option == "--busy-poll") {
+			const auto cpu = std::atoi(argv[2]);
+			if (cpu < 0 || std::string_view{argv[2]}.find_first_not_of("0123456789") != std::string_view::npos) {
+				fmt::print("cannot parse cpu '{}'\n", argv[2]);
+				return -1;
+			}
+			busyPollCPU = static_cast<unsigned>(cpu);
+		} else if (option == "--arena") {
+			const auto config = ParseArena(argv[2]);
+			if (!config) {
+				fmt::print("cannot parse arena '{}'\n", argv[2]);
+				return -1;
+			}
+			if (auto result = netstack::Buffer::ReserveArena(*config); result) {
+				fmt::print("cannot reserve buffer arena: {}\n", strerror(*result));
+				return -1;
+			}
+			LOG_INFO(dl, "buffer arena of {} segments", netstack::Buffer::GetArenaUsage().slots);
+		} else {
+			// --steer takes 'queue=filter', the others just the filter
+			std::string expression = argv[2];
+			size_t queue = 0;
+			if (option == "--steer") {
+				const auto eq = expression.find('=');
+				if (eq == std::string::npos || eq == 0 || expression.find_first_not_of("0123456789") != eq) {
+					fmt::print("cannot parse steering rule '{}'\n", expression);
+					return -1;
+				}
+				queue = static_cast<size_t>(std::atoi(expression.c_str()));
+				expression = expression.substr(eq + 1);
+			}
+			auto program = CompileFilter(expression);
+			if (!program) return -1;
+			if (option == "--drop") {
+				filters.drop = std::move(*program);
+			} else if (option == "--steer") {
+				filters.steer.emplace_back(std::move(*program), queue);
+			} else {
+				traceConfig.filter = [program = std::move(*program)](const netstack::Buffer& buffer) { return netstack::filter::Matches(program, buffer); };
+				trace = true;
+			}
+		}
+		argv[2] = argv[0];
+		argc -= 2;
+		argv += 2;
+	}
+	if (trace && !StartTracing(dl, traceConfig, traceFile))
 		return -1;
+	// Device counters are kept by the devices themselves and copied to the
+	// stats file periodically
+	if (exportStats) {
+		std::thread([]() {
+			while(true) {
+				netstack::stats::Publish();
+				std::this_thread::sleep_for(StatsPublishInterval);
+			}
+		}).detach();
 	}
 
-	while(true)
-	{
-		printf("read start\n");
-		auto result = slip.Read([](std::unique_ptr<netstack::Buffer> buffer)
-		{
-			netstack::dump_buffer::Dump(buffer->data(), [](const size_t offset, auto bytes, auto chars) {
-				fmt::print("{:4x}: {:48s} {}\n", offset, bytes, chars);
-			});
-			auto result = netstack::protocol::ip::ParseHeader(*buffer);
-		});
-		printf("read done\n");
+	if (argc >= 3 && std::string(argv[1]) == "--forward")
+		return RunForwarder(dl, std::vector<std::string>(argv + 2, argv + argc));
+
+	if (argc != 2 && argc != 3) {
+		fmt::print("usage: {} [options] device [workers]\n", argv[0]);
+		fmt::print("       {} [options] --forward device=addr... [route=prefix/length,interface[,gateway]...]\n", argv[0]);
+		fmt::print("       {} --show-stats file\n", argv[0]);
+		fmt::print("device is a SLIP [cslip:]tty[@baudrate], tun:name, pcap:file or pcap-ts:file\n");
+		fmt::print("options are --capture file, --stats file, --trace rate (log the start of\n");
+		fmt::print("every rate'th packet), --trace-file file (write them to a capture file),\n");
+		fmt::print("--trace-filter filter (trace only matching packets), --drop filter,\n");
+		fmt::print("--steer queue=filter (hand matching packets to the worker queue),\n");
+		fmt::print("--udp-echo port (run a UDP echo server on the port), --busy-poll cpu\n");
+		fmt::print("(poll SLIP devices without blocking; receiving threads are pinned to\n");
+		fmt::print("cpu and the CPUs after it) and --arena megabytes[,normal|thp|huge][,lazy]\n");
+		fmt::print("(take buffers from a region mapped at startup, with normal, transparent\n");
+		fmt::print("huge or reserved huge pages, faulted in right away unless lazy)\n");
+		return -1;
 	}
-	return 0;
+	const auto device = argv[1];
+	const size_t numberOfWorkers = argc == 3 ? std::max(1, std::atoi(argv[2])) : 1;
+	// Multiple workers on a TUN device each get a queue of their own, which
+	// bypasses OpenDevice() and thus capturing
+	if (const std::string_view tun{device}; tun.rfind("tun:", 0) == 0 && numberOfWorkers > 1 && !captureWriter)
+		return RunTUNHost(dl, std::string(tun.substr(4)), numberOfWorkers);
+	return RunHost(dl, device, numberOfWorkers);
 }
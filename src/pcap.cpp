@@ -0,0 +1,430 @@
+#include "pcap.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <algorithm>
+#include <cstring>
+
+#include "buffer.h"
+
+namespace netstack::pcap {
+
+namespace {
+
+constexpr uint32_t PcapMagicMicroseconds = 0xa1b2c3d4;
+constexpr uint32_t PcapMagicNanoseconds = 0xa1b23c4d;
+constexpr size_t PcapHeaderSize = 24;
+constexpr size_t PcapRecordHeaderSize = 16;
+
+namespace block {
+	constexpr uint32_t SectionHeader = 0x0a0d0d0a;
+	constexpr uint32_t InterfaceDescription = 1;
+	constexpr uint32_t SimplePacket = 3;
+	constexpr uint32_t EnhancedPacket = 6;
+	constexpr uint32_t ByteOrderMagic = 0x1a2b3c4d;
+	constexpr uint16_t OptionEnd = 0;
+	constexpr uint16_t OptionTimestampResolution = 9;
+}
+
+constexpr uint16_t EtherTypeIPv4 = 0x0800;
+constexpr uint16_t EtherTypeVLAN = 0x8100;
+constexpr uint32_t FamilyInet = 2;
+
+uint16_t Load16BE(const std::byte* p) { return static_cast<uint16_t>((std::to_integer<uint16_t>(p[0]) << 8) | std::to_integer<uint16_t>(p[1])); }
+
+uint32_t Load32(const std::byte* p)
+{
+	uint32_t v;
+	std::memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+uint64_t ToNanoseconds(const uint64_t units, const uint64_t unitsPerSecond)
+{
+	constexpr uint64_t NanosecondsPerSecond = 1'000'000'000;
+	if (NanosecondsPerSecond % unitsPerSecond == 0)
+		return units * (NanosecondsPerSecond / unitsPerSecond);
+	return (units / unitsPerSecond) * NanosecondsPerSecond + (units % unitsPerSecond) * NanosecondsPerSecond / unitsPerSecond;
+}
+
+// Strips the link layer header; returns an empty span for anything but IPv4
+nonstd::span<const std::byte> ExtractIPv4(const uint32_t linkType, nonstd::span<const std::byte> frame)
+{
+	const auto Skip = [&](const size_t amount) -> nonstd::span<const std::byte> {
+		if (frame.size() < amount) return {};
+		return frame.subspan(amount);
+	};
+
+	nonstd::span<const std::byte> packet;
+	switch(linkType) {
+		case constants::link_type::Raw:
+		case constants::link_type::IPv4:
+			packet = frame;
+			break;
+		case constants::link_type::Null: {
+			// The address family is in the byte order of the capturing host
+			if (frame.size() < 4) return {};
+			const auto family = Load32(frame.data());
+			if (family != FamilyInet && __builtin_bswap32(family) != FamilyInet) return {};
+			packet = Skip(4);
+			break;
+		}
+		case constants::link_type::Ethernet: {
+			if (frame.size() < 14) return {};
+			auto etherType = Load16BE(frame.data() + 12);
+			size_t headerSize = 14;
+			if (etherType == EtherTypeVLAN) {
+				if (frame.size() < 18) return {};
+				etherType = Load16BE(frame.data() + 16);
+				headerSize = 18;
+			}
+			if (etherType != EtherTypeIPv4) return {};
+			packet = Skip(headerSize);
+			break;
+		}
+		case constants::link_type::LinuxSLL:
+			if (frame.size() < 16 || Load16BE(frame.data() + 14) != EtherTypeIPv4) return {};
+			packet = Skip(16);
+			break;
+		case constants::link_type::LinuxSLL2:
+			if (frame.size() < 20 || Load16BE(frame.data()) != EtherTypeIPv4) return {};
+			packet = Skip(20);
+			break;
+		default:
+			return {};
+	}
+	if (packet.empty() || (std::to_integer<uint8_t>(packet[0]) >> 4) != 4) return {};
+	return packet;
+}
+
+bool WriteAll(const int fd, const std::byte* data, size_t length)
+{
+	while (length > 0) {
+		const auto bytesWritten = ::write(fd, data, length);
+		if (bytesWritten < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+		data += bytesWritten;
+		length -= static_cast<size_t>(bytesWritten);
+	}
+	return true;
+}
+
+template<typename T> void AppendValue(std::vector<std::byte>& v, const T value)
+{
+	const auto offset = v.size();
+	v.resize(offset + sizeof(T));
+	std::memcpy(v.data() + offset, &value, sizeof(T));
+}
+
+}
+
+Reader::~Reader()
+{
+	Close();
+}
+
+void Reader::Close()
+{
+	if (base != nullptr) ::munmap(const_cast<std::byte*>(base), size);
+	base = nullptr;
+	size = 0;
+	interfaces.clear();
+}
+
+uint16_t Reader::Read16(const size_t at) const
+{
+	uint16_t v;
+	std::memcpy(&v, base + at, sizeof(v));
+	return swapped ? __builtin_bswap16(v) : v;
+}
+
+uint32_t Reader::Read32(const size_t at) const
+{
+	const auto v = Load32(base + at);
+	return swapped ? __builtin_bswap32(v) : v;
+}
+
+Result Reader::Open(const std::string& path)
+{
+	Close();
+	const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return Result::CannotOpen;
+
+	struct stat st;
+	if (::fstat(fd, &st) < 0) {
+		::close(fd);
+		return Result::CannotOpen;
+	}
+	if (st.st_size < static_cast<off_t>(PcapHeaderSize)) {
+		::close(fd);
+		return Result::InvalidFormat;
+	}
+	size = static_cast<size_t>(st.st_size);
+	// Packets are read front to back, exactly once per pass
+	const auto mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if (mapping == MAP_FAILED) {
+		size = 0;
+		return Result::CannotOpen;
+	}
+	base = static_cast<const std::byte*>(mapping);
+	::madvise(mapping, size, MADV_SEQUENTIAL);
+
+	const auto magic = Load32(base);
+	if (magic == block::SectionHeader) {
+		pcapng = true;
+		if (!ParseSectionHeader(0)) {
+			Close();
+			return Result::InvalidFormat;
+		}
+		firstRecord = 0;
+	} else {
+		pcapng = false;
+		uint64_t unitsPerSecond;
+		if (magic == PcapMagicMicroseconds || magic == __builtin_bswap32(PcapMagicMicroseconds))
+			unitsPerSecond = 1'000'000;
+		else if (magic == PcapMagicNanoseconds || magic == __builtin_bswap32(PcapMagicNanoseconds))
+			unitsPerSecond = 1'000'000'000;
+		else {
+			Close();
+			return Result::InvalidFormat;
+		}
+		swapped = magic != PcapMagicMicroseconds && magic != PcapMagicNanoseconds;
+		interfaces.push_back({ Read32(20), unitsPerSecond });
+		firstRecord = PcapHeaderSize;
+	}
+	offset = firstRecord;
+	return Result::Success;
+}
+
+void Reader::Rewind()
+{
+	offset = firstRecord;
+	if (pcapng) interfaces.clear();
+}
+
+bool Reader::ParseSectionHeader(const size_t at)
+{
+	if (at + 12 > size) return false;
+	const auto magic = Load32(base + at + 8);
+	if (magic == block::ByteOrderMagic)
+		swapped = false;
+	else if (magic == __builtin_bswap32(block::ByteOrderMagic))
+		swapped = true;
+	else
+		return false;
+	// Interface numbering starts over in every section
+	interfaces.clear();
+	return true;
+}
+
+std::optional<Packet> Reader::Next()
+{
+	return pcapng ? NextPcapNG() : NextPcap();
+}
+
+std::optional<Packet> Reader::NextPcap()
+{
+	const auto& interface = interfaces.front();
+	while (offset + PcapRecordHeaderSize <= size) {
+		const auto seconds = Read32(offset);
+		const auto fraction = Read32(offset + 4);
+		const auto capturedLength = Read32(offset + 8);
+		const auto data = offset + PcapRecordHeaderSize;
+		if (data + capturedLength > size) break; // truncated capture
+		offset = data + capturedLength;
+
+		const auto packet = ExtractIPv4(interface.linkType, { base + data, capturedLength });
+		if (packet.empty()) continue;
+		return Packet{ seconds * 1'000'000'000ull + ToNanoseconds(fraction, interface.unitsPerSecond), packet };
+	}
+	offset = size;
+	return {};
+}
+
+std::optional<Packet> Reader::NextPcapNG()
+{
+	while (offset + 12 <= size) {
+		const auto blockOffset = offset;
+		// The section header has a palindromic type, so it can be recognized
+		// before the byte order is known
+		if (Load32(base + blockOffset) == block::SectionHeader && !ParseSectionHeader(blockOffset))
+			break;
+		const auto type = Read32(blockOffset);
+		const auto length = Read32(blockOffset + 4);
+		if (length < 12 || (length % 4) != 0 || blockOffset + length > size) break;
+		offset = blockOffset + length;
+
+		switch(type) {
+			case block::InterfaceDescription: {
+				if (length < 20) break;
+				Interface interface{ Read16(blockOffset + 8), 1'000'000 };
+				for (size_t option = blockOffset + 16; option + 4 <= blockOffset + length - 4; ) {
+					const auto code = Read16(option);
+					const auto optionLength = Read16(option + 2);
+					if (code == block::OptionEnd) break;
+					if (code == block::OptionTimestampResolution && optionLength >= 1) {
+						const auto resolution = std::to_integer<uint8_t>(base[option + 4]);
+						const auto exponent = resolution & 0x7f;
+						if (exponent >= 64) break;
+						uint64_t unitsPerSecond = 1;
+						for (int n = 0; n < exponent; ++n)
+							unitsPerSecond *= (resolution & 0x80) ? 2 : 10;
+						interface.unitsPerSecond = unitsPerSecond;
+					}
+					option += 4 + ((optionLength + 3) & ~3u);
+				}
+				interfaces.push_back(interface);
+				break;
+			}
+			case block::EnhancedPacket: {
+				if (length < 32) break;
+				const auto interfaceId = Read32(blockOffset + 8);
+				const auto timestamp = (static_cast<uint64_t>(Read32(blockOffset + 12)) << 32) | Read32(blockOffset + 16);
+				const auto capturedLength = Read32(blockOffset + 20);
+				// Written so that it cannot wrap; length is at least 32
+				if (interfaceId >= interfaces.size() || capturedLength > length - 32) break;
+
+				const auto& interface = interfaces[interfaceId];
+				const auto packet = ExtractIPv4(interface.linkType, { base + blockOffset + 28, capturedLength });
+				if (packet.empty()) break;
+				return Packet{ ToNanoseconds(timestamp, interface.unitsPerSecond), packet };
+			}
+			case block::SimplePacket: {
+				// No timestamp and always from the first interface
+				if (length < 16 || interfaces.empty()) break;
+				const auto capturedLength = std::min<size_t>(Read32(blockOffset + 8), length - 16);
+				const auto packet = ExtractIPv4(interfaces.front().linkType, { base + blockOffset + 12, capturedLength });
+				if (packet.empty()) break;
+				return Packet{ 0, packet };
+			}
+		}
+	}
+	offset = size;
+	return {};
+}
+
+Writer::~Writer()
+{
+	Close();
+}
+
+Result Writer::Open(const std::string& path)
+{
+	Close();
+	fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return Result::CannotOpen;
+
+	std::vector<std::byte> header;
+	AppendValue(header, PcapMagicNanoseconds);
+	AppendValue(header, static_cast<uint16_t>(2)); // version
+	AppendValue(header, static_cast<uint16_t>(4));
+	AppendValue(header, static_cast<uint32_t>(0)); // thiszone
+	AppendValue(header, static_cast<uint32_t>(0)); // sigfigs
+	AppendValue(header, static_cast<uint32_t>(65535)); // snaplen
+	AppendValue(header, constants::link_type::Raw);
+	if (!WriteAll(fd, header.data(), header.size())) {
+		::close(fd);
+		fd = -1;
+		return Result::WriteError;
+	}
+
+	active.reserve(bufferSize);
+	pending.reserve(bufferSize);
+	stop = false;
+	writeError = false;
+	thread = std::thread([this]() { Run(); });
+	return Result::Success;
+}
+
+Result Writer::Close()
+{
+	if (fd < 0) return Result::Success;
+	const auto result = Flush();
+	{
+		std::lock_guard lock(mutex);
+		stop = true;
+	}
+	wakeup.notify_one();
+	thread.join();
+	::close(fd);
+	fd = -1;
+	return result;
+}
+
+void Writer::Write(const Buffer& buffer, const uint64_t timestamp)
+{
+	const auto length = static_cast<uint32_t>(buffer.data().size());
+
+	std::unique_lock lock(mutex);
+	AppendRecordHeader(timestamp, length, length);
+	for (const auto b : buffer.chain()) {
+		const auto readSpan = b->ReadSpan();
+		active.insert(active.end(), readSpan.begin(), readSpan.end());
+	}
+	SwapIfFull(lock);
+}
+
+void Writer::Write(const nonstd::span<const std::byte> data, const uint32_t originalLength, const uint64_t timestamp)
+{
+	std::unique_lock lock(mutex);
+	AppendRecordHeader(timestamp, static_cast<uint32_t>(data.size()), originalLength);
+	active.insert(active.end(), data.begin(), data.end());
+	SwapIfFull(lock);
+}
+
+void Writer::AppendRecordHeader(const uint64_t timestamp, const uint32_t capturedLength, const uint32_t originalLength)
+{
+	AppendValue(active, static_cast<uint32_t>(timestamp / 1'000'000'000));
+	AppendValue(active, static_cast<uint32_t>(timestamp % 1'000'000'000));
+	AppendValue(active, capturedLength);
+	AppendValue(active, originalLength);
+}
+
+void Writer::SwapIfFull(std::unique_lock<std::mutex>& lock)
+{
+	if (active.size() >= bufferSize) {
+		flushed.wait(lock, [&]() { return pending.empty(); });
+		std::swap(active, pending);
+		wakeup.notify_one();
+	}
+}
+
+Result Writer::Flush()
+{
+	std::unique_lock lock(mutex);
+	flushed.wait(lock, [&]() { return pending.empty(); });
+	std::swap(active, pending);
+	wakeup.notify_one();
+	flushed.wait(lock, [&]() { return pending.empty(); });
+	return writeError ? Result::WriteError : Result::Success;
+}
+
+void Writer::Run()
+{
+	std::unique_lock lock(mutex);
+	while(true) {
+		wakeup.wait_for(lock, FlushInterval, [&]() { return stop || !pending.empty(); });
+		// Nobody filled a buffer in time; write what there is
+		if (pending.empty())
+			std::swap(active, pending);
+		if (pending.empty()) {
+			if (stop) break;
+			continue;
+		}
+
+		// Writers only append to 'active' meanwhile
+		lock.unlock();
+		const auto ok = WriteAll(fd, pending.data(), pending.size());
+		lock.lock();
+		if (!ok) writeError = true;
+		pending.clear();
+		flushed.notify_all();
+	}
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "nonstd/span.hpp"
+
+namespace netstack {
+
+class Buffer;
+
+namespace pcap {
+
+namespace constants {
+	namespace link_type {
+		static constexpr inline uint32_t Null = 0;
+		static constexpr inline uint32_t Ethernet = 1;
+		static constexpr inline uint32_t Raw = 101;
+		static constexpr inline uint32_t LinuxSLL = 113;
+		static constexpr inline uint32_t IPv4 = 228;
+		static constexpr inline uint32_t LinuxSLL2 = 276;
+	}
+}
+
+enum class Result {
+	Success,
+	CannotOpen,
+	InvalidFormat,
+	WriteError,
+};
+
+struct Packet {
+	uint64_t timestamp; // nanoseconds
+	// The IPv4 packet with any link layer header removed; points into the
+	// mapped file
+	nonstd::span<const std::byte> data;
+};
+
+// Reads IPv4 packets from a memory-mapped pcap or pcapng file. Packets are
+// not copied; frames that do not carry IPv4 are skipped.
+class Reader
+{
+public:
+	Reader() = default;
+	~Reader();
+	Reader(const Reader&) = delete;
+	Reader& operator=(const Reader&) = delete;
+
+	Result Open(const std::string& path);
+	void Close();
+
+	std::optional<Packet> Next();
+	void Rewind();
+
+private:
+	struct Interface {
+		uint32_t linkType;
+		uint64_t unitsPerSecond;
+	};
+
+	std::optional<Packet> NextPcap();
+	std::optional<Packet> NextPcapNG();
+	bool ParseSectionHeader(size_t offset);
+	uint16_t Read16(size_t offset) const;
+	uint32_t Read32(size_t offset) const;
+
+	const std::byte* base{};
+	size_t size{};
+	size_t offset{};
+	size_t firstRecord{};
+	bool pcapng{};
+	bool swapped{};
+	// Classic pcap has a single interface, pcapng one per IDB in the section
+	std::vector<Interface> interfaces;
+};
+
+// Writes packets to a classic pcap file with nanosecond timestamps and raw
+// IP link type. Records are gathered in memory and written by a background
+// thread, either once the buffer is full or periodically; Write() only
+// blocks if the buffer fills up while the previous one is still being
+// written. Write() may be called from multiple threads.
+class Writer
+{
+public:
+	static constexpr inline size_t DefaultBufferSize = 1 << 20;
+	static constexpr inline std::chrono::milliseconds FlushInterval{100};
+
+	explicit Writer(size_t bufferSize = DefaultBufferSize) : bufferSize(bufferSize) { }
+	~Writer();
+	Writer(const Writer&) = delete;
+	Writer& operator=(const Writer&) = delete;
+
+	Result Open(const std::string& path);
+	// Writes all pending records and stops the background thread
+	Result Close();
+
+	void Write(const Buffer& buffer, uint64_t timestamp);
+	// Writes the first bytes of a packet of 'originalLength' bytes
+	void Write(nonstd::span<const std::byte> data, uint32_t originalLength, uint64_t timestamp);
+	// Returns once everything written so far is in the file
+	Result Flush();
+
+private:
+	void Run();
+	void AppendRecordHeader(uint64_t timestamp, uint32_t capturedLength, uint32_t originalLength);
+	void SwapIfFull(std::unique_lock<std::mutex>& lock);
+
+	const size_t bufferSize;
+	int fd{-1};
+	std::mutex mutex;
+	std::condition_variable wakeup;
+	std::condition_variable flushed;
+	std::vector<std::byte> active;
+	std::vector<std::byte> pending;
+	bool stop{};
+	bool writeError{};
+	std::thread thread;
+};
+
+}
+}
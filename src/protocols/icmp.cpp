@@ -1,6 +1,8 @@
 #include "icmp.h"
+#include <algorithm>
 #include "../buffer.h"
 #include "../netorder.h"
+#include "../stats.h"
 #include "ip.h"
 #include "ip_checksum.h"
 
@@ -32,42 +34,193 @@ uint16_t CalculateChecksum(const ip::Header& ipHeader, Buffer& buffer)
 	});
 }
 
+static_assert(stats::Offset(stats::Id::ICMPUnsupported, Result::ChecksumError) == stats::Id::ICMPChecksumError);
+
 std::variant<Result, Header> Parse(const ip::Header& ipHeader, Buffer& buffer)
 {
+	stats::Add(stats::Id::ICMPReceived);
+	const auto failed = [](const Result result) {
+		stats::Add(stats::Offset(stats::Id::ICMPUnsupported, result));
+		return result;
+	};
+
+	if (ipHeader.totalLength < ipHeader.headerSize || buffer.data().size() < ipHeader.totalLength) return failed(Result::NotEnoughData);
+
 	auto maybe_header = FillHeaderFromBuffer(ipHeader, buffer);
-	if (std::holds_alternative<Result>(maybe_header)) return std::get<Result>(maybe_header);
+	if (std::holds_alternative<Result>(maybe_header)) return failed(std::get<Result>(maybe_header));
 	auto& icmpHeader = std::get<Header>(maybe_header);
 
-	if (auto checksum = CalculateChecksum(ipHeader, buffer); checksum != 0) return Result::ChecksumError;
+	if (auto checksum = CalculateChecksum(ipHeader, buffer); checksum != 0) return failed(Result::ChecksumError);
 
 	return icmpHeader;
 }
 
-Buffer CreateEchoResponse(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer)
+BufferPtr CreateError(const uint8_t type, const uint8_t code, const uint32_t rest, const uint32_t sourceAddr, const Buffer& original)
 {
-	Buffer response;
+	auto originalData = original.data();
+	const auto originalSize = originalData.size();
+	if (originalSize < ip::constants::HeaderSize) return {};
+
+	uint32_t destAddr;
+	size_t originalHeaderSize;
+	{
+		auto it = originalData.begin();
+		originalHeaderSize = (net_order::Consume_u8(it) & 0xf) * sizeof(uint32_t);
+		net_order::Consumer consumer(originalData.begin() + ip::constants::offset::SourceAddr);
+		consumer >> destAddr;
+	}
+	const auto quotedSize = std::min(originalSize, originalHeaderSize + constants::ErrorQuotedDataSize);
+	const auto icmpSize = constants::ErrorHeaderSize + quotedSize;
+
+	auto response = std::make_unique<Buffer>();
+	ip::Header ipHeader{};
+	ipHeader.totalLength = static_cast<uint16_t>(ip::constants::HeaderSize + icmpSize);
+	ipHeader.ttl = ip::constants::DefaultTTL;
+	ipHeader.protocol = ip::constants::protocol::ICMP;
+	ipHeader.sourceAddr = sourceAddr;
+	ipHeader.destAddr = destAddr;
+	ipHeader.headerSize = ip::constants::HeaderSize;
+	ip::ConstructHeader(ipHeader, *response);
+
+	const auto icmpSpan = response->WriteSpan();
 	{
-		net_order::Producer producer(response.WriteSpan().begin());
-		producer << constants::message_type::EchoReply;
-		producer << static_cast<uint8_t>(0); // code
+		net_order::Producer producer(icmpSpan.begin());
+		producer << type;
+		producer << code;
 		producer << static_cast<uint16_t>(0); // checksum
-		response.IncrementFilled(producer.bytesProduced);
+		producer << rest;
+		response->IncrementFilled(producer.bytesProduced);
+	}
+	std::copy_n(originalData.begin(), quotedSize, response->WriteSpan().begin());
+	response->IncrementFilled(quotedSize);
+
+	{
+		net_order::Consumer consumer(icmpSpan.begin());
+		const auto checksum = ip::CalculateChecksum(icmpSize, [&]() {
+			uint8_t v; consumer >> v;
+			return v;
+		});
+		auto checksumIt = icmpSpan.begin() + 2;
+		net_order::Produce_u16(checksumIt, checksum);
 	}
-	const auto dataOffset = ipHeader.headerSize + 4; // icmp header is 4 bytes
-	const auto dataLength = ipHeader.totalLength - dataOffset;
-	std::copy(buffer.data().begin() + dataOffset, buffer.data().end(), response.WriteSpan().begin());
-	response.IncrementFilled(dataLength);
 	return response;
 }
 
-std::optional<Buffer> Process(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer)
+std::optional<Error> ErrorFor(const ip::Result result, const Buffer& original)
+{
+	switch(result) {
+		case ip::Result::CorruptHeader: {
+			// Point at the offending field: the header length, the flags or
+			// else the total length
+			const auto data = original.ReadSpan();
+			const size_t headerLength = std::to_integer<uint8_t>(data[0]) & 0xf;
+			const bool reservedFlag = (std::to_integer<uint8_t>(data[6]) & (ip::constants::flag::Reserved >> 8)) != 0;
+			const uint32_t pointer = headerLength < ip::constants::HeaderSize / sizeof(uint32_t) ? 0 : reservedFlag ? 6 : 2;
+			return Error{ constants::message_type::ParameterProblem, 0, pointer << 24 };
+		}
+		default:
+			return {};
+	}
+}
+
+bool MayReportError(const Buffer& original)
+{
+	const auto data = original.ReadSpan();
+	if (data.size() < ip::constants::HeaderSize) return false;
+
+	auto it = data.begin();
+	const auto headerSize = (net_order::Consume_u8(it) & 0xf) * sizeof(uint32_t);
+	it = data.begin() + 6;
+	const auto fragmentOffset = net_order::Consume_u16(it) & 0x1fff;
+	it = data.begin() + ip::constants::offset::Protocol;
+	const auto protocol = net_order::Consume_u8(it);
+	it = data.begin() + ip::constants::offset::SourceAddr;
+	const auto sourceAddr = net_order::Consume_u32(it);
+	const auto destAddr = net_order::Consume_u32(it);
+
+	const auto IsMulticast = [](const uint32_t addr) { return (addr >> 28) == 0xe; };
+	const auto IsBroadcast = [](const uint32_t addr) { return addr == 0xffffffff; };
+	if (fragmentOffset != 0) return false;
+	if (IsMulticast(destAddr) || IsBroadcast(destAddr)) return false;
+	if (sourceAddr == 0 || IsMulticast(sourceAddr) || IsBroadcast(sourceAddr) || (sourceAddr >> 24) == 127) return false;
+
+	if (protocol == ip::constants::protocol::ICMP) {
+		if (data.size() <= headerSize) return false;
+		switch(std::to_integer<uint8_t>(data[headerSize])) {
+			case constants::message_type::DestinationUnreachable:
+			case constants::message_type::SourceQuench:
+			case constants::message_type::Redirect:
+			case constants::message_type::TimeExceeded:
+			case constants::message_type::ParameterProblem:
+				return false;
+		}
+	}
+	return true;
+}
+
+BufferPtr ErrorGenerator::Generate(const Error& error, const uint32_t sourceAddr, const Buffer& original, const uint64_t nowMs)
+{
+	if (!MayReportError(original)) return {};
+
+	auto it = original.ReadSpan().begin() + ip::constants::offset::SourceAddr;
+	const auto destAddr = net_order::Consume_u32(it);
+	// The overall limit is checked first, but only spent if the destination
+	// may get an error, so one noisy source cannot use it up for the others
+	if (!totalBucket.Check(nowMs) || !buckets.Allow((static_cast<uint64_t>(destAddr) << 8) | error.type, nowMs)) {
+		++rateLimited;
+		stats::Add(stats::Id::ICMPErrorsRateLimited);
+		return {};
+	}
+	totalBucket.Take();
+	auto message = CreateError(error.type, error.code, error.rest, sourceAddr, original);
+	if (message) stats::Add(stats::Id::ICMPErrorsSent);
+	return message;
+}
+
+bool CreateEchoResponse(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer)
+{
+	const auto data = buffer.ModifySpan();
+	if (data.size() < ipHeader.headerSize + constants::HeaderSize) return false;
+
+	// Swapping the addresses does not change the one's complement sum, so
+	// only the TTL change needs to be folded into the IP header checksum
+	{
+		auto it = data.begin() + ip::constants::offset::TTL;
+		net_order::Produce_u8(it, ip::constants::DefaultTTL);
+
+		const auto oldWord = static_cast<uint16_t>((ipHeader.ttl << 8) | ipHeader.protocol);
+		const auto newWord = static_cast<uint16_t>((ip::constants::DefaultTTL << 8) | ipHeader.protocol);
+		it = data.begin() + ip::constants::offset::Checksum;
+		net_order::Produce_u16(it, ip::UpdateChecksum(ipHeader.checksum, oldWord, newWord));
+		net_order::Produce_u32(it, ipHeader.destAddr);
+		net_order::Produce_u32(it, ipHeader.sourceAddr);
+	}
+
+	{
+		const auto icmp = data.begin() + ipHeader.headerSize;
+		auto it = icmp + 2;
+		const auto checksum = net_order::Consume_u16(it);
+
+		const auto oldWord = static_cast<uint16_t>((icmpHeader.type << 8) | icmpHeader.code);
+		const auto newWord = static_cast<uint16_t>((constants::message_type::EchoReply << 8) | icmpHeader.code);
+		it = icmp;
+		net_order::Produce_u8(it, constants::message_type::EchoReply);
+		it = icmp + 2;
+		net_order::Produce_u16(it, ip::UpdateChecksum(checksum, oldWord, newWord));
+	}
+	return true;
+}
+
+bool Process(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer)
 {
 	switch(icmpHeader.type) {
 		case constants::message_type::EchoRequest: {
-			return CreateEchoResponse(ipHeader, icmpHeader, buffer);
+			if (!CreateEchoResponse(ipHeader, icmpHeader, buffer)) return false;
+			stats::Add(stats::Id::ICMPEchoReplies);
+			return true;
 		}
 	}
-	return {};
+	return false;
 }
 
 }
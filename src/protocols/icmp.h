@@ -1,24 +1,51 @@
 #pragma once
 
+#include <memory>
 #include <optional>
 #include <variant>
+#include <cstddef>
 #include <cstdint>
+#include "../ratelimit.h"
 
 namespace netstack {
 
 class Buffer;
+using BufferPtr = std::unique_ptr<Buffer>;
 namespace protocol {
 namespace ip {
 	struct Header;
+	enum class Result;
 }
 namespace icmp {
 
 namespace constants {
 static constexpr inline size_t HeaderSize = 4;
 
+static constexpr inline size_t ErrorHeaderSize = 8;
+static constexpr inline size_t ErrorQuotedDataSize = 8;
+
 namespace message_type {
 	static constexpr inline uint8_t EchoReply = 0;
+	static constexpr inline uint8_t DestinationUnreachable = 3;
+	static constexpr inline uint8_t SourceQuench = 4;
+	static constexpr inline uint8_t Redirect = 5;
 	static constexpr inline uint8_t EchoRequest = 8;
+	static constexpr inline uint8_t TimeExceeded = 11;
+	static constexpr inline uint8_t ParameterProblem = 12;
+}
+
+namespace code {
+namespace destination_unreachable {
+	static constexpr inline uint8_t Net = 0;
+	static constexpr inline uint8_t Host = 1;
+	static constexpr inline uint8_t Protocol = 2;
+	static constexpr inline uint8_t Port = 3;
+	static constexpr inline uint8_t FragmentationNeeded = 4;
+}
+namespace time_exceeded {
+	static constexpr inline uint8_t TTL = 0;
+	static constexpr inline uint8_t Reassembly = 1;
+}
 }
 }
 
@@ -35,10 +62,60 @@ enum class Result {
 	ChecksumError
 };
 
-Buffer CreateEchoResponse(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer);
+struct Error {
+	uint8_t type;
+	uint8_t code;
+	uint32_t rest{}; // type-specific second word, i.e. the parameter problem pointer
+};
+
+// Returns the error to report for a packet rejected by ip::ParseHeader, if
+// any; packets with a bad checksum or an unsupported version are dropped
+// silently
+std::optional<Error> ErrorFor(ip::Result result, const Buffer& original);
+
+// Returns whether an error may be reported about the packet at all; never
+// for ICMP errors, non-initial fragments or broadcast/multicast packets
+// (RFC 1122 3.2.2)
+bool MayReportError(const Buffer& original);
+
+// Creates an ICMP error message about the IP packet in 'original', which need
+// not have been parsed successfully; the message is addressed to its source
+BufferPtr CreateError(uint8_t type, uint8_t code, uint32_t rest, uint32_t sourceAddr, const Buffer& original);
+
+// Generates ICMP errors, limited per destination and message type by token
+// buckets, so that a flood of bad packets cannot be turned into a flood of
+// errors. Not thread-safe; every receiving thread needs its own generator.
+class ErrorGenerator
+{
+public:
+	static constexpr inline size_t NumberOfBuckets = 1024;
+	// As Linux' icmp_msgs_per_sec and icmp_msgs_burst
+	static constexpr inline ratelimit::Config DefaultTotal{ 1000, 50 };
+
+	// 'config' limits the errors sent to each destination, 'total' all of
+	// them together; the latter bounds what a flood from many (spoofed)
+	// sources gets, as each new one starts out with a full bucket
+	explicit ErrorGenerator(const ratelimit::Config& config = {}, const ratelimit::Config& total = DefaultTotal) : buckets(config), totalBucket(total) { }
+
+	// Returns the message to transmit, or nullptr if none is to be sent
+	BufferPtr Generate(const Error& error, uint32_t sourceAddr, const Buffer& original, uint64_t nowMs);
+
+	size_t NumberOfRateLimited() const { return rateLimited; }
+
+private:
+	ratelimit::TokenBucketTable<NumberOfBuckets> buckets;
+	ratelimit::TokenBucket totalBucket;
+	size_t rateLimited{};
+};
+
+// Rewrites an echo request into the matching reply in place; only the
+// headers in the first segment are touched and both checksums are patched
+// incrementally, so the payload is neither copied nor summed again
+bool CreateEchoResponse(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer);
 
 std::variant<Result, Header> Parse(const ip::Header&, Buffer&);
-std::optional<Buffer> Process(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer);
+// Returns true if the buffer was rewritten into a reply that is to be sent
+bool Process(const ip::Header& ipHeader, const Header& icmpHeader, Buffer& buffer);
 
 }
 }
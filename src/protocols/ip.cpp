@@ -1,13 +1,18 @@
 #include "ip.h"
 #include "../buffer.h"
 #include "../netorder.h"
+#include "../stats.h"
 #include "ip_checksum.h"
 
 namespace netstack {
 namespace protocol {
 namespace ip {
 
-std::variant<Result, Header> FillHeaderFromBuffer(Buffer& buffer)
+namespace {
+
+enum class Fragments { Reject, Accept };
+
+std::variant<Result, Header> FillHeaderFromBuffer(Buffer& buffer, const Fragments fragments)
 {
 	const auto bufferSize = buffer.data().size();
 	if (bufferSize < constants::HeaderSize) return Result::NotEnoughData;
@@ -18,6 +23,7 @@ std::variant<Result, Header> FillHeaderFromBuffer(Buffer& buffer)
 	consumer >> version_hlen;
 	if (version_hlen >> 4 != constants::Version) return Result::Unsupported;
 	header.headerSize = (version_hlen & 0xf) * sizeof(uint32_t);
+	if (header.headerSize < constants::HeaderSize) return Result::CorruptHeader;
 	if (header.headerSize > bufferSize) return Result::NotEnoughData;
 
 	consumer >> header.tos;
@@ -32,14 +38,16 @@ std::variant<Result, Header> FillHeaderFromBuffer(Buffer& buffer)
 	consumer >> header.destAddr;
 
 	if (flags_frag & ip::constants::flag::Reserved) return Result::CorruptHeader;
-	if (flags_frag & ip::constants::flag::MF) return Result::Unsupported;
+	if (fragments == Fragments::Reject && (flags_frag & ip::constants::flag::MF)) return Result::Unsupported;
 
 	header.flags = flags_frag;
 	header.frag = flags_frag & 0x1fff;
-	if (header.frag != 0) return Result::Unsupported;
+	if (fragments == Fragments::Reject && header.frag != 0) return Result::Unsupported;
 	return header;
 }
 
+}
+
 uint16_t CalculateHeaderChecksum(Buffer& buffer, size_t headerSize)
 {
 	auto readSpan = buffer.data();
@@ -49,22 +57,61 @@ uint16_t CalculateHeaderChecksum(Buffer& buffer, size_t headerSize)
 	});
 }
 
-std::variant<Result, Header> ParseHeader(Buffer& buffer)
+static_assert(stats::Offset(stats::Id::IPUnsupported, Result::ChecksumError) == stats::Id::IPChecksumError);
+
+namespace {
+
+std::variant<Result, Header> Parse(Buffer& buffer, const Fragments fragments)
 {
-	auto maybe_header = FillHeaderFromBuffer(buffer);
-	if (std::holds_alternative<protocol::ip::Result>(maybe_header)) return std::get<Result>(maybe_header);
+	stats::Add(stats::Id::IPReceived);
+	const auto failed = [](const Result result) {
+		stats::Add(stats::Offset(stats::Id::IPUnsupported, result));
+		return result;
+	};
+
+	stats::StageTimer timer;
+	auto maybe_header = FillHeaderFromBuffer(buffer, fragments);
+	timer.Mark(latency::Stage::IPParse);
+	if (std::holds_alternative<protocol::ip::Result>(maybe_header)) return failed(std::get<Result>(maybe_header));
 	Header& header = std::get<Header>(maybe_header);
 
-	if (auto checksum = CalculateHeaderChecksum(buffer, header.headerSize); checksum != 0) return Result::ChecksumError;
+	const auto checksum = CalculateHeaderChecksum(buffer, header.headerSize);
+	timer.Mark(latency::Stage::Checksum);
+	if (checksum != 0) return failed(Result::ChecksumError);
 
 	return header;
 }
 
+}
+
+std::variant<Result, Header> ParseHeader(Buffer& buffer)
+{
+	return Parse(buffer, Fragments::Reject);
+}
+
+std::variant<Result, Header> ParseHeaderForForwarding(Buffer& buffer)
+{
+	auto result = Parse(buffer, Fragments::Accept);
+	if (const auto header = std::get_if<Header>(&result); header) {
+		// The payload is passed on without being looked at, so at least its
+		// length must add up
+		if (header->totalLength < header->headerSize) {
+			stats::Add(stats::Id::IPCorruptHeader);
+			return Result::CorruptHeader;
+		}
+		if (header->totalLength > buffer.data().size()) {
+			stats::Add(stats::Id::IPNotEnoughData);
+			return Result::NotEnoughData;
+		}
+	}
+	return result;
+}
+
 void ConstructHeader(const Header& source, Buffer& buffer)
 {
 	{
 		net_order::Producer producer(buffer.WriteSpan().begin());
-		producer << static_cast<uint8_t>(0x40 + (source.headerSize / 4) & 0xf);
+		producer << static_cast<uint8_t>((constants::Version << 4) | ((source.headerSize / 4) & 0xf));
 		producer << static_cast<uint8_t>(source.tos); // tos
 		producer << static_cast<uint16_t>(source.totalLength);
 		producer << static_cast<uint16_t>(source.id);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <variant>
+#include <cstddef>
 #include <cstdint>
 
 namespace netstack {
@@ -12,7 +13,15 @@ namespace ip {
 namespace constants {
 	static constexpr inline uint8_t Version = 4;
 	static constexpr inline size_t HeaderSize = 20;
+	static constexpr inline uint8_t DefaultTTL = 64;
 
+namespace offset {
+	static constexpr inline size_t TTL = 8;
+	static constexpr inline size_t Protocol = 9;
+	static constexpr inline size_t Checksum = 10;
+	static constexpr inline size_t SourceAddr = 12;
+	static constexpr inline size_t DestAddr = 16;
+}
 namespace flag {
 	static constexpr inline uint16_t Reserved = (1 << 15);
 	static constexpr inline uint16_t DF = (1 << 14);
@@ -49,6 +58,9 @@ enum class Result {
 };
 
 std::variant<Result, Header> ParseHeader(Buffer& buffer);
+// As ParseHeader(), but accepts fragments, which a router passes on as they
+// are, and checks that the total length fits the buffer
+std::variant<Result, Header> ParseHeaderForForwarding(Buffer& buffer);
 void ConstructHeader(const Header& source, Buffer& buffer);
 
 }
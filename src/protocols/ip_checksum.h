@@ -18,6 +18,8 @@ uint16_t CalculateChecksum(size_t length, Func getByte)
 		const auto v = (hi << 8) | lo;
 		checksum += v;
 	}
+	if (length > 0)
+		checksum += static_cast<uint16_t>(getByte()) << 8;
 
 	const auto carry_count = checksum >> 16;
 	checksum = (checksum & 0xffff) + carry_count;
@@ -26,6 +28,18 @@ uint16_t CalculateChecksum(size_t length, Func getByte)
 	return (~checksum) & 0xffff;
 }
 
+// Incrementally updates a checksum after a 16-bit word changed from oldValue
+// to newValue (RFC 1624, eqn. 3)
+inline uint16_t UpdateChecksum(const uint16_t checksum, const uint16_t oldValue, const uint16_t newValue)
+{
+	uint32_t sum = static_cast<uint16_t>(~checksum);
+	sum += static_cast<uint16_t>(~oldValue);
+	sum += newValue;
+	sum = (sum & 0xffff) + (sum >> 16);
+	sum = (sum & 0xffff) + (sum >> 16);
+	return static_cast<uint16_t>(~sum);
+}
+
 }
 }
 }
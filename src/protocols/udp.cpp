@@ -0,0 +1,99 @@
+#include "udp.h"
+#include <array>
+#include "../buffer.h"
+#include "../netorder.h"
+#include "../stats.h"
+#include "ip.h"
+#include "ip_checksum.h"
+
+namespace netstack {
+namespace protocol {
+namespace udp {
+
+namespace {
+
+// Sums the pseudo header followed by the 'length' bytes of the datagram
+// starting at 'it'
+uint16_t CalculateChecksum(const uint32_t sourceAddr, const uint32_t destAddr, const uint16_t length, BufferDataIterator it)
+{
+	std::array<std::byte, 12> pseudoHeader;
+	{
+		auto p = pseudoHeader.begin();
+		net_order::Produce_u32(p, sourceAddr);
+		net_order::Produce_u32(p, destAddr);
+		net_order::Produce_u8(p, 0);
+		net_order::Produce_u8(p, ip::constants::protocol::UDP);
+		net_order::Produce_u16(p, length);
+	}
+	size_t n = 0;
+	return ip::CalculateChecksum(pseudoHeader.size() + length, [&]() {
+		if (n < pseudoHeader.size()) return std::to_integer<uint8_t>(pseudoHeader[n++]);
+		return net_order::Consume_u8(it);
+	});
+}
+
+}
+
+static_assert(stats::Offset(stats::Id::UDPNotEnoughData, Result::ChecksumError) == stats::Id::UDPChecksumError);
+
+std::variant<Result, Header> Parse(const ip::Header& ipHeader, const Buffer& buffer)
+{
+	stats::Add(stats::Id::UDPReceived);
+	const auto failed = [](const Result result) {
+		stats::Add(stats::Offset(stats::Id::UDPNotEnoughData, result));
+		return result;
+	};
+
+	if (ipHeader.totalLength < ipHeader.headerSize + constants::HeaderSize || buffer.data().size() < ipHeader.totalLength) return failed(Result::NotEnoughData);
+
+	Header header;
+	net_order::Consumer consumer(buffer.data().begin() + ipHeader.headerSize);
+	consumer >> header.sourcePort;
+	consumer >> header.destPort;
+	consumer >> header.length;
+	consumer >> header.checksum;
+	if (header.length != ipHeader.totalLength - ipHeader.headerSize) return failed(Result::CorruptHeader);
+
+	// A zero checksum means the sender did not compute one
+	if (header.checksum != 0 && CalculateChecksum(ipHeader.sourceAddr, ipHeader.destAddr, header.length, buffer.data().begin() + ipHeader.headerSize) != 0)
+		return failed(Result::ChecksumError);
+	return header;
+}
+
+BufferPtr Construct(const uint32_t sourceAddr, const uint16_t sourcePort, const uint32_t destAddr, const uint16_t destPort, BufferPtr payload)
+{
+	const size_t payloadSize = payload ? payload->data().size() : 0;
+	if (payloadSize > constants::MaxPayloadSize) return {};
+	const auto length = static_cast<uint16_t>(constants::HeaderSize + payloadSize);
+
+	auto buffer = std::make_unique<Buffer>();
+	ip::Header ipHeader{};
+	ipHeader.totalLength = static_cast<uint16_t>(ip::constants::HeaderSize + length);
+	ipHeader.ttl = ip::constants::DefaultTTL;
+	ipHeader.protocol = ip::constants::protocol::UDP;
+	ipHeader.sourceAddr = sourceAddr;
+	ipHeader.destAddr = destAddr;
+	ipHeader.headerSize = ip::constants::HeaderSize;
+	ip::ConstructHeader(ipHeader, *buffer);
+
+	const auto udpSpan = buffer->WriteSpan();
+	{
+		net_order::Producer producer(udpSpan.begin());
+		producer << sourcePort;
+		producer << destPort;
+		producer << length;
+		producer << static_cast<uint16_t>(0); // checksum
+		buffer->IncrementFilled(producer.bytesProduced);
+	}
+	if (payload) buffer->AddBuffer(std::move(payload));
+
+	auto checksum = CalculateChecksum(sourceAddr, destAddr, length, buffer->data().begin() + ip::constants::HeaderSize);
+	if (checksum == 0) checksum = 0xffff; // zero is reserved for no checksum
+	auto it = udpSpan.begin() + 6;
+	net_order::Produce_u16(it, checksum);
+	return buffer;
+}
+
+}
+}
+}
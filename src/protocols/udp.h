@@ -0,0 +1,48 @@
+#pragma once
+
+#include <memory>
+#include <variant>
+#include <cstddef>
+#include <cstdint>
+
+namespace netstack {
+
+class Buffer;
+using BufferPtr = std::unique_ptr<Buffer>;
+namespace protocol {
+namespace ip {
+	struct Header;
+}
+namespace udp {
+
+namespace constants {
+	static constexpr inline size_t HeaderSize = 8;
+	// The largest payload that fits an IPv4 packet without options
+	static constexpr inline size_t MaxPayloadSize = 65535 - 20 - HeaderSize;
+}
+
+struct Header {
+	uint16_t sourcePort;
+	uint16_t destPort;
+	uint16_t length;
+	uint16_t checksum;
+};
+
+enum class Result {
+	NotEnoughData,
+	CorruptHeader,
+	ChecksumError
+};
+
+// Parses the UDP header following the IP header; the length must match the
+// IP packet and the checksum, if any, must be valid
+std::variant<Result, Header> Parse(const ip::Header& ipHeader, const Buffer& buffer);
+
+// Prepends IP and UDP headers to the payload chain, which may be empty. The
+// headers go into a segment of their own, so the payload is not copied;
+// returns nullptr if the payload is too large.
+BufferPtr Construct(uint32_t sourceAddr, uint16_t sourcePort, uint32_t destAddr, uint16_t destPort, BufferPtr payload);
+
+}
+}
+}
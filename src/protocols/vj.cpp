@@ -0,0 +1,472 @@
+#include "vj.h"
+#include "ip.h"
+#include "ip_checksum.h"
+#include "../buffer.h"
+#include "../netorder.h"
+
+#include <algorithm>
+
+namespace netstack {
+namespace protocol {
+namespace vj {
+
+namespace {
+
+namespace tcp {
+	static constexpr inline size_t HeaderSize = 20;
+
+namespace offset {
+	static constexpr inline size_t Ports = 0;
+	static constexpr inline size_t Sequence = 4;
+	static constexpr inline size_t Ack = 8;
+	static constexpr inline size_t DataOffset = 12;
+	static constexpr inline size_t Flags = 13;
+	static constexpr inline size_t Window = 14;
+	static constexpr inline size_t Checksum = 16;
+	static constexpr inline size_t Urgent = 18;
+}
+namespace flag {
+	static constexpr inline uint8_t FIN = 0x01;
+	static constexpr inline uint8_t SYN = 0x02;
+	static constexpr inline uint8_t RST = 0x04;
+	static constexpr inline uint8_t PSH = 0x08;
+	static constexpr inline uint8_t ACK = 0x10;
+	static constexpr inline uint8_t URG = 0x20;
+}
+}
+
+namespace ip_offset {
+	static constexpr inline size_t TotalLength = 2;
+	static constexpr inline size_t Id = 4;
+	static constexpr inline size_t Flags = 6;
+	static constexpr inline size_t TOS = 1;
+}
+
+template<size_t N> size_t CopyHeader(const Buffer& buffer, std::array<std::byte, N>& header)
+{
+	size_t amount = 0;
+	for (const auto b : buffer.chain()) {
+		const auto span = b->ReadSpan();
+		const auto n = std::min(span.size(), N - amount);
+		std::copy_n(span.begin(), n, header.begin() + amount);
+		amount += n;
+		if (amount == N) break;
+	}
+	return amount;
+}
+
+uint8_t Get8(nonstd::span<const std::byte> s, const size_t offset) { return std::to_integer<uint8_t>(s[offset]); }
+
+uint16_t Get16(nonstd::span<const std::byte> s, const size_t offset)
+{
+	auto it = s.begin() + offset;
+	return net_order::Consume_u16(it);
+}
+
+uint32_t Get32(nonstd::span<const std::byte> s, const size_t offset)
+{
+	auto it = s.begin() + offset;
+	return net_order::Consume_u32(it);
+}
+
+void Put16(nonstd::span<std::byte> s, const size_t offset, const uint16_t v)
+{
+	auto it = s.begin() + offset;
+	net_order::Produce_u16(it, v);
+}
+
+void Put32(nonstd::span<std::byte> s, const size_t offset, const uint32_t v)
+{
+	auto it = s.begin() + offset;
+	net_order::Produce_u32(it, v);
+}
+
+size_t IPHeaderSize(nonstd::span<const std::byte> s) { return (Get8(s, 0) & 0xf) * sizeof(uint32_t); }
+size_t TCPHeaderSize(nonstd::span<const std::byte> s, const size_t ipHeaderSize) { return (Get8(s, ipHeaderSize + tcp::offset::DataOffset) >> 4) * sizeof(uint32_t); }
+
+uint16_t HeaderChecksum(nonstd::span<const std::byte> s, const size_t length)
+{
+	auto it = s.begin();
+	return ip::CalculateChecksum(length, [&]() { return net_order::Consume_u8(it); });
+}
+
+// Small values take a single byte; zero and anything above 255 are sent as
+// a zero byte followed by 16 bits
+void Encode(std::array<std::byte, constants::MaxCompressedSize>& out, size_t& offset, const uint16_t value)
+{
+	if (value == 0 || value > 0xff) {
+		out[offset++] = std::byte{0};
+		Put16(out, offset, value);
+		offset += 2;
+	} else {
+		out[offset++] = static_cast<std::byte>(value);
+	}
+}
+
+// Overwrites a byte of a chain, which need not be in the first buffer
+void Store(Buffer& buffer, size_t offset, const std::byte value)
+{
+	for (auto b : buffer.chain()) {
+		const auto span = b->ModifySpan();
+		if (offset < span.size()) {
+			span[offset] = value;
+			return;
+		}
+		offset -= span.size();
+	}
+}
+
+// Appends everything in 'source' past 'offset' to 'destination'
+void CopyData(const Buffer& source, size_t offset, Buffer& destination)
+{
+	auto out = &destination;
+	for (const auto b : source.chain()) {
+		auto span = b->ReadSpan();
+		if (offset >= span.size()) {
+			offset -= span.size();
+			continue;
+		}
+		span = span.subspan(offset);
+		offset = 0;
+		while (!span.empty()) {
+			if (out->WriteSpan().empty()) out = &out->AddBuffer();
+			const auto amount = std::min(span.size(), out->WriteSpan().size());
+			std::copy_n(span.begin(), amount, out->WriteSpan().begin());
+			out->IncrementFilled(amount);
+			span = span.subspan(amount);
+		}
+	}
+}
+
+}
+
+PacketType TypeOf(const std::byte first)
+{
+	const auto type = std::to_integer<uint8_t>(first);
+	if (type & constants::type::CompressedTCP) return PacketType::CompressedTCP;
+	if (type >= constants::type::UncompressedTCP) return PacketType::UncompressedTCP;
+	return PacketType::IP;
+}
+
+Compressor::Compressor()
+{
+	for (size_t n = 0; n < lru.size(); ++n)
+		lru[n] = static_cast<uint8_t>(n);
+}
+
+uint8_t Compressor::FindSlot(nonstd::span<const std::byte> header, const size_t ipHeaderSize, bool& found)
+{
+	const auto sameConnection = [&](const State& state) {
+		if (state.headerSize == 0) return false;
+		const nonstd::span<const std::byte> old{ state.header.data(), state.headerSize };
+		return std::equal(header.begin() + ip::constants::offset::SourceAddr, header.begin() + ip::constants::HeaderSize, old.begin() + ip::constants::offset::SourceAddr) &&
+			IPHeaderSize(old) == ipHeaderSize &&
+			Get32(header, ipHeaderSize + tcp::offset::Ports) == Get32(old, ipHeaderSize + tcp::offset::Ports);
+	};
+	auto it = std::find_if(lru.begin(), lru.end(), [&](const uint8_t slot) { return sameConnection(states[slot]); });
+	found = it != lru.end();
+	// A new connection takes the least recently used slot
+	if (!found) it = lru.end() - 1;
+	const auto slot = *it;
+	std::rotate(lru.begin(), it, it + 1);
+	return slot;
+}
+
+Compressor::Result Compressor::Compress(const Buffer& packet)
+{
+	Result result{};
+	result.type = PacketType::IP;
+
+	std::array<std::byte, constants::MaxHeaderSize> header;
+	const auto available = CopyHeader(packet, header);
+	const nonstd::span<const std::byte> h{ header.data(), available };
+	const auto sendAsIP = [&]() {
+		++stats.ip;
+		return result;
+	};
+
+	if (available < ip::constants::HeaderSize || Get8(h, 0) >> 4 != ip::constants::Version) return sendAsIP();
+	const auto ipHeaderSize = IPHeaderSize(h);
+	if (ipHeaderSize < ip::constants::HeaderSize) return sendAsIP();
+	if (Get8(h, ip::constants::offset::Protocol) != ip::constants::protocol::TCP || (Get16(h, ip_offset::Flags) & 0x3fff) != 0)
+		return sendAsIP();
+	if (available < ipHeaderSize + tcp::HeaderSize) return sendAsIP();
+	const auto tcpHeaderSize = TCPHeaderSize(h, ipHeaderSize);
+	const auto headerSize = ipHeaderSize + tcpHeaderSize;
+	if (tcpHeaderSize < tcp::HeaderSize || headerSize > available) return sendAsIP();
+	const auto flags = Get8(h, ipHeaderSize + tcp::offset::Flags);
+	if ((flags & (tcp::flag::SYN | tcp::flag::FIN | tcp::flag::RST)) != 0 || (flags & tcp::flag::ACK) == 0)
+		return sendAsIP();
+	// The receiver derives the length from the frame; padding would end up
+	// in the payload
+	const auto totalLength = Get16(h, ip_offset::TotalLength);
+	if (totalLength != packet.data().size()) return sendAsIP();
+
+	bool found;
+	const auto slot = FindSlot(h, ipHeaderSize, found);
+	auto& state = states[slot];
+
+	const auto sendUncompressed = [&]() {
+		std::copy_n(h.begin(), headerSize, state.header.begin());
+		state.headerSize = headerSize;
+		lastSlot = slot;
+		++stats.uncompressed;
+
+		// The slot goes in place of the protocol, which is TCP by definition
+		std::copy_n(h.begin(), headerSize, result.header.begin());
+		result.header[0] |= std::byte{constants::type::UncompressedTCP};
+		result.header[ip::constants::offset::Protocol] = static_cast<std::byte>(slot);
+		result.type = PacketType::UncompressedTCP;
+		result.headerSize = result.replaced = headerSize;
+		return result;
+	};
+	if (!found) return sendUncompressed();
+
+	// Only the fields the compressed format covers may have changed;
+	// unlike Linux, this includes the TCP flags other than PSH and URG, as
+	// the receiver would lose e.g. ECN bits
+	const nonstd::span<const std::byte> old{ state.header.data(), state.headerSize };
+	const auto ignoredFlags = tcp::flag::PSH | tcp::flag::URG;
+	if (state.headerSize != headerSize ||
+	    Get8(h, ip_offset::TOS) != Get8(old, ip_offset::TOS) ||
+	    (Get16(h, ip_offset::Flags) & ip::constants::flag::DF) != (Get16(old, ip_offset::Flags) & ip::constants::flag::DF) ||
+	    Get8(h, ip::constants::offset::TTL) != Get8(old, ip::constants::offset::TTL) ||
+	    Get8(h, ipHeaderSize + tcp::offset::DataOffset) != Get8(old, ipHeaderSize + tcp::offset::DataOffset) ||
+	    (flags & ~ignoredFlags) != (Get8(old, ipHeaderSize + tcp::offset::Flags) & ~ignoredFlags) ||
+	    !std::equal(h.begin() + ip::constants::HeaderSize, h.begin() + ipHeaderSize, old.begin() + ip::constants::HeaderSize) ||
+	    !std::equal(h.begin() + ipHeaderSize + tcp::HeaderSize, h.begin() + headerSize, old.begin() + ipHeaderSize + tcp::HeaderSize))
+		return sendUncompressed();
+
+	// Deltas go out in the order the receiver applies them
+	std::array<std::byte, constants::MaxCompressedSize> deltas;
+	size_t deltaSize = 0;
+	uint8_t changes = 0;
+
+	const auto urgent = Get16(h, ipHeaderSize + tcp::offset::Urgent);
+	if (flags & tcp::flag::URG) {
+		Encode(deltas, deltaSize, urgent);
+		changes |= constants::change::U;
+	} else if (urgent != Get16(old, ipHeaderSize + tcp::offset::Urgent)) {
+		return sendUncompressed();
+	}
+	if (const uint16_t deltaW = Get16(h, ipHeaderSize + tcp::offset::Window) - Get16(old, ipHeaderSize + tcp::offset::Window); deltaW != 0) {
+		Encode(deltas, deltaSize, deltaW);
+		changes |= constants::change::W;
+	}
+	const uint32_t deltaA = Get32(h, ipHeaderSize + tcp::offset::Ack) - Get32(old, ipHeaderSize + tcp::offset::Ack);
+	if (deltaA != 0) {
+		if (deltaA > 0xffff) return sendUncompressed();
+		Encode(deltas, deltaSize, static_cast<uint16_t>(deltaA));
+		changes |= constants::change::A;
+	}
+	const uint32_t deltaS = Get32(h, ipHeaderSize + tcp::offset::Sequence) - Get32(old, ipHeaderSize + tcp::offset::Sequence);
+	if (deltaS != 0) {
+		if (deltaS > 0xffff) return sendUncompressed();
+		Encode(deltas, deltaSize, static_cast<uint16_t>(deltaS));
+		changes |= constants::change::S;
+	}
+
+	const auto oldTotalLength = Get16(old, ip_offset::TotalLength);
+	const auto oldPayload = static_cast<uint32_t>(oldTotalLength - headerSize);
+	// The special encodings leave the receiver's URG flag alone
+	const bool specialAllowed = (Get8(old, ipHeaderSize + tcp::offset::Flags) & tcp::flag::URG) == 0;
+	switch(changes) {
+		case 0:
+			// Data following a bare ACK is normal for interactive traffic;
+			// anything else is likely a retransmission, which is sent
+			// uncompressed in case the receiver missed the original
+			if (totalLength != oldTotalLength && oldTotalLength == headerSize)
+				break;
+			return sendUncompressed();
+		case constants::change::SpecialI:
+		case constants::change::SpecialD:
+			return sendUncompressed();
+		case constants::change::S | constants::change::A:
+			if (specialAllowed && deltaS == deltaA && deltaS == oldPayload) {
+				changes = constants::change::SpecialI;
+				deltaSize = 0;
+			}
+			break;
+		case constants::change::S:
+			if (specialAllowed && deltaS == oldPayload) {
+				changes = constants::change::SpecialD;
+				deltaSize = 0;
+			}
+			break;
+	}
+	if (const uint16_t deltaI = Get16(h, ip_offset::Id) - Get16(old, ip_offset::Id); deltaI != 1) {
+		Encode(deltas, deltaSize, deltaI);
+		changes |= constants::change::I;
+	}
+	if (flags & tcp::flag::PSH)
+		changes |= constants::change::P;
+
+	std::copy_n(h.begin(), headerSize, state.header.begin());
+	++stats.compressed;
+
+	size_t size = 0;
+	if (slot != lastSlot) {
+		result.header[size++] = static_cast<std::byte>(constants::type::CompressedTCP | changes | constants::change::C);
+		result.header[size++] = static_cast<std::byte>(slot);
+		lastSlot = slot;
+	} else {
+		result.header[size++] = static_cast<std::byte>(constants::type::CompressedTCP | changes);
+	}
+	// The TCP checksum is passed on as is, to verify the reconstruction
+	std::copy_n(h.begin() + ipHeaderSize + tcp::offset::Checksum, 2, result.header.begin() + size);
+	size += 2;
+	std::copy_n(deltas.begin(), deltaSize, result.header.begin() + size);
+	size += deltaSize;
+
+	result.type = PacketType::CompressedTCP;
+	result.headerSize = size;
+	result.replaced = headerSize;
+	return result;
+}
+
+Decompressor::Decompressor() = default;
+
+BufferPtr Decompressor::Decompress(BufferPtr frame)
+{
+	auto data = frame->data();
+	if (data.begin() == data.end()) {
+		++stats.ip;
+		return frame;
+	}
+	switch(TypeOf(*data.begin())) {
+		case PacketType::IP:
+			++stats.ip;
+			return frame;
+		case PacketType::UncompressedTCP:
+			return Remember(std::move(frame));
+		case PacketType::CompressedTCP:
+			return Uncompress(*frame);
+	}
+	return Error();
+}
+
+BufferPtr Decompressor::Error()
+{
+	++stats.errors;
+	Toss();
+	return {};
+}
+
+BufferPtr Decompressor::Remember(BufferPtr frame)
+{
+	std::array<std::byte, constants::MaxHeaderSize> header;
+	const auto available = CopyHeader(*frame, header);
+	if (available < ip::constants::HeaderSize) return Error();
+
+	const auto slot = std::to_integer<uint8_t>(header[ip::constants::offset::Protocol]);
+	if (slot >= constants::Slots) return Error();
+	header[0] &= std::byte{0x4f};
+	header[ip::constants::offset::Protocol] = std::byte{ip::constants::protocol::TCP};
+
+	const nonstd::span<const std::byte> h{ header.data(), available };
+	const auto ipHeaderSize = IPHeaderSize(h);
+	if (ipHeaderSize < ip::constants::HeaderSize || available < ipHeaderSize + tcp::HeaderSize) return Error();
+	if (HeaderChecksum(h, ipHeaderSize) != 0) return Error();
+	const auto headerSize = ipHeaderSize + TCPHeaderSize(h, ipHeaderSize);
+	if (headerSize < ipHeaderSize + tcp::HeaderSize || headerSize > available) return Error();
+
+	auto& state = states[slot];
+	std::copy_n(h.begin(), headerSize, state.header.begin());
+	state.headerSize = headerSize;
+	currentSlot = slot;
+	tossing = false;
+	++stats.uncompressed;
+
+	// What remains is the original packet
+	Store(*frame, 0, header[0]);
+	Store(*frame, ip::constants::offset::Protocol, header[ip::constants::offset::Protocol]);
+	return frame;
+}
+
+BufferPtr Decompressor::Uncompress(const Buffer& frame)
+{
+	std::array<std::byte, constants::MaxCompressedSize> compressed;
+	const auto available = CopyHeader(frame, compressed);
+	size_t offset = 0;
+
+	const auto changes = std::to_integer<uint8_t>(compressed[offset++]);
+	if (changes & constants::change::C) {
+		if (offset == available) return Error();
+		const auto slot = std::to_integer<uint8_t>(compressed[offset++]);
+		if (slot >= constants::Slots) return Error();
+		currentSlot = slot;
+		tossing = false;
+	} else if (tossing) {
+		++stats.tossed;
+		return {};
+	}
+
+	auto& state = states[currentSlot];
+	if (state.headerSize == 0 || offset + 2 > available) return Error();
+	const nonstd::span<std::byte> h{ state.header.data(), state.headerSize };
+	const auto ipHeaderSize = IPHeaderSize(h);
+	std::copy_n(compressed.begin() + offset, 2, h.begin() + ipHeaderSize + tcp::offset::Checksum);
+	offset += 2;
+
+	bool valid = true;
+	const auto decode = [&]() -> uint16_t {
+		if (offset >= available) {
+			valid = false;
+			return 0;
+		}
+		const auto first = std::to_integer<uint8_t>(compressed[offset++]);
+		if (first != 0) return first;
+		if (offset + 2 > available) {
+			valid = false;
+			return 0;
+		}
+		offset += 2;
+		return Get16(compressed, offset - 2);
+	};
+	const auto add16 = [&](const size_t at, const uint16_t delta) { Put16(h, at, static_cast<uint16_t>(Get16(h, at) + delta)); };
+	const auto add32 = [&](const size_t at, const uint32_t delta) { Put32(h, at, Get32(h, at) + delta); };
+
+	auto flags = Get8(h, ipHeaderSize + tcp::offset::Flags);
+	flags = (changes & constants::change::P) ? (flags | tcp::flag::PSH) : (flags & ~tcp::flag::PSH);
+	const auto payload = static_cast<uint32_t>(Get16(h, ip_offset::TotalLength) - state.headerSize);
+	switch(changes & constants::change::SpecialsMask) {
+		case constants::change::SpecialI:
+			add32(ipHeaderSize + tcp::offset::Ack, payload);
+			add32(ipHeaderSize + tcp::offset::Sequence, payload);
+			break;
+		case constants::change::SpecialD:
+			add32(ipHeaderSize + tcp::offset::Sequence, payload);
+			break;
+		default:
+			if (changes & constants::change::U) {
+				flags |= tcp::flag::URG;
+				Put16(h, ipHeaderSize + tcp::offset::Urgent, decode());
+			} else {
+				flags &= ~tcp::flag::URG;
+			}
+			if (changes & constants::change::W) add16(ipHeaderSize + tcp::offset::Window, decode());
+			if (changes & constants::change::A) add32(ipHeaderSize + tcp::offset::Ack, decode());
+			if (changes & constants::change::S) add32(ipHeaderSize + tcp::offset::Sequence, decode());
+			break;
+	}
+	h[ipHeaderSize + tcp::offset::Flags] = static_cast<std::byte>(flags);
+	add16(ip_offset::Id, (changes & constants::change::I) ? decode() : 1);
+	if (!valid) return Error();
+
+	const auto totalLength = state.headerSize + frame.data().size() - offset;
+	if (totalLength > 0xffff) return Error();
+	Put16(h, ip_offset::TotalLength, static_cast<uint16_t>(totalLength));
+	Put16(h, ip::constants::offset::Checksum, 0);
+	Put16(h, ip::constants::offset::Checksum, HeaderChecksum(h, ipHeaderSize));
+	++stats.compressed;
+
+	auto packet = std::make_unique<Buffer>();
+	std::copy(h.begin(), h.end(), packet->WriteSpan().begin());
+	packet->IncrementFilled(h.size());
+	CopyData(frame, offset, *packet);
+	return packet;
+}
+
+}
+}
+}
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include "nonstd/span.hpp"
+
+namespace netstack {
+
+class Buffer;
+using BufferPtr = std::unique_ptr<Buffer>;
+namespace protocol {
+namespace vj {
+
+// Van Jacobson TCP/IP header compression (RFC 1144), in the wire format of
+// the Linux slhc code used by 'cslip': the packet type is encoded in the
+// first byte of the frame, and there are 16 connection slots on either side
+namespace constants {
+	static constexpr inline size_t Slots = 16;
+	// IP and TCP header with the maximum amount of options
+	static constexpr inline size_t MaxHeaderSize = 120;
+	// Change mask, slot, TCP checksum and five 3-byte deltas
+	static constexpr inline size_t MaxCompressedSize = 19;
+
+namespace type {
+	static constexpr inline uint8_t IP = 0x40;
+	static constexpr inline uint8_t UncompressedTCP = 0x70;
+	static constexpr inline uint8_t CompressedTCP = 0x80;
+}
+namespace change {
+	static constexpr inline uint8_t C = 0x40; // slot number follows
+	static constexpr inline uint8_t I = 0x20; // IP id delta follows
+	static constexpr inline uint8_t P = 0x10; // TCP push flag
+	static constexpr inline uint8_t S = 0x08;
+	static constexpr inline uint8_t A = 0x04;
+	static constexpr inline uint8_t W = 0x02;
+	static constexpr inline uint8_t U = 0x01;
+	// Combinations of S, A, W and U that cannot occur, used to encode
+	// echoed terminal traffic and unidirectional data without deltas
+	static constexpr inline uint8_t SpecialI = S | A | W;
+	static constexpr inline uint8_t SpecialD = S | A | W | U;
+	static constexpr inline uint8_t SpecialsMask = S | A | W | U;
+}
+}
+
+enum class PacketType {
+	IP,
+	UncompressedTCP,
+	CompressedTCP,
+};
+
+PacketType TypeOf(std::byte first);
+
+class Compressor
+{
+public:
+	struct Result {
+		PacketType type;
+		// Goes on the wire in place of the first 'replaced' bytes of the
+		// packet; both are zero if the packet is sent as is
+		std::array<std::byte, constants::MaxHeaderSize> header;
+		size_t headerSize{};
+		size_t replaced{};
+
+		nonstd::span<const std::byte> Header() const { return { header.data(), headerSize }; }
+	};
+
+	struct Stats {
+		uint64_t ip{};
+		uint64_t uncompressed{};
+		uint64_t compressed{};
+	};
+
+	Compressor();
+
+	// Anything that is not a TCP segment carrying a plain ACK is sent as
+	// IP; the first packet of a connection, and any packet whose header
+	// changed in a way the compressed format cannot express, is sent
+	// uncompressed to (re)establish the receiver's state
+	Result Compress(const Buffer& packet);
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct State {
+		std::array<std::byte, constants::MaxHeaderSize> header;
+		size_t headerSize{};
+	};
+
+	std::array<State, constants::Slots> states;
+	// Slot numbers, most recently used first
+	std::array<uint8_t, constants::Slots> lru;
+	// Slot of the previous packet, which compressed packets need not repeat
+	uint8_t lastSlot{0xff};
+	Stats stats;
+
+	uint8_t FindSlot(nonstd::span<const std::byte> header, size_t ipHeaderSize, bool& found);
+};
+
+class Decompressor
+{
+public:
+	struct Stats {
+		uint64_t ip{};
+		uint64_t uncompressed{};
+		uint64_t compressed{};
+		// Compressed packets dropped while waiting for a packet that names
+		// a slot after Toss()
+		uint64_t tossed{};
+		uint64_t errors{};
+	};
+
+	Decompressor();
+
+	// Returns the IP packet carried by a frame, or nullptr if the frame is
+	// to be dropped
+	BufferPtr Decompress(BufferPtr frame);
+
+	// To be called whenever a frame is lost: the state it would have
+	// updated is out of sync, so compressed packets are dropped until the
+	// sender re-establishes a slot
+	void Toss() { tossing = true; }
+
+	const Stats& GetStats() const { return stats; }
+
+private:
+	struct State {
+		std::array<std::byte, constants::MaxHeaderSize> header;
+		size_t headerSize{};
+	};
+
+	std::array<State, constants::Slots> states;
+	uint8_t currentSlot{};
+	bool tossing{true};
+	Stats stats;
+
+	BufferPtr Remember(BufferPtr frame);
+	BufferPtr Uncompress(const Buffer& frame);
+	BufferPtr Error();
+};
+
+}
+}
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace netstack::ratelimit {
+
+struct Config {
+	uint32_t tokensPerSecond{10};
+	uint32_t burst{10};
+};
+
+namespace detail {
+	// Tokens are kept in thousandths, so that a refill of 'tokensPerSecond'
+	// tokens amounts to 'tokensPerSecond' units per millisecond
+	static constexpr inline uint32_t Scale = 1000;
+
+	inline void Refill(const Config& config, uint32_t& tokens, uint32_t& lastRefill, const uint32_t now)
+	{
+		const uint64_t elapsed = now - lastRefill;
+		tokens = static_cast<uint32_t>(std::min<uint64_t>(config.burst * Scale, tokens + elapsed * config.tokensPerSecond));
+		lastRefill = now;
+	}
+}
+
+// A single token bucket, for a limit on everything together. Checking and
+// taking are separate, so that a token is only spent once all other limits
+// agree. Not thread-safe.
+class TokenBucket
+{
+public:
+	explicit TokenBucket(const Config& config = {}) : config(config), tokens(config.burst * detail::Scale) { }
+
+	// Refills the bucket; returns whether it has a token to take
+	bool Check(const uint64_t nowMs)
+	{
+		detail::Refill(config, tokens, lastRefill, static_cast<uint32_t>(nowMs));
+		return tokens >= detail::Scale;
+	}
+	// Only after Check() returned true
+	void Take() { tokens -= detail::Scale; }
+
+private:
+	Config config;
+	uint32_t tokens;
+	uint32_t lastRefill{};
+};
+
+// Fixed-size table of token buckets indexed by an arbitrary 64-bit key. It
+// uses open addressing with a short probe window; when the window is full,
+// the least recently refilled bucket is evicted, so memory use is bounded
+// no matter how many distinct keys are seen. Buckets are refilled lazily on
+// access, so no timer is needed. Not thread-safe; use one table per thread.
+template<size_t Capacity, size_t ProbeLength = 8>
+class TokenBucketTable
+{
+	static_assert((Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+	static_assert(ProbeLength <= Capacity, "probe window larger than table");
+
+	static constexpr inline uint32_t Scale = detail::Scale;
+	static constexpr inline uint32_t Empty = UINT32_MAX;
+
+	struct Entry {
+		uint64_t key{};
+		uint32_t tokens{Empty};
+		uint32_t lastRefill{};
+	};
+
+public:
+	explicit TokenBucketTable(const Config& config = {}) : config(config) { }
+
+	// Takes a token from the bucket of 'key'; returns false if it is empty
+	bool Allow(const uint64_t key, const uint64_t nowMs)
+	{
+		const auto now = static_cast<uint32_t>(nowMs);
+		const auto start = Hash(key);
+		Entry* victim = nullptr;
+		for (size_t n = 0; n < ProbeLength; ++n) {
+			auto& entry = entries[(start + n) & (Capacity - 1)];
+			if (entry.tokens == Empty) {
+				if (victim == nullptr || victim->tokens != Empty)
+					victim = &entry;
+				continue;
+			}
+			if (entry.key == key)
+				return Take(entry, now);
+			if (victim == nullptr || (victim->tokens != Empty && static_cast<int32_t>(entry.lastRefill - victim->lastRefill) < 0))
+				victim = &entry;
+		}
+
+		victim->key = key;
+		victim->tokens = MaxTokens();
+		victim->lastRefill = now;
+		return Take(*victim, now);
+	}
+
+private:
+	static size_t Hash(const uint64_t key)
+	{
+		return static_cast<size_t>((key * 0x9e3779b97f4a7c15ull) >> 32);
+	}
+
+	uint32_t MaxTokens() const { return config.burst * Scale; }
+
+	bool Take(Entry& entry, const uint32_t now)
+	{
+		detail::Refill(config, entry.tokens, entry.lastRefill, now);
+		if (entry.tokens < Scale) return false;
+		entry.tokens -= Scale;
+		return true;
+	}
+
+	Config config;
+	std::array<Entry, Capacity> entries{};
+};
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <thread>
+#include "ring.h"
+
+namespace netstack::rcu {
+	// Minimal user-space RCU: every reading thread owns a slot with a counter
+	// that is odd while the thread is inside a read-side critical section.
+	// Synchronize() waits until every reader that was inside a critical
+	// section when it was called has left it; readers never block.
+	namespace detail {
+		static constexpr inline size_t MaxReaders = 128;
+
+		struct alignas(CacheLineSize) ReaderSlot {
+			std::atomic<uint64_t> counter{};
+			std::atomic<bool> inUse{};
+		};
+
+		inline std::array<ReaderSlot, MaxReaders>& Slots()
+		{
+			static std::array<ReaderSlot, MaxReaders> slots;
+			return slots;
+		}
+
+		struct ThreadState {
+			ThreadState()
+			{
+				for (auto& s : Slots()) {
+					bool expected = false;
+					if (s.inUse.compare_exchange_strong(expected, true)) {
+						slot = &s;
+						break;
+					}
+				}
+				assert(slot != nullptr && "too many RCU reader threads");
+			}
+
+			~ThreadState()
+			{
+				slot->inUse.store(false, std::memory_order_release);
+			}
+
+			ReaderSlot* slot{};
+			unsigned int nesting{};
+		};
+
+		inline ThreadState& State()
+		{
+			thread_local ThreadState state;
+			return state;
+		}
+	}
+
+	class ReadGuard
+	{
+	public:
+		ReadGuard() : state(detail::State())
+		{
+			if (state.nesting++ == 0)
+				state.slot->counter.fetch_add(1, std::memory_order_seq_cst);
+		}
+
+		~ReadGuard()
+		{
+			if (--state.nesting == 0)
+				state.slot->counter.fetch_add(1, std::memory_order_release);
+		}
+
+		ReadGuard(const ReadGuard&) = delete;
+		ReadGuard& operator=(const ReadGuard&) = delete;
+
+	private:
+		detail::ThreadState& state;
+	};
+
+	inline void Synchronize()
+	{
+		std::atomic_thread_fence(std::memory_order_seq_cst);
+		auto& slots = detail::Slots();
+		std::array<uint64_t, detail::MaxReaders> snapshot;
+		for (size_t n = 0; n < slots.size(); ++n)
+			snapshot[n] = slots[n].counter.load(std::memory_order_seq_cst);
+
+		for (size_t n = 0; n < slots.size(); ++n) {
+			if ((snapshot[n] & 1) == 0) continue;
+			while (slots[n].counter.load(std::memory_order_acquire) == snapshot[n])
+				std::this_thread::yield();
+		}
+	}
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include "nonstd/span.hpp"
+
+namespace netstack {
+	static constexpr inline size_t CacheLineSize = 64;
+
+	// Bounded single-producer/single-consumer ring. Each side caches the
+	// other side's index so that the shared cache lines are only touched
+	// when the ring appears to be full/empty.
+	template<typename T, size_t Capacity>
+	class SPSCRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+		static constexpr inline size_t Mask = Capacity - 1;
+
+	public:
+		bool Push(T&& item)
+		{
+			return PushBurst(nonstd::span<T>{&item, 1}) == 1;
+		}
+
+		std::optional<T> Pop()
+		{
+			T item;
+			if (PopBurst(nonstd::span<T>{&item, 1}) == 0)
+				return {};
+			return item;
+		}
+
+		// Moves up to items.size() entries into the ring; returns the number moved
+		size_t PushBurst(nonstd::span<T> items)
+		{
+			const auto t = tail.load(std::memory_order_relaxed);
+			if (Capacity - (t - cachedHead) < items.size())
+				cachedHead = head.load(std::memory_order_acquire);
+			const auto amount = std::min(items.size(), Capacity - (t - cachedHead));
+			for (size_t n = 0; n < amount; ++n)
+				slots[(t + n) & Mask] = std::move(items[n]);
+			tail.store(t + amount, std::memory_order_release);
+			return amount;
+		}
+
+		// Moves up to items.size() entries out of the ring; returns the number moved
+		size_t PopBurst(nonstd::span<T> items)
+		{
+			const auto h = head.load(std::memory_order_relaxed);
+			if (cachedTail - h < items.size())
+				cachedTail = tail.load(std::memory_order_acquire);
+			const auto amount = std::min(items.size(), cachedTail - h);
+			for (size_t n = 0; n < amount; ++n)
+				items[n] = std::move(slots[(h + n) & Mask]);
+			head.store(h + amount, std::memory_order_release);
+			return amount;
+		}
+
+		size_t Size() const
+		{
+			return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+		}
+
+		bool Empty() const { return Size() == 0; }
+
+	private:
+		alignas(CacheLineSize) std::atomic<size_t> head{};
+		size_t cachedTail{};
+		alignas(CacheLineSize) std::atomic<size_t> tail{};
+		size_t cachedHead{};
+		alignas(CacheLineSize) std::array<T, Capacity> slots{};
+	};
+
+	// Bounded multi-producer/single-consumer ring. Producers reserve a range of
+	// slots using a CAS on the tail; every slot carries a sequence number which
+	// tells the consumer when the producer has finished storing into it.
+	template<typename T, size_t Capacity>
+	class MPSCRing
+	{
+		static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity must be a power of two");
+		static constexpr inline size_t Mask = Capacity - 1;
+
+		struct Slot {
+			std::atomic<size_t> sequence;
+			T item;
+		};
+
+	public:
+		MPSCRing()
+		{
+			for (size_t n = 0; n < Capacity; ++n)
+				slots[n].sequence.store(n, std::memory_order_relaxed);
+		}
+
+		bool Push(T&& item)
+		{
+			return PushBurst(nonstd::span<T>{&item, 1}) == 1;
+		}
+
+		std::optional<T> Pop()
+		{
+			T item;
+			if (PopBurst(nonstd::span<T>{&item, 1}) == 0)
+				return {};
+			return item;
+		}
+
+		// Moves up to items.size() entries into the ring; returns the number moved
+		size_t PushBurst(nonstd::span<T> items)
+		{
+			if (items.empty())
+				return 0;
+
+			auto t = tail.load(std::memory_order_relaxed);
+			size_t amount;
+			for(;;) {
+				if (!IsFree(t)) {
+					const auto current = tail.load(std::memory_order_relaxed);
+					if (current == t)
+						return 0;
+					t = current;
+					continue;
+				}
+
+				// The consumer frees slots in order, so the free slots form a
+				// run starting at t; binary search for the end of it
+				size_t lo = 1, hi = std::min(items.size(), Capacity);
+				while (lo < hi) {
+					const auto mid = lo + (hi - lo + 1) / 2;
+					if (IsFree(t + mid - 1))
+						lo = mid;
+					else
+						hi = mid - 1;
+				}
+				amount = lo;
+				if (tail.compare_exchange_weak(t, t + amount, std::memory_order_relaxed))
+					break;
+			}
+
+			for (size_t n = 0; n < amount; ++n) {
+				auto& slot = slots[(t + n) & Mask];
+				slot.item = std::move(items[n]);
+				slot.sequence.store(t + n + 1, std::memory_order_release);
+			}
+			return amount;
+		}
+
+		// Moves up to items.size() entries out of the ring; returns the number moved
+		size_t PopBurst(nonstd::span<T> items)
+		{
+			size_t amount = 0;
+			for (; amount < items.size(); ++amount, ++head) {
+				auto& slot = slots[head & Mask];
+				if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+					break;
+				items[amount] = std::move(slot.item);
+				slot.sequence.store(head + Capacity, std::memory_order_release);
+			}
+			return amount;
+		}
+
+	private:
+		bool IsFree(const size_t position) const
+		{
+			return slots[position & Mask].sequence.load(std::memory_order_acquire) == position;
+		}
+
+		alignas(CacheLineSize) std::atomic<size_t> tail{};
+		alignas(CacheLineSize) size_t head{};
+		alignas(CacheLineSize) std::array<Slot, Capacity> slots;
+	};
+}
@@ -0,0 +1,192 @@
+#include "routing.h"
+#include <algorithm>
+#include <array>
+#include "rcu.h"
+
+namespace netstack::routing {
+
+namespace detail {
+
+// Entries are either 0 (no route), a next hop index + 1, or a reference to a
+// group of 256 entries for the next 8 address bits
+using Entry = uint32_t;
+static constexpr inline Entry GroupFlag = 0x80000000;
+using Group = std::array<Entry, 256>;
+
+struct Fib {
+	std::vector<Entry> tbl16 = std::vector<Entry>(65536);
+	std::vector<Group> groups;
+	std::vector<NextHop> nextHops;
+
+	// Returns the group entry replacing the given entry; a new group inherits
+	// the value of the entry it replaces
+	Entry ExpandToGroup(const Entry entry)
+	{
+		if (entry & GroupFlag) return entry;
+		Group group;
+		group.fill(entry);
+		groups.push_back(group);
+		return GroupFlag | static_cast<Entry>(groups.size() - 1);
+	}
+
+	// Routes must be painted in order of increasing prefix length; a longer
+	// prefix then simply overwrites the entries of the shorter ones it covers
+	void Paint(const Route& route)
+	{
+		nextHops.push_back(route.nextHop);
+		const auto value = static_cast<Entry>(nextHops.size());
+
+		const auto Fill = [&](Entry* first, const size_t count) {
+			std::fill(first, first + count, value);
+		};
+
+		const auto addr = route.prefix;
+		if (route.length <= 16) {
+			Fill(&tbl16[addr >> 16], size_t(1) << (16 - route.length));
+			return;
+		}
+
+		const auto entry2 = ExpandToGroup(tbl16[addr >> 16]);
+		tbl16[addr >> 16] = entry2;
+		const auto level2 = entry2 & ~GroupFlag;
+		if (route.length <= 24) {
+			Fill(&groups[level2][(addr >> 8) & 0xff], size_t(1) << (24 - route.length));
+			return;
+		}
+
+		const auto entry3 = ExpandToGroup(groups[level2][(addr >> 8) & 0xff]);
+		groups[level2][(addr >> 8) & 0xff] = entry3;
+		const auto level3 = entry3 & ~GroupFlag;
+		Fill(&groups[level3][addr & 0xff], size_t(1) << (32 - route.length));
+	}
+
+	const Entry* Level1(const uint32_t addr) const
+	{
+		return &tbl16[addr >> 16];
+	}
+
+	std::optional<NextHop> Resolve(Entry entry, const uint32_t addr) const
+	{
+		if (entry & GroupFlag) {
+			entry = groups[entry & ~GroupFlag][(addr >> 8) & 0xff];
+			if (entry & GroupFlag)
+				entry = groups[entry & ~GroupFlag][addr & 0xff];
+		}
+		if (entry == 0) return {};
+		return nextHops[entry - 1];
+	}
+};
+
+}
+
+namespace {
+
+uint32_t Mask(const uint8_t length)
+{
+	return length == 0 ? 0 : ~uint32_t(0) << (32 - length);
+}
+
+}
+
+Table::Table()
+{
+	Publish();
+}
+
+Table::~Table()
+{
+	delete fib.load();
+}
+
+Result Table::Add(const Route& route)
+{
+	if (route.length > 32) return Result::InvalidPrefixLength;
+	std::lock_guard lock(updateMutex);
+	Route normalized{route};
+	normalized.prefix &= Mask(route.length);
+	auto it = std::find_if(routes.begin(), routes.end(), [&](const auto& r) {
+		return r.prefix == normalized.prefix && r.length == normalized.length;
+	});
+	if (it != routes.end())
+		*it = normalized;
+	else
+		routes.push_back(normalized);
+	Publish();
+	return Result::Success;
+}
+
+Result Table::Remove(const uint32_t prefix, const uint8_t length)
+{
+	if (length > 32) return Result::InvalidPrefixLength;
+	std::lock_guard lock(updateMutex);
+	auto it = std::find_if(routes.begin(), routes.end(), [&](const auto& r) {
+		return r.prefix == (prefix & Mask(length)) && r.length == length;
+	});
+	if (it == routes.end()) return Result::NotFound;
+	routes.erase(it);
+	Publish();
+	return Result::Success;
+}
+
+void Table::Replace(std::vector<Route> newRoutes)
+{
+	std::lock_guard lock(updateMutex);
+	routes.clear();
+	for (auto& route : newRoutes) {
+		if (route.length > 32) continue;
+		route.prefix &= Mask(route.length);
+		routes.push_back(route);
+	}
+	Publish();
+}
+
+std::vector<Route> Table::Routes() const
+{
+	std::lock_guard lock(updateMutex);
+	return routes;
+}
+
+void Table::Publish()
+{
+	auto sorted = routes;
+	std::stable_sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.length < b.length; });
+
+	auto newFib = new detail::Fib;
+	for (const auto& route : sorted)
+		newFib->Paint(route);
+
+	const auto oldFib = fib.exchange(newFib, std::memory_order_seq_cst);
+	if (oldFib != nullptr) {
+		rcu::Synchronize();
+		delete oldFib;
+	}
+}
+
+std::optional<NextHop> Table::Lookup(const uint32_t addr) const
+{
+	rcu::ReadGuard guard;
+	const auto current = fib.load(std::memory_order_seq_cst);
+	return current->Resolve(*current->Level1(addr), addr);
+}
+
+void Table::Lookup(nonstd::span<const uint32_t> addrs, nonstd::span<std::optional<NextHop>> nextHops) const
+{
+	rcu::ReadGuard guard;
+	const auto current = fib.load(std::memory_order_seq_cst);
+	const auto count = std::min(addrs.size(), nextHops.size());
+	for (size_t offset = 0; offset < count; offset += BulkLookupSize) {
+		const auto chunk = std::min(BulkLookupSize, count - offset);
+
+		// Issue all first-level loads of a chunk before resolving any of them,
+		// so their cache misses overlap
+		std::array<const detail::Entry*, BulkLookupSize> level1;
+		for (size_t n = 0; n < chunk; ++n) {
+			level1[n] = current->Level1(addrs[offset + n]);
+			__builtin_prefetch(level1[n]);
+		}
+		for (size_t n = 0; n < chunk; ++n)
+			nextHops[offset + n] = current->Resolve(*level1[n], addrs[offset + n]);
+	}
+}
+
+}
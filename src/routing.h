@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include "nonstd/span.hpp"
+
+namespace netstack::routing {
+
+struct NextHop {
+	size_t interface{};
+	uint32_t gateway{}; // 0 for directly connected destinations
+};
+
+struct Route {
+	uint32_t prefix{};
+	uint8_t length{};
+	NextHop nextHop;
+};
+
+enum class Result {
+	Success,
+	InvalidPrefixLength,
+	NotFound,
+};
+
+namespace detail { struct Fib; }
+
+// IPv4 routing table with longest-prefix-match lookups. Lookups run against
+// an immutable, DIR-16-8-8 style forwarding table (at most three dependent
+// loads) which is rebuilt and swapped in on every update; readers never take
+// a lock and old tables are reclaimed once no reader can still see them.
+class Table
+{
+public:
+	static constexpr inline size_t BulkLookupSize = 32;
+
+	Table();
+	~Table();
+	Table(const Table&) = delete;
+	Table& operator=(const Table&) = delete;
+
+	// Adds the route, replacing any existing route for the same prefix
+	Result Add(const Route& route);
+	Result Remove(uint32_t prefix, uint8_t length);
+	void Replace(std::vector<Route> routes);
+	std::vector<Route> Routes() const;
+
+	std::optional<NextHop> Lookup(uint32_t addr) const;
+	// Looks up all addresses within a single read-side critical section
+	void Lookup(nonstd::span<const uint32_t> addrs, nonstd::span<std::optional<NextHop>> nextHops) const;
+
+private:
+	void Publish();
+
+	mutable std::mutex updateMutex;
+	std::vector<Route> routes;
+	std::atomic<const detail::Fib*> fib{};
+};
+
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include "buffer.h"
 #include "range/v3/algorithm/for_each.hpp"
 
@@ -11,29 +13,47 @@ namespace netstack::slip {
 		static constexpr inline std::byte ESC_ESC{0xdd};
 	}
 	
-	template<typename TransmitFn> void Transmit(Buffer& buffer, TransmitFn&& transmit)
+	// Returns whether the byte needed escaping
+	template<typename TransmitFn> bool TransmitEscaped(const std::byte byte, TransmitFn&& transmit)
 	{
+		switch(byte) {
+			case constants::END:
+				transmit(constants::ESC);
+				transmit(constants::ESC_END);
+				return true;
+			case constants::ESC:
+				transmit(constants::ESC);
+				transmit(constants::ESC_ESC);
+				return true;
+			default:
+				transmit(byte);
+				return false;
+		}
+	}
+
+	// Sends 'header' followed by the contents of 'buffer' past the first
+	// 'skip' bytes as a single frame, i.e. with the packet's own header
+	// replaced by a compressed one. Returns the number of escaped bytes.
+	template<typename TransmitFn> size_t Transmit(nonstd::span<const std::byte> header, const Buffer& buffer, size_t skip, TransmitFn&& transmit)
+	{
+		size_t escapes = 0;
+		const auto escaped = [&](const auto byte) { escapes += TransmitEscaped(byte, transmit); };
 		transmit(constants::END);
+		ranges::for_each(header, escaped);
 		ranges::for_each(buffer.chain(), [&](const auto buffer)
 		{
-			ranges::for_each(buffer->ReadSpan(), [&](const auto byte)
-			{
-				switch(byte) {
-					case constants::END:
-						transmit(constants::ESC);
-						transmit(constants::ESC_END);
-						break;
-					case constants::ESC:
-						transmit(constants::ESC);
-						transmit(constants::ESC_ESC);
-						break;
-					default:
-						transmit(byte);
-						break;
-				}
-			});
+			auto span = buffer->ReadSpan();
+			const auto skipped = std::min(skip, span.size());
+			skip -= skipped;
+			ranges::for_each(span.subspan(skipped), escaped);
 		});
 		transmit(constants::END);
+		return escapes;
+	}
+
+	template<typename TransmitFn> size_t Transmit(const Buffer& buffer, TransmitFn&& transmit)
+	{
+		return Transmit({}, buffer, 0, transmit);
 	}
 
 	template<typename Container, typename OnByteFn, typename OnEndFn> typename Container::const_iterator Decode(const Container& container, OnByteFn&& onByte, OnEndFn&& onEnd)
@@ -68,4 +88,90 @@ namespace netstack::slip {
 		}
 		return it;
 	}
-}
\ No newline at end of file
+
+	// Resumable decoder: the state of a frame, including a pending escape, is
+	// kept between calls, so every call consumes all of its input.
+	//
+	// onEnd() is called at the end of each frame; onEnd(false) means the
+	// bytes passed on since the previous frame end must be discarded. That
+	// happens to frames exceeding the maximum size, and to frames that end in
+	// the middle of an escape sequence.
+	class Decoder
+	{
+	public:
+		static constexpr inline size_t DefaultMaxFrameSize = 65536;
+
+		struct Stats {
+			// Frames discarded, for whatever reason
+			uint64_t dropped{};
+			uint64_t oversized{};
+			uint64_t invalidEscapes{};
+			uint64_t escapes{};
+		};
+
+		explicit Decoder(const size_t maxFrameSize = DefaultMaxFrameSize) : maxFrameSize(maxFrameSize) { }
+
+		const Stats& GetStats() const { return stats; }
+
+		template<typename Container, typename OnByteFn, typename OnEndFn> typename Container::const_iterator Decode(const Container& container, OnByteFn&& onByte, OnEndFn&& onEnd)
+		{
+			for (auto byte : container) {
+				if (byte == constants::END) {
+					// An END always ends the frame, so that a corrupt frame
+					// cannot swallow the next one
+					if (escaped) {
+						++stats.invalidEscapes;
+						if (!discarding) ++stats.dropped;
+						discarding = true;
+					}
+					if (discarding)
+						onEnd(false);
+					else
+						onEnd();
+					escaped = discarding = false;
+					frameSize = 0;
+					continue;
+				}
+
+				if (escaped) {
+					escaped = false;
+					++stats.escapes;
+					if (byte == constants::ESC_END)
+						byte = constants::END;
+					else if (byte == constants::ESC_ESC)
+						byte = constants::ESC;
+					else // RFC 1055: leave the byte alone and put it in the frame
+						++stats.invalidEscapes;
+				} else if (byte == constants::ESC) {
+					escaped = true;
+					continue;
+				}
+
+				if (discarding) continue;
+				if (++frameSize > maxFrameSize) {
+					++stats.oversized;
+					Discard(onEnd);
+					continue;
+				}
+				onByte(byte);
+			}
+			return container.end();
+		}
+
+	private:
+		template<typename OnEndFn> void Discard(OnEndFn&& onEnd)
+		{
+			if (discarding) return;
+			discarding = true;
+			++stats.dropped;
+			// Lets the receiver free what it has collected right away
+			onEnd(false);
+		}
+
+		const size_t maxFrameSize;
+		size_t frameSize{};
+		bool escaped{};
+		bool discarding{};
+		Stats stats;
+	};
+}
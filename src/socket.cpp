@@ -0,0 +1,128 @@
+#include "socket.h"
+#include "protocols/ip.h"
+#include "protocols/udp.h"
+#include "stats.h"
+
+#include <cerrno>
+#include <utility>
+
+namespace netstack::socket {
+
+Stack::~Stack()
+{
+	for (const auto handle : ready)
+		handle.destroy();
+	// The frames usually own the sockets they wait on, which then unbind
+	// themselves; the others are unbound here
+	while (!udpSockets.empty()) {
+		const auto port = udpSockets.begin()->first;
+		if (const auto waiter = std::exchange(udpSockets.begin()->second->waiter, {}); waiter)
+			waiter.destroy();
+		if (const auto it = udpSockets.find(port); it != udpSockets.end())
+			it->second->Unbind();
+	}
+}
+
+bool Stack::Deliver(const protocol::ip::Header& ipHeader, const protocol::udp::Header& udpHeader, BufferPtr& buffer)
+{
+	const auto it = udpSockets.find(udpHeader.destPort);
+	if (it == udpSockets.end() || (it->second->local.addr != 0 && it->second->local.addr != ipHeader.destAddr)) {
+		stats::Add(stats::Id::UDPNoPort);
+		return false;
+	}
+
+	// The headers are always in the first segment, as the devices never
+	// split a packet before the first kilobyte
+	buffer->Consume(ipHeader.headerSize + protocol::udp::constants::HeaderSize);
+	Datagram datagram{ std::move(buffer), { ipHeader.sourceAddr, udpHeader.sourcePort }, { ipHeader.destAddr, udpHeader.destPort } };
+	if (!it->second->Push(std::move(datagram)))
+		stats::Add(stats::Id::UDPReceiveQueueDrops);
+	return true;
+}
+
+size_t Stack::Run()
+{
+	// Coroutines resumed here may well complete further operations
+	// before this returns; they are left to the next call
+	resuming.swap(ready);
+	for (const auto handle : resuming)
+		handle.resume();
+	const auto amount = resuming.size();
+	resuming.clear();
+	return amount;
+}
+
+std::optional<ErrorCode> UDPSocket::Bind(const Endpoint& endpoint)
+{
+	if (bound) return EINVAL;
+	auto port = endpoint.port;
+	if (port == 0) {
+		// Try every ephemeral port once, starting after the last one used
+		for (size_t n = 0; n < 65536 - Stack::FirstEphemeralPort && port == 0; ++n) {
+			const auto candidate = stack.nextEphemeralPort;
+			stack.nextEphemeralPort = candidate == 65535 ? Stack::FirstEphemeralPort : static_cast<uint16_t>(candidate + 1);
+			if (stack.udpSockets.count(candidate) == 0) port = candidate;
+		}
+		if (port == 0) return EADDRINUSE;
+	}
+	if (!stack.udpSockets.try_emplace(port, this).second) return EADDRINUSE;
+
+	local = { endpoint.addr, port };
+	bound = true;
+	return {};
+}
+
+void UDPSocket::Close()
+{
+	Unbind();
+	if (waiter) {
+		stack.Ready(waiter);
+		waiter = {};
+	}
+}
+
+void UDPSocket::Unbind()
+{
+	if (!bound) return;
+	stack.udpSockets.erase(local.port);
+	bound = false;
+	for (; queued > 0; --queued) {
+		queue[head].data.reset();
+		head = (head + 1) % QueueLength;
+	}
+}
+
+bool UDPSocket::Push(Datagram datagram)
+{
+	if (queued == QueueLength) return false;
+	queue[(head + queued) % QueueLength] = std::move(datagram);
+	++queued;
+	if (waiter) {
+		stack.Ready(waiter);
+		waiter = {};
+	}
+	return true;
+}
+
+Datagram UDPSocket::Pop()
+{
+	if (queued == 0) return {};
+	auto datagram = std::move(queue[head]);
+	head = (head + 1) % QueueLength;
+	--queued;
+	return datagram;
+}
+
+std::optional<ErrorCode> UDPSocket::SendNow(Datagram datagram)
+{
+	const auto sourceAddr = datagram.source.addr != 0 ? datagram.source.addr : local.addr;
+	if (sourceAddr == 0 || !bound) return EADDRNOTAVAIL;
+
+	auto packet = protocol::udp::Construct(sourceAddr, local.port, datagram.destination.addr, datagram.destination.port, std::move(datagram.data));
+	if (!packet) return EMSGSIZE;
+	if (!stack.transmit(std::move(packet))) return ENOBUFS;
+	stats::Add(stats::Id::UDPSent);
+	return {};
+}
+
+}
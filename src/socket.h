@@ -0,0 +1,181 @@
+#pragma once
+
+#include <array>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "buffer.h"
+
+namespace netstack {
+namespace protocol {
+namespace ip { struct Header; }
+namespace udp { struct Header; }
+}
+
+// Sockets for applications running on top of the stack, as C++20
+// coroutines:
+//
+//	socket::Task Echo(socket::Stack& stack)
+//	{
+//		socket::UDPSocket socket(stack);
+//		if (socket.Bind({ 0, 7 })) co_return;
+//		for (;;) {
+//			auto datagram = co_await socket.Receive();
+//			std::swap(datagram.source, datagram.destination);
+//			co_await socket.Send(std::move(datagram));
+//		}
+//	}
+//
+// Payloads are passed as buffer chains, by ownership, so neither receiving
+// nor sending copies them. A suspended coroutine is resumed by the Stack
+// it waits on, from the loop of the thread that owns the stack, so a
+// socket costs a few hundred bytes and no thread or allocation of its own.
+namespace socket {
+
+using ErrorCode = int;
+
+struct Endpoint {
+	uint32_t addr{};
+	uint16_t port{};
+
+	friend bool operator==(const Endpoint&, const Endpoint&) = default;
+};
+
+struct Datagram {
+	// The payload, without any headers
+	BufferPtr data;
+	Endpoint source;
+	Endpoint destination;
+};
+
+// A coroutine that starts running when called and frees itself when it
+// returns; nothing waits for it
+struct Task {
+	struct promise_type {
+		Task get_return_object() { return {}; }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() { }
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+class UDPSocket;
+
+// The sockets of one thread: received datagrams are handed to them by
+// Deliver() and the coroutines waiting for them are resumed by Run(), which
+// the thread calls from its loop. Not thread-safe; use one stack per
+// thread. Coroutines still waiting on its sockets when the stack is
+// destroyed are destroyed along with it.
+class Stack
+{
+public:
+	// Queues a packet for transmission; returns false if it was dropped
+	using Transmit = std::function<bool(BufferPtr)>;
+
+	explicit Stack(Transmit transmit) : transmit(std::move(transmit)) { }
+	~Stack();
+
+	Stack(const Stack&) = delete;
+	Stack& operator=(const Stack&) = delete;
+
+	// Hands a parsed UDP packet addressed to this host to the socket bound
+	// to its destination, taking the buffer; returns false and leaves the
+	// buffer alone if there is no such socket
+	bool Deliver(const protocol::ip::Header& ipHeader, const protocol::udp::Header& udpHeader, BufferPtr& buffer);
+
+	// Resumes the coroutines whose operations completed since the last
+	// call; returns their number
+	size_t Run();
+
+private:
+	friend class UDPSocket;
+
+	// Ephemeral ports, as suggested by RFC 6335
+	static constexpr inline uint16_t FirstEphemeralPort = 49152;
+
+	void Ready(std::coroutine_handle<> handle) { ready.push_back(handle); }
+
+	Transmit transmit;
+	std::unordered_map<uint16_t, UDPSocket*> udpSockets;
+	uint16_t nextEphemeralPort{FirstEphemeralPort};
+	std::vector<std::coroutine_handle<>> ready;
+	std::vector<std::coroutine_handle<>> resuming;
+};
+
+// A UDP endpoint. Datagrams arriving while the application is busy are
+// queued, up to QueueLength of them; further ones are dropped, like a full
+// socket buffer would. Only one coroutine may wait on a socket at a time.
+class UDPSocket
+{
+public:
+	static constexpr inline size_t QueueLength = 8;
+
+	explicit UDPSocket(Stack& stack) : stack(stack) { }
+	~UDPSocket() { Unbind(); }
+
+	UDPSocket(const UDPSocket&) = delete;
+	UDPSocket& operator=(const UDPSocket&) = delete;
+
+	// Binds the socket to a local port, or an ephemeral one if the port is
+	// zero, and optionally a local address; with a zero address, datagrams
+	// to any address of the host are received
+	std::optional<ErrorCode> Bind(const Endpoint& local);
+	// Drops the queued datagrams; a coroutine waiting to receive gets a
+	// datagram without data
+	void Close();
+
+	const Endpoint& Local() const { return local; }
+
+	struct ReceiveOperation {
+		UDPSocket& socket;
+
+		bool await_ready() const { return socket.queued > 0; }
+		void await_suspend(std::coroutine_handle<> handle) { socket.waiter = handle; }
+		Datagram await_resume() { return socket.Pop(); }
+	};
+
+	// UDP never waits for the network, so sending completes immediately;
+	// the operation only exists to keep the interface of stream sockets
+	struct SendOperation {
+		UDPSocket& socket;
+		Datagram datagram;
+
+		bool await_ready() const { return true; }
+		void await_suspend(std::coroutine_handle<>) { }
+		std::optional<ErrorCode> await_resume() { return socket.SendNow(std::move(datagram)); }
+	};
+
+	// Waits for the next datagram
+	ReceiveOperation Receive() { return { *this }; }
+
+	// Sends the payload to the destination; the port of the source is the
+	// socket's own and a zero source address is replaced by the socket's
+	// address. Fails with EADDRNOTAVAIL if neither is set, EMSGSIZE if the
+	// payload is too large and ENOBUFS if it cannot be queued.
+	SendOperation Send(Datagram datagram) { return { *this, std::move(datagram) }; }
+
+private:
+	friend class Stack;
+
+	void Unbind();
+	bool Push(Datagram datagram);
+	Datagram Pop();
+	std::optional<ErrorCode> SendNow(Datagram datagram);
+
+	Stack& stack;
+	Endpoint local;
+	bool bound{};
+	std::coroutine_handle<> waiter;
+	std::array<Datagram, QueueLength> queue;
+	size_t head{};
+	size_t queued{};
+};
+
+}
+}
@@ -0,0 +1,210 @@
+#include "stats.h"
+#include <algorithm>
+#include <cerrno>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "drivers/netdevice.h"
+
+namespace netstack::stats {
+
+namespace {
+
+constexpr std::array<std::string_view, NumberOfCounters> counterNames{
+	"ip.received",
+	"ip.unsupported",
+	"ip.not_enough_data",
+	"ip.invalid_version",
+	"ip.corrupt_header",
+	"ip.checksum_error",
+	"icmp.received",
+	"icmp.unsupported",
+	"icmp.not_enough_data",
+	"icmp.checksum_error",
+	"icmp.echo_replies",
+	"icmp.errors_sent",
+	"icmp.errors_rate_limited",
+	"udp.received",
+	"udp.not_enough_data",
+	"udp.corrupt_header",
+	"udp.checksum_error",
+	"udp.no_port",
+	"udp.receive_queue_drops",
+	"udp.sent",
+	"forward.forwarded",
+	"forward.local",
+	"forward.invalid",
+	"forward.no_route",
+	"forward.time_exceeded",
+	"slip.tx_escapes",
+	"slip.rx_escapes",
+	"ring.receive_drops",
+	"ring.transmit_drops",
+	"trace.packets",
+	"trace.drops",
+	"filter.drops",
+};
+
+constexpr std::array<std::string_view, NumberOfDeviceCounters> deviceCounterNames{
+	"rx_packets", "rx_bytes", "rx_dropped", "rx_errors",
+	"tx_packets", "tx_bytes", "tx_dropped", "tx_errors",
+};
+
+template<size_t N> void CopyName(std::array<char, N>& dest, const std::string_view name)
+{
+	dest.fill('\0');
+	std::copy_n(name.begin(), std::min(name.size(), N - 1), dest.begin());
+}
+
+void Initialize(Table& table)
+{
+	table.magic = Table::Magic;
+	table.version = Table::Version;
+	table.numberOfCounters = NumberOfCounters;
+	table.numberOfSlots = NumberOfSlots;
+	table.numberOfLatencyBuckets = latency::Enabled ? latency::NumberOfBuckets : 0;
+	table.ticksPerNanosecond = latency::Enabled ? latency::TicksPerNanosecond() : 1.0;
+	for (size_t n = 0; n < NumberOfCounters; ++n)
+		CopyName(table.counterNames[n], counterNames[n]);
+	for (size_t n = 0; n < NumberOfDeviceCounters; ++n)
+		CopyName(table.deviceCounterNames[n], deviceCounterNames[n]);
+}
+
+Snapshot Aggregate(const Table& table)
+{
+	Snapshot snapshot;
+	snapshot.sequence = table.sequence.load(std::memory_order_acquire);
+	snapshot.ticksPerNanosecond = table.ticksPerNanosecond;
+	for (const auto& slot : table.slots) {
+		for (size_t n = 0; n < NumberOfCounters; ++n)
+			snapshot.counters[n] += slot.values[n].load(std::memory_order_relaxed);
+		for (size_t stage = 0; stage < snapshot.latency.size(); ++stage) {
+			for (size_t bucket = 0; bucket < latency::NumberOfBuckets; ++bucket)
+				snapshot.latency[stage][bucket] += slot.latency[stage][bucket].load(std::memory_order_relaxed);
+		}
+	}
+	const auto numberOfDevices = std::min<size_t>(table.numberOfDevices.load(std::memory_order_acquire), MaxDevices);
+	for (size_t n = 0; n < numberOfDevices; ++n) {
+		const auto& device = table.devices[n];
+		auto& entry = snapshot.devices.emplace_back();
+		entry.name.assign(device.name.data(), std::find(device.name.begin(), device.name.end(), '\0'));
+		for (size_t v = 0; v < NumberOfDeviceCounters; ++v)
+			entry.values[v] = device.values[v].load(std::memory_order_relaxed);
+	}
+	return snapshot;
+}
+
+// Devices whose counters Publish() copies, in the order of the table
+std::mutex devicesMutex;
+std::vector<const devices::Counters*> registeredDevices;
+
+}
+
+std::string_view Name(const Id id)
+{
+	return counterNames[static_cast<size_t>(id)];
+}
+
+std::string_view DeviceCounterName(const size_t index)
+{
+	return deviceCounterNames[index];
+}
+
+std::optional<ErrorCode> Export(const std::string& path)
+{
+	const auto fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) return errno;
+	if (::ftruncate(fd, sizeof(Table)) != 0) {
+		const auto error = errno;
+		::close(fd);
+		return error;
+	}
+	const auto p = ::mmap(nullptr, sizeof(Table), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	const auto error = errno;
+	::close(fd);
+	if (p == MAP_FAILED) return error;
+
+	// The file is zero-filled, which is a valid initial state for all
+	// counters
+	auto table = static_cast<Table*>(p);
+	Initialize(*table);
+	{
+		std::lock_guard lock(devicesMutex);
+		registeredDevices.clear();
+	}
+	detail::current.store(table, std::memory_order_release);
+	detail::handle.Release();
+	return {};
+}
+
+std::optional<ErrorCode> RegisterDevice(const std::string_view name, const devices::Counters& counters)
+{
+	std::lock_guard lock(devicesMutex);
+	if (registeredDevices.size() == MaxDevices) return ENOSPC;
+
+	auto& table = *detail::current.load(std::memory_order_acquire);
+	CopyName(table.devices[registeredDevices.size()].name, name);
+	registeredDevices.push_back(&counters);
+	table.numberOfDevices.store(static_cast<uint32_t>(registeredDevices.size()), std::memory_order_release);
+	return {};
+}
+
+void UnregisterDevice(const devices::Counters& counters)
+{
+	std::lock_guard lock(devicesMutex);
+	for (auto& registered : registeredDevices) {
+		if (registered == &counters) registered = nullptr;
+	}
+}
+
+void Publish()
+{
+	std::lock_guard lock(devicesMutex);
+	auto& table = *detail::current.load(std::memory_order_acquire);
+	for (size_t n = 0; n < registeredDevices.size(); ++n) {
+		if (registeredDevices[n] == nullptr) continue;
+		const auto& counters = *registeredDevices[n];
+		auto& values = table.devices[n].values;
+		size_t v = 0;
+		for (const auto counter : { &counters.rxPackets, &counters.rxBytes, &counters.rxDropped, &counters.rxErrors,
+		                            &counters.txPackets, &counters.txBytes, &counters.txDropped, &counters.txErrors })
+			values[v++].store(counter->Get(), std::memory_order_relaxed);
+	}
+	table.sequence.fetch_add(1, std::memory_order_release);
+}
+
+Snapshot Aggregate()
+{
+	auto snapshot = Aggregate(*detail::current.load(std::memory_order_acquire));
+	// The process table is not initialized
+	if constexpr (latency::Enabled) snapshot.ticksPerNanosecond = latency::TicksPerNanosecond();
+	return snapshot;
+}
+
+std::variant<ErrorCode, Snapshot> Read(const std::string& path)
+{
+	const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd < 0) return errno;
+	// Touching a mapping beyond the end of the file would fault
+	if (::lseek(fd, 0, SEEK_END) != static_cast<off_t>(sizeof(Table))) {
+		::close(fd);
+		return EINVAL;
+	}
+	const auto p = ::mmap(nullptr, sizeof(Table), PROT_READ, MAP_SHARED, fd, 0);
+	const auto error = errno;
+	::close(fd);
+	if (p == MAP_FAILED) return error;
+
+	const auto& table = *static_cast<const Table*>(p);
+	std::variant<ErrorCode, Snapshot> result{EINVAL};
+	if (table.magic == Table::Magic && table.version == Table::Version &&
+	    table.numberOfCounters == NumberOfCounters && table.numberOfSlots == NumberOfSlots &&
+	    table.numberOfLatencyBuckets == (latency::Enabled ? latency::NumberOfBuckets : 0))
+		result = Aggregate(table);
+	::munmap(p, sizeof(Table));
+	return result;
+}
+
+}
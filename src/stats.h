@@ -0,0 +1,264 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include "latency.h"
+
+namespace netstack {
+namespace devices { struct Counters; }
+
+// Stack-wide statistics. Every thread counts into a slot of its own, which
+// occupies whole cache lines, so counting is a plain load and store without
+// any bus locking or false sharing; readers sum all slots.
+//
+// The slots live in a Table, which can be placed in a file with Export(),
+// where other processes may read it at any time while the stack runs. With
+// NETSTACK_LATENCY, the slots also hold the latency histograms.
+namespace stats {
+
+using ErrorCode = int;
+
+enum class Id : uint32_t {
+	// In the order of ip::Result, following IPReceived
+	IPReceived,
+	IPUnsupported,
+	IPNotEnoughData,
+	IPInvalidVersion,
+	IPCorruptHeader,
+	IPChecksumError,
+	// In the order of icmp::Result, following ICMPReceived
+	ICMPReceived,
+	ICMPUnsupported,
+	ICMPNotEnoughData,
+	ICMPChecksumError,
+	ICMPEchoReplies,
+	ICMPErrorsSent,
+	ICMPErrorsRateLimited,
+	UDPReceived,
+	// In the order of udp::Result
+	UDPNotEnoughData,
+	UDPCorruptHeader,
+	UDPChecksumError,
+	UDPNoPort,
+	UDPReceiveQueueDrops,
+	UDPSent,
+	// In the order of forward::Result
+	Forwarded,
+	ForwardedLocal,
+	ForwardInvalid,
+	ForwardNoRoute,
+	ForwardTimeExceeded,
+	SLIPTxEscapes,
+	SLIPRxEscapes,
+	ReceiveRingDrops,
+	TransmitRingDrops,
+	TracedPackets,
+	TraceDrops,
+	FilterDrops,
+	Count
+};
+constexpr inline size_t NumberOfCounters = static_cast<size_t>(Id::Count);
+
+// The counter following 'base' by the value of a result enumeration
+template<typename Result> constexpr Id Offset(const Id base, const Result result)
+{
+	return static_cast<Id>(static_cast<uint32_t>(base) + static_cast<uint32_t>(result));
+}
+
+std::string_view Name(Id id);
+std::string_view DeviceCounterName(size_t index);
+
+constexpr inline size_t CacheLineSize = 64;
+// Threads beyond the first NumberOfSlots - 1 share the last slot, which they
+// update with atomic additions
+constexpr inline size_t NumberOfSlots = 64;
+constexpr inline size_t MaxDevices = 16;
+constexpr inline size_t NameSize = 32;
+// rx packets/bytes/dropped/errors, tx packets/bytes/dropped/errors
+constexpr inline size_t NumberOfDeviceCounters = 8;
+
+struct alignas(CacheLineSize) Slot {
+	std::array<std::atomic<uint64_t>, NumberOfCounters> values;
+	latency::Histograms<std::atomic<uint64_t>> latency;
+};
+
+// Copied from the devices' own counters by Publish()
+struct Device {
+	std::array<char, NameSize> name;
+	std::array<std::atomic<uint64_t>, NumberOfDeviceCounters> values;
+};
+
+// The layout of the stats file; all integers are in host order
+struct Table {
+	static constexpr inline uint32_t Magic = 0x5453534e; // "NSST"
+	static constexpr inline uint32_t Version = 2;
+
+	uint32_t magic;
+	uint32_t version;
+	uint32_t numberOfCounters;
+	uint32_t numberOfSlots;
+	std::atomic<uint32_t> numberOfDevices;
+	// Zero unless built with NETSTACK_LATENCY
+	uint32_t numberOfLatencyBuckets;
+	// Converts the latency histograms' ticks
+	double ticksPerNanosecond;
+	// Incremented after every Publish()
+	std::atomic<uint64_t> sequence;
+	// One bit for each slot that is owned by a thread
+	std::atomic<uint64_t> slotsInUse;
+	std::array<std::array<char, NameSize>, NumberOfCounters> counterNames;
+	std::array<std::array<char, NameSize>, NumberOfDeviceCounters> deviceCounterNames;
+	std::array<Device, MaxDevices> devices;
+	std::array<Slot, NumberOfSlots> slots;
+};
+static_assert(NumberOfSlots <= 64, "slotsInUse is a 64-bit mask");
+static_assert(sizeof(Slot) % CacheLineSize == 0);
+
+namespace detail {
+	// Used until Export() is called
+	inline Table processTable{};
+	inline std::atomic<Table*> current{&processTable};
+
+	// A thread's slot is handed back when the thread exits; the counts stay
+	// and are continued by the next thread that takes the slot
+	struct Handle {
+		Table* table{};
+		Slot* slot{};
+		bool shared{};
+
+		~Handle() { Release(); }
+		void Acquire();
+		void Release();
+	};
+	inline thread_local Handle handle;
+
+	inline void Handle::Release()
+	{
+		if (slot != nullptr && !shared) {
+			const auto index = static_cast<size_t>(slot - table->slots.data());
+			table->slotsInUse.fetch_and(~(uint64_t{1} << index), std::memory_order_release);
+		}
+		slot = nullptr;
+		shared = false;
+	}
+
+	inline void Handle::Acquire()
+	{
+		// The last slot is reserved for sharing
+		constexpr uint64_t Exclusive = (uint64_t{1} << (NumberOfSlots - 1)) - 1;
+		table = current.load(std::memory_order_acquire);
+		auto inUse = table->slotsInUse.load(std::memory_order_relaxed);
+		for(;;) {
+			const auto available = ~inUse & Exclusive;
+			if (available == 0) {
+				slot = &table->slots.back();
+				shared = true;
+				return;
+			}
+			const auto index = static_cast<size_t>(__builtin_ctzll(available));
+			if (table->slotsInUse.compare_exchange_weak(inUse, inUse | (uint64_t{1} << index), std::memory_order_acquire, std::memory_order_relaxed)) {
+				slot = &table->slots[index];
+				return;
+			}
+		}
+	}
+
+	inline Slot& OwnSlot()
+	{
+		if (handle.slot == nullptr) handle.Acquire();
+		return *handle.slot;
+	}
+
+	inline void Increment(std::atomic<uint64_t>& value, const uint64_t amount)
+	{
+		if (handle.shared) {
+			value.fetch_add(amount, std::memory_order_relaxed);
+			return;
+		}
+		value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+}
+
+inline void Add(const Id id, const uint64_t amount = 1)
+{
+	detail::Increment(detail::OwnSlot().values[static_cast<size_t>(id)], amount);
+}
+
+// Adds a duration in latency::Now() ticks to the stage's histogram
+inline void Record(const latency::Stage stage, const uint64_t ticks)
+{
+	if constexpr (latency::Enabled) {
+		auto& histogram = detail::OwnSlot().latency[static_cast<size_t>(stage)];
+		detail::Increment(histogram[latency::BucketFor(ticks)], 1);
+	}
+}
+
+// Times the consecutive stages of handling a packet: every Mark() records
+// the time since the previous one, or since construction. Does nothing
+// unless built with NETSTACK_LATENCY.
+class StageTimer
+{
+public:
+	StageTimer() { Restart(); }
+
+	void Restart()
+	{
+		if constexpr (latency::Enabled) last = latency::Now();
+	}
+
+	void Mark(const latency::Stage stage)
+	{
+		if constexpr (latency::Enabled) {
+			const auto now = latency::Now();
+			Record(stage, now - last);
+			last = now;
+		}
+	}
+
+private:
+	uint64_t last{};
+};
+
+// Moves the counters to a newly created file at 'path'. Must be called
+// before any other thread starts counting; counts made so far are lost.
+// The file stays mapped until the process exits.
+std::optional<ErrorCode> Export(const std::string& path);
+
+// Adds a device whose counters are copied to the table by Publish(); the
+// counters must stay alive until they are unregistered
+std::optional<ErrorCode> RegisterDevice(std::string_view name, const devices::Counters& counters);
+// Stops Publish() from reading the counters; the device keeps its slot in the
+// table, with the values it last had
+void UnregisterDevice(const devices::Counters& counters);
+void Publish();
+
+struct Snapshot {
+	struct Device {
+		std::string name;
+		std::array<uint64_t, NumberOfDeviceCounters> values{};
+	};
+
+	std::array<uint64_t, NumberOfCounters> counters{};
+	std::vector<Device> devices;
+	uint64_t sequence{};
+	latency::Histograms<uint64_t> latency{};
+	double ticksPerNanosecond{1.0};
+
+	uint64_t operator[](const Id id) const { return counters[static_cast<size_t>(id)]; }
+};
+
+// Sums the slots of the current table
+Snapshot Aggregate();
+// Maps a file created by Export() and sums its slots, which is safe while
+// the stack keeps counting
+std::variant<ErrorCode, Snapshot> Read(const std::string& path);
+
+}
+}
@@ -0,0 +1,139 @@
+#include "timer.h"
+
+#include <algorithm>
+
+namespace netstack::timer {
+
+static_assert(Wheel::Slots == 64, "the occupied slots must fit a 64-bit mask");
+
+void Timer::Cancel()
+{
+	if (wheel != nullptr)
+		wheel->Unlink(*this);
+}
+
+Wheel::~Wheel()
+{
+	for (auto& level : levels) {
+		for (auto& slot : level) {
+			while (slot != nullptr)
+				Unlink(*slot);
+		}
+	}
+	while (expiring != nullptr)
+		Unlink(*expiring);
+}
+
+void Wheel::Arm(Timer& timer, const uint64_t expiry)
+{
+	timer.Cancel();
+	timer.expiry = expiry;
+	timer.wheel = this;
+	++armed;
+	Link(timer);
+}
+
+void Wheel::Link(Timer& timer)
+{
+	Timer** slot;
+	if (timer.expiry < current) {
+		// Overdue; fires with the next tick processed
+		const auto index = current & (Slots - 1);
+		slot = &levels[0][index];
+		occupied |= uint64_t{1} << index;
+	} else {
+		// Too distant timers are parked at the far end and placed again
+		// when that slot is expanded
+		const auto delta = std::min(timer.expiry - current, Range - 1);
+		const auto expiry = current + delta;
+		size_t level = 0;
+		while (delta >= (uint64_t{1} << (SlotBits * (level + 1))))
+			++level;
+		const auto index = (expiry >> (SlotBits * level)) & (Slots - 1);
+		slot = &levels[level][index];
+		if (level == 0) occupied |= uint64_t{1} << index;
+	}
+
+	timer.next = *slot;
+	if (timer.next != nullptr)
+		timer.next->pprev = &timer.next;
+	timer.pprev = slot;
+	*slot = &timer;
+}
+
+void Wheel::Unlink(Timer& timer)
+{
+	*timer.pprev = timer.next;
+	if (timer.next != nullptr)
+		timer.next->pprev = timer.pprev;
+	timer.next = nullptr;
+	timer.pprev = nullptr;
+	timer.wheel = nullptr;
+	--armed;
+}
+
+size_t Wheel::Expand(const size_t level)
+{
+	const auto index = (current >> (SlotBits * level)) & (Slots - 1);
+	auto timer = levels[level][index];
+	levels[level][index] = nullptr;
+	while (timer != nullptr) {
+		const auto next = timer->next;
+		Link(*timer);
+		timer = next;
+	}
+	return index;
+}
+
+size_t Wheel::Fire(Timer*& slot)
+{
+	// Detach the whole slot first; timers armed by the callbacks go into
+	// the wheel, timers cancelled by them simply leave the batch
+	expiring = slot;
+	slot = nullptr;
+	if (expiring != nullptr)
+		expiring->pprev = &expiring;
+
+	size_t fired = 0;
+	while (expiring != nullptr) {
+		auto& timer = *expiring;
+		Unlink(timer);
+		timer.callback();
+		++fired;
+	}
+	return fired;
+}
+
+size_t Wheel::Advance(const uint64_t now)
+{
+	size_t fired = 0;
+	while (current <= now) {
+		if (armed == 0) {
+			current = now + 1;
+			break;
+		}
+
+		const auto index = current & (Slots - 1);
+		if (index == 0) {
+			for (size_t level = 1; level < Levels && Expand(level) == 0; ++level) { }
+		}
+
+		const auto bit = uint64_t{1} << index;
+		if ((occupied & bit) != 0) {
+			occupied &= ~bit;
+			// Overdue timers armed by the callbacks go to the next tick
+			++current;
+			fired += Fire(levels[0][index]);
+			continue;
+		}
+
+		// Nothing to do until the next occupied slot, or until the lowest
+		// level wraps around and needs to be refilled
+		const auto ahead = occupied & (~uint64_t{0} << index);
+		const uint64_t next = ahead != 0 ? static_cast<uint64_t>(__builtin_ctzll(ahead)) : Slots;
+		current = std::min(now + 1, current - index + next);
+	}
+	return fired;
+}
+
+}
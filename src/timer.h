@@ -0,0 +1,106 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace netstack::timer {
+
+class Wheel;
+
+// A timer is embedded in the object it belongs to and linked into the
+// wheel directly, so arming and cancelling never allocate. The callback is
+// given once at construction; a lambda capturing a single pointer is stored
+// without allocating as well. Destroying an armed timer cancels it.
+class Timer
+{
+public:
+	using Callback = std::function<void()>;
+
+	explicit Timer(Callback callback) : callback(std::move(callback)) { }
+	~Timer() { Cancel(); }
+
+	Timer(const Timer&) = delete;
+	Timer& operator=(const Timer&) = delete;
+
+	bool Armed() const { return pprev != nullptr; }
+	uint64_t Expiry() const { return expiry; }
+	void Cancel();
+
+private:
+	friend class Wheel;
+
+	Callback callback;
+	Timer* next{};
+	// Points at whatever points at this timer, which allows unlinking it
+	// without knowing its slot
+	Timer** pprev{};
+	Wheel* wheel{};
+	uint64_t expiry{};
+};
+
+// Hashed hierarchical timing wheel in the style of the classic BSD and
+// Linux kernel timers. Time is measured in ticks of whatever unit the
+// caller uses for Advance(), typically clock::NowMilliseconds().
+//
+// Each level has Slots slots, and a slot on level n spans Slots^n ticks;
+// timers are hashed into the lowest level that can hold them. Whenever the
+// lowest level wraps around, the next slot of the level above is expanded
+// into it, so every timer is moved at most Levels - 1 times. Timers further
+// away than the top level reaches are parked there and expanded again.
+//
+// Not thread-safe; use one wheel per thread.
+class Wheel
+{
+public:
+	static constexpr inline unsigned SlotBits = 6;
+	static constexpr inline size_t Slots = size_t{1} << SlotBits;
+	static constexpr inline size_t Levels = 4;
+	// 2^24 ticks, about four and a half hours in milliseconds
+	static constexpr inline uint64_t Range = uint64_t{1} << (SlotBits * Levels);
+
+	explicit Wheel(const uint64_t now = 0) : current(now) { }
+	~Wheel();
+
+	Wheel(const Wheel&) = delete;
+	Wheel& operator=(const Wheel&) = delete;
+
+	// Arms the timer to fire once 'expiry' is reached, re-arming it if it
+	// was armed already; an expiry in the past fires on the next Advance()
+	void Arm(Timer& timer, uint64_t expiry);
+
+	// Fires every timer that has expired by 'now', in order of expiry; the
+	// timers of a slot are detached as one batch before their callbacks
+	// run, so callbacks are free to arm and cancel any timer; they must not
+	// call Advance() themselves. Returns the number of timers fired.
+	size_t Advance(uint64_t now);
+
+	size_t Size() const { return armed; }
+	// The next tick to be processed
+	uint64_t Current() const { return current; }
+
+private:
+	friend class Timer;
+
+	using Level = std::array<Timer*, Slots>;
+
+	void Link(Timer& timer);
+	void Unlink(Timer& timer);
+	// Moves the timers of the current slot of 'level' down; returns the
+	// slot index so the caller knows whether the level wrapped around
+	size_t Expand(size_t level);
+	size_t Fire(Timer*& slot);
+
+	std::array<Level, Levels> levels{};
+	// Slots of the lowest level that may hold timers; bits are set on
+	// linking and cleared when the slot is processed, which lets Advance()
+	// skip runs of empty slots
+	uint64_t occupied{};
+	// The slot whose timers are being fired
+	Timer* expiring{};
+	uint64_t current;
+	size_t armed{};
+};
+
+}
@@ -0,0 +1,69 @@
+#include "trace.h"
+#include <algorithm>
+#include "buffer.h"
+#include "clock.h"
+#include "stats.h"
+
+namespace netstack::trace {
+
+Tracer::Tracer(const Config& config, Sink sink)
+	: snapLength(std::min(config.snapLength, MaxSnapLength))
+	, sampleRate(std::max(config.sampleRate, uint32_t{1}))
+	, filter(config.filter)
+	, sink(std::move(sink))
+	, thread([this]() { Run(); })
+{
+}
+
+Tracer::~Tracer()
+{
+	stop.store(true, std::memory_order_release);
+	thread.join();
+}
+
+void Tracer::Trace(const Buffer& buffer, const uint16_t source)
+{
+	// Shared by all tracers, which only makes the sampling start at a
+	// different packet
+	static thread_local uint32_t skipped;
+	if (filter && !filter(buffer)) return;
+	if (++skipped < sampleRate) return;
+	skipped = 0;
+
+	Record record;
+	record.timestamp = clock::RealTimeNanoseconds();
+	record.source = source;
+	size_t length = 0;
+	for (const auto b : buffer.chain()) {
+		const auto readSpan = b->ReadSpan();
+		const auto amount = std::min(readSpan.size(), snapLength - std::min(length, snapLength));
+		std::copy_n(readSpan.begin(), amount, record.data.begin() + record.captured);
+		record.captured += static_cast<uint16_t>(amount);
+		length += readSpan.size();
+	}
+	record.length = static_cast<uint32_t>(length);
+
+	if (!ring.Push(std::move(record))) {
+		stats::Add(stats::Id::TraceDrops);
+		return;
+	}
+	stats::Add(stats::Id::TracedPackets);
+}
+
+void Tracer::Run()
+{
+	std::array<Record, BurstSize> burst;
+	for(;;) {
+		// Checked before emptying the ring, so that nothing pushed before
+		// the stop request is lost
+		const auto stopping = stop.load(std::memory_order_acquire);
+		const auto amount = ring.PopBurst(burst);
+		for (const auto& record : nonstd::span{burst.data(), amount})
+			sink(record);
+		if (amount > 0) continue;
+		if (stopping) break;
+		std::this_thread::sleep_for(IdleInterval);
+	}
+}
+
+}
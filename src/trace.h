@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include "nonstd/span.hpp"
+#include "ring.h"
+
+namespace netstack {
+
+class Buffer;
+
+// Packet tracing that stays off the packet path: Trace() copies no more
+// than the first bytes of the selected packets into a lock-free ring, and a
+// background thread hands them to a sink, which may take its time
+// formatting or writing them. When the ring is full, records are dropped
+// rather than holding up the stack.
+namespace trace {
+
+constexpr inline size_t MaxSnapLength = 128;
+constexpr inline size_t RingSize = 1024;
+
+struct Record {
+	uint64_t timestamp{}; // nanoseconds since the epoch
+	uint32_t length{}; // of the whole packet
+	uint16_t captured{};
+	// The queue or interface the packet was seen on
+	uint16_t source{};
+	std::array<std::byte, MaxSnapLength> data;
+
+	nonstd::span<const std::byte> Data() const { return { data.data(), captured }; }
+};
+
+using Filter = std::function<bool(const Buffer&)>;
+using Sink = std::function<void(const Record&)>;
+
+struct Config {
+	size_t snapLength = 64;
+	// Every sampleRate'th packet accepted by the filter is traced, counted
+	// per thread
+	uint32_t sampleRate = 1;
+	// All packets are accepted if there is none
+	Filter filter;
+};
+
+class Tracer
+{
+public:
+	static constexpr inline size_t BurstSize = 32;
+	static constexpr inline std::chrono::milliseconds IdleInterval{1};
+
+	Tracer(const Config& config, Sink sink);
+	// Hands all records still in the ring to the sink
+	~Tracer();
+	Tracer(const Tracer&) = delete;
+	Tracer& operator=(const Tracer&) = delete;
+
+	// May be called from any number of threads
+	void Trace(const Buffer& buffer, uint16_t source = 0);
+
+private:
+	void Run();
+
+	const size_t snapLength;
+	const uint32_t sampleRate;
+	const Filter filter;
+	const Sink sink;
+	MPSCRing<Record, RingSize> ring;
+	std::atomic<bool> stop{};
+	std::thread thread;
+};
+
+}
+}
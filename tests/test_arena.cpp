@@ -0,0 +1,140 @@
+#include "gtest/gtest.h"
+#include "arena.h"
+#include "buffer.h"
+#include "ring.h"
+
+#include <cerrno>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace netstack {
+
+namespace {
+
+constexpr arena::Config small{ 64 * 1024, arena::Pages::Normal, true };
+
+TEST(Arena, Allocates_Distinct_Aligned_Slots_Until_Full)
+{
+	arena::Arena arena;
+	ASSERT_FALSE(arena.Reserve(small, 1000).has_value());
+	const auto usage = arena.GetUsage();
+	EXPECT_EQ(64u * 1024 / 1024, usage.slots);
+
+	std::set<void*> slots;
+	for (size_t n = 0; n < usage.slots; ++n) {
+		const auto p = arena.Allocate(1000);
+		ASSERT_NE(nullptr, p);
+		EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(p) % arena::Arena::SlotAlignment);
+		EXPECT_TRUE(slots.insert(p).second);
+	}
+	EXPECT_EQ(usage.slots, arena.GetUsage().inUse);
+	EXPECT_EQ(nullptr, arena.Allocate(1000));
+	EXPECT_EQ(1u, arena.GetUsage().exhausted);
+
+	// Released slots are reused
+	const auto p = *slots.begin();
+	EXPECT_TRUE(arena.Release(p));
+	EXPECT_EQ(p, arena.Allocate(1000));
+}
+
+TEST(Arena, Small_Slots_Share_Cache_Lines)
+{
+	arena::Arena arena;
+	ASSERT_FALSE(arena.Reserve(small, 24).has_value());
+	EXPECT_EQ(64u * 1024 / 32, arena.GetUsage().slots);
+	const auto first = reinterpret_cast<uintptr_t>(arena.Allocate(24));
+	const auto second = reinterpret_cast<uintptr_t>(arena.Allocate(24));
+	EXPECT_EQ(0u, first % 32);
+	EXPECT_EQ(32u, second - first);
+}
+
+TEST(Arena, Rejects_What_It_Does_Not_Own)
+{
+	arena::Arena arena;
+	int onTheStack;
+	EXPECT_EQ(nullptr, arena.Allocate(8));
+	EXPECT_FALSE(arena.Release(&onTheStack));
+
+	ASSERT_FALSE(arena.Reserve(small, 64).has_value());
+	EXPECT_EQ(EBUSY, arena.Reserve(small, 64));
+	EXPECT_EQ(nullptr, arena.Allocate(65));
+	EXPECT_FALSE(arena.Release(&onTheStack));
+	EXPECT_EQ(0u, arena.GetUsage().inUse);
+}
+
+TEST(Arena, Huge_Pages)
+{
+	for (const auto pages : { arena::Pages::Transparent, arena::Pages::Huge }) {
+		arena::Arena arena;
+		const auto result = arena.Reserve({ 1, pages, true }, Buffer::Size);
+		if (pages == arena::Pages::Huge && result == ENOMEM) continue; // none reserved
+		ASSERT_FALSE(result.has_value());
+		// Rounded up to a whole huge page
+		EXPECT_EQ(arena::Arena::HugePageSize / 1024, arena.GetUsage().slots);
+		EXPECT_NE(nullptr, arena.Allocate(Buffer::Size));
+	}
+}
+
+TEST(Arena, Slots_Move_Between_Threads)
+{
+	// A receiving thread allocates what another thread frees, as with the
+	// workers and the transmitter
+	constexpr size_t NumberOfAllocations = 50000;
+	arena::Arena arena;
+	ASSERT_FALSE(arena.Reserve(small, 256).has_value());
+	SPSCRing<void*, 64> ring;
+	std::thread consumer([&]() {
+		for (size_t n = 0; n < NumberOfAllocations; ) {
+			auto p = ring.Pop();
+			if (!p) {
+				std::this_thread::yield();
+				continue;
+			}
+			if (*p != nullptr) {
+				EXPECT_TRUE(arena.Release(*p));
+			}
+			++n;
+		}
+	});
+	for (size_t n = 0; n < NumberOfAllocations; ++n) {
+		auto p = arena.Allocate(256);
+		while (!ring.Push(std::move(p)))
+			std::this_thread::yield();
+	}
+	consumer.join();
+	EXPECT_EQ(0u, arena.GetUsage().inUse);
+}
+
+// On the heap, a buffer and its data are a single block
+bool DataFollowsDescriptor(Buffer& buffer)
+{
+	const auto offset = buffer.WriteSpan().data() - reinterpret_cast<std::byte*>(&buffer);
+	return offset >= static_cast<ptrdiff_t>(sizeof(Buffer)) && offset < static_cast<ptrdiff_t>(sizeof(Buffer) + Buffer::DataAlignment);
+}
+
+TEST(Arena, Buffers_Come_From_The_Arena_Once_Reserved)
+{
+	// The buffer arena lives as long as the process, so the other tests
+	// continue to use it
+	std::vector<BufferPtr> buffers;
+	buffers.push_back(std::make_unique<Buffer>());
+	EXPECT_TRUE(DataFollowsDescriptor(*buffers.front()));
+	ASSERT_FALSE(Buffer::ReserveArena(small).has_value());
+	EXPECT_EQ(EBUSY, Buffer::ReserveArena(small));
+	const auto usage = Buffer::GetArenaUsage();
+	EXPECT_EQ(0u, usage.inUse);
+
+	// Beyond the arena, buffers come from the heap again
+	for (size_t n = 0; n < usage.slots + 4; ++n)
+		buffers.push_back(std::make_unique<Buffer>());
+	EXPECT_EQ(usage.slots, Buffer::GetArenaUsage().inUse);
+	EXPECT_EQ(4u, Buffer::GetArenaUsage().exhausted);
+	EXPECT_FALSE(DataFollowsDescriptor(*buffers[1]));
+	EXPECT_TRUE(DataFollowsDescriptor(*buffers.back()));
+	buffers.clear();
+	EXPECT_EQ(0u, Buffer::GetArenaUsage().inUse);
+}
+
+}
+}
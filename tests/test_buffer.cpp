@@ -31,6 +31,14 @@ TEST(Buffer, Empty_When_Created)
 	EXPECT_EQ(static_cast<size_t>(Buffer::Size), buffer.WriteSpan().size());
 }
 
+TEST(Buffer, Data_Is_Cache_Line_Aligned)
+{
+	Buffer buffer;
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(buffer.WriteSpan().data()) % Buffer::DataAlignment);
+	auto segment = std::make_unique<Buffer>();
+	EXPECT_EQ(0u, reinterpret_cast<uintptr_t>(segment->WriteSpan().data()) % Buffer::DataAlignment);
+}
+
 TEST(Buffer, Data_Can_Be_Written)
 {
 	Buffer buffer;
@@ -56,6 +64,20 @@ TEST(Buffer, Entire_Buffer_Can_Be_Used)
 	EXPECT_TRUE(buffer.WriteSpan().empty());
 }
 
+TEST(Buffer, Consumed_Data_Is_Skipped)
+{
+	Buffer buffer;
+	Append(testBytes, buffer);
+	buffer.Consume(4);
+	Verify(testBytes | ranges::views::drop(4) | ranges::to<std::vector>(), buffer);
+	EXPECT_EQ(Buffer::Size - testBytes.size(), buffer.WriteSpan().size());
+
+	// Never beyond the data
+	buffer.Consume(100);
+	EXPECT_TRUE(buffer.ReadSpan().empty());
+	EXPECT_TRUE(buffer.ModifySpan().empty());
+}
+
 TEST(Buffer, Chain_Iterate_Over_Single_Buffer)
 {
 	Buffer buffer;
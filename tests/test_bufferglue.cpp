@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "buffer.h"
 #include "drivers/bufferglue.h"
+#include "slip.h"
 #include "helpers.h"
 
 #include "range/v3/range/conversion.hpp"
@@ -122,5 +123,94 @@ TEST(BufferGlue, Empty_Buffers_Are_Never_Complete)
 	EXPECT_EQ(0, numberOfEndCalls);
 }
 
+TEST(BufferGlue, External_Data_Is_Processed_In_Place)
+{
+	BufferGlue glue;
+	auto data = testBytes | ranges::to<std::vector>();
+	data.push_back(constants::FLUSH);
+
+	int numberOfEndCalls{};
+	glue.HandleData(data, [](auto span, auto&& onByte, auto&& onComplete) { return Process(span, onByte, onComplete); }, [&](auto buffer)
+	{
+		Verify(testBytes, *buffer);
+		++numberOfEndCalls;
+	});
+	EXPECT_EQ(1, numberOfEndCalls);
+}
+
+TEST(BufferGlue, External_Data_Leftovers_Are_Kept)
+{
+	// An escape at the end cannot be decoded until the next byte is known
+	const std::vector<std::byte> first{ 1_b, slip::constants::ESC };
+	const std::vector<std::byte> second{ slip::constants::ESC_END, 2_b, slip::constants::END };
+
+	BufferGlue glue;
+	int numberOfEndCalls{};
+	const auto decode = [](auto span, auto&& onByte, auto&& onComplete) { return slip::Decode(span, onByte, onComplete); };
+	const auto verify = [&](auto buffer)
+	{
+		Verify(std::array{ 1_b, slip::constants::END, 2_b }, *buffer);
+		++numberOfEndCalls;
+	};
+	glue.HandleData(first, decode, verify);
+	EXPECT_EQ(0, numberOfEndCalls);
+	glue.HandleData(second, decode, verify);
+	EXPECT_EQ(1, numberOfEndCalls);
+}
+
+TEST(BufferGlue, Read_Size_Grows_While_Reads_Fill_It)
+{
+	BufferGlue glue({ 16, 64 });
+	const auto nothing = [](auto span, auto&&, auto&&) { return span.cend(); };
+	for (const auto expected : { 32_sz, 64_sz, 64_sz }) {
+		const auto writeSpan = glue.GetWriteSpan();
+		glue.HandleDataReceived(writeSpan.size(), nothing, [](auto) { });
+		EXPECT_EQ(expected, glue.ReadSize());
+		EXPECT_EQ(expected, glue.GetWriteSpan().size());
+	}
+	EXPECT_EQ(2u, glue.GetStats().grown);
+}
+
+TEST(BufferGlue, Read_Size_Shrinks_After_Small_Reads)
+{
+	BufferGlue glue({ 16, 64 });
+	const auto nothing = [](auto span, auto&&, auto&&) { return span.cend(); };
+	glue.HandleDataReceived(glue.GetWriteSpan().size(), nothing, [](auto) { });
+	ASSERT_EQ(32_sz, glue.ReadSize());
+
+	for (unsigned n = 0; n < BufferGlue::ShrinkAfter - 1; ++n)
+		glue.HandleDataReceived(1, nothing, [](auto) { });
+	EXPECT_EQ(32_sz, glue.ReadSize());
+	glue.HandleDataReceived(1, nothing, [](auto) { });
+	EXPECT_EQ(16_sz, glue.ReadSize());
+	EXPECT_EQ(1u, glue.GetStats().shrunk);
+}
+
+TEST(BufferGlue, Stats_Count_Reads_And_Bytes)
+{
+	BufferGlue glue;
+	const auto nothing = [](auto span, auto&&, auto&&) { return span.cend(); };
+	glue.HandleDataReceived(10, nothing, [](auto) { });
+	glue.HandleData(nonstd::span<const std::byte>{ testBytes.data(), testBytes.size() }, nothing, [](auto) { });
+	EXPECT_EQ(2u, glue.GetStats().reads);
+	EXPECT_EQ(26u, glue.GetStats().bytes);
+	EXPECT_DOUBLE_EQ(13.0, glue.GetStats().BytesPerRead());
+}
+
+TEST(BufferGlue, Discarded_Frames_Are_Not_Delivered)
+{
+	BufferGlue glue;
+	slip::Decoder decoder(2);
+	const std::vector<std::byte> data{ 1_b, 2_b, 3_b, slip::constants::END, 4_b, slip::constants::END };
+
+	int numberOfEndCalls{};
+	glue.HandleData(data, [&](auto span, auto&& onByte, auto&& onComplete) { return decoder.Decode(span, onByte, onComplete); }, [&](auto buffer)
+	{
+		Verify(std::array{ 4_b }, *buffer);
+		++numberOfEndCalls;
+	});
+	EXPECT_EQ(1, numberOfEndCalls);
+}
+
+}
 }
-}
\ No newline at end of file
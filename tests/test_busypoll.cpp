@@ -0,0 +1,58 @@
+#include "gtest/gtest.h"
+#include "busypoll.h"
+
+#include <cerrno>
+#include <chrono>
+#include <sched.h>
+
+namespace netstack {
+
+namespace {
+
+TEST(BusyPoll, Backoff_Sleeps_Only_After_Spinning_And_Pausing)
+{
+	using Clock = std::chrono::steady_clock;
+	busypoll::Backoff backoff({ 1000, 100, std::chrono::milliseconds(20) });
+
+	auto start = Clock::now();
+	for (size_t n = 0; n < 1100; ++n)
+		backoff.Idle();
+	EXPECT_LT(Clock::now() - start, std::chrono::milliseconds(20));
+
+	start = Clock::now();
+	backoff.Idle();
+	EXPECT_GE(Clock::now() - start, std::chrono::milliseconds(20));
+
+	// Work starts the cycle over
+	backoff.Reset();
+	start = Clock::now();
+	backoff.Idle();
+	EXPECT_LT(Clock::now() - start, std::chrono::milliseconds(20));
+}
+
+TEST(BusyPoll, Backoff_Without_Sleep_Keeps_Pausing)
+{
+	using Clock = std::chrono::steady_clock;
+	busypoll::Backoff backoff({ 0, 0, std::chrono::microseconds(0) });
+	const auto start = Clock::now();
+	for (size_t n = 0; n < 10000; ++n)
+		backoff.Idle();
+	EXPECT_LT(Clock::now() - start, std::chrono::seconds(1));
+}
+
+TEST(BusyPoll, Threads_Can_Be_Pinned)
+{
+	cpu_set_t original;
+	ASSERT_EQ(0, ::sched_getaffinity(0, sizeof(original), &original));
+	unsigned cpu = 0;
+	while (!CPU_ISSET(cpu, &original))
+		++cpu;
+
+	EXPECT_FALSE(busypoll::PinThread(cpu).has_value());
+	EXPECT_EQ(static_cast<int>(cpu), ::sched_getcpu());
+	EXPECT_EQ(EINVAL, busypoll::PinThread(CPU_SETSIZE));
+	::sched_setaffinity(0, sizeof(original), &original);
+}
+
+}
+}
@@ -63,5 +63,66 @@ TEST(Dump, Single_Line_Plus_One_Byte)
 	ASSERT_EQ(".", lines[1].chars);
 }
 
+// What printing the lines of Dump() gives
+std::string PrintedDump(const std::vector<std::byte>& data)
+{
+	std::string result;
+	dump_buffer::Dump(data, [&](const size_t offset, std::string_view bytes, std::string_view chars) {
+		result += fmt::format("{:4x}: {:48s} {}\n", offset, bytes, chars);
+	});
+	return result;
+}
+
+std::vector<std::byte> AllByteValues(const size_t size)
+{
+	std::vector<std::byte> data(size);
+	for (size_t n = 0; n < size; ++n)
+		data[n] = static_cast<std::byte>(n * 7);
+	return data;
+}
+
+TEST(Dump, Format_Matches_Printed_Lines)
+{
+	for (const auto size : { 0_sz, 1_sz, 15_sz, 16_sz, 17_sz, 256_sz, 1000_sz }) {
+		const auto data = AllByteValues(size);
+		EXPECT_EQ(PrintedDump(data), dump_buffer::Format(data)) << size;
+	}
+}
+
+TEST(Dump, Format_Widens_Large_Offsets)
+{
+	const auto data = AllByteValues(0x10010);
+	const auto dump = dump_buffer::Format(data);
+	EXPECT_EQ(PrintedDump(data), dump);
+	EXPECT_EQ("10000: ", dump.substr(dump.rfind('\n', dump.size() - 2) + 1, 7));
+}
+
+TEST(Dump, Format_Stays_Within_The_Maximum_Size)
+{
+	const auto data = AllByteValues(100);
+	std::string out(dump_buffer::MaxFormattedSize(data.size()) + 1, '#');
+	const auto end = dump_buffer::FormatTo(data, out.data(), 0x123456);
+	EXPECT_LE(static_cast<size_t>(end - out.data()), dump_buffer::MaxFormattedSize(data.size()));
+	EXPECT_EQ('#', out.back());
+	EXPECT_EQ("123456: ", out.substr(0, 8));
+}
+
+TEST(Dump, Format_Chain_Continues_Lines_Across_Buffers)
+{
+	const auto data = AllByteValues(3 * Buffer::Size / 2);
+	for (const auto firstSize : { 5_sz, 16_sz, 100_sz }) {
+		Buffer buffer;
+		Append(nonstd::span<const std::byte>{ data.data(), firstSize }, buffer);
+		auto& second = buffer.AddBuffer();
+		Append(nonstd::span<const std::byte>{ data.data() + firstSize, Buffer::Size }, second);
+		// An empty buffer in the middle of the chain holds nothing up
+		auto& third = second.AddBuffer().AddBuffer();
+		Append(nonstd::span<const std::byte>{ data.data() + firstSize + Buffer::Size, 3 }, third);
+
+		const std::vector<std::byte> flat(data.begin(), data.begin() + firstSize + Buffer::Size + 3);
+		EXPECT_EQ(PrintedDump(flat), dump_buffer::Format(buffer)) << firstSize;
+	}
+}
+
 }
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "gtest/gtest.h"
+#include "filter.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include <string>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+// 10.0.0.1 -> 192.168.1.2, followed by 'payload'; by default the first
+// fragment of a larger packet
+std::vector<std::byte> MakePacket(const uint8_t protocol, const std::vector<std::byte>& payload, const uint8_t headerWords = 5, const uint16_t fragment = 0x2000)
+{
+	std::vector<std::byte> packet(headerWords * 4u);
+	packet[0] = static_cast<std::byte>(0x40 | headerWords);
+	packet[1] = 0x10_b;
+	packet[3] = static_cast<std::byte>(packet.size() + payload.size());
+	packet[6] = static_cast<std::byte>(fragment >> 8);
+	packet[7] = static_cast<std::byte>(fragment);
+	packet[8] = 64_b;
+	packet[9] = static_cast<std::byte>(protocol);
+	for (const auto& [offset, addr] : { std::pair{ 12, 0x0a000001u }, std::pair{ 16, 0xc0a80102u } }) {
+		for (int n = 0; n < 4; ++n)
+			packet[offset + n] = static_cast<std::byte>(addr >> (24 - 8 * n));
+	}
+	packet.insert(packet.end(), payload.begin(), payload.end());
+	return packet;
+}
+
+const auto ICMPEcho = MakePacket(1, { 8_b, 0_b, 0_b, 0_b });
+// Source port 1234, destination port 22
+const auto TCPSsh = MakePacket(6, { 0x04_b, 0xd2_b, 0x00_b, 0x16_b });
+const auto UDPDns = MakePacket(17, { 0x04_b, 0xd2_b, 0x00_b, 0x35_b }, 6);
+// MF, fragment offset 0x0123; the bytes look like ports but are not
+const auto TCPFragment = MakePacket(6, { 0x04_b, 0xd2_b, 0x00_b, 0x16_b }, 5, 0x2123);
+
+bool Matches(const std::string& expression, const std::vector<std::byte>& packet)
+{
+	auto result = filter::Compile(expression);
+	if (auto error = std::get_if<filter::Error>(&result)) {
+		ADD_FAILURE() << expression << ": " << error->message << " at " << error->position;
+		return false;
+	}
+	return std::get<filter::Program>(result)(packet);
+}
+
+filter::Error CompileError(const std::string& expression)
+{
+	auto result = filter::Compile(expression);
+	EXPECT_TRUE(std::holds_alternative<filter::Error>(result)) << expression;
+	if (auto error = std::get_if<filter::Error>(&result)) return *error;
+	return {};
+}
+
+TEST(Filter, Protocols)
+{
+	EXPECT_TRUE(Matches("icmp", ICMPEcho));
+	EXPECT_FALSE(Matches("icmp", TCPSsh));
+	EXPECT_TRUE(Matches("tcp", TCPSsh));
+	EXPECT_TRUE(Matches("udp", UDPDns));
+	EXPECT_TRUE(Matches("ip.proto == 17", UDPDns));
+}
+
+TEST(Filter, Header_Fields)
+{
+	EXPECT_TRUE(Matches("ip.tos == 0x10", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.len == 24", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.ttl >= 64 && ip.ttl <= 64", ICMPEcho));
+	EXPECT_FALSE(Matches("ip.ttl < 64", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.frag == 0", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.frag == 0x0123", TCPFragment));
+	EXPECT_TRUE(Matches("ip.src == 10.0.0.1 and ip.dst == 192.168.1.2", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.src != 10.0.0.2", ICMPEcho));
+}
+
+TEST(Filter, Fields_Following_The_Header_Honour_Its_Length)
+{
+	EXPECT_TRUE(Matches("icmp.type == 8 and icmp.code == 0", ICMPEcho));
+	EXPECT_TRUE(Matches("tcp and dport == 22 and sport > 1023", TCPSsh));
+	// Options make the header 24 bytes long
+	EXPECT_TRUE(Matches("udp and (sport == 53 or dport == 53)", UDPDns));
+	EXPECT_TRUE(Matches("payload[2:2] == 53", UDPDns));
+	EXPECT_FALSE(Matches("ip[22:2] == 53", UDPDns));
+}
+
+TEST(Filter, Raw_Offsets_And_Masks)
+{
+	EXPECT_TRUE(Matches("ip[9] == 6", TCPSsh));
+	EXPECT_TRUE(Matches("ip[12:4] == 0x0a000001", TCPSsh));
+	EXPECT_TRUE(Matches("ip[6:2] & 0x2000 != 0", TCPSsh));
+	EXPECT_TRUE(Matches("ip.frag & 0xff == 0x23", TCPFragment));
+}
+
+TEST(Filter, Later_Fragments_Have_No_Transport_Header)
+{
+	EXPECT_TRUE(Matches("tcp and ip.frag != 0", TCPFragment));
+	EXPECT_FALSE(Matches("tcp and dport == 22", TCPFragment));
+	EXPECT_FALSE(Matches("dport != 22", TCPFragment));
+	EXPECT_FALSE(Matches("payload[0] == 4", TCPFragment));
+	EXPECT_TRUE(Matches("not dport == 22", TCPFragment));
+	// The first fragment does have one
+	EXPECT_TRUE(Matches("tcp and dport == 22", TCPSsh));
+}
+
+TEST(Filter, Addresses_And_Prefixes)
+{
+	EXPECT_TRUE(Matches("src 10.0.0.0/8", ICMPEcho));
+	EXPECT_FALSE(Matches("src 10.0.1.0/24", ICMPEcho));
+	EXPECT_TRUE(Matches("dst 192.168.1.2", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.dst == 192.168.0.0/16", ICMPEcho));
+	EXPECT_TRUE(Matches("ip.dst != 172.16.0.0/12", ICMPEcho));
+	EXPECT_TRUE(Matches("src 0.0.0.0/0", ICMPEcho));
+	EXPECT_TRUE(Matches("host 192.168.1.2", ICMPEcho));
+	EXPECT_FALSE(Matches("host 192.168.1.3", ICMPEcho));
+}
+
+TEST(Filter, Boolean_Operators)
+{
+	EXPECT_TRUE(Matches("not tcp", ICMPEcho));
+	EXPECT_TRUE(Matches("!!icmp", ICMPEcho));
+	EXPECT_TRUE(Matches("tcp or icmp and ip.ttl == 64", TCPSsh));
+	EXPECT_FALSE(Matches("(tcp or icmp) and ip.ttl == 1", TCPSsh));
+	EXPECT_TRUE(Matches("true", TCPSsh));
+	EXPECT_FALSE(Matches("false or false", TCPSsh));
+	EXPECT_TRUE(Matches("false or tcp", TCPSsh));
+}
+
+TEST(Filter, Bytes_Beyond_The_Packet_Do_Not_Match)
+{
+	const std::vector<std::byte> truncated(ICMPEcho.begin(), ICMPEcho.begin() + 10);
+	EXPECT_FALSE(Matches("ip.src == 10.0.0.1", truncated));
+	EXPECT_FALSE(Matches("ip.src != 10.0.0.1", truncated));
+	EXPECT_TRUE(Matches("not ip.src == 10.0.0.1", truncated));
+	EXPECT_FALSE(Matches("icmp.type == 8", std::vector<std::byte>(ICMPEcho.begin(), ICMPEcho.begin() + 20)));
+	EXPECT_FALSE(Matches("payload[0] == 0", {}));
+}
+
+TEST(Filter, Only_The_First_Segment_Is_Seen)
+{
+	auto program = std::get<filter::Program>(filter::Compile("icmp.type == 8"));
+	Buffer buffer;
+	Append(std::vector<std::byte>(ICMPEcho.begin(), ICMPEcho.begin() + 20), buffer);
+	Append(std::vector<std::byte>(ICMPEcho.begin() + 20, ICMPEcho.end()), buffer.AddBuffer());
+	EXPECT_FALSE(filter::Matches(program, buffer));
+	EXPECT_TRUE(filter::Matches(std::get<filter::Program>(filter::Compile("icmp")), buffer));
+}
+
+TEST(Filter, Errors_Point_At_The_Problem)
+{
+	EXPECT_EQ(0u, CompileError("").position);
+	EXPECT_EQ(5u, CompileError("icmp tcp").position);
+	EXPECT_EQ(0u, CompileError("ip.bogus == 1").position);
+	EXPECT_EQ(7u, CompileError("ip.ttl 1").position);
+	EXPECT_EQ(10u, CompileError("ip.ttl == 1.2.3").position);
+	EXPECT_EQ(8u, CompileError("(icmp or").position);
+	EXPECT_EQ(6u, CompileError("(icmp ").position);
+	EXPECT_EQ(5u, CompileError("ip[1:3] == 1").position);
+	EXPECT_EQ(9u, CompileError("ip.src < 10.0.0.0/8").position);
+	EXPECT_EQ(12u, CompileError("src 1.2.3.4/33").position);
+	EXPECT_EQ(10u, CompileError("ip.ttl == 0x100000000").position);
+	EXPECT_EQ(0u, CompileError("$").position);
+}
+
+}
+}
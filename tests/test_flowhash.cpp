@@ -0,0 +1,111 @@
+#include "gtest/gtest.h"
+#include "flowhash.h"
+#include "buffer.h"
+#include "helpers.h"
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+constexpr uint32_t Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	return (static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 8) | d;
+}
+
+// Verification vectors from the Microsoft RSS specification
+TEST(FlowHash, Toeplitz_IPv4_Only)
+{
+	flow::ToeplitzHasher hasher;
+	EXPECT_EQ(0x323e8fc2u, hasher.Hash(flow::Key{ Addr(66, 9, 149, 187), Addr(161, 142, 100, 80), 0, {}, {} }));
+	EXPECT_EQ(0xd718262au, hasher.Hash(flow::Key{ Addr(199, 92, 111, 2), Addr(65, 69, 140, 83), 0, {}, {} }));
+}
+
+TEST(FlowHash, Toeplitz_IPv4_With_Ports)
+{
+	flow::ToeplitzHasher hasher;
+	EXPECT_EQ(0x51ccc178u, hasher.Hash(flow::Key{ Addr(66, 9, 149, 187), Addr(161, 142, 100, 80), 6, 2794, 1766 }));
+	EXPECT_EQ(0xc626b0eau, hasher.Hash(flow::Key{ Addr(199, 92, 111, 2), Addr(65, 69, 140, 83), 6, 14230, 4739 }));
+}
+
+TEST(FlowHash, Extract_Key_From_ICMP_Packet)
+{
+	constexpr std::array icmpHeader{
+		0x45_b, 0x00_b, 0x00_b, 0x54_b, 0xf8_b, 0xbe_b, 0x40_b, 0x00_b, 0x40_b, 0x01_b, 0x87_b, 0xa8_b, 0xac_b, 0x1f_b, 0x31_b, 0x01_b,
+		0xac_b, 0x1f_b, 0x31_b, 0x02_b, 0x08_b, 0x00_b, 0x21_b, 0xa3_b
+	};
+	Buffer buffer;
+	Append(icmpHeader, buffer);
+
+	const auto key = flow::ExtractKey(buffer);
+	ASSERT_TRUE(key.has_value());
+	EXPECT_EQ(Addr(172, 31, 49, 1), key->sourceAddr);
+	EXPECT_EQ(Addr(172, 31, 49, 2), key->destAddr);
+	EXPECT_EQ(protocol::ip::constants::protocol::ICMP, key->protocol);
+	EXPECT_FALSE(key->sourcePort.has_value());
+}
+
+TEST(FlowHash, Extract_Key_With_Ports_From_UDP_Packet)
+{
+	constexpr std::array udpHeader{
+		0x45_b, 0x00_b, 0x00_b, 0x1c_b, 0x00_b, 0x01_b, 0x00_b, 0x00_b, 0x40_b, 0x11_b, 0x00_b, 0x00_b, 0x0a_b, 0x00_b, 0x00_b, 0x01_b,
+		0x0a_b, 0x00_b, 0x00_b, 0x02_b, 0x04_b, 0xd2_b, 0x00_b, 0x35_b, 0x00_b, 0x08_b, 0x00_b, 0x00_b
+	};
+	Buffer buffer;
+	Append(udpHeader, buffer);
+
+	const auto key = flow::ExtractKey(buffer);
+	ASSERT_TRUE(key.has_value());
+	EXPECT_EQ(1234, key->sourcePort);
+	EXPECT_EQ(53, key->destPort);
+}
+
+TEST(FlowHash, Extract_Key_Ignores_Ports_Of_Fragments)
+{
+	constexpr std::array udpFragment{
+		0x45_b, 0x00_b, 0x00_b, 0x1c_b, 0x00_b, 0x01_b, 0x20_b, 0x00_b, 0x40_b, 0x11_b, 0x00_b, 0x00_b, 0x0a_b, 0x00_b, 0x00_b, 0x01_b,
+		0x0a_b, 0x00_b, 0x00_b, 0x02_b, 0x04_b, 0xd2_b, 0x00_b, 0x35_b, 0x00_b, 0x08_b, 0x00_b, 0x00_b
+	};
+	Buffer buffer;
+	Append(udpFragment, buffer);
+
+	const auto key = flow::ExtractKey(buffer);
+	ASSERT_TRUE(key.has_value());
+	EXPECT_FALSE(key->sourcePort.has_value());
+}
+
+TEST(FlowHash, Extract_Key_Rejects_Short_Packet)
+{
+	Buffer buffer;
+	Append(std::array{ 0x45_b, 0x00_b }, buffer);
+	EXPECT_FALSE(flow::ExtractKey(buffer).has_value());
+}
+
+TEST(FlowHash, Extract_Key_Rejects_Short_Header_Length)
+{
+	// IHL 4: the "ports" would be the destination address
+	constexpr std::array udpHeader{
+		0x44_b, 0x00_b, 0x00_b, 0x1c_b, 0x00_b, 0x01_b, 0x00_b, 0x00_b, 0x40_b, 0x11_b, 0x00_b, 0x00_b, 0x0a_b, 0x00_b, 0x00_b, 0x01_b,
+		0x0a_b, 0x00_b, 0x00_b, 0x02_b, 0x04_b, 0xd2_b, 0x00_b, 0x35_b, 0x00_b, 0x08_b, 0x00_b, 0x00_b
+	};
+	Buffer buffer;
+	Append(udpHeader, buffer);
+	EXPECT_FALSE(flow::ExtractKey(buffer).has_value());
+}
+
+TEST(FlowHash, Indirection_Table_Spreads_Over_Queues)
+{
+	flow::IndirectionTable<8> table(3);
+	EXPECT_EQ(0_sz, table.QueueFor(0));
+	EXPECT_EQ(1_sz, table.QueueFor(1));
+	EXPECT_EQ(2_sz, table.QueueFor(2));
+	EXPECT_EQ(0_sz, table.QueueFor(3));
+	EXPECT_EQ(1_sz, table.QueueFor(9));
+
+	table.Set(1, 2);
+	EXPECT_EQ(2_sz, table.QueueFor(9));
+}
+
+}
+}
@@ -0,0 +1,185 @@
+#include "gtest/gtest.h"
+#include "forward.h"
+#include "buffer.h"
+#include "protocols/icmp.h"
+#include "protocols/ip.h"
+#include "helpers.h"
+
+#include <utility>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+constexpr uint32_t Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	return (static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 8) | d;
+}
+
+BufferPtr MakePacket(const uint32_t sourceAddr, const uint32_t destAddr, const uint8_t ttl, const uint16_t flags = 0, const uint16_t frag = 0)
+{
+	constexpr std::array payload{ 1_b, 2_b, 3_b, 4_b, 5_b, 6_b, 7_b, 8_b };
+	protocol::ip::Header header{};
+	header.totalLength = static_cast<uint16_t>(protocol::ip::constants::HeaderSize + payload.size());
+	header.flags = flags;
+	header.frag = frag;
+	header.ttl = ttl;
+	header.protocol = protocol::ip::constants::protocol::UDP;
+	header.sourceAddr = sourceAddr;
+	header.destAddr = destAddr;
+	header.headerSize = protocol::ip::constants::HeaderSize;
+
+	auto buffer = std::make_unique<Buffer>();
+	protocol::ip::ConstructHeader(header, *buffer);
+	Append(payload, *buffer);
+	return buffer;
+}
+
+struct ForwardTest : ::testing::Test
+{
+	ForwardTest() : forwarder(routes, [this](size_t interface, BufferPtr buffer) {
+		transmitted.emplace_back(interface, std::move(buffer));
+	}, [this]() { return now; }, { 1, 2 })
+	{
+		forwarder.AddInterface(Addr(10, 0, 0, 1));
+		forwarder.AddInterface(Addr(10, 1, 0, 1));
+		routes.Add({ Addr(10, 0, 0, 0), 16, { 0 } });
+		routes.Add({ Addr(10, 1, 0, 0), 16, { 1 } });
+	}
+
+	routing::Table routes;
+	uint64_t now{};
+	forward::Forwarder forwarder;
+	std::vector<std::pair<size_t, BufferPtr>> transmitted;
+};
+
+TEST_F(ForwardTest, Packet_Is_Forwarded_In_Place_With_Decremented_TTL)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 2), 64);
+	const auto raw = packet.get();
+
+	EXPECT_EQ(forward::Result::Forwarded, forwarder.Forward(0, packet));
+	EXPECT_EQ(nullptr, packet);
+	ASSERT_EQ(1_sz, transmitted.size());
+	EXPECT_EQ(1_sz, transmitted[0].first);
+	EXPECT_EQ(raw, transmitted[0].second.get());
+
+	const auto result = protocol::ip::ParseHeader(*transmitted[0].second);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(result));
+	EXPECT_EQ(63, std::get<protocol::ip::Header>(result).ttl);
+}
+
+TEST_F(ForwardTest, Packet_For_Local_Address_Is_Not_Forwarded)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 1), 64);
+	EXPECT_EQ(forward::Result::Local, forwarder.Forward(0, packet));
+	EXPECT_NE(nullptr, packet);
+	EXPECT_TRUE(transmitted.empty());
+}
+
+TEST_F(ForwardTest, Local_Packet_Hands_Back_Its_Header)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 1), 64);
+	protocol::ip::Header header{};
+	EXPECT_EQ(forward::Result::Local, forwarder.Forward(0, packet, &header));
+	EXPECT_EQ(Addr(10, 0, 0, 2), header.sourceAddr);
+	EXPECT_EQ(Addr(10, 1, 0, 1), header.destAddr);
+	EXPECT_EQ(protocol::ip::constants::protocol::UDP, header.protocol);
+	EXPECT_EQ(64, header.ttl);
+}
+
+TEST_F(ForwardTest, Expired_TTL_Generates_Time_Exceeded)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 2), 1);
+	EXPECT_EQ(forward::Result::TimeExceeded, forwarder.Forward(0, packet));
+	ASSERT_EQ(1_sz, transmitted.size());
+	EXPECT_EQ(0_sz, transmitted[0].first);
+
+	auto& error = *transmitted[0].second;
+	const auto ipResult = protocol::ip::ParseHeader(error);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(ipResult));
+	const auto& ipHeader = std::get<protocol::ip::Header>(ipResult);
+	EXPECT_EQ(Addr(10, 0, 0, 1), ipHeader.sourceAddr);
+	EXPECT_EQ(Addr(10, 0, 0, 2), ipHeader.destAddr);
+
+	const auto icmpResult = protocol::icmp::Parse(ipHeader, error);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(icmpResult));
+	EXPECT_EQ(protocol::icmp::constants::message_type::TimeExceeded, std::get<protocol::icmp::Header>(icmpResult).type);
+}
+
+TEST_F(ForwardTest, Packet_Without_Route_Generates_Destination_Unreachable)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(192, 168, 0, 1), 64);
+	EXPECT_EQ(forward::Result::NoRoute, forwarder.Forward(0, packet));
+	EXPECT_EQ(nullptr, packet);
+	ASSERT_EQ(1_sz, transmitted.size());
+	EXPECT_EQ(0_sz, transmitted[0].first);
+
+	auto& error = *transmitted[0].second;
+	const auto ipResult = protocol::ip::ParseHeader(error);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(ipResult));
+	const auto icmpResult = protocol::icmp::Parse(std::get<protocol::ip::Header>(ipResult), error);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(icmpResult));
+	const auto& icmpHeader = std::get<protocol::icmp::Header>(icmpResult);
+	EXPECT_EQ(protocol::icmp::constants::message_type::DestinationUnreachable, icmpHeader.type);
+	EXPECT_EQ(protocol::icmp::constants::code::destination_unreachable::Net, icmpHeader.code);
+}
+
+TEST_F(ForwardTest, Errors_Are_Rate_Limited)
+{
+	for (int n = 0; n < 5; ++n) {
+		auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(192, 168, 0, 1), 64);
+		EXPECT_EQ(forward::Result::NoRoute, forwarder.Forward(0, packet));
+	}
+	// Burst of 2, then nothing until a token has been refilled
+	EXPECT_EQ(2_sz, transmitted.size());
+
+	now += 1000;
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(192, 168, 0, 1), 64);
+	EXPECT_EQ(forward::Result::NoRoute, forwarder.Forward(0, packet));
+	EXPECT_EQ(3_sz, transmitted.size());
+}
+
+TEST_F(ForwardTest, Invalid_Packet_Is_Rejected)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 2), 64);
+	packet->ModifySpan()[protocol::ip::constants::offset::Checksum] ^= 1_b;
+	EXPECT_EQ(forward::Result::Invalid, forwarder.Forward(0, packet));
+	EXPECT_NE(nullptr, packet);
+	EXPECT_TRUE(transmitted.empty());
+}
+
+TEST_F(ForwardTest, Fragments_Are_Forwarded)
+{
+	// The first fragment, and one further on
+	for (const auto& [flags, frag] : { std::pair{ protocol::ip::constants::flag::MF, uint16_t{0} }, std::pair{ uint16_t{0}, uint16_t{185} } }) {
+		auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 2), 64, flags, frag);
+		EXPECT_EQ(forward::Result::Forwarded, forwarder.Forward(0, packet));
+		ASSERT_FALSE(transmitted.empty());
+		EXPECT_EQ(1_sz, transmitted.back().first);
+
+		// Untouched apart from the TTL
+		const auto result = protocol::ip::ParseHeaderForForwarding(*transmitted.back().second);
+		ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(result));
+		const auto& header = std::get<protocol::ip::Header>(result);
+		EXPECT_EQ(63, header.ttl);
+		EXPECT_EQ(flags, header.flags & protocol::ip::constants::flag::MF);
+		EXPECT_EQ(frag, header.frag);
+	}
+	EXPECT_EQ(2_sz, transmitted.size());
+}
+
+TEST_F(ForwardTest, Truncated_Packet_Is_Rejected)
+{
+	auto packet = MakePacket(Addr(10, 0, 0, 2), Addr(10, 1, 0, 2), 64);
+	auto truncated = std::make_unique<Buffer>();
+	Append(packet->ReadSpan().first(packet->ReadSpan().size() - 1), *truncated);
+	EXPECT_EQ(forward::Result::Invalid, forwarder.Forward(0, truncated));
+	EXPECT_TRUE(transmitted.empty());
+}
+
+}
+}
@@ -1,6 +1,7 @@
 #include "gtest/gtest.h"
 #include "protocols/icmp.h"
 #include "protocols/ip.h"
+#include "protocols/ip_checksum.h"
 #include "buffer.h"
 #include "helpers.h"
 
@@ -52,6 +53,145 @@ TEST(ICMP, Valid_ICMP_Echo_Request_Packet)
 	EXPECT_EQ(0, icmpHeader.code);
 }
 
+TEST(ICMP, Create_Time_Exceeded_Error)
+{
+	Buffer request;
+	Append(icmpEchoRequest, request);
+
+	const auto error = protocol::icmp::CreateError(protocol::icmp::constants::message_type::TimeExceeded,
+		protocol::icmp::constants::code::time_exceeded::TTL, 0, 0x0a000001, request);
+	ASSERT_NE(nullptr, error);
+
+	const auto ipResult = protocol::ip::ParseHeader(*error);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(ipResult));
+	const auto& ipHeader = std::get<protocol::ip::Header>(ipResult);
+	EXPECT_EQ(0x0a000001u, ipHeader.sourceAddr);
+	EXPECT_EQ(0xac1f3101u, ipHeader.destAddr);
+	EXPECT_EQ(20 + 8 + 28, ipHeader.totalLength);
+	EXPECT_EQ(ipHeader.totalLength, error->data().size());
+
+	const auto icmpResult = protocol::icmp::Parse(ipHeader, *error);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(icmpResult));
+	const auto& icmpHeader = std::get<protocol::icmp::Header>(icmpResult);
+	EXPECT_EQ(protocol::icmp::constants::message_type::TimeExceeded, icmpHeader.type);
+	EXPECT_EQ(protocol::icmp::constants::code::time_exceeded::TTL, icmpHeader.code);
+
+	const auto quoted = error->ReadSpan().subspan(28);
+	EXPECT_TRUE(std::equal(quoted.begin(), quoted.end(), icmpEchoRequest.begin()));
+}
+
+TEST(ICMP, Create_Error_Needs_IP_Header)
+{
+	Buffer request;
+	Append(std::array{ 0x45_b, 0x00_b }, request);
+	EXPECT_EQ(nullptr, protocol::icmp::CreateError(protocol::icmp::constants::message_type::TimeExceeded, 0, 0, 0, request));
+}
+
+TEST(ICMP, Corrupt_Header_Yields_Parameter_Problem)
+{
+	auto data = icmpEchoRequest | ranges::to<std::vector>();
+	data[6] |= 0x80_b; // reserved flag
+	Buffer buffer;
+	Append(data, buffer);
+
+	const auto ipResult = protocol::ip::ParseHeader(buffer);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Result>(ipResult));
+	const auto error = protocol::icmp::ErrorFor(std::get<protocol::ip::Result>(ipResult), buffer);
+	ASSERT_TRUE(error.has_value());
+	EXPECT_EQ(protocol::icmp::constants::message_type::ParameterProblem, error->type);
+	EXPECT_EQ(6u << 24, error->rest);
+}
+
+TEST(ICMP, Checksum_Error_Is_Not_Reported)
+{
+	auto data = icmpEchoRequest | ranges::to<std::vector>();
+	data[protocol::ip::constants::offset::Checksum] ^= 1_b;
+	Buffer buffer;
+	Append(data, buffer);
+	EXPECT_FALSE(protocol::icmp::ErrorFor(protocol::ip::Result::ChecksumError, buffer).has_value());
+}
+
+TEST(ICMP, Errors_Are_Not_Reported_About_Errors_Or_Multicast)
+{
+	Buffer request;
+	Append(icmpEchoRequest, request);
+	EXPECT_TRUE(protocol::icmp::MayReportError(request));
+
+	const auto error = protocol::icmp::CreateError(protocol::icmp::constants::message_type::TimeExceeded, 0, 0, 0x0a000001, request);
+	ASSERT_NE(nullptr, error);
+	EXPECT_FALSE(protocol::icmp::MayReportError(*error));
+
+	auto multicast = icmpEchoRequest | ranges::to<std::vector>();
+	multicast[protocol::ip::constants::offset::DestAddr] = 0xe0_b;
+	Buffer multicastRequest;
+	Append(multicast, multicastRequest);
+	EXPECT_FALSE(protocol::icmp::MayReportError(multicastRequest));
+
+	auto fragment = icmpEchoRequest | ranges::to<std::vector>();
+	fragment[7] = 0x01_b;
+	Buffer fragmentRequest;
+	Append(fragment, fragmentRequest);
+	EXPECT_FALSE(protocol::icmp::MayReportError(fragmentRequest));
+}
+
+TEST(ICMP, Error_Generator_Limits_Rate_Per_Destination)
+{
+	protocol::icmp::ErrorGenerator generator({ 1, 3 });
+	const protocol::icmp::Error error{ protocol::icmp::constants::message_type::DestinationUnreachable, protocol::icmp::constants::code::destination_unreachable::Net };
+
+	Buffer request;
+	Append(icmpEchoRequest, request);
+	auto other = icmpEchoRequest | ranges::to<std::vector>();
+	other[protocol::ip::constants::offset::SourceAddr + 3] = 0x09_b;
+	Buffer otherRequest;
+	Append(other, otherRequest);
+
+	size_t sent = 0;
+	for (int n = 0; n < 10; ++n) {
+		if (generator.Generate(error, 0x0a000001, request, 0)) ++sent;
+	}
+	EXPECT_EQ(3_sz, sent);
+	EXPECT_EQ(7_sz, generator.NumberOfRateLimited());
+
+	// Other destinations have their own bucket
+	EXPECT_NE(nullptr, generator.Generate(error, 0x0a000001, otherRequest, 0));
+	// ... and the bucket is refilled over time
+	EXPECT_EQ(nullptr, generator.Generate(error, 0x0a000001, request, 999));
+	EXPECT_NE(nullptr, generator.Generate(error, 0x0a000001, request, 1000));
+}
+
+TEST(ICMP, Error_Generator_Limits_Total_Rate_Across_Destinations)
+{
+	protocol::icmp::ErrorGenerator generator({ 1, 3 }, { 100, 20 });
+	const protocol::icmp::Error error{ protocol::icmp::constants::message_type::DestinationUnreachable, protocol::icmp::constants::code::destination_unreachable::Net };
+
+	// Far more sources than there are buckets, so every one of them starts
+	// out with a full bucket of its own
+	constexpr size_t NumberOfSources = 4 * protocol::icmp::ErrorGenerator::NumberOfBuckets;
+	auto packet = icmpEchoRequest | ranges::to<std::vector>();
+	const auto send = [&](const size_t source, const uint64_t nowMs) {
+		packet[protocol::ip::constants::offset::SourceAddr + 2] = static_cast<std::byte>(source >> 8);
+		packet[protocol::ip::constants::offset::SourceAddr + 3] = static_cast<std::byte>(source);
+		Buffer request;
+		Append(packet, request);
+		return generator.Generate(error, 0x0a000001, request, nowMs) != nullptr;
+	};
+
+	size_t sent = 0;
+	for (size_t source = 0; source < NumberOfSources; ++source) {
+		if (send(source, 0)) ++sent;
+	}
+	EXPECT_EQ(20_sz, sent);
+
+	// Spread over a second, the rate is the limit
+	sent = 0;
+	for (size_t source = 0; source < NumberOfSources; ++source) {
+		if (send(source, 1 + source * 1000 / NumberOfSources)) ++sent;
+	}
+	EXPECT_LE(sent, 100_sz);
+	EXPECT_GE(sent, 90_sz);
+}
+
 TEST(ICMP, Create_Response_Based_On_ICMP_Echo_Request)
 {
     Buffer request;
@@ -62,8 +202,63 @@ TEST(ICMP, Create_Response_Based_On_ICMP_Echo_Request)
 	const auto icmpResult = protocol::icmp::Parse(ipHeader, request);
 	const auto& icmpHeader = std::get<protocol::icmp::Header>(icmpResult);
 
-	auto response = protocol::icmp::CreateEchoResponse(ipHeader, icmpHeader, request);
-	const auto responseData = response.ReadSpan();
+	ASSERT_TRUE(protocol::icmp::CreateEchoResponse(ipHeader, icmpHeader, request));
+
+	const auto responseIpResult = protocol::ip::ParseHeader(request);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(responseIpResult));
+	const auto& responseIpHeader = std::get<protocol::ip::Header>(responseIpResult);
+	EXPECT_EQ(ipHeader.sourceAddr, responseIpHeader.destAddr);
+	EXPECT_EQ(ipHeader.destAddr, responseIpHeader.sourceAddr);
+	EXPECT_EQ(ipHeader.totalLength, responseIpHeader.totalLength);
+
+	const auto responseIcmpResult = protocol::icmp::Parse(responseIpHeader, request);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(responseIcmpResult));
+	EXPECT_EQ(protocol::icmp::constants::message_type::EchoReply, std::get<protocol::icmp::Header>(responseIcmpResult).type);
+
+	// Identifier, sequence number and payload are echoed unchanged
+	const auto responseData = request.ReadSpan();
+	EXPECT_TRUE(std::equal(responseData.begin() + 24, responseData.end(), icmpEchoRequest.begin() + 24, icmpEchoRequest.end()));
+}
+
+TEST(ICMP, Create_Response_For_Request_Spanning_Multiple_Buffers)
+{
+	constexpr size_t payloadSize = 1500;
+	std::vector<std::byte> packet(icmpEchoRequest.begin(), icmpEchoRequest.begin() + 28);
+	for (size_t n = 0; n < payloadSize; ++n)
+		packet.push_back(std::byte{static_cast<uint8_t>(n)});
+	const auto totalLength = static_cast<uint16_t>(packet.size());
+	packet[2] = std::byte{static_cast<uint8_t>(totalLength >> 8)};
+	packet[3] = std::byte{static_cast<uint8_t>(totalLength & 0xff)};
+
+	const auto Checksum = [&](const size_t offset, const size_t length) {
+		auto it = packet.begin() + offset;
+		return protocol::ip::CalculateChecksum(length, [&]() { return std::to_integer<uint8_t>(*it++); });
+	};
+	packet[10] = packet[11] = packet[22] = packet[23] = 0_b;
+	const auto ipChecksum = Checksum(0, 20);
+	packet[10] = std::byte{static_cast<uint8_t>(ipChecksum >> 8)};
+	packet[11] = std::byte{static_cast<uint8_t>(ipChecksum & 0xff)};
+	const auto icmpChecksum = Checksum(20, packet.size() - 20);
+	packet[22] = std::byte{static_cast<uint8_t>(icmpChecksum >> 8)};
+	packet[23] = std::byte{static_cast<uint8_t>(icmpChecksum & 0xff)};
+
+	Buffer request;
+	Append(nonstd::span{packet.data(), Buffer::Size}, request);
+	Append(nonstd::span{packet.data() + Buffer::Size, packet.size() - Buffer::Size}, request.AddBuffer());
+
+	const auto ipResult = protocol::ip::ParseHeader(request);
+	const auto& ipHeader = std::get<protocol::ip::Header>(ipResult);
+	const auto icmpResult = protocol::icmp::Parse(ipHeader, request);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(icmpResult));
+	ASSERT_TRUE(protocol::icmp::Process(ipHeader, std::get<protocol::icmp::Header>(icmpResult), request));
+
+	const auto responseIpResult = protocol::ip::ParseHeader(request);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(responseIpResult));
+	const auto& responseIpHeader = std::get<protocol::ip::Header>(responseIpResult);
+	const auto responseIcmpResult = protocol::icmp::Parse(responseIpHeader, request);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(responseIcmpResult));
+	EXPECT_EQ(protocol::icmp::constants::message_type::EchoReply, std::get<protocol::icmp::Header>(responseIcmpResult).type);
+	EXPECT_EQ(packet.size(), request.data().size());
 }
 
 }
@@ -173,5 +173,44 @@ TEST(IP, ConstructHeader)
 	EXPECT_EQ(20, buffer.ReadSpan().size());
 }
 
+TEST(IP, ConstructHeader_Can_Be_Parsed)
+{
+	const protocol::ip::Header header{
+		.tos = 0,
+		.totalLength = 20,
+		.id = 12345,
+		.flags = 0,
+		.frag = 0,
+		.ttl = 64,
+		.protocol = protocol::ip::constants::protocol::ICMP,
+		.checksum = 0,
+		.sourceAddr = 0xac100001,
+		.destAddr = 0xac100002,
+		.headerSize = 20
+	};
+	Buffer buffer;
+	protocol::ip::ConstructHeader(header, buffer);
+
+	const auto result = protocol::ip::ParseHeader(buffer);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Header>(result));
+	const auto& parsed = std::get<protocol::ip::Header>(result);
+	EXPECT_EQ(header.id, parsed.id);
+	EXPECT_EQ(header.ttl, parsed.ttl);
+	EXPECT_EQ(header.sourceAddr, parsed.sourceAddr);
+	EXPECT_EQ(header.destAddr, parsed.destAddr);
+}
+
+TEST(IP, Header_Length_Below_Minimum_Is_Corrupt)
+{
+	auto data = icmpEchoRequest | ranges::to<std::vector>();
+	data[0] = 0x44_b;
+	Buffer buffer;
+	Append(data, buffer);
+
+	const auto result = protocol::ip::ParseHeader(buffer);
+	ASSERT_TRUE(std::holds_alternative<protocol::ip::Result>(result));
+	EXPECT_EQ(protocol::ip::Result::CorruptHeader, std::get<protocol::ip::Result>(result));
+}
+
 }
 }
@@ -39,5 +39,28 @@ TEST(IPChecksum, Calculate_Checksum_2)
 	EXPECT_EQ(0x87a8, CalculateChecksumFor(ipHeader));
 }
 
+TEST(IPChecksum, Odd_Length_Is_Padded_With_Zero)
+{
+	constexpr std::array odd{ 0x12_b, 0x34_b, 0x56_b };
+	constexpr std::array padded{ 0x12_b, 0x34_b, 0x56_b, 0x00_b };
+	EXPECT_EQ(CalculateChecksumFor(padded), CalculateChecksumFor(odd));
+}
+
+TEST(IPChecksum, Update_Checksum_Matches_Full_Calculation)
+{
+	auto ipHeader = std::array{
+        0x45_b, 0x00_b, 0x00_b, 0x54_b, 0xf8_b, 0xbe_b, 0x40_b, 0x00_b, 0x40_b, 0x01_b, 0x00_b, 0x00_b, 0xac_b, 0x1f_b, 0x31_b, 0x01_b,
+        0xac_b, 0x1f_b, 0x31_b, 0x02_b
+	};
+	uint16_t checksum = CalculateChecksumFor(ipHeader);
+	for (int ttl = 0x40; ttl > 0; --ttl) {
+		const uint16_t oldWord = (ttl << 8) | 0x01;
+		const uint16_t newWord = ((ttl - 1) << 8) | 0x01;
+		ipHeader[8] = std::byte{static_cast<uint8_t>(ttl - 1)};
+		checksum = protocol::ip::UpdateChecksum(checksum, oldWord, newWord);
+		EXPECT_EQ(CalculateChecksumFor(ipHeader), checksum);
+	}
+}
+
 }
 }
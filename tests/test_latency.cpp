@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+#include "latency.h"
+#include "stats.h"
+
+namespace netstack {
+
+namespace {
+
+TEST(Latency, Small_Values_Have_Buckets_Of_Their_Own)
+{
+	for (uint64_t v = 0; v < latency::SubBuckets; ++v) {
+		EXPECT_EQ(v, latency::BucketFor(v));
+		EXPECT_EQ(v, latency::LowerBound(v));
+		EXPECT_EQ(v, latency::UpperBound(v));
+	}
+}
+
+TEST(Latency, Buckets_Cover_All_Values_In_Order)
+{
+	for (size_t bucket = 0; bucket + 1 < latency::NumberOfBuckets; ++bucket) {
+		EXPECT_EQ(latency::UpperBound(bucket) + 1, latency::LowerBound(bucket + 1));
+		EXPECT_EQ(bucket, latency::BucketFor(latency::LowerBound(bucket)));
+		EXPECT_EQ(bucket, latency::BucketFor(latency::UpperBound(bucket)));
+	}
+	EXPECT_EQ(latency::NumberOfBuckets - 1, latency::BucketFor(latency::MaxValue));
+	EXPECT_EQ(latency::NumberOfBuckets - 1, latency::BucketFor(~uint64_t{0}));
+}
+
+TEST(Latency, Bucket_Width_Is_Bounded_By_The_Value)
+{
+	for (size_t bucket = latency::SubBuckets; bucket < latency::NumberOfBuckets; ++bucket) {
+		const auto width = latency::UpperBound(bucket) - latency::LowerBound(bucket) + 1;
+		EXPECT_LE(width * latency::SubBuckets, latency::LowerBound(bucket));
+	}
+}
+
+TEST(Latency, Percentiles_Are_Taken_From_The_Buckets)
+{
+	latency::Histogram<uint64_t> histogram{};
+	histogram[latency::BucketFor(100)] = 900;
+	histogram[latency::BucketFor(1000)] = 99;
+	histogram[latency::BucketFor(100000)] = 1;
+
+	const auto summary = latency::Summarize(histogram, 2.0);
+	EXPECT_EQ(1000u, summary.count);
+	EXPECT_EQ(static_cast<double>(latency::UpperBound(latency::BucketFor(100))) / 2.0, summary.p50);
+	EXPECT_EQ(static_cast<double>(latency::UpperBound(latency::BucketFor(1000))) / 2.0, summary.p99);
+	EXPECT_EQ(static_cast<double>(latency::UpperBound(latency::BucketFor(100000))) / 2.0, summary.max);
+	EXPECT_GE(summary.p50 * 2.0, 100.0);
+	EXPECT_LT(summary.p50 * 2.0, 100.0 * (1.0 + 1.0 / latency::SubBuckets));
+}
+
+TEST(Latency, Empty_Histograms_Have_An_Empty_Summary)
+{
+	const auto summary = latency::Summarize(latency::Histogram<uint64_t>{}, 1.0);
+	EXPECT_EQ(0u, summary.count);
+	EXPECT_EQ(0.0, summary.max);
+}
+
+TEST(Latency, Stage_Timer_Records_Only_When_Enabled)
+{
+	const auto count = [](const stats::Snapshot& snapshot) {
+		return latency::Summarize(snapshot.latency[static_cast<size_t>(latency::Stage::Protocol)], 1.0).count;
+	};
+
+	const auto before = stats::Aggregate();
+	stats::StageTimer timer;
+	timer.Mark(latency::Stage::Protocol);
+	timer.Mark(latency::Stage::Protocol);
+	const auto after = stats::Aggregate();
+
+	if constexpr (latency::Enabled) {
+		EXPECT_EQ(count(before) + 2, count(after));
+		EXPECT_GT(after.ticksPerNanosecond, 0.0);
+	} else {
+		EXPECT_TRUE(after.latency.empty());
+	}
+}
+
+}
+}
@@ -0,0 +1,352 @@
+#include "gtest/gtest.h"
+#include "pcap.h"
+#include "drivers/pcapdevice.h"
+#include "drivers/wiredevice.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+// Minimal IPv4 packet; only the version nibble matters to the reader
+std::vector<std::byte> MakeIPv4(const std::byte tag, const size_t size = 20)
+{
+	std::vector<std::byte> packet(size);
+	packet[0] = 0x45_b;
+	packet[size - 1] = tag;
+	return packet;
+}
+
+class Bytes
+{
+public:
+	Bytes& LE16(const uint16_t v) { return Put(v, 2, false); }
+	Bytes& LE32(const uint32_t v) { return Put(v, 4, false); }
+	Bytes& BE16(const uint16_t v) { return Put(v, 2, true); }
+	Bytes& BE32(const uint32_t v) { return Put(v, 4, true); }
+	Bytes& Append(const std::vector<std::byte>& v) { data.insert(data.end(), v.begin(), v.end()); return *this; }
+	Bytes& Pad() { while (data.size() % 4) data.push_back(0_b); return *this; }
+	size_t Size() const { return data.size(); }
+
+	std::vector<std::byte> data;
+
+private:
+	Bytes& Put(const uint32_t v, const int size, const bool bigEndian)
+	{
+		for (int n = 0; n < size; ++n) {
+			const auto shift = bigEndian ? (size - 1 - n) * 8 : n * 8;
+			data.push_back(static_cast<std::byte>(v >> shift));
+		}
+		return *this;
+	}
+};
+
+struct PcapTest : ::testing::Test
+{
+	PcapTest()
+	{
+		char name[] = "/tmp/netstack_pcap_XXXXXX";
+		const auto fd = ::mkstemp(name);
+		::close(fd);
+		path = name;
+	}
+	~PcapTest() { std::remove(path.c_str()); }
+
+	void WriteFile(const std::vector<std::byte>& data)
+	{
+		std::ofstream f(path, std::ios::binary | std::ios::trunc);
+		f.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size()));
+	}
+
+	std::string path;
+};
+
+TEST_F(PcapTest, Written_Packets_Can_Be_Read_Back)
+{
+	std::vector<BufferPtr> packets;
+	for (const auto size : { 20_sz, 100_sz, Buffer::Size + 500 }) {
+		auto data = MakeIPv4(static_cast<std::byte>(size), size);
+		auto packet = std::make_unique<Buffer>();
+		auto buffer = packet.get();
+		for (size_t offset = 0; offset < data.size(); ) {
+			if (buffer->WriteSpan().empty()) buffer = &buffer->AddBuffer();
+			const auto amount = std::min(buffer->WriteSpan().size(), data.size() - offset);
+			std::copy_n(data.begin() + offset, amount, buffer->WriteSpan().begin());
+			buffer->IncrementFilled(amount);
+			offset += amount;
+		}
+		packets.push_back(std::move(packet));
+	}
+
+	{
+		pcap::Writer writer(64); // tiny buffer, so that it is swapped often
+		ASSERT_EQ(pcap::Result::Success, writer.Open(path));
+		for (size_t n = 0; n < packets.size(); ++n)
+			writer.Write(*packets[n], 1'600'000'000'123'456'789ull + n);
+		EXPECT_EQ(pcap::Result::Success, writer.Close());
+	}
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	for (size_t n = 0; n < packets.size(); ++n) {
+		const auto packet = reader.Next();
+		ASSERT_TRUE(packet.has_value());
+		EXPECT_EQ(1'600'000'000'123'456'789ull + n, packet->timestamp);
+		const std::vector<std::byte> expected(packets[n]->data().begin(), packets[n]->data().end());
+		EXPECT_TRUE(std::equal(expected.begin(), expected.end(), packet->data.begin(), packet->data.end()));
+	}
+	EXPECT_FALSE(reader.Next().has_value());
+}
+
+TEST_F(PcapTest, Truncated_Records_Keep_Their_Original_Length)
+{
+	const auto packet = MakeIPv4(7_b, 100);
+	{
+		pcap::Writer writer;
+		ASSERT_EQ(pcap::Result::Success, writer.Open(path));
+		writer.Write(nonstd::span<const std::byte>{ packet.data(), 40 }, 100, 5);
+		EXPECT_EQ(pcap::Result::Success, writer.Close());
+	}
+
+	std::ifstream f(path, std::ios::binary);
+	std::vector<char> file{ std::istreambuf_iterator<char>(f), std::istreambuf_iterator<char>() };
+	ASSERT_EQ(24u + 16u + 40u, file.size());
+	uint32_t captured, original;
+	std::memcpy(&captured, file.data() + 24 + 8, 4);
+	std::memcpy(&original, file.data() + 24 + 12, 4);
+	EXPECT_EQ(40u, captured);
+	EXPECT_EQ(100u, original);
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	const auto read = reader.Next();
+	ASSERT_TRUE(read.has_value());
+	EXPECT_EQ(5u, read->timestamp);
+	EXPECT_EQ(40u, read->data.size());
+}
+
+TEST_F(PcapTest, Writer_Flushes_Periodically)
+{
+	pcap::Writer writer;
+	ASSERT_EQ(pcap::Result::Success, writer.Open(path));
+	Buffer buffer;
+	Append(MakeIPv4(1_b), buffer);
+	writer.Write(buffer, 0);
+
+	// Nowhere near a full buffer, yet it shows up in the file
+	std::this_thread::sleep_for(pcap::Writer::FlushInterval * 3);
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	EXPECT_TRUE(reader.Next().has_value());
+}
+
+TEST_F(PcapTest, Swapped_Microsecond_Ethernet_Capture)
+{
+	const auto ipv4 = MakeIPv4(1_b);
+	const auto vlanIPv4 = MakeIPv4(2_b);
+	const std::vector<std::byte> arp(28);
+
+	// Big-endian file, so swapped on the machines we run on
+	Bytes file;
+	file.BE32(0xa1b2c3d4).BE16(2).BE16(4).BE32(0).BE32(0).BE32(65535).BE32(pcap::constants::link_type::Ethernet);
+	const auto Record = [&](const uint32_t seconds, const uint32_t microseconds, const std::vector<std::byte>& frame) {
+		file.BE32(seconds).BE32(microseconds).BE32(frame.size()).BE32(frame.size()).Append(frame);
+	};
+	const auto Ethernet = [](const uint16_t etherType, const std::vector<std::byte>& payload, const bool vlan = false) {
+		Bytes frame;
+		frame.Append(std::vector<std::byte>(12));
+		if (vlan) frame.BE16(0x8100).BE16(42);
+		frame.BE16(etherType).Append(payload);
+		return frame.data;
+	};
+	Record(10, 500000, Ethernet(0x0800, ipv4));
+	Record(11, 0, Ethernet(0x0806, arp));
+	Record(12, 1, Ethernet(0x0800, vlanIPv4, true));
+	WriteFile(file.data);
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	auto packet = reader.Next();
+	ASSERT_TRUE(packet.has_value());
+	EXPECT_EQ(10'500'000'000ull, packet->timestamp);
+	EXPECT_TRUE(std::equal(ipv4.begin(), ipv4.end(), packet->data.begin(), packet->data.end()));
+
+	packet = reader.Next();
+	ASSERT_TRUE(packet.has_value());
+	EXPECT_EQ(12'000'001'000ull, packet->timestamp);
+	EXPECT_TRUE(std::equal(vlanIPv4.begin(), vlanIPv4.end(), packet->data.begin(), packet->data.end()));
+	EXPECT_FALSE(reader.Next().has_value());
+
+	reader.Rewind();
+	EXPECT_TRUE(reader.Next().has_value());
+}
+
+TEST_F(PcapTest, PcapNG_With_Timestamp_Resolution)
+{
+	const auto first = MakeIPv4(1_b, 21);
+	const auto second = MakeIPv4(2_b);
+
+	Bytes file;
+	// Section header
+	file.LE32(0x0a0d0d0a).LE32(28).LE32(0x1a2b3c4d).LE16(1).LE16(0).LE32(0xffffffff).LE32(0xffffffff).LE32(28);
+	// Interface with nanosecond timestamps
+	file.LE32(1).LE32(32).LE16(pcap::constants::link_type::Raw).LE16(0).LE32(0);
+	file.LE16(9).LE16(1).Append({ 9_b }).Pad().LE16(0).LE16(0).LE32(32);
+	// Enhanced packet
+	{
+		Bytes block;
+		constexpr uint64_t timestamp = 5'000'000'000'123;
+		block.LE32(timestamp >> 32).LE32(timestamp & 0xffffffff).LE32(first.size()).LE32(first.size()).Append(first).Pad();
+		const auto length = static_cast<uint32_t>(block.Size() + 16);
+		file.LE32(6).LE32(length).LE32(0).Append(block.data).LE32(length);
+	}
+	// Some unknown block
+	file.LE32(0x0bad).LE32(16).LE32(0).LE32(16);
+	// Simple packet
+	{
+		Bytes block;
+		block.LE32(second.size()).Append(second).Pad();
+		const auto length = static_cast<uint32_t>(block.Size() + 12);
+		file.LE32(3).LE32(length).Append(block.data).LE32(length);
+	}
+	WriteFile(file.data);
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	auto packet = reader.Next();
+	ASSERT_TRUE(packet.has_value());
+	EXPECT_EQ(5'000'000'000'123ull, packet->timestamp);
+	EXPECT_TRUE(std::equal(first.begin(), first.end(), packet->data.begin(), packet->data.end()));
+
+	packet = reader.Next();
+	ASSERT_TRUE(packet.has_value());
+	EXPECT_TRUE(std::equal(second.begin(), second.end(), packet->data.begin(), packet->data.end()));
+	EXPECT_FALSE(reader.Next().has_value());
+}
+
+TEST_F(PcapTest, Garbage_Is_Rejected)
+{
+	WriteFile(std::vector<std::byte>(64, 0x55_b));
+	pcap::Reader reader;
+	EXPECT_EQ(pcap::Result::InvalidFormat, reader.Open(path));
+	EXPECT_EQ(pcap::Result::CannotOpen, reader.Open("/nonexistent/file.pcap"));
+}
+
+TEST_F(PcapTest, Oversized_Enhanced_Packet_Is_Rejected)
+{
+	const auto packet = MakeIPv4(1_b);
+
+	Bytes file;
+	file.LE32(0x0a0d0d0a).LE32(28).LE32(0x1a2b3c4d).LE16(1).LE16(0).LE32(0xffffffff).LE32(0xffffffff).LE32(28);
+	file.LE32(1).LE32(20).LE16(pcap::constants::link_type::Raw).LE16(0).LE32(0).LE32(20);
+	// The captured length would wrap a 32-bit bounds check
+	{
+		Bytes block;
+		block.LE32(0).LE32(0).LE32(0xfffffff0).LE32(packet.size()).Append(packet).Pad();
+		const auto length = static_cast<uint32_t>(block.Size() + 16);
+		file.LE32(6).LE32(length).LE32(0).Append(block.data).LE32(length);
+	}
+	WriteFile(file.data);
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	EXPECT_FALSE(reader.Next().has_value());
+}
+
+void WriteCapture(const std::string& path, const size_t numberOfPackets, const uint64_t spacing)
+{
+	pcap::Writer writer;
+	ASSERT_EQ(pcap::Result::Success, writer.Open(path));
+	for (size_t n = 0; n < numberOfPackets; ++n) {
+		Buffer buffer;
+		Append(MakeIPv4(static_cast<std::byte>(n)), buffer);
+		writer.Write(buffer, n * spacing);
+	}
+}
+
+TEST_F(PcapTest, Replay_At_Maximum_Speed)
+{
+	WriteCapture(path, 5, 1'000'000'000);
+	devices::PcapReplayDevice device;
+	ASSERT_EQ(pcap::Result::Success, device.Open(path));
+
+	// Timestamps are a second apart, which must not matter
+	const auto start = std::chrono::steady_clock::now();
+	std::array<BufferPtr, 3> burst;
+	EXPECT_EQ(3_sz, std::get<size_t>(device.RxBurst(burst)));
+	Verify(MakeIPv4(0_b), *burst[0]);
+	EXPECT_EQ(2_sz, std::get<size_t>(device.RxBurst(burst)));
+	Verify(MakeIPv4(4_b), *burst[1]);
+	EXPECT_EQ(0_sz, std::get<size_t>(device.RxBurst(burst)));
+	EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(500));
+	EXPECT_EQ(5u, device.GetCounters().rxPackets.Get());
+}
+
+TEST_F(PcapTest, Replay_Loops)
+{
+	WriteCapture(path, 2, 0);
+	devices::ReplayConfig config;
+	config.loop = true;
+	devices::PcapReplayDevice device(config);
+	ASSERT_EQ(pcap::Result::Success, device.Open(path));
+
+	std::array<BufferPtr, 5> burst;
+	EXPECT_EQ(5_sz, std::get<size_t>(device.RxBurst(burst)));
+	Verify(MakeIPv4(0_b), *burst[4]);
+}
+
+TEST_F(PcapTest, Replay_Honors_Timestamps)
+{
+	constexpr auto spacing = std::chrono::milliseconds(30);
+	WriteCapture(path, 3, std::chrono::nanoseconds(spacing).count());
+	devices::ReplayConfig config;
+	config.honorTimestamps = true;
+	devices::PcapReplayDevice device(config);
+	ASSERT_EQ(pcap::Result::Success, device.Open(path));
+
+	const auto start = std::chrono::steady_clock::now();
+	std::array<BufferPtr, 8> burst;
+	size_t received = 0;
+	while (received < 3) {
+		// Packets are not held back until the burst is full
+		const auto amount = std::get<size_t>(device.RxBurst(burst));
+		EXPECT_EQ(1_sz, amount);
+		received += amount;
+	}
+	EXPECT_GE(std::chrono::steady_clock::now() - start, spacing * 2);
+}
+
+TEST_F(PcapTest, Capture_Records_Both_Directions)
+{
+	pcap::Writer writer;
+	ASSERT_EQ(pcap::Result::Success, writer.Open(path));
+	devices::CaptureDevice device(devices::WireDevice::CreateLoopback(), writer);
+
+	std::array<BufferPtr, 1> burst{ std::make_unique<Buffer>() };
+	Append(MakeIPv4(7_b), *burst[0]);
+	ASSERT_EQ(1_sz, std::get<size_t>(device.TxBurst(burst)));
+	ASSERT_EQ(1_sz, std::get<size_t>(device.RxBurst(burst)));
+	EXPECT_EQ(1u, device.GetCounters().txPackets.Get());
+	EXPECT_EQ(1u, device.GetCounters().rxPackets.Get());
+	ASSERT_EQ(pcap::Result::Success, writer.Close());
+
+	pcap::Reader reader;
+	ASSERT_EQ(pcap::Result::Success, reader.Open(path));
+	EXPECT_TRUE(reader.Next().has_value());
+	EXPECT_TRUE(reader.Next().has_value());
+	EXPECT_FALSE(reader.Next().has_value());
+}
+
+}
+}
@@ -0,0 +1,66 @@
+#include "gtest/gtest.h"
+#include "ratelimit.h"
+
+namespace netstack {
+
+namespace {
+
+TEST(RateLimit, Burst_Is_Allowed_Then_Limited)
+{
+	ratelimit::TokenBucketTable<16> table({ 1, 4 });
+	for (int n = 0; n < 4; ++n)
+		EXPECT_TRUE(table.Allow(1, 0));
+	EXPECT_FALSE(table.Allow(1, 0));
+}
+
+TEST(RateLimit, Tokens_Are_Refilled_Over_Time)
+{
+	ratelimit::TokenBucketTable<16> table({ 10, 1 });
+	EXPECT_TRUE(table.Allow(1, 0));
+	EXPECT_FALSE(table.Allow(1, 50));
+	EXPECT_TRUE(table.Allow(1, 100));
+	EXPECT_FALSE(table.Allow(1, 100));
+
+	// Refill never exceeds the burst size
+	EXPECT_TRUE(table.Allow(1, 100000));
+	EXPECT_FALSE(table.Allow(1, 100000));
+}
+
+TEST(RateLimit, Single_Bucket_Is_Only_Spent_When_Taken)
+{
+	ratelimit::TokenBucket bucket({ 10, 2 });
+	EXPECT_TRUE(bucket.Check(0));
+	EXPECT_TRUE(bucket.Check(0));
+	bucket.Take();
+	bucket.Take();
+	EXPECT_FALSE(bucket.Check(0));
+	EXPECT_FALSE(bucket.Check(50));
+	EXPECT_TRUE(bucket.Check(100));
+}
+
+TEST(RateLimit, Keys_Have_Independent_Buckets)
+{
+	ratelimit::TokenBucketTable<16> table({ 1, 1 });
+	EXPECT_TRUE(table.Allow(1, 0));
+	EXPECT_TRUE(table.Allow(2, 0));
+	EXPECT_FALSE(table.Allow(1, 0));
+	EXPECT_FALSE(table.Allow(2, 0));
+}
+
+TEST(RateLimit, Oldest_Bucket_Is_Evicted_When_Full)
+{
+	ratelimit::TokenBucketTable<4, 4> table({ 1, 1 });
+	for (uint64_t key = 0; key < 4; ++key)
+		EXPECT_TRUE(table.Allow(key, key));
+
+	// Evicts key 0, which then starts over with a full bucket
+	EXPECT_TRUE(table.Allow(4, 10));
+	EXPECT_FALSE(table.Allow(4, 10));
+	EXPECT_TRUE(table.Allow(0, 10));
+	// ... evicting key 1 in turn; the others keep their state
+	EXPECT_FALSE(table.Allow(2, 10));
+	EXPECT_TRUE(table.Allow(1, 10));
+}
+
+}
+}
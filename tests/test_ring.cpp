@@ -0,0 +1,155 @@
+#include "gtest/gtest.h"
+#include "ring.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include <thread>
+#include <vector>
+
+namespace netstack {
+namespace {
+
+using namespace helpers;
+
+TEST(SPSCRing, Empty_When_Created)
+{
+	SPSCRing<int, 4> ring;
+	EXPECT_TRUE(ring.Empty());
+	EXPECT_FALSE(ring.Pop().has_value());
+}
+
+TEST(SPSCRing, Items_Are_Popped_In_Order)
+{
+	SPSCRing<int, 4> ring;
+	EXPECT_TRUE(ring.Push(1));
+	EXPECT_TRUE(ring.Push(2));
+	EXPECT_EQ(2_sz, ring.Size());
+	EXPECT_EQ(1, *ring.Pop());
+	EXPECT_EQ(2, *ring.Pop());
+	EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SPSCRing, Push_Fails_When_Full)
+{
+	SPSCRing<int, 4> ring;
+	for (int n = 0; n < 4; ++n)
+		EXPECT_TRUE(ring.Push(std::move(n)));
+	EXPECT_FALSE(ring.Push(4));
+	EXPECT_EQ(0, *ring.Pop());
+	EXPECT_TRUE(ring.Push(4));
+}
+
+TEST(SPSCRing, Burst_Is_Truncated_To_Available_Space)
+{
+	SPSCRing<int, 4> ring;
+	std::array in{ 1, 2, 3, 4, 5, 6 };
+	EXPECT_EQ(4_sz, ring.PushBurst(in));
+
+	std::array<int, 6> out{};
+	EXPECT_EQ(4_sz, ring.PopBurst(out));
+	EXPECT_EQ(1, out[0]);
+	EXPECT_EQ(4, out[3]);
+	EXPECT_EQ(0_sz, ring.PopBurst(out));
+}
+
+TEST(SPSCRing, Carries_Buffers_By_Ownership)
+{
+	SPSCRing<BufferPtr, 2> ring;
+	auto buffer = std::make_unique<Buffer>();
+	const auto raw = buffer.get();
+	EXPECT_TRUE(ring.Push(std::move(buffer)));
+	EXPECT_EQ(nullptr, buffer);
+
+	auto popped = ring.Pop();
+	ASSERT_TRUE(popped.has_value());
+	EXPECT_EQ(raw, popped->get());
+}
+
+TEST(SPSCRing, Transfers_Between_Threads)
+{
+	constexpr size_t numberOfItems = 100000;
+	SPSCRing<size_t, 64> ring;
+
+	std::thread producer([&]() {
+		std::array<size_t, 8> burst;
+		for (size_t n = 0; n < numberOfItems; ) {
+			size_t amount = std::min(burst.size(), numberOfItems - n);
+			for (size_t i = 0; i < amount; ++i)
+				burst[i] = n + i;
+			size_t pushed = 0;
+			while (pushed < amount)
+				pushed += ring.PushBurst(nonstd::span{burst.data() + pushed, amount - pushed});
+			n += amount;
+		}
+	});
+
+	size_t expected = 0;
+	std::array<size_t, 16> burst;
+	while (expected < numberOfItems) {
+		const auto amount = ring.PopBurst(burst);
+		for (size_t i = 0; i < amount; ++i)
+			ASSERT_EQ(expected++, burst[i]);
+	}
+	producer.join();
+	EXPECT_TRUE(ring.Empty());
+}
+
+TEST(MPSCRing, Items_Are_Popped_In_Order)
+{
+	MPSCRing<int, 4> ring;
+	EXPECT_TRUE(ring.Push(1));
+	EXPECT_TRUE(ring.Push(2));
+	EXPECT_EQ(1, *ring.Pop());
+	EXPECT_EQ(2, *ring.Pop());
+	EXPECT_FALSE(ring.Pop().has_value());
+}
+
+TEST(MPSCRing, Burst_Is_Truncated_To_Available_Space)
+{
+	MPSCRing<int, 4> ring;
+	EXPECT_TRUE(ring.Push(0));
+	std::array in{ 1, 2, 3, 4, 5 };
+	EXPECT_EQ(3_sz, ring.PushBurst(in));
+	EXPECT_FALSE(ring.Push(6));
+
+	std::array<int, 8> out{};
+	EXPECT_EQ(4_sz, ring.PopBurst(out));
+	EXPECT_EQ(0, out[0]);
+	EXPECT_EQ(3, out[3]);
+}
+
+TEST(MPSCRing, Preserves_Per_Producer_Order)
+{
+	constexpr size_t numberOfProducers = 4;
+	constexpr size_t itemsPerProducer = 50000;
+	MPSCRing<size_t, 128> ring;
+
+	std::vector<std::thread> producers;
+	for (size_t p = 0; p < numberOfProducers; ++p) {
+		producers.emplace_back([&, p]() {
+			for (size_t n = 0; n < itemsPerProducer; ++n) {
+				auto item = (p << 32) | n;
+				while (!ring.Push(std::move(item)))
+					std::this_thread::yield();
+			}
+		});
+	}
+
+	std::array<size_t, numberOfProducers> next{};
+	size_t received = 0;
+	std::array<size_t, 32> burst;
+	while (received < numberOfProducers * itemsPerProducer) {
+		const auto amount = ring.PopBurst(burst);
+		for (size_t i = 0; i < amount; ++i) {
+			const auto producer = burst[i] >> 32;
+			ASSERT_LT(producer, numberOfProducers);
+			ASSERT_EQ(next[producer]++, burst[i] & 0xffffffff);
+		}
+		received += amount;
+	}
+	for (auto& t : producers)
+		t.join();
+}
+
+}
+}
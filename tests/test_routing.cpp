@@ -0,0 +1,158 @@
+#include "gtest/gtest.h"
+#include "routing.h"
+#include "helpers.h"
+
+#include <atomic>
+#include <thread>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+constexpr uint32_t Addr(uint8_t a, uint8_t b, uint8_t c, uint8_t d)
+{
+	return (static_cast<uint32_t>(a) << 24) | (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(c) << 8) | d;
+}
+
+std::optional<size_t> InterfaceFor(const routing::Table& table, const uint32_t addr)
+{
+	if (auto nextHop = table.Lookup(addr); nextHop) return nextHop->interface;
+	return {};
+}
+
+TEST(Routing, Empty_Table_Has_No_Routes)
+{
+	routing::Table table;
+	EXPECT_FALSE(table.Lookup(Addr(10, 0, 0, 1)).has_value());
+}
+
+TEST(Routing, Default_Route_Matches_Everything)
+{
+	routing::Table table;
+	EXPECT_EQ(routing::Result::Success, table.Add({ 0, 0, { 1, Addr(10, 0, 0, 254) } }));
+	const auto nextHop = table.Lookup(Addr(192, 168, 1, 1));
+	ASSERT_TRUE(nextHop.has_value());
+	EXPECT_EQ(1_sz, nextHop->interface);
+	EXPECT_EQ(Addr(10, 0, 0, 254), nextHop->gateway);
+}
+
+TEST(Routing, Longest_Prefix_Wins_At_Every_Level)
+{
+	routing::Table table;
+	table.Add({ Addr(10, 0, 0, 0), 8, { 1 } });
+	table.Add({ Addr(10, 1, 0, 0), 16, { 2 } });
+	table.Add({ Addr(10, 1, 2, 0), 24, { 3 } });
+	table.Add({ Addr(10, 1, 2, 128), 25, { 4 } });
+	table.Add({ Addr(10, 1, 2, 200), 32, { 5 } });
+
+	EXPECT_EQ(1_sz, InterfaceFor(table, Addr(10, 9, 9, 9)));
+	EXPECT_EQ(2_sz, InterfaceFor(table, Addr(10, 1, 9, 9)));
+	EXPECT_EQ(3_sz, InterfaceFor(table, Addr(10, 1, 2, 1)));
+	EXPECT_EQ(4_sz, InterfaceFor(table, Addr(10, 1, 2, 129)));
+	EXPECT_EQ(5_sz, InterfaceFor(table, Addr(10, 1, 2, 200)));
+	EXPECT_FALSE(table.Lookup(Addr(11, 0, 0, 0)).has_value());
+}
+
+TEST(Routing, Insertion_Order_Does_Not_Matter)
+{
+	routing::Table table;
+	table.Add({ Addr(10, 1, 2, 128), 25, { 4 } });
+	table.Add({ Addr(10, 1, 0, 0), 17, { 2 } });
+	table.Add({ Addr(10, 0, 0, 0), 8, { 1 } });
+
+	EXPECT_EQ(1_sz, InterfaceFor(table, Addr(10, 1, 128, 0)));
+	EXPECT_EQ(2_sz, InterfaceFor(table, Addr(10, 1, 2, 127)));
+	EXPECT_EQ(4_sz, InterfaceFor(table, Addr(10, 1, 2, 255)));
+}
+
+TEST(Routing, Host_Bits_Of_Prefix_Are_Ignored)
+{
+	routing::Table table;
+	table.Add({ Addr(192, 168, 1, 77), 24, { 3 } });
+	EXPECT_EQ(3_sz, InterfaceFor(table, Addr(192, 168, 1, 1)));
+	EXPECT_EQ(routing::Result::Success, table.Remove(Addr(192, 168, 1, 0), 24));
+	EXPECT_FALSE(table.Lookup(Addr(192, 168, 1, 1)).has_value());
+}
+
+TEST(Routing, Add_Replaces_Existing_Route)
+{
+	routing::Table table;
+	table.Add({ Addr(10, 0, 0, 0), 8, { 1 } });
+	table.Add({ Addr(10, 0, 0, 0), 8, { 2 } });
+	EXPECT_EQ(1_sz, table.Routes().size());
+	EXPECT_EQ(2_sz, InterfaceFor(table, Addr(10, 0, 0, 1)));
+}
+
+TEST(Routing, Remove_Falls_Back_To_Shorter_Prefix)
+{
+	routing::Table table;
+	table.Add({ Addr(10, 0, 0, 0), 8, { 1 } });
+	table.Add({ Addr(10, 1, 2, 0), 24, { 3 } });
+	EXPECT_EQ(3_sz, InterfaceFor(table, Addr(10, 1, 2, 3)));
+
+	EXPECT_EQ(routing::Result::Success, table.Remove(Addr(10, 1, 2, 0), 24));
+	EXPECT_EQ(1_sz, InterfaceFor(table, Addr(10, 1, 2, 3)));
+	EXPECT_EQ(routing::Result::NotFound, table.Remove(Addr(10, 1, 2, 0), 24));
+}
+
+TEST(Routing, Invalid_Prefix_Length_Is_Rejected)
+{
+	routing::Table table;
+	EXPECT_EQ(routing::Result::InvalidPrefixLength, table.Add({ 0, 33, { 1 } }));
+}
+
+TEST(Routing, Bulk_Lookup)
+{
+	routing::Table table;
+	table.Replace({
+		{ Addr(10, 0, 0, 0), 8, { 1 } },
+		{ Addr(172, 16, 0, 0), 12, { 2 } },
+		{ Addr(192, 168, 0, 0), 16, { 3 } },
+	});
+
+	std::vector<uint32_t> addrs;
+	for (int n = 0; n < 100; ++n) {
+		addrs.push_back(Addr(10, 0, 0, n));
+		addrs.push_back(Addr(172, 31, n, 0));
+		addrs.push_back(Addr(192, 168, 0, n));
+		addrs.push_back(Addr(8, 8, 8, n));
+	}
+	std::vector<std::optional<routing::NextHop>> nextHops(addrs.size());
+	table.Lookup(addrs, nextHops);
+	for (size_t n = 0; n < addrs.size(); ++n) {
+		const auto expected = table.Lookup(addrs[n]);
+		ASSERT_EQ(expected.has_value(), nextHops[n].has_value());
+		if (!expected) continue;
+		EXPECT_EQ(expected->interface, nextHops[n]->interface);
+	}
+	EXPECT_FALSE(nextHops[3].has_value());
+}
+
+TEST(Routing, Readers_Are_Not_Disturbed_By_Updates)
+{
+	routing::Table table;
+	table.Add({ Addr(10, 0, 0, 0), 8, { 1 } });
+
+	std::atomic<bool> done{};
+	std::atomic<size_t> misses{};
+	std::thread reader([&]() {
+		while (!done) {
+			// The covering /8 is never removed, so every lookup must succeed
+			if (!table.Lookup(Addr(10, 1, 2, 3)))
+				++misses;
+		}
+	});
+
+	for (int n = 0; n < 200; ++n) {
+		table.Add({ Addr(10, 1, 2, 0), 24, { 2 } });
+		table.Remove(Addr(10, 1, 2, 0), 24);
+	}
+	done = true;
+	reader.join();
+	EXPECT_EQ(0_sz, misses.load());
+}
+
+}
+}
@@ -108,7 +108,7 @@ TEST(SLIP, Transmit_Only_Special_Bytes_In_Single_Buffer)
 	};
 
 	CaptureTransmit capture;
-	slip::Transmit(buffer, capture);
+	EXPECT_EQ(2u, slip::Transmit(buffer, capture));
 	capture.Verify(expected);
 }
 
@@ -259,5 +259,85 @@ TEST(SLIP, Decode_Single_Escape_Does_Not_Advance_Iterator)
 	EXPECT_EQ(data.begin(), it);
 }
 
+// Collects the frames produced by a slip::Decoder
+struct DecodedFrames
+{
+	template<typename Container> void Feed(slip::Decoder& decoder, const Container& data)
+	{
+		const auto it = decoder.Decode(data, [&](const auto b) {
+			current.push_back(b);
+		}, [&](const bool complete = true) {
+			if (complete && !current.empty()) frames.push_back(current);
+			if (!complete) ++discarded;
+			current.clear();
+		});
+		EXPECT_EQ(data.end(), it);
+	}
+
+	std::vector<std::vector<std::byte>> frames;
+	std::vector<std::byte> current;
+	int discarded{};
+};
+
+TEST(SLIPDecoder, Escape_Is_Resumed_In_The_Next_Call)
+{
+	slip::Decoder decoder;
+	DecodedFrames decoded;
+	decoded.Feed(decoder, std::array{ 1_b, slip::constants::ESC });
+	decoded.Feed(decoder, std::array{ slip::constants::ESC_ESC, 2_b, slip::constants::END });
+
+	ASSERT_EQ(1_sz, decoded.frames.size());
+	EXPECT_EQ((std::vector{ 1_b, slip::constants::ESC, 2_b }), decoded.frames[0]);
+	EXPECT_EQ(0u, decoder.GetStats().invalidEscapes);
+	EXPECT_EQ(1u, decoder.GetStats().escapes);
+}
+
+TEST(SLIPDecoder, Oversized_Frames_Are_Dropped)
+{
+	slip::Decoder decoder(4);
+	DecodedFrames decoded;
+	decoded.Feed(decoder, std::array{ 1_b, 2_b, 3_b, 4_b, 5_b, 6_b, slip::constants::END, 7_b, slip::constants::END });
+
+	ASSERT_EQ(1_sz, decoded.frames.size());
+	EXPECT_EQ((std::vector{ 7_b }), decoded.frames[0]);
+	EXPECT_EQ(1u, decoder.GetStats().oversized);
+	EXPECT_EQ(1u, decoder.GetStats().dropped);
+}
+
+TEST(SLIPDecoder, Frame_Of_Maximum_Size_Is_Accepted)
+{
+	slip::Decoder decoder(4);
+	DecodedFrames decoded;
+	decoded.Feed(decoder, std::array{ 1_b, 2_b, slip::constants::ESC, slip::constants::ESC_END, 4_b, slip::constants::END });
+
+	ASSERT_EQ(1_sz, decoded.frames.size());
+	EXPECT_EQ(0u, decoder.GetStats().dropped);
+}
+
+TEST(SLIPDecoder, Invalid_Escape_Keeps_The_Byte)
+{
+	slip::Decoder decoder;
+	DecodedFrames decoded;
+	decoded.Feed(decoder, std::array{ 1_b, slip::constants::ESC, 0x42_b, slip::constants::END });
+
+	ASSERT_EQ(1_sz, decoded.frames.size());
+	EXPECT_EQ((std::vector{ 1_b, 0x42_b }), decoded.frames[0]);
+	EXPECT_EQ(1u, decoder.GetStats().invalidEscapes);
+	EXPECT_EQ(0u, decoder.GetStats().dropped);
+}
+
+TEST(SLIPDecoder, Escape_Before_End_Drops_The_Frame)
+{
+	slip::Decoder decoder;
+	DecodedFrames decoded;
+	decoded.Feed(decoder, std::array{ 1_b, slip::constants::ESC, slip::constants::END, 2_b, slip::constants::END });
+
+	ASSERT_EQ(1_sz, decoded.frames.size());
+	EXPECT_EQ((std::vector{ 2_b }), decoded.frames[0]);
+	EXPECT_EQ(1, decoded.discarded);
+	EXPECT_EQ(1u, decoder.GetStats().invalidEscapes);
+	EXPECT_EQ(1u, decoder.GetStats().dropped);
+}
+
+}
 }
-}
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include "gtest/gtest.h"
+#include "drivers/slipdevice.h"
+#include "buffer.h"
+#include "slip.h"
+#include "netorder.h"
+#include "protocols/ip_checksum.h"
+#include "helpers.h"
+
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <cerrno>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+// Provides a SLIPDevice on the slave side of a pseudo terminal; the test
+// plays the remote end on the master side
+struct SLIPDeviceTest : ::testing::TestWithParam<devices::SLIPDevice::Backend>
+{
+	void SetUp() override
+	{
+		master = ::posix_openpt(O_RDWR | O_NOCTTY);
+		if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0)
+			GTEST_SKIP() << "cannot allocate a pseudo terminal";
+
+		// No line discipline processing, so bytes pass unmodified
+		termios tio{};
+		::tcgetattr(master, &tio);
+		::cfmakeraw(&tio);
+		::tcsetattr(master, TCSANOW, &tio);
+
+		ASSERT_FALSE(OpenDevice({}).has_value());
+	}
+
+	std::optional<devices::NetDevice::ErrorCode> OpenDevice(devices::SLIPConfig config)
+	{
+		config.backend = GetParam();
+		return device.Open(::ptsname(master), config);
+	}
+
+	termios SlaveAttributes()
+	{
+		termios tio{};
+		const auto slave = ::open(::ptsname(master), O_RDWR | O_NOCTTY);
+		EXPECT_GE(slave, 0);
+		EXPECT_EQ(0, ::tcgetattr(slave, &tio));
+		::close(slave);
+		return tio;
+	}
+
+	void TearDown() override
+	{
+		if (master >= 0) ::close(master);
+	}
+
+	void SendFromRemote(const std::vector<std::byte>& packet)
+	{
+		Buffer buffer;
+		auto current = &buffer;
+		for (size_t offset = 0; offset < packet.size(); offset += Buffer::Size) {
+			if (offset > 0) current = &current->AddBuffer();
+			const auto end = packet.begin() + std::min(offset + Buffer::Size, packet.size());
+			Append(std::vector<std::byte>(packet.begin() + offset, end), *current);
+		}
+		std::vector<std::byte> encoded;
+		slip::Transmit(buffer, [&](const std::byte b) { encoded.push_back(b); });
+		ASSERT_EQ(static_cast<ssize_t>(encoded.size()), ::write(master, encoded.data(), encoded.size()));
+	}
+
+	int master{-1};
+	devices::SLIPDevice device;
+};
+
+TEST_P(SLIPDeviceTest, Default_MTU_And_No_Capabilities)
+{
+	EXPECT_EQ(devices::SLIPDevice::DefaultMTU, device.MTU());
+	EXPECT_EQ(0u, device.Capabilities());
+}
+
+TEST_P(SLIPDeviceTest, RxBurst_Returns_All_Frames_Received_Together)
+{
+	SendFromRemote({ 1_b, 2_b, 3_b });
+	SendFromRemote({ 0xc0_b, 0xdb_b });
+	SendFromRemote({ 4_b });
+
+	std::array<BufferPtr, 8> burst;
+	size_t received = 0;
+	while (received < 3) {
+		const auto result = device.RxBurst(nonstd::span{burst.data() + received, burst.size() - received});
+		ASSERT_TRUE(std::holds_alternative<size_t>(result));
+		received += std::get<size_t>(result);
+	}
+	Verify(std::array{ 1_b, 2_b, 3_b }, *burst[0]);
+	Verify(std::array{ 0xc0_b, 0xdb_b }, *burst[1]);
+	Verify(std::array{ 4_b }, *burst[2]);
+	EXPECT_EQ(3u, device.GetCounters().rxPackets.Get());
+	EXPECT_EQ(6u, device.GetCounters().rxBytes.Get());
+}
+
+TEST_P(SLIPDeviceTest, RxBurst_Keeps_Frames_That_Do_Not_Fit)
+{
+	SendFromRemote({ 1_b });
+	SendFromRemote({ 2_b });
+
+	std::array<BufferPtr, 1> burst;
+	for (const auto expected : { 1_b, 2_b }) {
+		const auto result = device.RxBurst(burst);
+		ASSERT_TRUE(std::holds_alternative<size_t>(result));
+		ASSERT_EQ(1u, std::get<size_t>(result));
+		Verify(std::array{ expected }, *burst[0]);
+	}
+}
+
+TEST_P(SLIPDeviceTest, TxBurst_Encodes_All_Frames)
+{
+	std::array<BufferPtr, 2> burst;
+	burst[0] = std::make_unique<Buffer>();
+	Append(std::array{ 1_b, 0xc0_b }, *burst[0]);
+	burst[1] = std::make_unique<Buffer>();
+	Append(std::array{ 2_b }, *burst[1]);
+
+	const auto result = device.TxBurst(burst);
+	ASSERT_TRUE(std::holds_alternative<size_t>(result));
+	EXPECT_EQ(2u, std::get<size_t>(result));
+	EXPECT_EQ(nullptr, burst[0]);
+	EXPECT_EQ(2u, device.GetCounters().txPackets.Get());
+
+	const std::array expected{ 0xc0_b, 1_b, 0xdb_b, 0xdc_b, 0xc0_b, 0xc0_b, 2_b, 0xc0_b };
+	std::array<std::byte, expected.size()> encoded;
+	size_t filled = 0;
+	while (filled < encoded.size()) {
+		const auto amount = ::read(master, encoded.data() + filled, encoded.size() - filled);
+		ASSERT_GT(amount, 0);
+		filled += static_cast<size_t>(amount);
+	}
+	EXPECT_EQ(expected, encoded);
+}
+
+TEST_P(SLIPDeviceTest, TxBurst_Keeps_Frames_In_Order_Across_Bursts)
+{
+	// More bursts than there may be writes in flight
+	constexpr size_t NumberOfBursts = 32;
+	for (size_t n = 0; n < NumberOfBursts; ++n) {
+		std::array<BufferPtr, 1> burst;
+		burst[0] = std::make_unique<Buffer>();
+		Append(std::array{ static_cast<std::byte>(n) }, *burst[0]);
+		ASSERT_TRUE(std::holds_alternative<size_t>(device.TxBurst(burst)));
+	}
+
+	std::array<std::byte, NumberOfBursts * 3> encoded;
+	size_t filled = 0;
+	while (filled < encoded.size()) {
+		const auto amount = ::read(master, encoded.data() + filled, encoded.size() - filled);
+		ASSERT_GT(amount, 0);
+		filled += static_cast<size_t>(amount);
+	}
+	for (size_t n = 0; n < NumberOfBursts; ++n)
+		EXPECT_EQ(static_cast<std::byte>(n), encoded[n * 3 + 1]);
+	EXPECT_EQ(NumberOfBursts, device.GetCounters().txPackets.Get());
+}
+
+TEST_P(SLIPDeviceTest, Frames_Spanning_Many_Reads_Arrive_In_Order)
+{
+	// Far more than a read returns, so that reads must stay in order
+	constexpr size_t NumberOfFrames = 64;
+	std::thread remote([&]() {
+		for (size_t n = 0; n < NumberOfFrames; ++n)
+			SendFromRemote(std::vector<std::byte>(1000, static_cast<std::byte>(n)));
+	});
+
+	std::array<BufferPtr, NumberOfFrames> burst;
+	size_t received = 0;
+	while (received < NumberOfFrames) {
+		const auto result = device.RxBurst(nonstd::span{burst.data() + received, burst.size() - received});
+		if (!std::holds_alternative<size_t>(result)) break;
+		received += std::get<size_t>(result);
+	}
+	remote.join();
+	ASSERT_EQ(NumberOfFrames, received);
+	for (size_t n = 0; n < NumberOfFrames; ++n)
+		Verify(std::vector<std::byte>(1000, static_cast<std::byte>(n)), *burst[n]);
+}
+
+TEST_P(SLIPDeviceTest, Frames_Larger_Than_A_Buffer_Are_Received)
+{
+	std::vector<std::byte> packet;
+	for (size_t n = 0; n < 1500; ++n)
+		packet.push_back(static_cast<std::byte>(n));
+	SendFromRemote(packet);
+	SendFromRemote(packet);
+
+	std::array<BufferPtr, 2> burst;
+	size_t received = 0;
+	while (received < 2) {
+		const auto result = device.RxBurst(nonstd::span{burst.data() + received, burst.size() - received});
+		ASSERT_TRUE(std::holds_alternative<size_t>(result));
+		received += std::get<size_t>(result);
+	}
+	for (const auto& buffer : burst) {
+		auto data = buffer->data();
+		EXPECT_EQ(packet, std::vector<std::byte>(data.begin(), data.end()));
+	}
+}
+
+TEST_P(SLIPDeviceTest, Tty_Is_Put_In_Raw_Mode)
+{
+	const auto tio = SlaveAttributes();
+	EXPECT_EQ(0u, tio.c_lflag & (ICANON | ECHO | ISIG));
+	EXPECT_EQ(0u, tio.c_iflag & (ICRNL | IXON | ISTRIP));
+	EXPECT_EQ(0u, tio.c_oflag & OPOST);
+	EXPECT_EQ(1, tio.c_cc[VMIN]);
+	EXPECT_EQ(0, tio.c_cc[VTIME]);
+}
+
+TEST_P(SLIPDeviceTest, Read_Batching_Is_Configurable)
+{
+	devices::SLIPConfig config;
+	config.minBytes = 64;
+	config.interByteTimeout = 2;
+	ASSERT_FALSE(OpenDevice(config).has_value());
+
+	const auto tio = SlaveAttributes();
+	EXPECT_EQ(64, tio.c_cc[VMIN]);
+	EXPECT_EQ(2, tio.c_cc[VTIME]);
+}
+
+TEST_P(SLIPDeviceTest, Baud_Rate_Is_Applied)
+{
+	devices::SLIPConfig config;
+	config.baudRate = 115200;
+	ASSERT_FALSE(OpenDevice(config).has_value());
+
+	const auto tio = SlaveAttributes();
+	EXPECT_EQ(B115200, ::cfgetospeed(&tio));
+	EXPECT_EQ(B115200, ::cfgetispeed(&tio));
+}
+
+TEST_P(SLIPDeviceTest, Unsupported_Baud_Rate_Is_Rejected)
+{
+	devices::SLIPConfig config;
+	config.baudRate = 12345;
+	const auto result = OpenDevice(config);
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(EINVAL, *result);
+}
+
+TEST_P(SLIPDeviceTest, Control_Characters_Pass_Unmodified)
+{
+	// Carriage return, newline, interrupt, XON/XOFF, erase and EOF would all
+	// be acted upon by a tty in canonical mode
+	const std::vector packet{ 0x0d_b, 0x0a_b, 0x03_b, 0x11_b, 0x13_b, 0x7f_b, 0x04_b, 0xff_b };
+	SendFromRemote(packet);
+
+	std::array<BufferPtr, 1> burst;
+	const auto result = device.RxBurst(burst);
+	ASSERT_TRUE(std::holds_alternative<size_t>(result));
+	ASSERT_EQ(1u, std::get<size_t>(result));
+	Verify(packet, *burst[0]);
+}
+
+TEST_P(SLIPDeviceTest, IOUring_Is_Used_If_The_Kernel_Supports_It)
+{
+	if (GetParam() != devices::SLIPDevice::Backend::IOUring) {
+		EXPECT_EQ(GetParam(), device.GetBackend());
+		return;
+	}
+	devices::uring::Ring ring;
+	if (ring.Setup(4))
+		GTEST_SKIP() << "io_uring is not available";
+	EXPECT_EQ(devices::SLIPDevice::Backend::IOUring, device.GetBackend());
+}
+
+TEST_P(SLIPDeviceTest, Compressed_Headers_Round_Trip)
+{
+	devices::SLIPConfig config;
+	config.compressHeaders = true;
+	ASSERT_FALSE(OpenDevice(config).has_value());
+
+	// Two consecutive segments of a bulk transfer; the second one only
+	// differs in the IP id and sequence number
+	const auto segment = [](const uint16_t id, const uint32_t seq) {
+		std::vector<std::byte> packet(140);
+		auto it = packet.begin();
+		using namespace net_order;
+		for (const uint16_t v : { 0x4500, 140, int(id), 0x4000, 0x4006, 0, 0x0a00, 0x0001, 0x0a00, 0x0002, 1234, 80 })
+			Produce_u16(it, v);
+		Produce_u32(it, seq);
+		Produce_u32(it, 2000);
+		for (const uint16_t v : { 0x5010, 8192, 0x1234, 0 })
+			Produce_u16(it, v);
+		auto source = packet.begin();
+		const auto checksum = protocol::ip::CalculateChecksum(20, [&]() { return Consume_u8(source); });
+		auto dest = packet.begin() + 10;
+		Produce_u16(dest, checksum);
+		return packet;
+	};
+	const std::vector packets{ segment(1, 1000), segment(2, 1100) };
+
+	std::array<BufferPtr, 2> burst;
+	for (size_t n = 0; n < burst.size(); ++n) {
+		burst[n] = std::make_unique<Buffer>();
+		Append(packets[n], *burst[n]);
+	}
+	ASSERT_TRUE(std::holds_alternative<size_t>(device.TxBurst(burst)));
+	EXPECT_EQ(1u, device.GetCompressorStats().uncompressed);
+	EXPECT_EQ(1u, device.GetCompressorStats().compressed);
+
+	// Both frames with their delimiters; the second one has a 3 byte header
+	std::vector<std::byte> encoded(142 + 105);
+	size_t filled = 0;
+	while (filled < encoded.size()) {
+		const auto amount = ::read(master, encoded.data() + filled, encoded.size() - filled);
+		ASSERT_GT(amount, 0);
+		filled += static_cast<size_t>(amount);
+	}
+	EXPECT_EQ(0x75_b, encoded[1]);
+	EXPECT_EQ(std::byte{0x80 | protocol::vj::constants::change::SpecialD}, encoded[143]);
+
+	// Played back, the remote's frames decompress to the original packets
+	ASSERT_EQ(static_cast<ssize_t>(encoded.size()), ::write(master, encoded.data(), encoded.size()));
+	size_t received = 0;
+	while (received < 2) {
+		const auto result = device.RxBurst(nonstd::span{burst.data() + received, burst.size() - received});
+		ASSERT_TRUE(std::holds_alternative<size_t>(result));
+		received += std::get<size_t>(result);
+	}
+	for (size_t n = 0; n < burst.size(); ++n)
+		Verify(packets[n], *burst[n]);
+	EXPECT_EQ(1u, device.GetDecompressorStats().compressed);
+}
+
+INSTANTIATE_TEST_SUITE_P(SLIP, SLIPDeviceTest, ::testing::Values(devices::SLIPDevice::Backend::Read, devices::SLIPDevice::Backend::IOUring, devices::SLIPDevice::Backend::BusyPoll),
+	[](const auto& info) {
+		switch(info.param) {
+			case devices::SLIPDevice::Backend::Read: return "Read";
+			case devices::SLIPDevice::Backend::IOUring: return "IOUring";
+			default: return "BusyPoll";
+		}
+	});
+
+}
+}
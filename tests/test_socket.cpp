@@ -0,0 +1,239 @@
+#include "gtest/gtest.h"
+#include "socket.h"
+#include "protocols/ip.h"
+#include "protocols/udp.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include "range/v3/range/conversion.hpp"
+
+#include <cerrno>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+constexpr socket::Endpoint client{ 0x0a000001, 1234 };
+constexpr socket::Endpoint server{ 0x0a000002, 7 };
+
+BufferPtr MakePacket(const socket::Endpoint& source, const socket::Endpoint& destination, const std::string_view text)
+{
+	auto payload = std::make_unique<Buffer>();
+	Append(nonstd::span{reinterpret_cast<const std::byte*>(text.data()), text.size()}, *payload);
+	return protocol::udp::Construct(source.addr, source.port, destination.addr, destination.port, std::move(payload));
+}
+
+std::string Text(const Buffer& buffer)
+{
+	const auto bytes = buffer.data() | ranges::to<std::vector>();
+	return std::string(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+}
+
+struct Stack {
+	// Parses the packet as the main loop does and hands it over
+	bool Deliver(BufferPtr& buffer)
+	{
+		const auto ipHeader = std::get<protocol::ip::Header>(protocol::ip::ParseHeader(*buffer));
+		const auto udpHeader = std::get<protocol::udp::Header>(protocol::udp::Parse(ipHeader, *buffer));
+		return sockets.Deliver(ipHeader, udpHeader, buffer);
+	}
+
+	bool Deliver(const socket::Endpoint& source, const socket::Endpoint& destination, const std::string_view text)
+	{
+		auto buffer = MakePacket(source, destination, text);
+		return Deliver(buffer);
+	}
+
+	std::vector<BufferPtr> transmitted;
+	bool transmitFails{};
+	socket::Stack sockets{[this](BufferPtr buffer) {
+		if (transmitFails) return false;
+		transmitted.push_back(std::move(buffer));
+		return true;
+	}};
+};
+
+socket::Task ReceiveOne(socket::Stack& stack, const socket::Endpoint local, std::vector<socket::Datagram>& received)
+{
+	socket::UDPSocket socket(stack);
+	if (socket.Bind(local)) co_return;
+	received.push_back(co_await socket.Receive());
+}
+
+socket::Task Echo(socket::Stack& stack, const uint16_t port)
+{
+	socket::UDPSocket socket(stack);
+	if (socket.Bind({ 0, port })) co_return;
+	for (;;) {
+		auto datagram = co_await socket.Receive();
+		std::swap(datagram.source, datagram.destination);
+		co_await socket.Send(std::move(datagram));
+	}
+}
+
+TEST(Socket, Receiving_Coroutine_Is_Resumed_By_Run)
+{
+	Stack stack;
+	std::vector<socket::Datagram> received;
+	ReceiveOne(stack.sockets, { 0, server.port }, received);
+
+	EXPECT_TRUE(stack.Deliver(client, server, "hello"));
+	EXPECT_TRUE(received.empty());
+	EXPECT_EQ(1u, stack.sockets.Run());
+	ASSERT_EQ(1u, received.size());
+	EXPECT_EQ("hello", Text(*received[0].data));
+	EXPECT_EQ(client, received[0].source);
+	EXPECT_EQ(server, received[0].destination);
+	EXPECT_EQ(0u, stack.sockets.Run());
+
+	// The coroutine has returned, so the port is free again
+	EXPECT_FALSE(stack.Deliver(client, server, "again"));
+}
+
+TEST(Socket, Packets_For_Other_Ports_And_Addresses_Are_Left_Alone)
+{
+	Stack stack;
+	std::vector<socket::Datagram> received;
+	ReceiveOne(stack.sockets, server, received);
+
+	auto buffer = MakePacket(client, { server.addr, 8 }, "hello");
+	EXPECT_FALSE(stack.Deliver(buffer));
+	ASSERT_TRUE(buffer);
+	buffer = MakePacket(client, { server.addr + 1, server.port }, "hello");
+	EXPECT_FALSE(stack.Deliver(buffer));
+	ASSERT_TRUE(buffer);
+	EXPECT_EQ(0u, stack.sockets.Run());
+	EXPECT_TRUE(received.empty());
+}
+
+TEST(Socket, Echo_Sends_The_Received_Buffer_Back)
+{
+	Stack stack;
+	Echo(stack.sockets, server.port);
+
+	auto buffer = MakePacket(client, server, "ping");
+	const auto payload = buffer->next();
+	ASSERT_TRUE(stack.Deliver(buffer));
+	stack.sockets.Run();
+
+	ASSERT_EQ(1u, stack.transmitted.size());
+	auto& reply = *stack.transmitted[0];
+	const auto ipHeader = std::get<protocol::ip::Header>(protocol::ip::ParseHeader(reply));
+	const auto udpResult = protocol::udp::Parse(ipHeader, reply);
+	ASSERT_TRUE(std::holds_alternative<protocol::udp::Header>(udpResult));
+	const auto& udpHeader = std::get<protocol::udp::Header>(udpResult);
+	EXPECT_EQ(server.addr, ipHeader.sourceAddr);
+	EXPECT_EQ(client.addr, ipHeader.destAddr);
+	EXPECT_EQ(server.port, udpHeader.sourcePort);
+	EXPECT_EQ(client.port, udpHeader.destPort);
+
+	// The payload went back in the very segment it arrived in
+	bool found = false;
+	for (const auto segment : reply.chain())
+		found |= segment == payload;
+	EXPECT_TRUE(found);
+	reply.Consume(ipHeader.headerSize + protocol::udp::constants::HeaderSize);
+	EXPECT_EQ("ping", Text(reply));
+}
+
+TEST(Socket, Datagrams_Beyond_The_Queue_Are_Dropped)
+{
+	Stack stack;
+	std::vector<socket::Datagram> received;
+	ReceiveOne(stack.sockets, server, received);
+	for (size_t n = 0; n < socket::UDPSocket::QueueLength + 2; ++n)
+		EXPECT_TRUE(stack.Deliver(client, server, std::to_string(n)));
+	stack.sockets.Run();
+	ASSERT_EQ(1u, received.size());
+	EXPECT_EQ("0", Text(*received[0].data));
+}
+
+TEST(Socket, Ports_Are_Bound_Once)
+{
+	Stack stack;
+	socket::UDPSocket first(stack.sockets);
+	socket::UDPSocket second(stack.sockets);
+	EXPECT_FALSE(first.Bind({ 0, 53 }).has_value());
+	EXPECT_EQ(EINVAL, first.Bind({ 0, 54 }));
+	EXPECT_EQ(EADDRINUSE, second.Bind({ 0, 53 }));
+
+	first.Close();
+	EXPECT_FALSE(second.Bind({ 0, 53 }).has_value());
+}
+
+TEST(Socket, Ephemeral_Ports_Are_Unique)
+{
+	Stack stack;
+	std::vector<std::unique_ptr<socket::UDPSocket>> sockets;
+	for (size_t n = 0; n < 100; ++n) {
+		auto& socket = *sockets.emplace_back(std::make_unique<socket::UDPSocket>(stack.sockets));
+		ASSERT_FALSE(socket.Bind({}).has_value());
+		EXPECT_GE(socket.Local().port, 49152);
+		for (size_t m = 0; m < n; ++m)
+			EXPECT_NE(sockets[m]->Local().port, socket.Local().port);
+	}
+}
+
+TEST(Socket, Closing_Wakes_The_Receiver)
+{
+	Stack stack;
+	socket::UDPSocket socket(stack.sockets);
+	ASSERT_FALSE(socket.Bind(server).has_value());
+
+	bool woken = false;
+	[](socket::UDPSocket& socket, bool& woken) -> socket::Task {
+		const auto datagram = co_await socket.Receive();
+		woken = !datagram.data;
+	}(socket, woken);
+
+	socket.Close();
+	EXPECT_FALSE(woken);
+	stack.sockets.Run();
+	EXPECT_TRUE(woken);
+}
+
+TEST(Socket, Send_Errors)
+{
+	Stack stack;
+	socket::UDPSocket socket(stack.sockets);
+	ASSERT_FALSE(socket.Bind({ 0, 7 }).has_value());
+
+	std::vector<std::optional<socket::ErrorCode>> results;
+	[](socket::UDPSocket& socket, Stack& stack, std::vector<std::optional<socket::ErrorCode>>& results) -> socket::Task {
+		// Bound to any address, so the source must be given
+		results.push_back(co_await socket.Send({ {}, {}, client }));
+		results.push_back(co_await socket.Send({ {}, server, client }));
+		stack.transmitFails = true;
+		results.push_back(co_await socket.Send({ {}, server, client }));
+	}(socket, stack, results);
+
+	ASSERT_EQ(3u, results.size());
+	EXPECT_EQ(EADDRNOTAVAIL, results[0]);
+	EXPECT_FALSE(results[1].has_value());
+	EXPECT_EQ(ENOBUFS, results[2]);
+	EXPECT_EQ(1u, stack.transmitted.size());
+}
+
+TEST(Socket, Thousands_Of_Endpoints)
+{
+	constexpr size_t NumberOfEndpoints = 10000;
+	Stack stack;
+	std::vector<socket::Datagram> received;
+	for (size_t n = 0; n < NumberOfEndpoints; ++n)
+		ReceiveOne(stack.sockets, { 0, static_cast<uint16_t>(1000 + n) }, received);
+
+	for (size_t n = 0; n < NumberOfEndpoints; ++n)
+		ASSERT_TRUE(stack.Deliver(client, { server.addr, static_cast<uint16_t>(1000 + n) }, "x"));
+	EXPECT_EQ(NumberOfEndpoints, stack.sockets.Run());
+	ASSERT_EQ(NumberOfEndpoints, received.size());
+	EXPECT_EQ(1000 + NumberOfEndpoints - 1, received.back().destination.port);
+}
+
+}
+}
@@ -0,0 +1,136 @@
+#include "gtest/gtest.h"
+#include "stats.h"
+#include "buffer.h"
+#include "drivers/netdevice.h"
+#include "protocols/ip.h"
+#include "helpers.h"
+
+#include <unistd.h>
+#include <cerrno>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+static_assert(alignof(stats::Slot) == stats::CacheLineSize);
+
+uint64_t Get(const stats::Id id) { return stats::Aggregate()[id]; }
+
+TEST(Stats, Counts_Are_Visible_In_The_Aggregate)
+{
+	const auto before = Get(stats::Id::ReceiveRingDrops);
+	stats::Add(stats::Id::ReceiveRingDrops);
+	stats::Add(stats::Id::ReceiveRingDrops, 4);
+	EXPECT_EQ(before + 5, Get(stats::Id::ReceiveRingDrops));
+}
+
+TEST(Stats, Threads_Count_Into_Their_Own_Slots)
+{
+	constexpr size_t NumberOfThreads = 8;
+	constexpr size_t NumberOfAdds = 100000;
+	const auto before = Get(stats::Id::TransmitRingDrops);
+
+	std::vector<std::thread> threads;
+	for (size_t n = 0; n < NumberOfThreads; ++n) {
+		threads.emplace_back([]() {
+			for (size_t i = 0; i < NumberOfAdds; ++i)
+				stats::Add(stats::Id::TransmitRingDrops);
+		});
+	}
+	for (auto& thread : threads)
+		thread.join();
+	EXPECT_EQ(before + NumberOfThreads * NumberOfAdds, Get(stats::Id::TransmitRingDrops));
+}
+
+TEST(Stats, Slots_Of_Exited_Threads_Are_Reused_And_Keep_Their_Counts)
+{
+	const auto before = Get(stats::Id::SLIPRxEscapes);
+	for (size_t n = 0; n < 2 * stats::NumberOfSlots; ++n)
+		std::thread([]() { stats::Add(stats::Id::SLIPRxEscapes); }).join();
+	EXPECT_EQ(before + 2 * stats::NumberOfSlots, Get(stats::Id::SLIPRxEscapes));
+
+	const auto inUse = stats::detail::current.load()->slotsInUse.load();
+	EXPECT_LT(__builtin_popcountll(inUse), 4);
+}
+
+TEST(Stats, IP_Drops_Are_Counted_By_Reason)
+{
+	const auto before = stats::Aggregate();
+	Buffer buffer;
+	Append(std::array{ 0x45_b, 0x00_b }, buffer);
+	protocol::ip::ParseHeader(buffer);
+
+	const auto after = stats::Aggregate();
+	EXPECT_EQ(before[stats::Id::IPReceived] + 1, after[stats::Id::IPReceived]);
+	EXPECT_EQ(before[stats::Id::IPNotEnoughData] + 1, after[stats::Id::IPNotEnoughData]);
+	EXPECT_EQ(before[stats::Id::IPChecksumError], after[stats::Id::IPChecksumError]);
+}
+
+TEST(Stats, Names_Are_Set)
+{
+	EXPECT_EQ("ip.received", stats::Name(stats::Id::IPReceived));
+	EXPECT_EQ("ring.transmit_drops", stats::Name(stats::Id::TransmitRingDrops));
+	EXPECT_EQ("tx_errors", stats::DeviceCounterName(stats::NumberOfDeviceCounters - 1));
+}
+
+TEST(Stats, Files_Of_Other_Kinds_Are_Rejected)
+{
+	char path[] = "/tmp/netstack-stats-XXXXXX";
+	const auto fd = ::mkstemp(path);
+	ASSERT_GE(fd, 0);
+	ASSERT_EQ(5, ::write(fd, "hello", 5));
+	::close(fd);
+
+	const auto result = stats::Read(path);
+	::unlink(path);
+	ASSERT_TRUE(std::holds_alternative<stats::ErrorCode>(result));
+	EXPECT_EQ(EINVAL, std::get<stats::ErrorCode>(result));
+}
+
+// Exporting redirects the counting of the whole test process; the other
+// tests only compare counts taken before and after
+TEST(Stats, Exported_File_Can_Be_Read_While_Counting)
+{
+	char path[] = "/tmp/netstack-stats-XXXXXX";
+	const auto fd = ::mkstemp(path);
+	ASSERT_GE(fd, 0);
+	::close(fd);
+	ASSERT_FALSE(stats::Export(path).has_value());
+
+	static devices::Counters counters;
+	counters.rxPackets.Add(3);
+	counters.txErrors.Add(1);
+	ASSERT_FALSE(stats::RegisterDevice("tun:test", counters).has_value());
+
+	std::thread([]() { stats::Add(stats::Id::ICMPEchoReplies, 7); }).join();
+	stats::Add(stats::Id::ICMPEchoReplies);
+	stats::Publish();
+
+	const auto result = stats::Read(path);
+	::unlink(path);
+	ASSERT_TRUE(std::holds_alternative<stats::Snapshot>(result));
+	const auto& snapshot = std::get<stats::Snapshot>(result);
+	EXPECT_EQ(8u, snapshot[stats::Id::ICMPEchoReplies]);
+	EXPECT_EQ(0u, snapshot[stats::Id::IPReceived]);
+	EXPECT_EQ(1u, snapshot.sequence);
+	ASSERT_EQ(1u, snapshot.devices.size());
+	EXPECT_EQ("tun:test", snapshot.devices[0].name);
+	EXPECT_EQ(3u, snapshot.devices[0].values[0]);
+	EXPECT_EQ(1u, snapshot.devices[0].values[7]);
+
+	// The device keeps the values it had when it went away
+	stats::UnregisterDevice(counters);
+	counters.rxPackets.Add(1);
+	stats::Publish();
+	const auto unregistered = stats::Aggregate();
+	ASSERT_EQ(1u, unregistered.devices.size());
+	EXPECT_EQ(3u, unregistered.devices[0].values[0]);
+}
+
+}
+}
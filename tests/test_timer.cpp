@@ -0,0 +1,177 @@
+#include "gtest/gtest.h"
+#include "timer.h"
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace netstack {
+
+namespace {
+
+// Remembers when it fired, according to the test's notion of time
+struct Recorder {
+	explicit Recorder(const uint64_t& now) : timer([this, &now]() { firedAt.push_back(now); }) { }
+
+	timer::Timer timer;
+	std::vector<uint64_t> firedAt;
+};
+
+TEST(Timer, Fires_Once_When_Expired)
+{
+	uint64_t now = 0;
+	timer::Wheel wheel;
+	Recorder recorder(now);
+	wheel.Arm(recorder.timer, 10);
+	EXPECT_TRUE(recorder.timer.Armed());
+	EXPECT_EQ(1u, wheel.Size());
+
+	now = 9;
+	EXPECT_EQ(0u, wheel.Advance(now));
+	now = 10;
+	EXPECT_EQ(1u, wheel.Advance(now));
+	now = 1000;
+	EXPECT_EQ(0u, wheel.Advance(now));
+
+	EXPECT_EQ(std::vector<uint64_t>{ 10 }, recorder.firedAt);
+	EXPECT_FALSE(recorder.timer.Armed());
+	EXPECT_EQ(0u, wheel.Size());
+}
+
+TEST(Timer, Cancelled_Timers_Do_Not_Fire)
+{
+	uint64_t now = 0;
+	timer::Wheel wheel;
+	Recorder recorder(now);
+	wheel.Arm(recorder.timer, 5);
+	recorder.timer.Cancel();
+	EXPECT_FALSE(recorder.timer.Armed());
+	EXPECT_EQ(0u, wheel.Size());
+	EXPECT_EQ(0u, wheel.Advance(100));
+	EXPECT_TRUE(recorder.firedAt.empty());
+
+	// Destroying an armed timer cancels it as well
+	{
+		Recorder gone(now);
+		wheel.Arm(gone.timer, 5000);
+	}
+	EXPECT_EQ(0u, wheel.Size());
+	EXPECT_EQ(0u, wheel.Advance(10000));
+}
+
+TEST(Timer, Rearming_Moves_The_Timer)
+{
+	uint64_t now = 0;
+	timer::Wheel wheel;
+	Recorder recorder(now);
+	wheel.Arm(recorder.timer, 5);
+	wheel.Arm(recorder.timer, 500);
+	EXPECT_EQ(1u, wheel.Size());
+	for (now = 0; now <= 600; ++now)
+		wheel.Advance(now);
+	EXPECT_EQ(std::vector<uint64_t>{ 500 }, recorder.firedAt);
+}
+
+TEST(Timer, Overdue_Timers_Fire_On_The_Next_Advance)
+{
+	uint64_t now = 100;
+	timer::Wheel wheel(now);
+	Recorder recorder(now);
+	wheel.Arm(recorder.timer, 3);
+	EXPECT_EQ(1u, wheel.Advance(now));
+	EXPECT_EQ(std::vector<uint64_t>{ 100 }, recorder.firedAt);
+}
+
+// Covers every level, and timers beyond the range of the wheel, by jumping
+// ahead and by advancing in steps
+TEST(Timer, Timers_On_All_Levels_Fire_At_Their_Expiry)
+{
+	const std::vector<uint64_t> expiries{
+		1, 63, 64, 65, 4095, 4096, 4097, 262143, 262144, 300000,
+		timer::Wheel::Range - 1, timer::Wheel::Range, timer::Wheel::Range + 12345, 3 * timer::Wheel::Range
+	};
+
+	for (const uint64_t step : { uint64_t{1}, uint64_t{37}, uint64_t{4000} }) {
+		uint64_t now = 7;
+		timer::Wheel wheel(now);
+		std::vector<std::unique_ptr<Recorder>> recorders;
+		for (const auto expiry : expiries)
+			wheel.Arm(recorders.emplace_back(std::make_unique<Recorder>(now))->timer, now + expiry);
+
+		while (wheel.Size() > 0) {
+			now += step;
+			wheel.Advance(now);
+		}
+		for (size_t n = 0; n < expiries.size(); ++n) {
+			ASSERT_EQ(1u, recorders[n]->firedAt.size());
+			const auto expiry = 7 + expiries[n];
+			// Fired on the first Advance() at or past its expiry
+			EXPECT_GE(recorders[n]->firedAt[0], expiry);
+			EXPECT_LT(recorders[n]->firedAt[0], expiry + step);
+		}
+	}
+}
+
+TEST(Timer, Fire_In_Order_Of_Expiry)
+{
+	std::mt19937 random(1);
+	timer::Wheel wheel;
+	std::vector<uint64_t> expiries;
+	std::vector<uint64_t> fired;
+	std::vector<std::unique_ptr<timer::Timer>> timers;
+	for (size_t n = 0; n < 1000; ++n) {
+		const uint64_t expiry = random() % 1000000;
+		expiries.push_back(expiry);
+		auto& timer = *timers.emplace_back(std::make_unique<timer::Timer>([&fired, expiry]() { fired.push_back(expiry); }));
+		wheel.Arm(timer, expiry);
+	}
+	EXPECT_EQ(expiries.size(), wheel.Advance(2000000));
+	std::sort(expiries.begin(), expiries.end());
+	EXPECT_EQ(expiries, fired);
+}
+
+TEST(Timer, Callbacks_May_Rearm_And_Cancel)
+{
+	timer::Wheel wheel;
+	size_t periodicCount = 0;
+	size_t victimCount = 0;
+	timer::Timer victim([&]() { ++victimCount; });
+	timer::Timer periodic([&]() {
+		++periodicCount;
+		victim.Cancel();
+		wheel.Arm(periodic, wheel.Current() + 9);
+	});
+
+	wheel.Arm(periodic, 10);
+	wheel.Arm(victim, 11);
+	for (uint64_t now = 0; now <= 100; ++now)
+		wheel.Advance(now);
+	EXPECT_EQ(10u, periodicCount);
+	EXPECT_EQ(0u, victimCount);
+	EXPECT_TRUE(periodic.Armed());
+
+	// An overdue timer armed from a callback runs in the same Advance() as
+	// long as it has not caught up with 'now' yet
+	size_t chained = 0;
+	timer::Timer chain([&]() {
+		if (++chained < 3) wheel.Arm(chain, 0);
+	});
+	wheel.Arm(chain, 0);
+	wheel.Advance(110);
+	EXPECT_EQ(3u, chained);
+}
+
+TEST(Timer, Destroying_The_Wheel_Disarms_Its_Timers)
+{
+	uint64_t now = 0;
+	Recorder recorder(now);
+	{
+		timer::Wheel wheel;
+		wheel.Arm(recorder.timer, 100000);
+	}
+	EXPECT_FALSE(recorder.timer.Armed());
+}
+
+}
+}
@@ -0,0 +1,127 @@
+#include "gtest/gtest.h"
+#include "trace.h"
+#include "buffer.h"
+#include "stats.h"
+#include "helpers.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+struct Collected {
+	std::mutex mutex;
+	std::vector<trace::Record> records;
+
+	trace::Sink Sink()
+	{
+		return [this](const trace::Record& record) {
+			std::lock_guard lock(mutex);
+			records.push_back(record);
+		};
+	}
+};
+
+BufferPtr MakePacket(const size_t size, const std::byte tag)
+{
+	auto packet = std::make_unique<Buffer>();
+	auto buffer = packet.get();
+	for (size_t n = 0; n < size; ++n) {
+		if (buffer->WriteSpan().empty()) buffer = &buffer->AddBuffer();
+		buffer->WriteSpan().front() = n == 0 ? tag : static_cast<std::byte>(n);
+		buffer->IncrementFilled(1);
+	}
+	return packet;
+}
+
+TEST(Trace, Records_Hold_The_Start_Of_The_Packet)
+{
+	Collected collected;
+	{
+		trace::Config config;
+		config.snapLength = 16;
+		trace::Tracer tracer(config, collected.Sink());
+		tracer.Trace(*MakePacket(100, 1_b), 3);
+		tracer.Trace(*MakePacket(8, 2_b), 4);
+	}
+
+	ASSERT_EQ(2u, collected.records.size());
+	const auto& first = collected.records[0];
+	EXPECT_EQ(100u, first.length);
+	EXPECT_EQ(16u, first.captured);
+	EXPECT_EQ(3u, first.source);
+	EXPECT_EQ(1_b, first.Data()[0]);
+	EXPECT_EQ(15_b, first.Data()[15]);
+	EXPECT_NE(0u, first.timestamp);
+	EXPECT_EQ(8u, collected.records[1].captured);
+	EXPECT_EQ(2_b, collected.records[1].Data()[0]);
+}
+
+TEST(Trace, Snap_Length_Spans_Chained_Buffers)
+{
+	Collected collected;
+	{
+		trace::Config config;
+		config.snapLength = trace::MaxSnapLength;
+		trace::Tracer tracer(config, collected.Sink());
+		auto packet = MakePacket(Buffer::Size - 4, 1_b);
+		Append(std::vector<std::byte>(8, 9_b), packet->AddBuffer());
+		tracer.Trace(*packet);
+	}
+
+	ASSERT_EQ(1u, collected.records.size());
+	EXPECT_EQ(Buffer::Size + 4, collected.records[0].length);
+	EXPECT_EQ(trace::MaxSnapLength, collected.records[0].captured);
+}
+
+TEST(Trace, Every_Nth_Accepted_Packet_Is_Sampled)
+{
+	Collected collected;
+	{
+		trace::Config config;
+		config.sampleRate = 3;
+		config.filter = [](const Buffer& buffer) { return buffer.ReadSpan().front() == 1_b; };
+		trace::Tracer tracer(config, collected.Sink());
+		for (size_t n = 0; n < 18; ++n)
+			tracer.Trace(*MakePacket(20, n % 2 ? 1_b : 2_b));
+	}
+
+	// 9 packets pass the filter, of which every third is traced
+	ASSERT_EQ(3u, collected.records.size());
+	for (const auto& record : collected.records)
+		EXPECT_EQ(1_b, record.Data()[0]);
+}
+
+TEST(Trace, Records_Are_Dropped_When_The_Sink_Falls_Behind)
+{
+	const auto before = stats::Aggregate();
+	std::atomic<bool> blocked{true};
+	std::atomic<size_t> received{};
+	constexpr size_t NumberOfPackets = 2 * trace::RingSize;
+	{
+		trace::Tracer tracer(trace::Config{}, [&](const trace::Record&) {
+			while (blocked.load()) std::this_thread::yield();
+			++received;
+		});
+		const auto packet = MakePacket(20, 1_b);
+		for (size_t n = 0; n < NumberOfPackets; ++n)
+			tracer.Trace(*packet);
+		blocked = false;
+	}
+
+	const auto after = stats::Aggregate();
+	const auto traced = after[stats::Id::TracedPackets] - before[stats::Id::TracedPackets];
+	const auto dropped = after[stats::Id::TraceDrops] - before[stats::Id::TraceDrops];
+	EXPECT_EQ(NumberOfPackets, traced + dropped);
+	EXPECT_EQ(traced, received.load());
+	EXPECT_GE(dropped, trace::RingSize - trace::Tracer::BurstSize);
+}
+
+}
+}
@@ -0,0 +1,187 @@
+#include "gtest/gtest.h"
+#include "drivers/tundevice.h"
+#include "protocols/icmp.h"
+#include "protocols/ip.h"
+#include "protocols/ip_checksum.h"
+#include "buffer.h"
+#include "netorder.h"
+#include "helpers.h"
+
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <netinet/in.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <cstring>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+// 198.18.0.0/15 is reserved for benchmarking and should not clash with
+// anything on the host
+constexpr uint32_t LocalAddr = 0xc6120001;  // 198.18.0.1, the kernel side
+constexpr uint32_t RemoteAddr = 0xc6120002; // 198.18.0.2, our side
+
+// Assigns an address to the interface and brings it up
+bool Configure(const std::string& name, const uint32_t addr, const uint32_t netmask)
+{
+	const auto sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) return false;
+
+	const auto SetAddr = [&](const unsigned long request, const uint32_t value) {
+		ifreq ifr{};
+		std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+		sockaddr_in sin{};
+		sin.sin_family = AF_INET;
+		sin.sin_addr.s_addr = htonl(value);
+		std::memcpy(&ifr.ifr_addr, &sin, sizeof(sin));
+		return ::ioctl(sock, request, &ifr) == 0;
+	};
+
+	ifreq ifr{};
+	std::strncpy(ifr.ifr_name, name.c_str(), IFNAMSIZ - 1);
+	ifr.ifr_flags = IFF_UP | IFF_RUNNING;
+	const auto ok = SetAddr(SIOCSIFADDR, addr) && SetAddr(SIOCSIFNETMASK, netmask) && ::ioctl(sock, SIOCSIFFLAGS, &ifr) == 0;
+	::close(sock);
+	return ok;
+}
+
+// Creates an echo request whose payload spans multiple buffers
+BufferPtr MakeEchoRequest(const size_t payloadSize)
+{
+	std::vector<std::byte> icmp(protocol::icmp::constants::ErrorHeaderSize + payloadSize);
+	icmp[0] = std::byte{protocol::icmp::constants::message_type::EchoRequest};
+	icmp[4] = 0x12_b; // identifier
+	icmp[7] = 0x01_b; // sequence
+	for (size_t n = 8; n < icmp.size(); ++n)
+		icmp[n] = static_cast<std::byte>(n);
+	{
+		size_t index = 0;
+		const auto checksum = protocol::ip::CalculateChecksum(icmp.size(), [&]() { return std::to_integer<uint8_t>(icmp[index++]); });
+		auto it = icmp.begin() + 2;
+		net_order::Produce_u16(it, checksum);
+	}
+
+	protocol::ip::Header header{};
+	header.totalLength = static_cast<uint16_t>(protocol::ip::constants::HeaderSize + icmp.size());
+	header.ttl = protocol::ip::constants::DefaultTTL;
+	header.protocol = protocol::ip::constants::protocol::ICMP;
+	header.sourceAddr = RemoteAddr;
+	header.destAddr = LocalAddr;
+	header.headerSize = protocol::ip::constants::HeaderSize;
+
+	auto packet = std::make_unique<Buffer>();
+	protocol::ip::ConstructHeader(header, *packet);
+	auto buffer = packet.get();
+	for (const auto b : icmp) {
+		if (buffer->WriteSpan().empty())
+			buffer = &buffer->AddBuffer();
+		buffer->WriteSpan().front() = b;
+		buffer->IncrementFilled(1);
+	}
+	return packet;
+}
+
+struct TUNDeviceTest : ::testing::Test
+{
+	void SetUp() override
+	{
+		if (const auto result = device.Open("nstest%d"); result)
+			GTEST_SKIP() << "cannot create tun device: " << strerror(*result);
+	}
+
+	devices::TUNDevice device;
+};
+
+TEST_F(TUNDeviceTest, Kernel_Assigns_Name)
+{
+	EXPECT_EQ(0, device.Name().rfind("nstest", 0));
+	EXPECT_NE(std::string::npos, device.Name().find_first_of("0123456789"));
+	EXPECT_GT(device.MTU(), 0_sz);
+}
+
+TEST_F(TUNDeviceTest, Multiple_Queues_Need_Multi_Queue_Flag)
+{
+	devices::TUNDevice mq1, mq2;
+	ASSERT_FALSE(mq1.Open("nstestmq%d", devices::TUNDevice::MultiQueue).has_value());
+	EXPECT_FALSE(mq2.Open(mq1.Name(), devices::TUNDevice::MultiQueue).has_value());
+
+	devices::TUNDevice single;
+	EXPECT_TRUE(single.Open(device.Name()).has_value());
+}
+
+TEST_F(TUNDeviceTest, Kernel_Answers_Echo_Request)
+{
+	if (!Configure(device.Name(), LocalAddr, 0xfffffffc))
+		GTEST_SKIP() << "cannot configure " << device.Name();
+
+	constexpr size_t payloadSize = 1400;
+	auto request = MakeEchoRequest(payloadSize);
+	ASSERT_NE(nullptr, request->next());
+	ASSERT_FALSE(device.Write(*request).has_value());
+
+	// The kernel may emit other packets (i.e. IPv6 router solicitations)
+	// on a fresh interface; wait for the reply
+	BufferPtr reply;
+	for (int n = 0; n < 16 && !reply; ++n) {
+		ASSERT_FALSE(device.Read([&](BufferPtr buffer) {
+			const auto result = protocol::ip::ParseHeader(*buffer);
+			if (std::holds_alternative<protocol::ip::Header>(result) && std::get<protocol::ip::Header>(result).protocol == protocol::ip::constants::protocol::ICMP)
+				reply = std::move(buffer);
+		}).has_value());
+	}
+	ASSERT_NE(nullptr, reply);
+	EXPECT_NE(nullptr, reply->next());
+	EXPECT_EQ(protocol::ip::constants::HeaderSize + protocol::icmp::constants::ErrorHeaderSize + payloadSize, reply->data().size());
+
+	const auto ipResult = protocol::ip::ParseHeader(*reply);
+	const auto& ipHeader = std::get<protocol::ip::Header>(ipResult);
+	EXPECT_EQ(LocalAddr, ipHeader.sourceAddr);
+	EXPECT_EQ(RemoteAddr, ipHeader.destAddr);
+
+	const auto icmpResult = protocol::icmp::Parse(ipHeader, *reply);
+	ASSERT_TRUE(std::holds_alternative<protocol::icmp::Header>(icmpResult));
+	EXPECT_EQ(protocol::icmp::constants::message_type::EchoReply, std::get<protocol::icmp::Header>(icmpResult).type);
+}
+
+TEST_F(TUNDeviceTest, Bursts_Are_Counted)
+{
+	if (!Configure(device.Name(), LocalAddr, 0xfffffffc))
+		GTEST_SKIP() << "cannot configure " << device.Name();
+	EXPECT_NE(0u, device.Capabilities() & devices::capability::ScatterGather);
+
+	constexpr size_t numberOfRequests = 4;
+	std::array<BufferPtr, numberOfRequests> requests;
+	for (auto& request : requests)
+		request = MakeEchoRequest(64);
+	const auto requestSize = requests[0]->data().size();
+
+	const auto txResult = device.TxBurst(requests);
+	ASSERT_TRUE(std::holds_alternative<size_t>(txResult));
+	EXPECT_EQ(numberOfRequests, std::get<size_t>(txResult));
+	EXPECT_EQ(nullptr, requests[0]);
+	EXPECT_EQ(numberOfRequests, device.GetCounters().txPackets.Get());
+	EXPECT_EQ(numberOfRequests * requestSize, device.GetCounters().txBytes.Get());
+
+	size_t replies = 0;
+	for (int n = 0; n < 16 && replies < numberOfRequests; ++n) {
+		std::array<BufferPtr, 8> burst;
+		const auto rxResult = device.RxBurst(burst);
+		ASSERT_TRUE(std::holds_alternative<size_t>(rxResult));
+		for (size_t i = 0; i < std::get<size_t>(rxResult); ++i) {
+			const auto result = protocol::ip::ParseHeader(*burst[i]);
+			if (std::holds_alternative<protocol::ip::Header>(result) && std::get<protocol::ip::Header>(result).protocol == protocol::ip::constants::protocol::ICMP)
+				++replies;
+		}
+	}
+	EXPECT_EQ(numberOfRequests, replies);
+	EXPECT_GE(device.GetCounters().rxPackets.Get(), numberOfRequests);
+}
+
+}
+}
@@ -0,0 +1,139 @@
+#include "gtest/gtest.h"
+#include "protocols/ip.h"
+#include "protocols/udp.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include "range/v3/range/conversion.hpp"
+
+#include <string_view>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+// 10.0.0.1:1234 -> 10.0.0.2:7, "hello"
+constexpr std::array udpHello{
+	0x45_b, 0x00_b, 0x00_b, 0x21_b, 0x12_b, 0x34_b, 0x40_b, 0x00_b, 0x40_b, 0x11_b, 0x14_b, 0x96_b, 0x0a_b, 0x00_b, 0x00_b, 0x01_b,
+	0x0a_b, 0x00_b, 0x00_b, 0x02_b, 0x04_b, 0xd2_b, 0x00_b, 0x07_b, 0x00_b, 0x0d_b, 0xa3_b, 0x26_b, 0x68_b, 0x65_b, 0x6c_b, 0x6c_b,
+	0x6f_b
+};
+
+std::variant<protocol::udp::Result, protocol::udp::Header> Parse(Buffer& buffer)
+{
+	const auto ipResult = protocol::ip::ParseHeader(buffer);
+	return protocol::udp::Parse(std::get<protocol::ip::Header>(ipResult), buffer);
+}
+
+template<typename Container> void ExpectResult(const protocol::udp::Result expected, const Container& packet)
+{
+	Buffer buffer;
+	Append(packet, buffer);
+	const auto result = Parse(buffer);
+	ASSERT_TRUE(std::holds_alternative<protocol::udp::Result>(result));
+	EXPECT_EQ(expected, std::get<protocol::udp::Result>(result));
+}
+
+BufferPtr MakePayload(const std::string_view text)
+{
+	auto buffer = std::make_unique<Buffer>();
+	Append(nonstd::span{reinterpret_cast<const std::byte*>(text.data()), text.size()}, *buffer);
+	return buffer;
+}
+
+TEST(UDP, Valid_Datagram)
+{
+	Buffer buffer;
+	Append(udpHello, buffer);
+	const auto result = Parse(buffer);
+	ASSERT_TRUE(std::holds_alternative<protocol::udp::Header>(result));
+	const auto& header = std::get<protocol::udp::Header>(result);
+	EXPECT_EQ(1234, header.sourcePort);
+	EXPECT_EQ(7, header.destPort);
+	EXPECT_EQ(13, header.length);
+}
+
+TEST(UDP, Corrupted_Payload_Fails_The_Checksum)
+{
+	auto packet = udpHello | ranges::to<std::vector>();
+	packet.back() ^= 1_b;
+	ExpectResult(protocol::udp::Result::ChecksumError, packet);
+
+	// ... unless the sender did not compute one
+	packet[26] = packet[27] = 0_b;
+	Buffer buffer;
+	Append(packet, buffer);
+	EXPECT_TRUE(std::holds_alternative<protocol::udp::Header>(Parse(buffer)));
+}
+
+TEST(UDP, Length_Must_Match_The_IP_Packet)
+{
+	auto packet = udpHello | ranges::to<std::vector>();
+	packet[25] = 0x0c_b;
+	ExpectResult(protocol::udp::Result::CorruptHeader, packet);
+}
+
+TEST(UDP, Truncated_Header)
+{
+	// A bare IP header claiming to carry UDP; the IP checksum covers the
+	// changed length
+	auto packet = udpHello | ranges::to<std::vector>();
+	packet.resize(24);
+	packet[3] = 0x18_b;
+	packet[10] = 0x14_b;
+	packet[11] = 0x9f_b;
+	ExpectResult(protocol::udp::Result::NotEnoughData, packet);
+}
+
+TEST(UDP, Constructed_Datagram_Matches_The_Wire_Format)
+{
+	auto payload = MakePayload("hello");
+	const auto payloadBuffer = payload.get();
+	const auto packet = protocol::udp::Construct(0x0a000001, 1234, 0x0a000002, 7, std::move(payload));
+	ASSERT_TRUE(packet);
+
+	// The payload is chained behind the headers, not copied
+	EXPECT_EQ(payloadBuffer, packet->next());
+	EXPECT_EQ(28u, packet->ReadSpan().size());
+
+	auto data = packet->data() | ranges::to<std::vector>();
+	// Apart from the IP identification, and thus the IP checksum
+	data[4] = 0x12_b;
+	data[5] = 0x34_b;
+	data[6] = 0x40_b;
+	data[10] = 0x14_b;
+	data[11] = 0x96_b;
+	EXPECT_EQ(udpHello | ranges::to<std::vector>(), data);
+}
+
+TEST(UDP, Constructed_Datagrams_Parse)
+{
+	// Spread over several segments, and empty
+	std::vector<BufferPtr> payloads;
+	payloads.push_back(MakePayload("first segment"));
+	payloads.back()->AddBuffer(MakePayload("second, odd"));
+	payloads.emplace_back();
+	for (auto& payload : payloads) {
+		const auto size = payload ? payload->data().size() : 0;
+		auto packet = protocol::udp::Construct(0xc0a80001, 53, 0xc0a80002, 40000, std::move(payload));
+		const auto result = Parse(*packet);
+		ASSERT_TRUE(std::holds_alternative<protocol::udp::Header>(result));
+		EXPECT_EQ(8 + size, std::get<protocol::udp::Header>(result).length);
+	}
+}
+
+TEST(UDP, Oversized_Payloads_Are_Rejected)
+{
+	auto payload = std::make_unique<Buffer>();
+	auto* last = payload.get();
+	for (size_t size = 0; size <= protocol::udp::constants::MaxPayloadSize; size += Buffer::Size) {
+		last->IncrementFilled(Buffer::Size);
+		last = &last->AddBuffer();
+	}
+	EXPECT_FALSE(protocol::udp::Construct(1, 1, 2, 2, std::move(payload)));
+}
+
+}
+}
@@ -0,0 +1,332 @@
+#include "gtest/gtest.h"
+#include "protocols/vj.h"
+#include "protocols/ip_checksum.h"
+#include "buffer.h"
+#include "netorder.h"
+#include "helpers.h"
+
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+namespace vj = protocol::vj;
+
+namespace {
+
+constexpr uint8_t FIN = 0x01, SYN = 0x02, PSH = 0x08, ACK = 0x10, URG = 0x20;
+
+struct Segment {
+	uint32_t sourceAddr{0x0a000001};
+	uint16_t sourcePort{1234};
+	uint16_t destPort{80};
+	uint16_t id{1};
+	uint8_t tos{};
+	uint32_t seq{1000};
+	uint32_t ack{2000};
+	uint8_t flags{ACK};
+	uint16_t window{8192};
+	uint16_t checksum{0x1234};
+	uint16_t urgent{};
+	std::vector<std::byte> options;
+	size_t payload{};
+};
+
+std::vector<std::byte> Build(const Segment& s)
+{
+	const auto headerSize = 40 + s.options.size();
+	std::vector<std::byte> packet(headerSize + s.payload);
+	auto it = packet.begin();
+	using namespace net_order;
+	Produce_u8(it, 0x45);
+	Produce_u8(it, s.tos);
+	Produce_u16(it, static_cast<uint16_t>(packet.size()));
+	Produce_u16(it, s.id);
+	Produce_u16(it, 0x4000); // DF
+	Produce_u8(it, 64);
+	Produce_u8(it, 6);
+	Produce_u16(it, 0);
+	Produce_u32(it, s.sourceAddr);
+	Produce_u32(it, 0x0a000002);
+	Produce_u16(it, s.sourcePort);
+	Produce_u16(it, s.destPort);
+	Produce_u32(it, s.seq);
+	Produce_u32(it, s.ack);
+	Produce_u8(it, static_cast<uint8_t>((headerSize - 20) / 4 << 4));
+	Produce_u8(it, s.flags);
+	Produce_u16(it, s.window);
+	Produce_u16(it, s.checksum);
+	Produce_u16(it, s.urgent);
+	it = std::copy(s.options.begin(), s.options.end(), it);
+	for (size_t n = 0; n < s.payload; ++n)
+		*it++ = static_cast<std::byte>(n);
+
+	auto source = packet.begin();
+	const auto checksum = protocol::ip::CalculateChecksum(20, [&]() { return Consume_u8(source); });
+	auto dest = packet.begin() + 10;
+	Produce_u16(dest, checksum);
+	return packet;
+}
+
+BufferPtr ToBuffer(const std::vector<std::byte>& data)
+{
+	auto buffer = std::make_unique<Buffer>();
+	auto current = buffer.get();
+	for (size_t offset = 0; offset < data.size(); offset += Buffer::Size) {
+		if (offset > 0) current = &current->AddBuffer();
+		const auto end = data.begin() + std::min(offset + Buffer::Size, data.size());
+		Append(std::vector<std::byte>(data.begin() + offset, end), *current);
+	}
+	return buffer;
+}
+
+std::vector<std::byte> ToVector(const Buffer& buffer)
+{
+	auto data = buffer.data();
+	return { data.begin(), data.end() };
+}
+
+// The frame as it goes on the wire, minus the SLIP framing
+std::vector<std::byte> Frame(const vj::Compressor::Result& result, const std::vector<std::byte>& packet)
+{
+	const auto header = result.Header();
+	std::vector<std::byte> frame(header.begin(), header.end());
+	frame.insert(frame.end(), packet.begin() + result.replaced, packet.end());
+	return frame;
+}
+
+struct VJTest : ::testing::Test
+{
+	// Compresses the packet and checks that it survives decompression
+	vj::Compressor::Result RoundTrip(const Segment& segment)
+	{
+		const auto packet = Build(segment);
+		const auto result = compressor.Compress(*ToBuffer(packet));
+		const auto output = decompressor.Decompress(ToBuffer(Frame(result, packet)));
+		EXPECT_NE(nullptr, output);
+		if (output) {
+			EXPECT_EQ(packet, ToVector(*output));
+		}
+		return result;
+	}
+
+	vj::Compressor compressor;
+	vj::Decompressor decompressor;
+};
+
+TEST(VJ, Packet_Type_Is_Taken_From_The_First_Byte)
+{
+	EXPECT_EQ(vj::PacketType::IP, vj::TypeOf(0x45_b));
+	EXPECT_EQ(vj::PacketType::IP, vj::TypeOf(0x60_b));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, vj::TypeOf(0x75_b));
+	EXPECT_EQ(vj::PacketType::CompressedTCP, vj::TypeOf(0x80_b));
+	EXPECT_EQ(vj::PacketType::CompressedTCP, vj::TypeOf(0xff_b));
+}
+
+TEST_F(VJTest, Non_TCP_And_Connection_Control_Is_Sent_As_IP)
+{
+	auto icmp = Build({});
+	icmp[9] = 1_b;
+	EXPECT_EQ(vj::PacketType::IP, compressor.Compress(*ToBuffer(icmp)).type);
+
+	for (const auto flags : { SYN, static_cast<uint8_t>(SYN | ACK), static_cast<uint8_t>(FIN | ACK), uint8_t{} }) {
+		Segment segment;
+		segment.flags = flags;
+		const auto result = RoundTrip(segment);
+		EXPECT_EQ(vj::PacketType::IP, result.type);
+		EXPECT_EQ(0u, result.headerSize);
+		EXPECT_EQ(0u, result.replaced);
+	}
+	EXPECT_EQ(5u, compressor.GetStats().ip);
+	EXPECT_EQ(4u, decompressor.GetStats().ip);
+}
+
+TEST_F(VJTest, First_Segment_Is_Sent_Uncompressed_With_The_Slot_As_Protocol)
+{
+	const auto packet = Build({});
+	const auto result = RoundTrip({});
+	ASSERT_EQ(vj::PacketType::UncompressedTCP, result.type);
+	ASSERT_EQ(40u, result.headerSize);
+	EXPECT_EQ(40u, result.replaced);
+	EXPECT_EQ(0x75_b, result.header[0]);
+	EXPECT_LT(std::to_integer<size_t>(result.header[9]), vj::constants::Slots);
+	EXPECT_TRUE(std::equal(packet.begin() + 1, packet.begin() + 9, result.header.begin() + 1));
+	EXPECT_TRUE(std::equal(packet.begin() + 10, packet.begin() + 40, result.header.begin() + 10));
+	EXPECT_EQ(1u, decompressor.GetStats().uncompressed);
+}
+
+TEST_F(VJTest, Unidirectional_Data_Compresses_To_Three_Bytes)
+{
+	Segment segment;
+	segment.payload = 100;
+	RoundTrip(segment);
+
+	segment.id = 2;
+	segment.seq += 100;
+	segment.flags = ACK | PSH;
+	segment.checksum = 0xabcd;
+	const auto result = RoundTrip(segment);
+	ASSERT_EQ(vj::PacketType::CompressedTCP, result.type);
+	EXPECT_EQ(40u, result.replaced);
+	// Type and changes, then the TCP checksum; no slot as it did not change
+	const std::array expected{ 0x9f_b, 0xab_b, 0xcd_b };
+	EXPECT_TRUE(ranges::equal(expected, result.Header()));
+}
+
+TEST_F(VJTest, Echoed_Terminal_Traffic_Uses_The_Special_Encoding)
+{
+	Segment segment;
+	segment.payload = 1;
+	RoundTrip(segment);
+
+	segment.id = 2;
+	segment.seq += 1;
+	segment.ack += 1;
+	const auto result = RoundTrip(segment);
+	ASSERT_EQ(vj::PacketType::CompressedTCP, result.type);
+	EXPECT_EQ(std::byte{0x80 | vj::constants::change::SpecialI}, result.header[0]);
+	EXPECT_EQ(3u, result.headerSize);
+}
+
+TEST_F(VJTest, Changed_Fields_Are_Sent_As_Deltas)
+{
+	Segment segment;
+	RoundTrip(segment);
+
+	// ack +300 takes three bytes, window +1 and id +5 take one each
+	segment.id = 6;
+	segment.ack += 300;
+	segment.window += 1;
+	segment.payload = 10;
+	const auto result = RoundTrip(segment);
+	ASSERT_EQ(vj::PacketType::CompressedTCP, result.type);
+	const std::array expected{ std::byte{0x80 | vj::constants::change::I | vj::constants::change::A | vj::constants::change::W},
+		0x12_b, 0x34_b, 0x01_b, 0x00_b, 0x01_b, 0x2c_b, 0x05_b };
+	EXPECT_TRUE(ranges::equal(expected, result.Header()));
+}
+
+TEST_F(VJTest, Unexpressible_Changes_Are_Sent_Uncompressed)
+{
+	Segment segment;
+	segment.payload = 10;
+	RoundTrip(segment);
+
+	const auto next = [&](auto&& change) {
+		++segment.id;
+		segment.seq += 10;
+		change(segment);
+		return RoundTrip(segment).type;
+	};
+	EXPECT_EQ(vj::PacketType::CompressedTCP, next([](Segment&) { }));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, next([](Segment& s) { s.tos = 0x10; }));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, next([](Segment& s) { s.seq += 0x10000; }));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, next([](Segment& s) { s.ack -= 1; }));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, next([](Segment& s) { s.options = { 1_b, 1_b, 1_b, 1_b }; }));
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, next([](Segment& s) { s.flags |= 0x40; })); // ECE
+	EXPECT_EQ(vj::PacketType::CompressedTCP, next([](Segment& s) { s.window -= 1000; }));
+	EXPECT_EQ(vj::PacketType::CompressedTCP, next([](Segment& s) { s.flags |= URG; s.urgent = 5; }));
+	EXPECT_EQ(vj::PacketType::CompressedTCP, next([](Segment& s) { s.flags &= ~URG; }));
+}
+
+TEST_F(VJTest, Retransmissions_Are_Sent_Uncompressed)
+{
+	Segment segment;
+	segment.payload = 10;
+	RoundTrip(segment);
+	segment.id = 2;
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, RoundTrip(segment).type);
+}
+
+TEST_F(VJTest, Slot_Is_Named_When_The_Connection_Changes)
+{
+	Segment a, b;
+	b.sourcePort = 4321;
+	const auto slotA = RoundTrip(a).header[9];
+	const auto slotB = RoundTrip(b).header[9];
+	EXPECT_NE(slotA, slotB);
+
+	a.id = 2;
+	a.payload = 1;
+	const auto result = RoundTrip(a);
+	ASSERT_EQ(vj::PacketType::CompressedTCP, result.type);
+	EXPECT_EQ(vj::constants::change::C, std::to_integer<uint8_t>(result.header[0]) & vj::constants::change::C);
+	EXPECT_EQ(slotA, result.header[1]);
+}
+
+TEST_F(VJTest, More_Connections_Than_Slots_Reuse_The_Least_Recently_Used)
+{
+	std::vector<Segment> segments(vj::constants::Slots + 1);
+	for (size_t n = 0; n < segments.size(); ++n) {
+		segments[n].sourcePort = static_cast<uint16_t>(1000 + n);
+		EXPECT_EQ(vj::PacketType::UncompressedTCP, RoundTrip(segments[n]).type);
+	}
+	// The first connection lost its slot, the second one is still known
+	for (const size_t n : { 1, 0 }) {
+		segments[n].id = 2;
+		segments[n].payload = 1;
+	}
+	EXPECT_EQ(vj::PacketType::CompressedTCP, RoundTrip(segments[1]).type);
+	EXPECT_EQ(vj::PacketType::UncompressedTCP, RoundTrip(segments[0]).type);
+}
+
+TEST_F(VJTest, Large_Segments_Spanning_Buffers_Round_Trip)
+{
+	Segment segment;
+	segment.payload = 1460;
+	RoundTrip(segment);
+	segment.id = 2;
+	segment.seq += 1460;
+	EXPECT_EQ(vj::PacketType::CompressedTCP, RoundTrip(segment).type);
+	EXPECT_EQ(1u, decompressor.GetStats().compressed);
+}
+
+TEST_F(VJTest, Compressed_Packets_Are_Tossed_Until_A_Slot_Is_Named)
+{
+	Segment segment;
+	segment.payload = 10;
+	RoundTrip(segment);
+
+	segment.id = 2;
+	segment.seq += 10;
+	const auto packet = Build(segment);
+	const auto result = compressor.Compress(*ToBuffer(packet));
+	ASSERT_EQ(vj::PacketType::CompressedTCP, result.type);
+
+	decompressor.Toss();
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(Frame(result, packet))));
+	EXPECT_EQ(1u, decompressor.GetStats().tossed);
+}
+
+TEST_F(VJTest, Decompressor_Starts_Out_Tossing)
+{
+	const std::vector frame{ 0x9f_b, 0x12_b, 0x34_b, 1_b };
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(frame)));
+	EXPECT_EQ(1u, decompressor.GetStats().tossed);
+}
+
+TEST_F(VJTest, Corrupt_Packets_Are_Rejected)
+{
+	// Slot number out of range
+	auto uncompressed = Build({});
+	uncompressed[0] = 0x75_b;
+	uncompressed[9] = std::byte{vj::constants::Slots};
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(uncompressed)));
+
+	// Bad IP header checksum
+	uncompressed[9] = 0_b;
+	uncompressed[8] = 1_b;
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(uncompressed)));
+
+	// Naming a slot that never was set up
+	const std::vector compressed{ std::byte{0x80 | vj::constants::change::C}, 3_b, 0x12_b, 0x34_b };
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(compressed)));
+
+	// Truncated delta
+	RoundTrip({});
+	const std::vector truncated{ std::byte{0x80 | vj::constants::change::A}, 0x12_b, 0x34_b, 0x00_b, 0x01_b };
+	EXPECT_EQ(nullptr, decompressor.Decompress(ToBuffer(truncated)));
+	EXPECT_EQ(4u, decompressor.GetStats().errors);
+}
+
+}
+}
@@ -0,0 +1,121 @@
+#include "gtest/gtest.h"
+#include "drivers/wiredevice.h"
+#include "buffer.h"
+#include "helpers.h"
+
+#include <thread>
+#include <vector>
+
+namespace netstack {
+
+using namespace helpers;
+
+namespace {
+
+BufferPtr MakeBuffer(const std::vector<std::byte>& data)
+{
+	auto buffer = std::make_unique<Buffer>();
+	Append(data, *buffer);
+	return buffer;
+}
+
+class WireDeviceTest : public ::testing::TestWithParam<bool>
+{
+protected:
+	devices::WireConfig Config() const
+	{
+		devices::WireConfig config;
+		config.slip = GetParam();
+		return config;
+	}
+};
+
+TEST_P(WireDeviceTest, Packets_Arrive_At_The_Other_End)
+{
+	auto [a, b] = devices::WireDevice::CreatePair(Config());
+
+	std::array<BufferPtr, 2> tx{ MakeBuffer({ 1_b, 0xc0_b }), MakeBuffer({ 0xdb_b, 2_b, 3_b }) };
+	const auto txResult = a->TxBurst(tx);
+	ASSERT_TRUE(std::holds_alternative<size_t>(txResult));
+	EXPECT_EQ(2_sz, std::get<size_t>(txResult));
+	EXPECT_EQ(nullptr, tx[0]);
+
+	std::array<BufferPtr, 8> rx;
+	const auto rxResult = b->RxBurst(rx);
+	ASSERT_TRUE(std::holds_alternative<size_t>(rxResult));
+	ASSERT_EQ(2_sz, std::get<size_t>(rxResult));
+	Verify(std::array{ 1_b, 0xc0_b }, *rx[0]);
+	Verify(std::array{ 0xdb_b, 2_b, 3_b }, *rx[1]);
+
+	EXPECT_EQ(2u, a->GetCounters().txPackets.Get());
+	EXPECT_EQ(5u, a->GetCounters().txBytes.Get());
+	EXPECT_EQ(2u, b->GetCounters().rxPackets.Get());
+	EXPECT_EQ(5u, b->GetCounters().rxBytes.Get());
+}
+
+TEST_P(WireDeviceTest, Loopback_Receives_Own_Packets)
+{
+	auto device = devices::WireDevice::CreateLoopback(Config());
+	ASSERT_FALSE(device->Write(*MakeBuffer({ 7_b, 8_b })).has_value());
+
+	std::vector<BufferPtr> received;
+	ASSERT_FALSE(device->Read([&](BufferPtr buffer) { received.push_back(std::move(buffer)); }).has_value());
+	ASSERT_EQ(1_sz, received.size());
+	Verify(std::array{ 7_b, 8_b }, *received[0]);
+}
+
+TEST_P(WireDeviceTest, Multi_Buffer_Packets_Are_Preserved)
+{
+	auto [a, b] = devices::WireDevice::CreatePair(Config());
+
+	auto packet = std::make_unique<Buffer>();
+	std::vector<std::byte> data(Buffer::Size + 100);
+	for (size_t n = 0; n < data.size(); ++n)
+		data[n] = static_cast<std::byte>(n);
+	Append(nonstd::span{data.data(), Buffer::Size}, *packet);
+	Append(nonstd::span{data.data() + Buffer::Size, data.size() - Buffer::Size}, packet->AddBuffer());
+	ASSERT_FALSE(a->Write(*packet).has_value());
+
+	std::array<BufferPtr, 1> rx;
+	ASSERT_EQ(1_sz, std::get<size_t>(b->RxBurst(rx)));
+	std::vector<std::byte> received(rx[0]->data().begin(), rx[0]->data().end());
+	EXPECT_EQ(data, received);
+}
+
+TEST_P(WireDeviceTest, Ping_Pong_Between_Threads)
+{
+	auto [a, b] = devices::WireDevice::CreatePair(Config());
+	constexpr size_t rounds = 1000;
+
+	std::thread echo([&b = *b]() {
+		std::array<BufferPtr, 8> burst;
+		for (size_t n = 0; n < rounds; ) {
+			const auto amount = std::get<size_t>(b.RxBurst(burst));
+			b.TxBurst(nonstd::span{burst.data(), amount});
+			n += amount;
+		}
+	});
+
+	for (size_t n = 0; n < rounds; ++n) {
+		std::array<BufferPtr, 1> burst{ MakeBuffer({ static_cast<std::byte>(n) }) };
+		ASSERT_EQ(1_sz, std::get<size_t>(a->TxBurst(burst)));
+		ASSERT_EQ(1_sz, std::get<size_t>(a->RxBurst(burst)));
+		Verify(std::array{ static_cast<std::byte>(n) }, *burst[0]);
+	}
+	echo.join();
+}
+
+INSTANTIATE_TEST_SUITE_P(Wire, WireDeviceTest, ::testing::Values(false, true), [](const auto& info) { return info.param ? "SLIP" : "Direct"; });
+
+TEST(WireDevice, Full_Ring_Is_Reported)
+{
+	auto [a, b] = devices::WireDevice::CreatePair();
+	for (size_t n = 0; n < devices::WireDevice::RingSize; ++n)
+		ASSERT_FALSE(a->Write(*MakeBuffer({ 1_b })).has_value());
+	const auto result = a->Write(*MakeBuffer({ 1_b }));
+	ASSERT_TRUE(result.has_value());
+	EXPECT_EQ(ENOBUFS, *result);
+}
+
+}
+}